@@ -388,8 +388,10 @@ PRODUCT_COPY_FILES += \
 # Power
 PRODUCT_PACKAGES += \
     android.hardware.power-service.cepheus-libperfmgr \
-    android.hardware.power.stats@1.0-service.xiaomi
+    android.hardware.power.stats@1.0-service.xiaomi \
+    powerhint.bin.cepheus
 
+# powerhint.bin is generated from this file and must be installed with it
 PRODUCT_COPY_FILES += \
     $(LOCAL_PATH)/configs/power-libperfmgr/powerhint.json:$(TARGET_COPY_OUT_VENDOR)/etc/powerhint.json
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "powerhal-libperfmgr"
+
+#include "PidController.h"
+
+#include <android-base/logging.h>
+#include <android-base/parsedouble.h>
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::StringPrintf;
+
+constexpr char kPowerHalAdpfPidPOver[] = "vendor.powerhal.adpf.pid_p.over";
+constexpr char kPowerHalAdpfPidPUnder[] = "vendor.powerhal.adpf.pid_p.under";
+constexpr char kPowerHalAdpfPidI[] = "vendor.powerhal.adpf.pid_i";
+constexpr char kPowerHalAdpfPidDOver[] = "vendor.powerhal.adpf.pid_d.over";
+constexpr char kPowerHalAdpfPidDUnder[] = "vendor.powerhal.adpf.pid_d.under";
+constexpr char kPowerHalAdpfPidIInit[] = "vendor.powerhal.adpf.pid_i.init";
+constexpr char kPowerHalAdpfPidIHighLimit[] = "vendor.powerhal.adpf.pid_i.high_limit";
+constexpr char kPowerHalAdpfPidILowLimit[] = "vendor.powerhal.adpf.pid_i.low_limit";
+constexpr char kPowerHalAdpfPSamplingWindow[] = "vendor.powerhal.adpf.p.window";
+constexpr char kPowerHalAdpfISamplingWindow[] = "vendor.powerhal.adpf.i.window";
+constexpr char kPowerHalAdpfDSamplingWindow[] = "vendor.powerhal.adpf.d.window";
+constexpr char kPowerHalAdpfPredict[] = "vendor.powerhal.adpf.predict";
+constexpr char kPowerHalAdpfPredictAlpha[] = "vendor.powerhal.adpf.predict.alpha";
+constexpr char kPowerHalAdpfPredictThreshold[] = "vendor.powerhal.adpf.predict.threshold";
+constexpr char kPowerHalAdpfPredictBoost[] = "vendor.powerhal.adpf.predict.boost";
+
+namespace {
+double getDoubleProperty(const char *prop, double value) {
+    std::string result = ::android::base::GetProperty(prop, std::to_string(value).c_str());
+    if (!::android::base::ParseDouble(result.c_str(), &value)) {
+        ALOGE("PowerHintSession : failed to parse double in %s", prop);
+    }
+    return value;
+}
+
+inline int64_t ns_to_100us(int64_t ns) {
+    return ns / 100000;
+}
+
+// Index of the first sample of a window over length samples
+inline int64_t windowStart(int64_t window, int64_t length) {
+    return window == 0 || window > length ? 0 : length - window;
+}
+
+std::shared_ptr<const PidConfig> sConfig = std::make_shared<const PidConfig>(
+        PidConfig::fromProperties());
+}  // namespace
+
+PidConfig PidConfig::fromProperties() {
+    PidConfig c;
+    c.pOver = getDoubleProperty(kPowerHalAdpfPidPOver, 5.0);
+    c.pUnder = getDoubleProperty(kPowerHalAdpfPidPUnder, 3.0);
+    c.i = getDoubleProperty(kPowerHalAdpfPidI, 0.001);
+    c.dOver = getDoubleProperty(kPowerHalAdpfPidDOver, 500.0);
+    c.dUnder = getDoubleProperty(kPowerHalAdpfPidDUnder, 0.0);
+    auto scaled = [&c](const char *prop, int64_t value) -> int64_t {
+        return c.i == 0 ? 0
+                        : static_cast<int64_t>(
+                                  ::android::base::GetIntProperty<int64_t>(prop, value) / c.i);
+    };
+    c.iInit = scaled(kPowerHalAdpfPidIInit, 200);
+    c.iHighLimit = scaled(kPowerHalAdpfPidIHighLimit, 512);
+    c.iLowLimit = scaled(kPowerHalAdpfPidILowLimit, -120);
+    c.pWindow = ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfPSamplingWindow, 1);
+    c.iWindow = ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfISamplingWindow, 0);
+    c.dWindow = ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfDSamplingWindow, 1);
+    c.predictEnable = ::android::base::GetBoolProperty(kPowerHalAdpfPredict, false);
+    c.predictAlpha = std::clamp(getDoubleProperty(kPowerHalAdpfPredictAlpha, 0.2), 0.0, 1.0);
+    c.predictThreshold = getDoubleProperty(kPowerHalAdpfPredictThreshold, 0.3);
+    c.predictBoost = ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfPredictBoost, 64);
+    return c;
+}
+
+std::string PidConfig::toString() const {
+    return StringPrintf(
+            "ADPF PID: p(over %.3f, under %.3f, window %" PRId64 "), i(%.6f, init %" PRId64
+            ", high %" PRId64 ", low %" PRId64 ", window %" PRId64
+            "), d(over %.3f, under %.3f, window %" PRId64
+            "), predict(%s, alpha %.3f, threshold %.3f, boost %" PRId64 ")\n",
+            pOver, pUnder, pWindow, i, iInit, iHighLimit, iLowLimit, iWindow, dOver, dUnder,
+            dWindow, predictEnable ? "on" : "off", predictAlpha, predictThreshold, predictBoost);
+}
+
+void DurationModel::add(int64_t durationNanos, double alpha) {
+    const double x = static_cast<double>(durationNanos);
+    if (mSamples++ == 0) {
+        mMean = x;
+        mVariance = 0;
+        return;
+    }
+    const double delta = x - mMean;
+    mMean += alpha * delta;
+    mVariance = (1 - alpha) * (mVariance + alpha * delta * delta);
+}
+
+double DurationModel::overrunProbability(int64_t targetNanos) const {
+    if (mSamples == 0) {
+        return 0;
+    }
+    const double margin = static_cast<double>(targetNanos) - mMean;
+    if (mVariance <= 0) {
+        return margin < 0 ? 1 : 0;
+    }
+    return 0.5 * std::erfc(margin / std::sqrt(2 * mVariance));
+}
+
+PidController::PidController(std::shared_ptr<const PidConfig> config)
+    : mConfig(std::move(config)), mIntegralError(0), mPreviousError(0) {}
+
+PidOutput PidController::update(const std::vector<WorkDuration> &actualDurations,
+                                int64_t targetNanos) {
+    const std::shared_ptr<const PidConfig> config = this->config();
+    const int64_t length = actualDurations.size();
+    const int64_t p_start = windowStart(config->pWindow, length);
+    const int64_t i_start = windowStart(config->iWindow, length);
+    const int64_t d_start = windowStart(config->dWindow, length);
+    const int64_t dt = ns_to_100us(targetNanos);
+    int64_t err_sum = 0;
+    // The derivative terms of the window telescope to the last error minus
+    // the one before the window.
+    int64_t d_base = mPreviousError;
+    for (int64_t i = std::min({p_start, i_start, d_start}); i < length; i++) {
+        int64_t actualDurationNanos = actualDurations[i].durationNanos;
+        if (std::abs(actualDurationNanos) > targetNanos * 20) {
+            ALOGW("The actual duration is way far from the target (%" PRId64 " >> %" PRId64 ")",
+                  actualDurationNanos, targetNanos);
+        }
+        int64_t error = ns_to_100us(actualDurationNanos - targetNanos);
+        // Fed even with prediction off, so enabling it by a reload starts
+        // from a model of the recent frames
+        mModel.add(actualDurationNanos, config->predictAlpha);
+        if (i == d_start - 1) {
+            d_base = error;
+        }
+        if (i >= p_start) {
+            err_sum += error;
+        }
+        if (i >= i_start) {
+            mIntegralError = mIntegralError + error * dt;
+            mIntegralError = std::min(config->iHighLimit, mIntegralError);
+            mIntegralError = std::max(config->iLowLimit, mIntegralError);
+        }
+        mPreviousError = error;
+    }
+    const int64_t derivative_sum = mPreviousError - d_base;
+
+    PidOutput out;
+    out.p = static_cast<int64_t>((err_sum > 0 ? config->pOver : config->pUnder) * err_sum /
+                                 (length - p_start));
+    out.i = static_cast<int64_t>(config->i * mIntegralError);
+    out.d = static_cast<int64_t>((derivative_sum > 0 ? config->dOver : config->dUnder) *
+                                 derivative_sum / dt / (length - d_start));
+    out.boost = 0;
+    if (config->predictEnable &&
+        mModel.overrunProbability(targetNanos) > config->predictThreshold) {
+        out.boost = config->predictBoost;
+    }
+    return out;
+}
+
+void PidController::resetIntegral() {
+    mIntegralError = std::max(config()->iInit, mIntegralError);
+}
+
+void PidController::scaleIntegral(double ratio) {
+    mIntegralError = std::max(config()->iInit, static_cast<int64_t>(mIntegralError * ratio));
+}
+
+std::shared_ptr<const PidConfig> PidController::config() const {
+    return mConfig ? mConfig : getConfig();
+}
+
+std::shared_ptr<const PidConfig> PidController::getConfig() {
+    return std::atomic_load(&sConfig);
+}
+
+void PidController::setConfig(std::shared_ptr<const PidConfig> config) {
+    std::atomic_store(&sConfig, std::move(config));
+}
+
+std::shared_ptr<const PidConfig> PidController::reloadConfig() {
+    auto config = std::make_shared<const PidConfig>(PidConfig::fromProperties());
+    setConfig(config);
+    LOG(INFO) << "Reloaded " << config->toString();
+    return config;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
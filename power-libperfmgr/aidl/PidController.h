@@ -0,0 +1,127 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/power/WorkDuration.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using aidl::android::hardware::power::WorkDuration;
+
+// Gains and sampling windows of the ADPF PID controller, read from the
+// vendor.powerhal.adpf.* properties.
+struct PidConfig {
+    double pOver;
+    double pUnder;
+    double i;
+    double dOver;
+    double dUnder;
+    // Bounds of the integral error, already scaled by 1 / i
+    int64_t iInit;
+    int64_t iHighLimit;
+    int64_t iLowLimit;
+    // Number of the latest samples of a report used by each term, 0 for all
+    int64_t pWindow;
+    int64_t iWindow;
+    int64_t dWindow;
+    // Predictive boost: raise uclamp.min by predictBoost when the modelled
+    // chance of the next frame missing its target exceeds predictThreshold.
+    bool predictEnable;
+    double predictAlpha;  // EWMA weight of the newest sample
+    double predictThreshold;
+    int64_t predictBoost;
+
+    static PidConfig fromProperties();
+    std::string toString() const;
+};
+
+struct PidOutput {
+    int64_t p;
+    int64_t i;
+    int64_t d;
+    // Minimum uclamp.min raise ahead of a predicted overrun, 0 if none
+    int64_t boost;
+    int64_t total() const { return p + i + d; }
+};
+
+// EWMA of the mean and variance of work durations, used to estimate the
+// chance that the next frame overruns its target.
+class DurationModel {
+  public:
+    DurationModel() : mMean(0), mVariance(0), mSamples(0) {}
+    void add(int64_t durationNanos, double alpha);
+    // Return the probability that a duration exceeds targetNanos, assuming
+    // durations are normally distributed.
+    double overrunProbability(int64_t targetNanos) const;
+
+  private:
+    double mMean;
+    double mVariance;
+    uint64_t mSamples;
+};
+
+// PID controller of one hint session, turning reported work durations into an
+// uclamp.min adjustment. Not thread safe; the session serializes its calls.
+class PidController {
+  public:
+    // Use config instead of the config shared by all sessions, e.g. in tests.
+    explicit PidController(std::shared_ptr<const PidConfig> config = nullptr);
+
+    // Run the controller over a report of actual durations against
+    // targetNanos. Each sample is visited once, and samples older than every
+    // window are skipped. The samples visited also feed the duration model,
+    // whether prediction is enabled or not.
+    PidOutput update(const std::vector<WorkDuration> &actualDurations, int64_t targetNanos);
+
+    // Raise the integral error to its initial value, e.g. after a pause.
+    void resetIntegral();
+    // Scale the integral error when the target duration changes.
+    void scaleIntegral(double ratio);
+
+    // Return the config used by all sessions, which reloadConfig replaces.
+    static std::shared_ptr<const PidConfig> getConfig();
+    // Replace the config used by all sessions, from their next report.
+    static void setConfig(std::shared_ptr<const PidConfig> config);
+    // Re-read the config from properties, used by the next report of every
+    // session. Return the new config.
+    static std::shared_ptr<const PidConfig> reloadConfig();
+
+  private:
+    std::shared_ptr<const PidConfig> config() const;
+
+    const std::shared_ptr<const PidConfig> mConfig;
+    int64_t mIntegralError;
+    int64_t mPreviousError;
+    DurationModel mModel;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -24,12 +24,15 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android/binder_enums.h>
 #include <cutils/properties.h>
 
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include "PidController.h"
 #include "PowerHintSession.h"
 #include "PowerSessionManager.h"
 
@@ -43,12 +46,15 @@ namespace impl {
 namespace pixel {
 
 using ::aidl::google::hardware::power::impl::pixel::PowerHintSession;
+using ::android::perfmgr::kInvalidHintId;
 
 constexpr char kPowerHalStateProp[] = "vendor.powerhal.state";
 constexpr char kPowerHalAudioProp[] = "vendor.powerhal.audio";
 constexpr char kPowerHalRenderingProp[] = "vendor.powerhal.rendering";
 constexpr char kPowerHalAdpfRateProp[] = "vendor.powerhal.adpf.rate";
 constexpr int64_t kPowerHalAdpfRateDefault = -1;
+constexpr char kDumpStatsArg[] = "--stats";
+constexpr char kDumpReloadPidArg[] = "--reload_adpf_pid";
 
 Power::Power(std::shared_ptr<HintManager> hm, std::shared_ptr<DisplayLowPower> dlpw)
     : mHintManager(hm),
@@ -56,7 +62,9 @@ Power::Power(std::shared_ptr<HintManager> hm, std::shared_ptr<DisplayLowPower> d
       mInteractionHandler(nullptr),
       mSustainedPerfModeOn(false),
       mAdpfRateNs(
-              ::android::base::GetIntProperty(kPowerHalAdpfRateProp, kPowerHalAdpfRateDefault)) {
+              ::android::base::GetIntProperty(kPowerHalAdpfRateProp, kPowerHalAdpfRateDefault)),
+      mBoostHints(buildHintTable<Boost>()),
+      mModeHints(buildHintTable<Mode>()) {
     mInteractionHandler = std::make_unique<InteractionHandler>(mHintManager);
     mInteractionHandler->Init();
 
@@ -85,10 +93,29 @@ Power::Power(std::shared_ptr<HintManager> hm, std::shared_ptr<DisplayLowPower> d
     LOG(INFO) << "PowerHAL ready to take hints, Adpf update rate: " << mAdpfRateNs;
 }
 
+template <typename E>
+std::vector<Power::HintEntry> Power::buildHintTable() const {
+    std::vector<HintEntry> table;
+    for (const auto type : ndk::enum_range<E>()) {
+        const auto index = static_cast<std::size_t>(type);
+        if (index >= table.size()) {
+            table.resize(index + 1, {"", kInvalidHintId});
+        }
+        table[index] = {toString(type), mHintManager->GetHintId(toString(type))};
+    }
+    return table;
+}
+
 ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
-    LOG(DEBUG) << "Power setMode: " << toString(type) << " to: " << enabled;
-    ATRACE_INT(toString(type).c_str(), enabled);
-    PowerSessionManager::getInstance()->updateHintMode(toString(type), enabled);
+    const auto index = static_cast<std::size_t>(type);
+    if (index >= mModeHints.size()) {
+        LOG(ERROR) << "Power setMode: unknown mode " << toString(type);
+        return ndk::ScopedAStatus::ok();
+    }
+    const HintEntry &hint = mModeHints[index];
+    LOG(DEBUG) << "Power setMode: " << hint.name << " to: " << enabled;
+    ATRACE_INT(hint.name.c_str(), enabled);
+    PowerSessionManager::getInstance()->updateHintMode(hint.name, enabled);
     switch (type) {
         case Mode::DOUBLE_TAP_TO_WAKE:
             ::android::base::WriteStringToFile(enabled ? "1" : "0", TARGET_TAP_TO_WAKE_NODE, true);
@@ -120,9 +147,9 @@ ndk::ScopedAStatus Power::setMode(Mode type, bool enabled) {
             [[fallthrough]];
         default:
             if (enabled) {
-                mHintManager->DoHint(toString(type));
+                mHintManager->DoHint(hint.id);
             } else {
-                mHintManager->EndHint(toString(type));
+                mHintManager->EndHint(hint.id);
             }
             break;
     }
@@ -142,8 +169,14 @@ ndk::ScopedAStatus Power::isModeSupported(Mode type, bool *_aidl_return) {
 }
 
 ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
-    LOG(DEBUG) << "Power setBoost: " << toString(type) << " duration: " << durationMs;
-    ATRACE_INT(toString(type).c_str(), durationMs);
+    const auto index = static_cast<std::size_t>(type);
+    if (index >= mBoostHints.size()) {
+        LOG(ERROR) << "Power setBoost: unknown boost " << toString(type);
+        return ndk::ScopedAStatus::ok();
+    }
+    const HintEntry &hint = mBoostHints[index];
+    LOG(DEBUG) << "Power setBoost: " << hint.name << " duration: " << durationMs;
+    ATRACE_INT(hint.name.c_str(), durationMs);
     switch (type) {
         case Boost::INTERACTION:
             if (mSustainedPerfModeOn) {
@@ -162,11 +195,11 @@ ndk::ScopedAStatus Power::setBoost(Boost type, int32_t durationMs) {
                 break;
             }
             if (durationMs > 0) {
-                mHintManager->DoHint(toString(type), std::chrono::milliseconds(durationMs));
+                mHintManager->DoHint(hint.id, std::chrono::milliseconds(durationMs));
             } else if (durationMs == 0) {
-                mHintManager->DoHint(toString(type));
+                mHintManager->DoHint(hint.id);
             } else {
-                mHintManager->EndHint(toString(type));
+                mHintManager->EndHint(hint.id);
             }
             break;
     }
@@ -209,6 +242,36 @@ ndk::ScopedAStatus Power::getHintSessionPreferredRate(int64_t *outNanoseconds) {
     return ndk::ScopedAStatus::ok();
 }
 
+binder_status_t Power::dump(int fd, const char **args, uint32_t numArgs) {
+    // Binary stats in the layout of perfmgr/StatsSnapshot.h, for telemetry
+    if (numArgs == 1 && std::string(args[0]) == kDumpStatsArg) {
+        mHintManager->DumpStatsToFd(fd);
+        fsync(fd);
+        return STATUS_OK;
+    }
+    // Re-read the ADPF PID gains and windows from vendor.powerhal.adpf.*
+    if (numArgs == 1 && std::string(args[0]) == kDumpReloadPidArg) {
+        if (!::android::base::WriteStringToFd(PidController::reloadConfig()->toString(), fd)) {
+            PLOG(ERROR) << "Failed to dump state to fd";
+        }
+        fsync(fd);
+        return STATUS_OK;
+    }
+    std::string buf(::android::base::StringPrintf(
+            "HintManager Running: %s\n"
+            "SustainedPerformanceMode: %s\n",
+            mHintManager->IsRunning() ? "true" : "false",
+            mSustainedPerfModeOn ? "true" : "false"));
+    buf.append(PidController::getConfig()->toString());
+    // Dump nodes through libperfmgr
+    mHintManager->DumpToFd(fd);
+    if (!::android::base::WriteStringToFd(buf, fd)) {
+        PLOG(ERROR) << "Failed to dump state to fd";
+    }
+    fsync(fd);
+    return STATUS_OK;
+}
+
 }  // namespace pixel
 }  // namespace impl
 }  // namespace power
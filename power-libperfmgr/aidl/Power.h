@@ -18,7 +18,9 @@
 
 #include <atomic>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <aidl/android/hardware/power/BnPower.h>
 #include <perfmgr/HintManager.h>
@@ -36,6 +38,7 @@ namespace pixel {
 using ::aidl::android::hardware::power::Boost;
 using ::aidl::android::hardware::power::IPowerHintSession;
 using ::aidl::android::hardware::power::Mode;
+using ::android::perfmgr::HintId;
 using ::android::perfmgr::HintManager;
 
 class Power : public ::aidl::android::hardware::power::BnPower {
@@ -50,13 +53,26 @@ class Power : public ::aidl::android::hardware::power::BnPower {
                                          int64_t durationNanos,
                                          std::shared_ptr<IPowerHintSession> *_aidl_return) override;
     ndk::ScopedAStatus getHintSessionPreferredRate(int64_t *outNanoseconds) override;
+    binder_status_t dump(int fd, const char **args, uint32_t numArgs) override;
 
   private:
+    // Hint name and interned id of an AIDL Boost or Mode value, resolved once
+    // at construction so setBoost/setMode skip toString() and the name lookup.
+    struct HintEntry {
+        std::string name;
+        HintId id;
+    };
+    template <typename E>
+    std::vector<HintEntry> buildHintTable() const;
+
     std::shared_ptr<HintManager> mHintManager;
     std::shared_ptr<DisplayLowPower> mDisplayLowPower;
     std::unique_ptr<InteractionHandler> mInteractionHandler;
     std::atomic<bool> mSustainedPerfModeOn;
     const int64_t mAdpfRateNs;
+    // Indexed by the Boost and Mode enum values.
+    std::vector<HintEntry> mBoostHints;
+    std::vector<HintEntry> mModeHints;
 };
 
 }  // namespace pixel
@@ -41,22 +41,11 @@ using std::chrono::duration_cast;
 using std::chrono::nanoseconds;
 using std::literals::chrono_literals::operator""s;
 
-constexpr char kPowerHalAdpfPidPOver[] = "vendor.powerhal.adpf.pid_p.over";
-constexpr char kPowerHalAdpfPidPUnder[] = "vendor.powerhal.adpf.pid_p.under";
-constexpr char kPowerHalAdpfPidI[] = "vendor.powerhal.adpf.pid_i";
-constexpr char kPowerHalAdpfPidDOver[] = "vendor.powerhal.adpf.pid_d.over";
-constexpr char kPowerHalAdpfPidDUnder[] = "vendor.powerhal.adpf.pid_d.under";
-constexpr char kPowerHalAdpfPidIInit[] = "vendor.powerhal.adpf.pid_i.init";
-constexpr char kPowerHalAdpfPidIHighLimit[] = "vendor.powerhal.adpf.pid_i.high_limit";
-constexpr char kPowerHalAdpfPidILowLimit[] = "vendor.powerhal.adpf.pid_i.low_limit";
 constexpr char kPowerHalAdpfUclampEnable[] = "vendor.powerhal.adpf.uclamp";
 constexpr char kPowerHalAdpfUclampMinGranularity[] = "vendor.powerhal.adpf.uclamp_min.granularity";
 constexpr char kPowerHalAdpfUclampMinHighLimit[] = "vendor.powerhal.adpf.uclamp_min.high_limit";
 constexpr char kPowerHalAdpfUclampMinLowLimit[] = "vendor.powerhal.adpf.uclamp_min.low_limit";
 constexpr char kPowerHalAdpfStaleTimeFactor[] = "vendor.powerhal.adpf.stale_timeout_factor";
-constexpr char kPowerHalAdpfPSamplingWindow[] = "vendor.powerhal.adpf.p.window";
-constexpr char kPowerHalAdpfISamplingWindow[] = "vendor.powerhal.adpf.i.window";
-constexpr char kPowerHalAdpfDSamplingWindow[] = "vendor.powerhal.adpf.d.window";
 
 namespace {
 /* there is no glibc or bionic wrapper */
@@ -83,38 +72,19 @@ static int sched_setattr(int pid, struct sched_attr *attr, unsigned int flags) {
     return syscall(__NR_sched_setattr, pid, attr, flags);
 }
 
-static inline int64_t ns_to_100us(int64_t ns) {
-    return ns / 100000;
-}
+int setThreadUclamp(int tid, int32_t min, int32_t max) {
+    sched_attr attr = {};
+    attr.size = sizeof(attr);
 
-static double getDoubleProperty(const char *prop, double value) {
-    std::string result = ::android::base::GetProperty(prop, std::to_string(value).c_str());
-    if (!::android::base::ParseDouble(result.c_str(), &value)) {
-        ALOGE("PowerHintSession : failed to parse double in %s", prop);
-    }
-    return value;
+    attr.sched_flags = (SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP);
+    attr.sched_util_min = min;
+    attr.sched_util_max = max;
+
+    return sched_setattr(tid, &attr, 0);
 }
 
-static double sPidPOver = getDoubleProperty(kPowerHalAdpfPidPOver, 5.0);
-static double sPidPUnder = getDoubleProperty(kPowerHalAdpfPidPUnder, 3.0);
-static double sPidI = getDoubleProperty(kPowerHalAdpfPidI, 0.001);
-static double sPidDOver = getDoubleProperty(kPowerHalAdpfPidDOver, 500.0);
-static double sPidDUnder = getDoubleProperty(kPowerHalAdpfPidDUnder, 0.0);
-static const int64_t sPidIInit =
-        (sPidI == 0) ? 0
-                     : static_cast<int64_t>(::android::base::GetIntProperty<int64_t>(
-                                                    kPowerHalAdpfPidIInit, 200) /
-                                            sPidI);
-static const int64_t sPidIHighLimit =
-        (sPidI == 0) ? 0
-                     : static_cast<int64_t>(::android::base::GetIntProperty<int64_t>(
-                                                    kPowerHalAdpfPidIHighLimit, 512) /
-                                            sPidI);
-static const int64_t sPidILowLimit =
-        (sPidI == 0) ? 0
-                     : static_cast<int64_t>(::android::base::GetIntProperty<int64_t>(
-                                                    kPowerHalAdpfPidILowLimit, -120) /
-                                            sPidI);
+std::atomic<PowerHintSession::UclampSetter> sUclampSetter(setThreadUclamp);
+
 static const int32_t sUclampMinHighLimit =
         ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfUclampMinHighLimit, 512);
 static const int32_t sUclampMinLowLimit =
@@ -123,31 +93,40 @@ static const uint32_t sUclampMinGranularity =
         ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfUclampMinGranularity, 5);
 static const int64_t sStaleTimeFactor =
         ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfStaleTimeFactor, 20);
-static const int64_t sPSamplingWindow =
-        ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfPSamplingWindow, 1);
-static const int64_t sISamplingWindow =
-        ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfISamplingWindow, 0);
-static const int64_t sDSamplingWindow =
-        ::android::base::GetUintProperty<uint32_t>(kPowerHalAdpfDSamplingWindow, 1);
 
 }  // namespace
 
+AppDescriptorTrace::AppDescriptorTrace(const std::string &idString)
+    : target(StringPrintf("adpf.%s-target", idString.c_str())),
+      active(StringPrintf("adpf.%s-active", idString.c_str())),
+      stale(StringPrintf("adpf.%s-stale", idString.c_str())),
+      actl_last(StringPrintf("adpf.%s-actl_last", idString.c_str())),
+      sample_size(StringPrintf("adpf.%s-sample_size", idString.c_str())),
+      min(StringPrintf("adpf.%s-min", idString.c_str())),
+      pid_count(StringPrintf("adpf.%s-pid.count", idString.c_str())),
+      pid_pOut(StringPrintf("adpf.%s-pid.pOut", idString.c_str())),
+      pid_iOut(StringPrintf("adpf.%s-pid.iOut", idString.c_str())),
+      pid_dOut(StringPrintf("adpf.%s-pid.dOut", idString.c_str())),
+      pid_output(StringPrintf("adpf.%s-pid.output", idString.c_str())),
+      pid_boost(StringPrintf("adpf.%s-pid.boost", idString.c_str())) {}
+
 PowerHintSession::PowerHintSession(int32_t tgid, int32_t uid, const std::vector<int32_t> &threadIds,
                                    int64_t durationNanos, const nanoseconds adpfRate)
-    : kAdpfRate(adpfRate) {
+    : mStaleTimer(this), mLastUpdatedTime(steady_clock::now()), kAdpfRate(adpfRate) {
     mDescriptor = new AppHintDesc(tgid, uid, threadIds);
     mDescriptor->duration = std::chrono::nanoseconds(durationNanos);
-    mStaleHandler = sp<StaleHandler>(new StaleHandler(this));
+    mAppliedMin.assign(mDescriptor->threadIds.size(), -1);
+    mAppliedMax.assign(mDescriptor->threadIds.size(), -1);
+    mTrace = std::make_unique<AppDescriptorTrace>(getIdString());
     mPowerManagerHandler = PowerSessionManager::getInstance();
 
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
-        sz = StringPrintf("adpf.%s-active", idstr.c_str());
-        ATRACE_INT(sz.c_str(), mDescriptor->is_active.load());
+        ATRACE_INT(mTrace->target.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(mTrace->active.c_str(), mDescriptor->is_active.load());
     }
     PowerSessionManager::getInstance()->addPowerSession(this);
+    // Armed here too, so a session which never reports still goes stale
+    PowerSessionManager::getInstance()->scheduleStaleTimer(&mStaleTimer, getStaleTime());
     // init boost
     setUclamp(sUclampMinHighLimit);
     ALOGV("PowerHintSession created: %s", mDescriptor->toString().c_str());
@@ -155,15 +134,13 @@ PowerHintSession::PowerHintSession(int32_t tgid, int32_t uid, const std::vector<
 
 PowerHintSession::~PowerHintSession() {
     close();
+    // A report racing with close() may have armed the timer again
+    PowerSessionManager::getInstance()->cancelStaleTimer(&mStaleTimer);
     ALOGV("PowerHintSession deleted: %s", mDescriptor->toString().c_str());
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), 0);
-        sz = StringPrintf("adpf.%s-actl_last", idstr.c_str());
-        ATRACE_INT(sz.c_str(), 0);
-        sz = sz = StringPrintf("adpf.%s-active", idstr.c_str());
-        ATRACE_INT(sz.c_str(), 0);
+        ATRACE_INT(mTrace->target.c_str(), 0);
+        ATRACE_INT(mTrace->actl_last.c_str(), 0);
+        ATRACE_INT(mTrace->active.c_str(), 0);
     }
     delete mDescriptor;
 }
@@ -175,64 +152,98 @@ std::string PowerHintSession::getIdString() const {
 }
 
 void PowerHintSession::updateUniveralBoostMode() {
+    PowerSessionManager::getInstance()->updateSessionActive(this, isActive() && !isStale());
     PowerHintMonitor::getInstance()->getLooper()->sendMessage(mPowerManagerHandler, NULL);
 }
 
-int PowerHintSession::setUclamp(int32_t min, int32_t max) {
-    std::lock_guard<std::mutex> guard(mLock);
-    min = std::max(0, min);
-    min = std::min(min, max);
-    max = std::max(0, max);
-    max = std::max(min, max);
-    if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-min", idstr.c_str());
-        ATRACE_INT(sz.c_str(), min);
+int PowerHintSession::setUclamp(int32_t min, int32_t max, int32_t boost) {
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        min = std::max(0, min);
+        min = std::min(min, max);
+        max = std::max(0, max);
+        max = std::max(min, max);
+        mDescriptor->current_min = min;
+        mDescriptor->current_boost = boost;
+        // The boost raises the threads but is not part of the PID baseline
+        if (boost > 0) {
+            min = std::max(min, std::min({min + boost, sUclampMinHighLimit, max}));
+        }
+        if (ATRACE_ENABLED()) {
+            ATRACE_INT(mTrace->min.c_str(), min);
+        }
+        mUclampMin = min;
+        mUclampMax = max;
     }
-    for (const auto tid : mDescriptor->threadIds) {
-        sched_attr attr = {};
-        attr.size = sizeof(attr);
+    // Threads are updated outside mLock so reports and state changes on this
+    // session do not wait for the syscalls.
+    applyUclamp();
+    return 0;
+}
 
-        attr.sched_flags = (SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP);
-        attr.sched_util_min = min;
-        attr.sched_util_max = max;
+PowerHintSession::UclampSetter PowerHintSession::setUclampSetter(UclampSetter setter) {
+    return sUclampSetter.exchange(setter);
+}
 
-        int ret = sched_setattr(tid, &attr, 0);
+void PowerHintSession::applyUclamp() {
+    std::lock_guard<std::mutex> applyGuard(mUclampApplyLock);
+    int32_t min, max;
+    {
+        // Read the target after taking mUclampApplyLock, so a caller queued
+        // behind another applies the latest target rather than its own.
+        std::lock_guard<std::mutex> guard(mLock);
+        min = mUclampMin;
+        max = mUclampMax;
+    }
+    const UclampSetter setUclampThread = sUclampSetter.load();
+    const std::vector<int> &tids = mDescriptor->threadIds;
+    for (size_t i = 0; i < tids.size(); i++) {
+        if (mAppliedMin[i] == min && mAppliedMax[i] == max) {
+            continue;
+        }
+        int ret = setUclampThread(tids[i], min, max);
         if (ret) {
-            ALOGW("sched_setattr failed for thread %d, err=%d", tid, errno);
+            ALOGW("sched_setattr failed for thread %d, err=%d", tids[i], errno);
+            // Unknown state, retry on the next change
+            mAppliedMin[i] = -1;
+            mAppliedMax[i] = -1;
+            continue;
         }
-        ALOGV("PowerHintSession tid: %d, uclamp(%d, %d)", tid, min, max);
+        mAppliedMin[i] = min;
+        mAppliedMax[i] = max;
+        ALOGV("PowerHintSession tid: %d, uclamp(%d, %d)", tids[i], min, max);
     }
-    mDescriptor->current_min = min;
-    return 0;
 }
 
 ndk::ScopedAStatus PowerHintSession::pause() {
-    if (!mDescriptor->is_active.load())
+    bool activeExpectedToBe = true;
+    if (!mDescriptor->is_active.compare_exchange_strong(activeExpectedToBe, false))
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     // Reset to default uclamp value.
     setUclamp(0);
-    mDescriptor->is_active.store(false);
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-active", idstr.c_str());
-        ATRACE_INT(sz.c_str(), mDescriptor->is_active.load());
+        ATRACE_INT(mTrace->active.c_str(), mDescriptor->is_active.load());
     }
     updateUniveralBoostMode();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus PowerHintSession::resume() {
-    if (mDescriptor->is_active.load())
+    bool activeExpectedToBe = false;
+    if (!mDescriptor->is_active.compare_exchange_strong(activeExpectedToBe, true))
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
-    mDescriptor->is_active.store(true);
-    mDescriptor->integral_error = std::max(sPidIInit, mDescriptor->integral_error);
+    {
+        std::lock_guard<std::mutex> guard(mPidLock);
+        mDescriptor->pid.resetIntegral();
+    }
+    // Like a new session, a resumed one is boosted until it goes stale,
+    // whether or not its timer fired while it was paused
+    mLastUpdatedTime.store(steady_clock::now());
+    PowerSessionManager::getInstance()->scheduleStaleTimer(&mStaleTimer, getStaleTime());
     // resume boost
     setUclamp(sUclampMinHighLimit);
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-active", idstr.c_str());
-        ATRACE_INT(sz.c_str(), mDescriptor->is_active.load());
+        ATRACE_INT(mTrace->active.c_str(), mDescriptor->is_active.load());
     }
     updateUniveralBoostMode();
     return ndk::ScopedAStatus::ok();
@@ -243,7 +254,7 @@ ndk::ScopedAStatus PowerHintSession::close() {
     if (!mSessionClosed.compare_exchange_strong(sessionClosedExpectedToBe, true)) {
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
     }
-    PowerHintMonitor::getInstance()->getLooper()->removeMessages(mStaleHandler);
+    PowerSessionManager::getInstance()->cancelStaleTimer(&mStaleTimer);
     setUclamp(0);
     PowerSessionManager::getInstance()->removePowerSession(this);
     updateUniveralBoostMode();
@@ -256,16 +267,14 @@ ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDura
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
     }
     ALOGV("update target duration: %" PRId64 " ns", targetDurationNanos);
+    std::lock_guard<std::mutex> guard(mPidLock);
     double ratio =
             targetDurationNanos == 0 ? 1.0 : mDescriptor->duration.count() / targetDurationNanos;
-    mDescriptor->integral_error =
-            std::max(sPidIInit, static_cast<int64_t>(mDescriptor->integral_error * ratio));
+    mDescriptor->pid.scaleIntegral(ratio);
 
     mDescriptor->duration = std::chrono::nanoseconds(targetDurationNanos);
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(mTrace->target.c_str(), (int64_t)mDescriptor->duration.count());
     }
 
     return ndk::ScopedAStatus::ok();
@@ -273,6 +282,7 @@ ndk::ScopedAStatus PowerHintSession::updateTargetWorkDuration(int64_t targetDura
 
 ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
         const std::vector<WorkDuration> &actualDurations) {
+    std::lock_guard<std::mutex> guard(mPidLock);
     if (mDescriptor->duration.count() == 0LL) {
         ALOGE("Expect to call updateTargetWorkDuration() first.");
         return ndk::ScopedAStatus::fromExceptionCode(EX_ILLEGAL_STATE);
@@ -287,83 +297,45 @@ ndk::ScopedAStatus PowerHintSession::reportActualWorkDuration(
     }
     if (PowerHintMonitor::getInstance()->isRunning() && isStale()) {
         if (ATRACE_ENABLED()) {
-            const std::string idstr = getIdString();
-            std::string sz = StringPrintf("adpf.%s-stale", idstr.c_str());
-            ATRACE_INT(sz.c_str(), 0);
+            ATRACE_INT(mTrace->stale.c_str(), 0);
         }
-        mDescriptor->integral_error = std::max(sPidIInit, mDescriptor->integral_error);
+        mDescriptor->pid.resetIntegral();
     }
     int64_t targetDurationNanos = (int64_t)mDescriptor->duration.count();
     int64_t length = actualDurations.size();
-    int64_t p_start =
-            sPSamplingWindow == 0 || sPSamplingWindow > length ? 0 : length - sPSamplingWindow;
-    int64_t i_start =
-            sISamplingWindow == 0 || sISamplingWindow > length ? 0 : length - sISamplingWindow;
-    int64_t d_start =
-            sDSamplingWindow == 0 || sDSamplingWindow > length ? 0 : length - sDSamplingWindow;
-    int64_t dt = ns_to_100us(targetDurationNanos);
-    int64_t err_sum = 0;
-    int64_t derivative_sum = 0;
-    for (int64_t i = std::min({p_start, i_start, d_start}); i < length; i++) {
-        int64_t actualDurationNanos = actualDurations[i].durationNanos;
-        if (std::abs(actualDurationNanos) > targetDurationNanos * 20) {
-            ALOGW("The actual duration is way far from the target (%" PRId64 " >> %" PRId64 ")",
-                  actualDurationNanos, targetDurationNanos);
-        }
-        // PID control algorithm
-        int64_t error = ns_to_100us(actualDurationNanos - targetDurationNanos);
-        if (i >= d_start) {
-            derivative_sum += error - mDescriptor->previous_error;
-        }
-        if (i >= p_start) {
-            err_sum += error;
-        }
-        if (i >= i_start) {
-            mDescriptor->integral_error = mDescriptor->integral_error + error * dt;
-            mDescriptor->integral_error = std::min(sPidIHighLimit, mDescriptor->integral_error);
-            mDescriptor->integral_error = std::max(sPidILowLimit, mDescriptor->integral_error);
-        }
-        mDescriptor->previous_error = error;
-    }
-    int64_t pOut = static_cast<int64_t>((err_sum > 0 ? sPidPOver : sPidPUnder) * err_sum /
-                                        (length - p_start));
-    int64_t iOut = static_cast<int64_t>(sPidI * mDescriptor->integral_error);
-    int64_t dOut = static_cast<int64_t>((derivative_sum > 0 ? sPidDOver : sPidDUnder) *
-                                        derivative_sum / dt / (length - d_start));
-
-    int64_t output = pOut + iOut + dOut;
+    const PidOutput pid = mDescriptor->pid.update(actualDurations, targetDurationNanos);
+    int64_t output = pid.total();
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-actl_last", idstr.c_str());
-        ATRACE_INT(sz.c_str(), actualDurations[length - 1].durationNanos);
-        sz = StringPrintf("adpf.%s-target", idstr.c_str());
-        ATRACE_INT(sz.c_str(), (int64_t)mDescriptor->duration.count());
-        sz = StringPrintf("adpf.%s-sample_size", idstr.c_str());
-        ATRACE_INT(sz.c_str(), length);
-        sz = StringPrintf("adpf.%s-pid.count", idstr.c_str());
-        ATRACE_INT(sz.c_str(), mDescriptor->update_count);
-        sz = StringPrintf("adpf.%s-pid.pOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), pOut);
-        sz = StringPrintf("adpf.%s-pid.iOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), iOut);
-        sz = StringPrintf("adpf.%s-pid.dOut", idstr.c_str());
-        ATRACE_INT(sz.c_str(), dOut);
-        sz = StringPrintf("adpf.%s-pid.output", idstr.c_str());
-        ATRACE_INT(sz.c_str(), output);
+        ATRACE_INT(mTrace->actl_last.c_str(), actualDurations[length - 1].durationNanos);
+        ATRACE_INT(mTrace->target.c_str(), (int64_t)mDescriptor->duration.count());
+        ATRACE_INT(mTrace->sample_size.c_str(), length);
+        ATRACE_INT(mTrace->pid_count.c_str(), mDescriptor->update_count);
+        ATRACE_INT(mTrace->pid_pOut.c_str(), pid.p);
+        ATRACE_INT(mTrace->pid_iOut.c_str(), pid.i);
+        ATRACE_INT(mTrace->pid_dOut.c_str(), pid.d);
+        ATRACE_INT(mTrace->pid_output.c_str(), output);
+        ATRACE_INT(mTrace->pid_boost.c_str(), pid.boost);
     }
     mDescriptor->update_count++;
 
-    mStaleHandler->updateStaleTimer();
+    updateStaleTimer();
 
     /* apply to all the threads in the group */
+    const int current_min = mDescriptor->current_min.load();
+    int next_min = current_min;
     if (output != 0) {
-        int next_min =
-                std::min(sUclampMinHighLimit, mDescriptor->current_min + static_cast<int>(output));
+        next_min = std::min(sUclampMinHighLimit, current_min + static_cast<int>(output));
         next_min = std::max(sUclampMinLowLimit, next_min);
-        if (std::abs(mDescriptor->current_min - next_min) > sUclampMinGranularity) {
-            setUclamp(next_min);
+        if (std::abs(current_min - next_min) <= sUclampMinGranularity) {
+            next_min = current_min;
         }
     }
+    // A predicted overrun raises the threads above the PID baseline for the
+    // next frame only, and the next report without one drops the boost.
+    const int boost = static_cast<int>(pid.boost);
+    if (next_min != current_min || boost != mDescriptor->current_boost.load()) {
+        setUclamp(next_min, kMaxUclampValue, boost);
+    }
 
     return ndk::ScopedAStatus::ok();
 }
@@ -373,7 +345,8 @@ std::string AppHintDesc::toString() const {
             StringPrintf("session %" PRIxPTR "\n", reinterpret_cast<uintptr_t>(this) & 0xffff);
     const int64_t durationNanos = duration.count();
     out.append(StringPrintf("  duration: %" PRId64 " ns\n", durationNanos));
-    out.append(StringPrintf("  uclamp.min: %d \n", current_min));
+    out.append(StringPrintf("  uclamp.min: %d \n", current_min.load()));
+    out.append(StringPrintf("  uclamp.min boost: %d \n", current_boost.load()));
     out.append(StringPrintf("  uid: %d, tgid: %d\n", uid, tgid));
 
     out.append("  threadIds: [");
@@ -395,7 +368,7 @@ bool PowerHintSession::isActive() {
 
 bool PowerHintSession::isStale() {
     auto now = std::chrono::steady_clock::now();
-    return now >= mStaleHandler->getStaleTime();
+    return now >= getStaleTime();
 }
 
 const std::vector<int> &PowerHintSession::getTidList() const {
@@ -404,9 +377,7 @@ const std::vector<int> &PowerHintSession::getTidList() const {
 
 void PowerHintSession::setStale() {
     if (ATRACE_ENABLED()) {
-        const std::string idstr = getIdString();
-        std::string sz = StringPrintf("adpf.%s-stale", idstr.c_str());
-        ATRACE_INT(sz.c_str(), 1);
+        ATRACE_INT(mTrace->stale.c_str(), 1);
     }
     // Reset to default uclamp value.
     setUclamp(0);
@@ -414,42 +385,30 @@ void PowerHintSession::setStale() {
     updateUniveralBoostMode();
 }
 
-void PowerHintSession::StaleHandler::updateStaleTimer() {
-    std::lock_guard<std::mutex> guard(mStaleLock);
+void PowerHintSession::updateStaleTimer() {
+    if (mSessionClosed.load()) {
+        return;
+    }
     if (PowerHintMonitor::getInstance()->isRunning()) {
         auto when = getStaleTime();
         auto now = std::chrono::steady_clock::now();
         mLastUpdatedTime.store(now);
         if (now > when) {
-            mSession->updateUniveralBoostMode();
-        }
-        if (!mIsMonitoringStale.load()) {
-            auto next = getStaleTime();
-            PowerHintMonitor::getInstance()->getLooper()->sendMessageDelayed(
-                    duration_cast<nanoseconds>(next - now).count(), this, NULL);
-            mIsMonitoringStale.store(true);
+            updateUniveralBoostMode();
         }
+        // Only moves the deadline while the timer is armed
+        PowerSessionManager::getInstance()->scheduleStaleTimer(&mStaleTimer, getStaleTime());
     }
 }
 
-time_point<steady_clock> PowerHintSession::StaleHandler::getStaleTime() {
+time_point<steady_clock> PowerHintSession::getStaleTime() {
     return mLastUpdatedTime.load() +
-           std::chrono::duration_cast<milliseconds>(mSession->kAdpfRate) * sStaleTimeFactor;
+           std::chrono::duration_cast<milliseconds>(kAdpfRate) * sStaleTimeFactor;
 }
 
-void PowerHintSession::StaleHandler::handleMessage(const Message &) {
-    std::lock_guard<std::mutex> guard(mStaleLock);
-    auto now = std::chrono::steady_clock::now();
-    auto when = getStaleTime();
-    // Check if the session is stale based on the last_updated_time.
-    if (now > when) {
-        mSession->setStale();
-        mIsMonitoringStale.store(false);
-        return;
-    }
-    // Schedule for the next checking time.
-    PowerHintMonitor::getInstance()->getLooper()->sendMessageDelayed(
-            duration_cast<nanoseconds>(when - now).count(), this, NULL);
+void PowerHintSession::StaleTimer::onExpired() {
+    // The wheel only fires once the latest deadline has passed
+    mSession->setStale();
 }
 
 }  // namespace pixel
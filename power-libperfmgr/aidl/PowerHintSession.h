@@ -21,7 +21,12 @@
 #include <utils/Looper.h>
 #include <utils/Thread.h>
 
+#include "PidController.h"
+#include "TimerWheel.h"
+
+#include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 namespace aidl {
@@ -42,6 +47,25 @@ using std::chrono::steady_clock;
 using std::chrono::time_point;
 
 static const int32_t kMaxUclampValue = 1024;
+
+// Names of the ATRACE counters of a session, built once so reports do not
+// format them on every call.
+struct AppDescriptorTrace {
+    explicit AppDescriptorTrace(const std::string &idString);
+    const std::string target;
+    const std::string active;
+    const std::string stale;
+    const std::string actl_last;
+    const std::string sample_size;
+    const std::string min;
+    const std::string pid_count;
+    const std::string pid_pOut;
+    const std::string pid_iOut;
+    const std::string pid_dOut;
+    const std::string pid_output;
+    const std::string pid_boost;
+};
+
 struct AppHintDesc {
     AppHintDesc(int32_t tgid, int32_t uid, std::vector<int> threadIds)
         : tgid(tgid),
@@ -49,22 +73,22 @@ struct AppHintDesc {
           threadIds(std::move(threadIds)),
           duration(0LL),
           current_min(0),
+          current_boost(0),
           is_active(true),
-          update_count(0),
-          integral_error(0),
-          previous_error(0) {}
+          update_count(0) {}
     std::string toString() const;
     const int32_t tgid;
     const int32_t uid;
     const std::vector<int> threadIds;
     nanoseconds duration;
-    int current_min;
+    // uclamp.min set by PID, and the predictive boost applied on top of it
+    std::atomic<int> current_min;
+    std::atomic<int> current_boost;
     // status
     std::atomic<bool> is_active;
     // pid
     uint64_t update_count;
-    int64_t integral_error;
-    int64_t previous_error;
+    PidController pid;
 };
 
 class PowerHintSession : public BnPowerHintSession {
@@ -82,33 +106,53 @@ class PowerHintSession : public BnPowerHintSession {
     bool isStale();
     const std::vector<int> &getTidList() const;
 
+    // Set the uclamp of one thread, return 0 on success
+    using UclampSetter = int (*)(int tid, int32_t min, int32_t max);
+    // Replace the function sessions use to set the uclamp of their threads,
+    // e.g. to observe the calls in tests. Return the previous one.
+    static UclampSetter setUclampSetter(UclampSetter setter);
+
   private:
-    class StaleHandler : public MessageHandler {
+    class StaleTimer : public TimerWheel::Timer {
       public:
-        StaleHandler(PowerHintSession *session)
-            : mSession(session), mIsMonitoringStale(false), mLastUpdatedTime(steady_clock::now()) {}
-        void handleMessage(const Message &message) override;
-        void updateStaleTimer();
-        time_point<steady_clock> getStaleTime();
+        explicit StaleTimer(PowerHintSession *session) : mSession(session) {}
+        void onExpired() override;
 
       private:
         PowerHintSession *mSession;
-        std::atomic<bool> mIsMonitoringStale;
-        std::atomic<time_point<steady_clock>> mLastUpdatedTime;
-        std::mutex mStaleLock;
     };
 
   private:
     void setStale();
+    void updateStaleTimer();
+    time_point<steady_clock> getStaleTime();
     void updateUniveralBoostMode();
-    int setUclamp(int32_t min, int32_t max = kMaxUclampValue);
+    // Set the PID baseline of uclamp.min, and apply it raised by boost
+    int setUclamp(int32_t min, int32_t max = kMaxUclampValue, int32_t boost = 0);
+    // Apply the latest uclamp target to the threads whose applied value
+    // differs from it. Must be called without mLock held.
+    void applyUclamp();
     std::string getIdString() const;
     AppHintDesc *mDescriptor = nullptr;
-    sp<StaleHandler> mStaleHandler;
+    std::unique_ptr<AppDescriptorTrace> mTrace;
+    StaleTimer mStaleTimer;
+    std::atomic<time_point<steady_clock>> mLastUpdatedTime;
     sp<MessageHandler> mPowerManagerHandler;
     std::mutex mLock;
+    // Latest uclamp target, protected by mLock
+    int32_t mUclampMin = -1;
+    int32_t mUclampMax = -1;
+    // Serializes applyUclamp so threads are left at the latest target
+    std::mutex mUclampApplyLock;
+    // Last uclamp applied to each of the threadIds, -1 if unknown, protected
+    // by mUclampApplyLock
+    std::vector<int32_t> mAppliedMin;
+    std::vector<int32_t> mAppliedMax;
     const nanoseconds kAdpfRate;
     std::atomic<bool> mSessionClosed = false;
+    // Serializes reports, target updates and PID resets of this session, so
+    // callers on different binder threads only wait for their own session.
+    std::mutex mPidLock;
 };
 
 }  // namespace pixel
@@ -19,6 +19,7 @@
 
 #include <log/log.h>
 #include <processgroup/processgroup.h>
+#include <sys/timerfd.h>
 #include <utils/Trace.h>
 
 #include "PowerSessionManager.h"
@@ -30,6 +31,14 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+namespace {
+bool setTaskProfiles(int tid, const std::vector<std::string> &profiles) {
+    return SetTaskProfiles(tid, profiles, true);
+}
+
+std::atomic<PowerSessionManager::TaskProfileSetter> sTaskProfileSetter(setTaskProfiles);
+}  // namespace
+
 void PowerSessionManager::setHintManager(std::shared_ptr<HintManager> const &hint_manager) {
     // Only initialize hintmanager instance if hint is supported.
     if (hint_manager->IsHintSupported(kDisableBoostHintName)) {
@@ -55,53 +64,112 @@ int PowerSessionManager::getDisplayRefreshRate() {
 }
 
 void PowerSessionManager::addPowerSession(PowerHintSession *session) {
-    std::lock_guard<std::mutex> guard(mLock);
-    for (auto t : session->getTidList()) {
-        if (mTidRefCountMap.find(t) == mTidRefCountMap.end()) {
-            if (!SetTaskProfiles(t, {"ResetUclampGrp"})) {
-                ALOGW("Failed to set ResetUclampGrp task profile for tid:%d", t);
-            } else {
-                mTidRefCountMap[t] = 1;
+    std::vector<int> tids;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        for (auto t : session->getTidList()) {
+            // Only the first session of a tid changes its task profile
+            if (mTidRefCountMap[t]++ == 0) {
+                tids.push_back(t);
             }
-            continue;
         }
-        if (mTidRefCountMap[t] <= 0) {
-            ALOGE("Error! Unexpected zero/negative RefCount:%d for tid:%d", mTidRefCountMap[t], t);
-            continue;
+        const bool active = session->isActive() && !session->isStale();
+        mSessions[session] = active;
+        if (active) {
+            mActiveSessionCount++;
         }
-        mTidRefCountMap[t]++;
     }
-    mSessions.insert(session);
+    applyTaskProfiles(tids);
 }
 
 void PowerSessionManager::removePowerSession(PowerHintSession *session) {
+    std::vector<int> tids;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        for (auto t : session->getTidList()) {
+            auto it = mTidRefCountMap.find(t);
+            if (it == mTidRefCountMap.end()) {
+                ALOGE("Unexpected Error! Failed to look up tid:%d in TidRefCountMap", t);
+                continue;
+            }
+            if (--it->second <= 0) {
+                mTidRefCountMap.erase(it);
+                tids.push_back(t);
+            }
+        }
+        auto it = mSessions.find(session);
+        if (it != mSessions.end()) {
+            if (it->second) {
+                mActiveSessionCount--;
+            }
+            mSessions.erase(it);
+        }
+    }
+    applyTaskProfiles(tids);
+}
+
+void PowerSessionManager::updateSessionActive(PowerHintSession *session, bool active) {
     std::lock_guard<std::mutex> guard(mLock);
-    for (auto t : session->getTidList()) {
-        if (mTidRefCountMap.find(t) == mTidRefCountMap.end()) {
-            ALOGE("Unexpected Error! Failed to look up tid:%d in TidRefCountMap", t);
+    auto it = mSessions.find(session);
+    if (it == mSessions.end() || it->second == active) {
+        return;
+    }
+    it->second = active;
+    if (active) {
+        mActiveSessionCount++;
+    } else {
+        mActiveSessionCount--;
+    }
+}
+
+size_t PowerSessionManager::getActiveSessionCount() {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mActiveSessionCount;
+}
+
+PowerSessionManager::TaskProfileSetter PowerSessionManager::setTaskProfileSetter(
+        TaskProfileSetter setter) {
+    return sTaskProfileSetter.exchange(setter);
+}
+
+void PowerSessionManager::applyTaskProfiles(const std::vector<int> &tids) {
+    if (tids.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> applyGuard(mTaskProfileLock);
+    // Read the wanted state after taking mTaskProfileLock, so a tid changed
+    // again by a later session is left at its latest state.
+    std::vector<std::pair<int, bool>> wanted;
+    wanted.reserve(tids.size());
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        for (auto t : tids) {
+            wanted.emplace_back(t, mTidRefCountMap.count(t) > 0);
+        }
+    }
+    const TaskProfileSetter setProfiles = sTaskProfileSetter.load();
+    for (const auto &[t, reset] : wanted) {
+        if (reset == (mResetUclampTids.count(t) > 0)) {
             continue;
         }
-        mTidRefCountMap[t]--;
-        if (mTidRefCountMap[t] <= 0) {
-            if (!SetTaskProfiles(t, {"NoResetUclampGrp"})) {
+        if (reset) {
+            if (!setProfiles(t, {"ResetUclampGrp"})) {
+                ALOGW("Failed to set ResetUclampGrp task profile for tid:%d", t);
+                continue;
+            }
+            mResetUclampTids.insert(t);
+        } else {
+            if (!setProfiles(t, {"NoResetUclampGrp"})) {
                 ALOGW("Failed to set NoResetUclampGrp task profile for tid:%d", t);
             }
-            mTidRefCountMap.erase(t);
+            mResetUclampTids.erase(t);
         }
     }
-    mSessions.erase(session);
 }
 
 std::optional<bool> PowerSessionManager::isAnySessionActive() {
     std::lock_guard<std::mutex> guard(mLock);
-    bool active = false;
-    for (PowerHintSession *s : mSessions) {
-        // session active and not stale is actually active.
-        if (s->isActive() && !s->isStale()) {
-            active = true;
-            break;
-        }
-    }
+    const bool active = mActiveSessionCount > 0;
     if (active == mActive) {
         return std::nullopt;
     } else {
@@ -123,6 +191,62 @@ void PowerSessionManager::handleMessage(const Message &) {
     }
 }
 
+void PowerSessionManager::scheduleStaleTimer(TimerWheel::Timer *timer,
+                                             time_point<steady_clock> deadline) {
+    std::call_once(mStaleTimerFdOnce, [this] { initStaleTimerFd(); });
+    const int64_t deadlineNs =
+            std::chrono::duration_cast<nanoseconds>(deadline.time_since_epoch()).count();
+    if (mStaleTimers.schedule(timer, deadlineNs)) {
+        armStaleTimerFd();
+    }
+}
+
+void PowerSessionManager::cancelStaleTimer(TimerWheel::Timer *timer) {
+    // The timerfd is left armed; a wakeup with nothing due just re-arms it.
+    mStaleTimers.cancel(timer);
+}
+
+void PowerSessionManager::initStaleTimerFd() {
+    mStaleTimerFd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (mStaleTimerFd.get() < 0) {
+        ALOGE("Failed to create stale timerfd, err=%d", errno);
+        return;
+    }
+    PowerHintMonitor::getInstance()->getLooper()->addFd(mStaleTimerFd.get(), 0,
+                                                        Looper::EVENT_INPUT, this, nullptr);
+}
+
+void PowerSessionManager::armStaleTimerFd() {
+    if (mStaleTimerFd.get() < 0) {
+        return;
+    }
+    // Serialized so the timerfd ends up at the latest expiry of the wheel
+    std::lock_guard<std::mutex> guard(mStaleTimerFdLock);
+    const int64_t expiryNs = mStaleTimers.nextExpiry();
+    struct itimerspec spec = {};
+    if (expiryNs > 0) {
+        spec.it_value.tv_sec = expiryNs / 1000000000;
+        spec.it_value.tv_nsec = expiryNs % 1000000000;
+    }
+    if (timerfd_settime(mStaleTimerFd.get(), TFD_TIMER_ABSTIME, &spec, nullptr)) {
+        ALOGW("Failed to arm stale timerfd, err=%d", errno);
+    }
+}
+
+int PowerSessionManager::handleEvent(int fd, int, void *) {
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        ALOGW("Failed to read stale timerfd, err=%d", errno);
+    }
+    const int64_t nowNs = std::chrono::duration_cast<nanoseconds>(
+                                  steady_clock::now().time_since_epoch())
+                                  .count();
+    mStaleTimers.advance(nowNs);
+    armStaleTimerFd();
+    // Keep the fd registered
+    return 1;
+}
+
 void PowerSessionManager::enableSystemTopAppBoost() {
     if (mHintManager) {
         ALOGV("PowerSessionManager::enableSystemTopAppBoost!!");
@@ -19,6 +19,7 @@
 #include "PowerHintSession.h"
 
 #include <android-base/properties.h>
+#include <android-base/unique_fd.h>
 #include <perfmgr/HintManager.h>
 #include <utils/Looper.h>
 
@@ -40,8 +41,11 @@ using ::android::Thread;
 using ::android::perfmgr::HintManager;
 
 constexpr char kPowerHalAdpfDisableTopAppBoost[] = "vendor.powerhal.adpf.disable.hint";
+// Granularity and size of the wheel of session stale timers
+constexpr std::chrono::milliseconds kStaleTimerTick(10);
+constexpr size_t kStaleTimerSlots = 64;
 
-class PowerSessionManager : public MessageHandler {
+class PowerSessionManager : public MessageHandler, public ::android::LooperCallback {
   public:
     // current hint info
     void updateHintMode(const std::string &mode, bool enabled);
@@ -49,8 +53,27 @@ class PowerSessionManager : public MessageHandler {
     // monitoring session status
     void addPowerSession(PowerHintSession *session);
     void removePowerSession(PowerHintSession *session);
+    // Record whether a session is active and not stale. Active sessions are
+    // counted, so isAnySessionActive does not scan the sessions.
+    void updateSessionActive(PowerHintSession *session, bool active);
+
+    // Arm the stale timer of a session, or push back its deadline. Timers of
+    // all sessions share one wheel, fired by a timerfd on the
+    // PowerHintMonitor looper.
+    void scheduleStaleTimer(TimerWheel::Timer *timer, time_point<steady_clock> deadline);
+    void cancelStaleTimer(TimerWheel::Timer *timer);
+
+    // Return the number of sessions counted as active
+    size_t getActiveSessionCount();
+
+    // Set the task profiles of one tid, return true on success
+    using TaskProfileSetter = bool (*)(int tid, const std::vector<std::string> &profiles);
+    // Replace the function used to set the task profiles of session tids,
+    // e.g. to observe the calls in tests. Return the previous one.
+    static TaskProfileSetter setTaskProfileSetter(TaskProfileSetter setter);
 
     void handleMessage(const Message &message) override;
+    int handleEvent(int fd, int events, void *data) override;
     void setHintManager(std::shared_ptr<HintManager> const &hint_manager);
 
     // Singleton
@@ -62,21 +85,40 @@ class PowerSessionManager : public MessageHandler {
   private:
     std::optional<bool> isAnySessionActive();
     void disableSystemTopAppBoost();
+    // Set the task profile of tids to match whether they are in a session.
+    // Must be called without mLock held.
+    void applyTaskProfiles(const std::vector<int> &tids);
     void enableSystemTopAppBoost();
+    void initStaleTimerFd();
+    // Set the timerfd to the next expiry of mStaleTimers
+    void armStaleTimerFd();
     const std::string kDisableBoostHintName;
     std::shared_ptr<HintManager> mHintManager;
-    std::unordered_set<PowerHintSession *> mSessions;  // protected by mLock
-    std::unordered_map<int, int> mTidRefCountMap;      // protected by mLock
+    // Sessions and whether each is counted in mActiveSessionCount, protected
+    // by mLock
+    std::unordered_map<PowerHintSession *, bool> mSessions;
+    size_t mActiveSessionCount;                    // protected by mLock
+    std::unordered_map<int, int> mTidRefCountMap;  // protected by mLock
+    // Serializes applyTaskProfiles so tids are left matching mTidRefCountMap
+    std::mutex mTaskProfileLock;
+    // Tids last set to ResetUclampGrp, protected by mTaskProfileLock
+    std::unordered_set<int> mResetUclampTids;
     std::mutex mLock;
-    int mDisplayRefreshRate;
+    std::atomic<int> mDisplayRefreshRate;
     bool mActive;  // protected by mLock
+    TimerWheel mStaleTimers;
+    ::android::base::unique_fd mStaleTimerFd;
+    std::once_flag mStaleTimerFdOnce;
+    std::mutex mStaleTimerFdLock;
     // Singleton
     PowerSessionManager()
         : kDisableBoostHintName(::android::base::GetProperty(kPowerHalAdpfDisableTopAppBoost,
                                                              "ADPF_DISABLE_TA_BOOST")),
           mHintManager(nullptr),
+          mActiveSessionCount(0),
           mDisplayRefreshRate(60),
-          mActive(false) {}
+          mActive(false),
+          mStaleTimers(kStaleTimerTick, kStaleTimerSlots) {}
     PowerSessionManager(PowerSessionManager const &) = delete;
     void operator=(PowerSessionManager const &) = delete;
 };
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+TimerWheel::TimerWheel(std::chrono::nanoseconds tick, size_t slots)
+    : kTickNs(std::max<int64_t>(tick.count(), 1)),
+      mSlots(std::max<size_t>(slots, 1), nullptr),
+      mCursorTick(-1),
+      mNextExpiryNs(-1),
+      mCount(0) {}
+
+int64_t TimerWheel::tickOf(int64_t ns) const {
+    // Round up so a timer never fires before its deadline
+    return ns <= 0 ? 0 : (ns + kTickNs - 1) / kTickNs;
+}
+
+void TimerWheel::link(Timer *timer, int64_t deadlineNs) {
+    const int64_t tick = std::max(tickOf(deadlineNs), mCursorTick + 1);
+    Timer *&head = mSlots[tick % mSlots.size()];
+    timer->mTick = tick;
+    timer->mPrev = nullptr;
+    timer->mNext = head;
+    if (head) {
+        head->mPrev = timer;
+    }
+    head = timer;
+    mCount++;
+}
+
+void TimerWheel::unlink(Timer *timer) {
+    if (timer->mPrev) {
+        timer->mPrev->mNext = timer->mNext;
+    } else {
+        mSlots[timer->mTick % mSlots.size()] = timer->mNext;
+    }
+    if (timer->mNext) {
+        timer->mNext->mPrev = timer->mPrev;
+    }
+    timer->mPrev = nullptr;
+    timer->mNext = nullptr;
+    mCount--;
+}
+
+bool TimerWheel::schedule(Timer *timer, int64_t deadlineNs) {
+    timer->mDeadlineNs.store(deadlineNs);
+    // Fast path: advance() re-reads the deadline after disarming, so either
+    // it sees the new deadline or this sees the timer disarmed.
+    if (timer->mArmed.load()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(mLock);
+    if (timer->mArmed.load()) {
+        return false;
+    }
+    link(timer, deadlineNs);
+    timer->mArmed.store(true);
+    const int64_t expiryNs = timer->mTick * kTickNs;
+    if (mNextExpiryNs < 0 || expiryNs < mNextExpiryNs) {
+        mNextExpiryNs = expiryNs;
+        return true;
+    }
+    return false;
+}
+
+void TimerWheel::cancel(Timer *timer) {
+    std::lock_guard<std::mutex> fireGuard(mFireLock);
+    std::lock_guard<std::mutex> guard(mLock);
+    if (timer->mArmed.load()) {
+        unlink(timer);
+        timer->mArmed.store(false);
+    }
+}
+
+int64_t TimerWheel::advance(int64_t nowNs) {
+    std::lock_guard<std::mutex> fireGuard(mFireLock);
+    int64_t next;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        const int64_t nowTick = nowNs / kTickNs;
+        // Visit each slot at most once, even after a long sleep
+        const int64_t firstTick =
+                std::max(mCursorTick + 1, nowTick - static_cast<int64_t>(mSlots.size()) + 1);
+        for (int64_t tick = firstTick; tick <= nowTick; tick++) {
+            Timer *timer = mSlots[tick % mSlots.size()];
+            while (timer) {
+                Timer *next_timer = timer->mNext;
+                if (timer->mTick <= nowTick) {
+                    unlink(timer);
+                    timer->mArmed.store(false);
+                    const int64_t deadlineNs = timer->mDeadlineNs.load();
+                    if (deadlineNs <= nowNs) {
+                        mExpired.push_back(timer);
+                    } else {
+                        // Pushed back since it was bucketed
+                        mMoved.push_back(timer);
+                    }
+                }
+                timer = next_timer;
+            }
+        }
+        mCursorTick = std::max(mCursorTick, nowTick);
+        for (Timer *timer : mMoved) {
+            link(timer, timer->mDeadlineNs.load());
+            timer->mArmed.store(true);
+        }
+        mMoved.clear();
+        mNextExpiryNs = nextExpiryLocked();
+        next = mNextExpiryNs;
+    }
+    // cancel() waits on mFireLock, so collected timers are still alive
+    for (Timer *timer : mExpired) {
+        timer->onExpired();
+    }
+    mExpired.clear();
+    return next;
+}
+
+int64_t TimerWheel::nextExpiryLocked() const {
+    if (mCount == 0) {
+        return -1;
+    }
+    // Nearest slot holding a timer due in this round, else the earliest of
+    // the later rounds
+    int64_t earliest = -1;
+    for (size_t i = 1; i <= mSlots.size(); i++) {
+        const int64_t tick = mCursorTick + i;
+        for (Timer *timer = mSlots[tick % mSlots.size()]; timer; timer = timer->mNext) {
+            if (timer->mTick == tick) {
+                return tick * kTickNs;
+            }
+            if (earliest < 0 || timer->mTick < earliest) {
+                earliest = timer->mTick;
+            }
+        }
+    }
+    return earliest * kTickNs;
+}
+
+int64_t TimerWheel::nextExpiry() {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mNextExpiryNs;
+}
+
+size_t TimerWheel::size() {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mCount;
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+// Hashed timer wheel of session deadlines. Timers are kept in intrusive lists
+// bucketed by the tick of their deadline, so arming or cancelling a timer is
+// O(1). While a timer is armed its deadline can be pushed back without taking
+// the wheel lock; the wheel moves it to a later bucket when its old bucket
+// comes due. The wheel has no clock of its own: callers pass the current time
+// in nanoseconds, e.g. of a timerfd on CLOCK_MONOTONIC.
+class TimerWheel {
+  public:
+    class Timer {
+      public:
+        virtual ~Timer() = default;
+        // Called from advance() once the deadline has passed. It must not
+        // call cancel(), which waits for running callbacks.
+        virtual void onExpired() = 0;
+
+      private:
+        friend class TimerWheel;
+        // Protected by the wheel lock
+        Timer *mPrev = nullptr;
+        Timer *mNext = nullptr;
+        int64_t mTick = 0;
+        // Latest deadline, may be moved later while mArmed is set
+        std::atomic<int64_t> mDeadlineNs{0};
+        std::atomic<bool> mArmed{false};
+    };
+
+    TimerWheel(std::chrono::nanoseconds tick, size_t slots);
+
+    // Set the deadline of timer and arm it if it is not armed. The deadline of
+    // an armed timer may only move later. Return true if the earliest expiry
+    // of the wheel moved earlier, in which case the caller must wake up the
+    // thread calling advance() by then.
+    bool schedule(Timer *timer, int64_t deadlineNs);
+    // Disarm timer. On return its onExpired() is not running and will not be
+    // called until it is scheduled again.
+    void cancel(Timer *timer);
+    // Fire the timers whose deadline is at or before nowNs. Return the time
+    // advance() should next be called at, or -1 if no timer is armed.
+    int64_t advance(int64_t nowNs);
+    // Return the time advance() should next be called at, or -1 if no timer
+    // is armed.
+    int64_t nextExpiry();
+    // Return the number of armed timers
+    size_t size();
+
+  private:
+    int64_t tickOf(int64_t ns) const;
+    // Must be called with mLock held
+    void link(Timer *timer, int64_t deadlineNs);
+    void unlink(Timer *timer);
+    int64_t nextExpiryLocked() const;
+
+    const int64_t kTickNs;
+    std::vector<Timer *> mSlots;  // protected by mLock
+    int64_t mCursorTick;          // last tick processed, protected by mLock
+    int64_t mNextExpiryNs;        // -1 if none, protected by mLock
+    size_t mCount;                // protected by mLock
+    std::vector<Timer *> mMoved;    // protected by mLock
+    std::vector<Timer *> mExpired;  // protected by mFireLock
+    std::mutex mLock;
+    // Held while callbacks run, so cancel() waits for a running callback
+    std::mutex mFireLock;
+};
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "PowerHintSession.h"
+
+namespace {
+
+// Heap allocations made by the process, counted to check reports allocate
+// nothing while tracing is off
+std::atomic<uint64_t> sAllocations(0);
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::literals::chrono_literals::operator""ms;
+
+namespace {
+
+constexpr int64_t kTargetNanos = 8333333;
+
+int NoopUclampSetter(int, int32_t, int32_t) {
+    return 0;
+}
+
+}  // namespace
+
+// Report state.range(0) durations per call to one session, alternating
+// between frames over and under the target so PID moves uclamp.
+static void BM_PowerHintSession_Report(benchmark::State &state) {
+    auto previous = PowerHintSession::setUclampSetter(NoopUclampSetter);
+    auto session = ndk::SharedRefBase::make<PowerHintSession>(
+            1000, 10000, std::vector<int32_t>{1001, 1002, 1003}, kTargetNanos,
+            std::chrono::nanoseconds(8ms));
+    std::vector<WorkDuration> over(state.range(0));
+    std::vector<WorkDuration> under(state.range(0));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        over[i].durationNanos = kTargetNanos * 3 / 2;
+        under[i].durationNanos = kTargetNanos / 2;
+    }
+    bool late = false;
+    const uint64_t allocations = sAllocations.load();
+    for (auto _ : state) {
+        late = !late;
+        session->reportActualWorkDuration(late ? over : under);
+    }
+    state.counters["allocs_per_report"] = benchmark::Counter(
+            static_cast<double>(sAllocations.load() - allocations),
+            benchmark::Counter::kAvgIterations);
+    session->close();
+    PowerHintSession::setUclampSetter(previous);
+}
+BENCHMARK(BM_PowerHintSession_Report)->Arg(1)->Arg(8)->Arg(64);
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
+
+BENCHMARK_MAIN();
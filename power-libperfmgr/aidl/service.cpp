@@ -38,6 +38,8 @@ using ::android::perfmgr::HintManager;
 constexpr std::string_view kPowerHalInitProp("vendor.powerhal.init");
 constexpr std::string_view kConfigProperty("vendor.powerhal.config");
 constexpr std::string_view kConfigDefaultFileName("powerhint.json");
+constexpr std::string_view kStatsSnapshotProperty("vendor.powerhal.stats_snapshot");
+constexpr std::string_view kBinderThreadsProperty("vendor.powerhal.binder_threads");
 
 int main() {
     const std::string config_path =
@@ -52,10 +54,24 @@ int main() {
         LOG(FATAL) << "Invalid config: " << config_path;
     }
 
+    // Stats shared with tools through a mapped file, off unless a path is set
+    const std::string stats_snapshot_path =
+            android::base::GetProperty(kStatsSnapshotProperty.data(), "");
+    if (!stats_snapshot_path.empty() && !hm->EnableStatsSnapshot(stats_snapshot_path)) {
+        LOG(ERROR) << "Failed to enable stats snapshot: " << stats_snapshot_path;
+    }
+
     std::shared_ptr<DisplayLowPower> dlpw = std::make_shared<DisplayLowPower>();
 
-    // single thread
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    // Single thread unless a pool is configured, so concurrent hint session
+    // reports from different apps are not serialized behind each other
+    const uint32_t binder_threads =
+            android::base::GetUintProperty<uint32_t>(kBinderThreadsProperty.data(), 0);
+    ABinderProcess_setThreadPoolMaxThreadCount(binder_threads);
+    if (binder_threads > 0) {
+        LOG(INFO) << "Binder thread pool max threads: " << binder_threads;
+        ABinderProcess_startThreadPool();
+    }
 
     // core service
     std::shared_ptr<Power> pw = ndk::SharedRefBase::make<Power>(hm, dlpw);
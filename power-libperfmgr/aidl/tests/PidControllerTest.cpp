@@ -0,0 +1,267 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+#include "PidController.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+namespace {
+
+constexpr int64_t kTargetNanos = 16666666;
+
+// The default vendor.powerhal.adpf.* config
+PidConfig MakeConfig(int64_t pWindow, int64_t iWindow, int64_t dWindow) {
+    PidConfig c;
+    c.pOver = 5.0;
+    c.pUnder = 3.0;
+    c.i = 0.001;
+    c.dOver = 500.0;
+    c.dUnder = 0.0;
+    c.iInit = static_cast<int64_t>(200 / c.i);
+    c.iHighLimit = static_cast<int64_t>(512 / c.i);
+    c.iLowLimit = static_cast<int64_t>(-120 / c.i);
+    c.pWindow = pWindow;
+    c.iWindow = iWindow;
+    c.dWindow = dWindow;
+    c.predictEnable = false;
+    c.predictAlpha = 0.2;
+    c.predictThreshold = 0.3;
+    c.predictBoost = 64;
+    return c;
+}
+
+std::vector<WorkDuration> MakeReport(const std::vector<int64_t> &durationNanos) {
+    std::vector<WorkDuration> report(durationNanos.size());
+    for (size_t i = 0; i < durationNanos.size(); i++) {
+        report[i].durationNanos = durationNanos[i];
+    }
+    return report;
+}
+
+// The PID update as written before PidController, summing the derivative of
+// every sample of its window
+class ReferencePid {
+  public:
+    explicit ReferencePid(const PidConfig &c) : c_(c), integral_error_(0), previous_error_(0) {}
+
+    PidOutput Update(const std::vector<WorkDuration> &actual, int64_t target) {
+        const int64_t length = actual.size();
+        auto start = [length](int64_t window) {
+            return window == 0 || window > length ? 0 : length - window;
+        };
+        const int64_t p_start = start(c_.pWindow);
+        const int64_t i_start = start(c_.iWindow);
+        const int64_t d_start = start(c_.dWindow);
+        const int64_t dt = target / 100000;
+        int64_t err_sum = 0;
+        int64_t derivative_sum = 0;
+        for (int64_t i = std::min({p_start, i_start, d_start}); i < length; i++) {
+            const int64_t error = (actual[i].durationNanos - target) / 100000;
+            if (i >= d_start) {
+                derivative_sum += error - previous_error_;
+            }
+            if (i >= p_start) {
+                err_sum += error;
+            }
+            if (i >= i_start) {
+                integral_error_ = std::min(c_.iHighLimit, integral_error_ + error * dt);
+                integral_error_ = std::max(c_.iLowLimit, integral_error_);
+            }
+            previous_error_ = error;
+        }
+        PidOutput out;
+        out.p = static_cast<int64_t>((err_sum > 0 ? c_.pOver : c_.pUnder) * err_sum /
+                                     (length - p_start));
+        out.i = static_cast<int64_t>(c_.i * integral_error_);
+        out.d = static_cast<int64_t>((derivative_sum > 0 ? c_.dOver : c_.dUnder) *
+                                     derivative_sum / dt / (length - d_start));
+        out.boost = 0;
+        return out;
+    }
+
+  private:
+    const PidConfig c_;
+    int64_t integral_error_;
+    int64_t previous_error_;
+};
+
+}  // namespace
+
+// Test a report on target leaves every term at zero
+TEST(PidControllerTest, OnTargetTest) {
+    PidController pid(std::make_shared<const PidConfig>(MakeConfig(1, 0, 1)));
+    PidOutput out = pid.update(MakeReport({kTargetNanos, kTargetNanos}), kTargetNanos);
+    EXPECT_EQ(0, out.p);
+    EXPECT_EQ(0, out.i);
+    EXPECT_EQ(0, out.d);
+    EXPECT_EQ(0, out.total());
+}
+
+// Test the P and D terms only use the samples of their windows
+TEST(PidControllerTest, WindowTest) {
+    PidController pid(std::make_shared<const PidConfig>(MakeConfig(1, 0, 1)));
+    // 4ms over, then on target: the last sample alone drives P
+    PidOutput out = pid.update(MakeReport({kTargetNanos + 4000000, kTargetNanos}), kTargetNanos);
+    EXPECT_EQ(0, out.p);
+    // The error dropped between the last two samples, and d.under is 0
+    EXPECT_EQ(0, out.d);
+    out = pid.update(MakeReport({kTargetNanos, kTargetNanos + 4000000}), kTargetNanos);
+    // The error rose by 40 (in 100us) over a 166 (in 100us) target
+    EXPECT_EQ(static_cast<int64_t>(5.0 * 40), out.p);
+    EXPECT_EQ(static_cast<int64_t>(500.0 * 40 / 166), out.d);
+}
+
+// Test the integral error is kept within its limits
+TEST(PidControllerTest, IntegralLimitTest) {
+    const PidConfig c = MakeConfig(1, 0, 1);
+    PidController pid(std::make_shared<const PidConfig>(c));
+    PidOutput out;
+    for (int i = 0; i < 100; i++) {
+        out = pid.update(MakeReport({kTargetNanos * 10}), kTargetNanos);
+    }
+    EXPECT_EQ(static_cast<int64_t>(c.i * c.iHighLimit), out.i);
+    for (int i = 0; i < 100; i++) {
+        out = pid.update(MakeReport({0}), kTargetNanos);
+    }
+    EXPECT_EQ(static_cast<int64_t>(c.i * c.iLowLimit), out.i);
+    // Resetting raises the integral error back to its initial value
+    pid.resetIntegral();
+    out = pid.update(MakeReport({kTargetNanos}), kTargetNanos);
+    EXPECT_EQ(static_cast<int64_t>(c.i * c.iInit), out.i);
+}
+
+// Test scaling the integral error never drops it below its initial value
+TEST(PidControllerTest, ScaleIntegralTest) {
+    const PidConfig c = MakeConfig(1, 0, 1);
+    PidController pid(std::make_shared<const PidConfig>(c));
+    for (int i = 0; i < 100; i++) {
+        pid.update(MakeReport({kTargetNanos * 10}), kTargetNanos);
+    }
+    pid.scaleIntegral(0.5);
+    PidOutput out = pid.update(MakeReport({kTargetNanos}), kTargetNanos);
+    EXPECT_EQ(static_cast<int64_t>(c.i * c.iHighLimit / 2), out.i);
+    pid.scaleIntegral(0.0);
+    out = pid.update(MakeReport({kTargetNanos}), kTargetNanos);
+    EXPECT_EQ(static_cast<int64_t>(c.i * c.iInit), out.i);
+}
+
+// Test the single pass update matches the previous per-sample one on random
+// reports and windows
+TEST(PidControllerTest, MatchReferenceTest) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int64_t> window(0, 8);
+    std::uniform_int_distribution<int64_t> length(1, 16);
+    std::uniform_int_distribution<int64_t> duration(0, kTargetNanos * 3);
+    for (int run = 0; run < 200; run++) {
+        const PidConfig c = MakeConfig(window(rng), window(rng), window(rng));
+        PidController pid(std::make_shared<const PidConfig>(c));
+        ReferencePid reference(c);
+        for (int report = 0; report < 20; report++) {
+            std::vector<int64_t> durations(length(rng));
+            for (auto &d : durations) {
+                d = duration(rng);
+            }
+            const auto actual = MakeReport(durations);
+            const PidOutput out = pid.update(actual, kTargetNanos);
+            const PidOutput expected = reference.Update(actual, kTargetNanos);
+            ASSERT_EQ(expected.p, out.p) << "run " << run << " report " << report;
+            ASSERT_EQ(expected.i, out.i) << "run " << run << " report " << report;
+            ASSERT_EQ(expected.d, out.d) << "run " << run << " report " << report;
+        }
+    }
+}
+
+// Test the model of an empty or constant series of durations
+TEST(DurationModelTest, ConstantTest) {
+    DurationModel model;
+    EXPECT_EQ(0, model.overrunProbability(kTargetNanos));
+    for (int i = 0; i < 10; i++) {
+        model.add(kTargetNanos / 2, 0.2);
+    }
+    EXPECT_EQ(0, model.overrunProbability(kTargetNanos));
+    EXPECT_EQ(1, model.overrunProbability(kTargetNanos / 4));
+}
+
+// Test the overrun probability of a replayed frame trace: light frames, a
+// heavy scene, then light frames again
+TEST(DurationModelTest, ReplayTest) {
+    struct Phase {
+        int frames;
+        double meanMs;
+        double stddevMs;
+    };
+    const std::vector<Phase> trace = {{300, 9.0, 1.5}, {300, 20.0, 2.0}, {300, 9.0, 1.5}};
+    std::mt19937 rng(3);
+    DurationModel model;
+    // Frames each phase predicted to overrun, after the first 20 of the phase
+    std::vector<int> predicted(trace.size(), 0);
+    // Frames of the last phase before the model stopped predicting overruns
+    int recovery = -1;
+    for (size_t p = 0; p < trace.size(); p++) {
+        std::normal_distribution<double> frame(trace[p].meanMs, trace[p].stddevMs);
+        for (int f = 0; f < trace[p].frames; f++) {
+            const bool overrun = model.overrunProbability(kTargetNanos) > 0.3;
+            if (f >= 20 && overrun) {
+                predicted[p]++;
+            }
+            if (p == 2 && !overrun && recovery < 0) {
+                recovery = f;
+            }
+            model.add(static_cast<int64_t>(frame(rng) * 1000000), 0.2);
+        }
+    }
+    EXPECT_EQ(0, predicted[0]);
+    // Nearly every heavy frame once the model adapted
+    EXPECT_LE(trace[1].frames - 30, predicted[1]);
+    EXPECT_EQ(0, predicted[2]);
+    EXPECT_LE(0, recovery);
+    EXPECT_GT(10, recovery);
+}
+
+// Test the boost only follows the model while prediction is enabled
+TEST(PidControllerTest, PredictBoostTest) {
+    PidConfig c = MakeConfig(1, 0, 1);
+    auto config = std::make_shared<PidConfig>(c);
+    PidController pid(config);
+    for (int i = 0; i < 20; i++) {
+        EXPECT_EQ(0, pid.update(MakeReport({kTargetNanos * 2}), kTargetNanos).boost);
+    }
+    // The model was fed while prediction was off
+    config->predictEnable = true;
+    EXPECT_EQ(c.predictBoost,
+              pid.update(MakeReport({kTargetNanos * 2}), kTargetNanos).boost);
+    for (int i = 0; i < 20; i++) {
+        pid.update(MakeReport({kTargetNanos / 2}), kTargetNanos);
+    }
+    EXPECT_EQ(0, pid.update(MakeReport({kTargetNanos / 2}), kTargetNanos).boost);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
@@ -0,0 +1,249 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "PowerHintSession.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::literals::chrono_literals::operator""ms;
+
+namespace {
+
+constexpr int64_t kTargetNanos = 16666666;
+
+struct UclampCall {
+    int32_t min;
+    int32_t max;
+};
+
+// Records the sched_setattr calls sessions make, per thread
+std::mutex sCallsLock;
+std::map<int, std::vector<UclampCall>> sCalls;
+std::set<int> sFailingTids;
+
+int FakeUclampSetter(int tid, int32_t min, int32_t max) {
+    std::lock_guard<std::mutex> guard(sCallsLock);
+    sCalls[tid].push_back({min, max});
+    return sFailingTids.count(tid) ? -1 : 0;
+}
+
+size_t CallCount(int tid) {
+    std::lock_guard<std::mutex> guard(sCallsLock);
+    return sCalls[tid].size();
+}
+
+UclampCall LastCall(int tid) {
+    std::lock_guard<std::mutex> guard(sCallsLock);
+    return sCalls[tid].empty() ? UclampCall{-1, -1} : sCalls[tid].back();
+}
+
+void SetFailing(int tid, bool failing) {
+    std::lock_guard<std::mutex> guard(sCallsLock);
+    if (failing) {
+        sFailingTids.insert(tid);
+    } else {
+        sFailingTids.erase(tid);
+    }
+}
+
+}  // namespace
+
+class PowerHintSessionTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        {
+            std::lock_guard<std::mutex> guard(sCallsLock);
+            sCalls.clear();
+            sFailingTids.clear();
+        }
+        previous_setter_ = PowerHintSession::setUclampSetter(FakeUclampSetter);
+    }
+
+    virtual void TearDown() { PowerHintSession::setUclampSetter(previous_setter_); }
+
+    std::shared_ptr<PowerHintSession> MakeSession(const std::vector<int32_t> &tids) {
+        return ndk::SharedRefBase::make<PowerHintSession>(1000, 10000, tids, kTargetNanos,
+                                                          std::chrono::nanoseconds(16ms));
+    }
+
+    PowerHintSession::UclampSetter previous_setter_;
+};
+
+// Test a new session boosts each of its threads once
+TEST_F(PowerHintSessionTest, CreateBoostTest) {
+    auto session = MakeSession({1001, 1002, 1003});
+    for (int tid : {1001, 1002, 1003}) {
+        EXPECT_EQ(1u, CallCount(tid));
+        EXPECT_LT(0, LastCall(tid).min);
+        EXPECT_EQ(kMaxUclampValue, LastCall(tid).max);
+    }
+    session->close();
+}
+
+// Test threads already at the target uclamp are not set again
+TEST_F(PowerHintSessionTest, SkipUnchangedUclampTest) {
+    auto session = MakeSession({1001, 1002});
+    EXPECT_TRUE(session->pause().isOk());
+    for (int tid : {1001, 1002}) {
+        EXPECT_EQ(2u, CallCount(tid));
+        EXPECT_EQ(0, LastCall(tid).min);
+    }
+    // Pausing again is rejected without a call
+    EXPECT_FALSE(session->pause().isOk());
+    // Closing resets to 0, which the threads already have
+    EXPECT_TRUE(session->close().isOk());
+    EXPECT_EQ(2u, CallCount(1001));
+    EXPECT_EQ(2u, CallCount(1002));
+}
+
+// Test a report on target leaves uclamp alone
+TEST_F(PowerHintSessionTest, ReportOnTargetTest) {
+    auto session = MakeSession({1001});
+    std::vector<WorkDuration> durations(4);
+    for (auto &d : durations) {
+        d.durationNanos = kTargetNanos;
+    }
+    EXPECT_TRUE(session->reportActualWorkDuration(durations).isOk());
+    EXPECT_TRUE(session->reportActualWorkDuration(durations).isOk());
+    EXPECT_EQ(1u, CallCount(1001));
+    session->close();
+}
+
+// Test a thread whose call failed is retried by the next update, even if the
+// target did not change
+TEST_F(PowerHintSessionTest, RetryFailedThreadTest) {
+    auto session = MakeSession({1001, 1002});
+    SetFailing(1002, true);
+    EXPECT_TRUE(session->pause().isOk());
+    EXPECT_EQ(2u, CallCount(1001));
+    EXPECT_EQ(2u, CallCount(1002));
+    SetFailing(1002, false);
+    EXPECT_TRUE(session->close().isOk());
+    EXPECT_EQ(2u, CallCount(1001));
+    EXPECT_EQ(3u, CallCount(1002));
+    EXPECT_EQ(0, LastCall(1002).min);
+}
+
+// Test the predictive boost raises the threads for the next frame only, and
+// does not accumulate into the PID baseline
+TEST_F(PowerHintSessionTest, PredictBoostTest) {
+    const auto previous = PidController::getConfig();
+    PidConfig config = *previous;
+    auto session = MakeSession({1001});
+    std::vector<WorkDuration> light(1);
+    light[0].durationNanos = kTargetNanos / 4;
+    std::vector<WorkDuration> heavy(1);
+    heavy[0].durationNanos = kTargetNanos * 2;
+    // Bring the PID baseline down
+    for (int i = 0; i < 50; i++) {
+        EXPECT_TRUE(session->reportActualWorkDuration(light).isOk());
+    }
+    const int32_t baseline = LastCall(1001).min;
+    // Only the prediction reacts to heavy frames
+    config.pOver = config.pUnder = config.i = config.dOver = config.dUnder = 0;
+    config.predictEnable = true;
+    PidController::setConfig(std::make_shared<const PidConfig>(config));
+    // Capped by the default uclamp_min.high_limit
+    const int32_t boosted = std::min<int32_t>(baseline + config.predictBoost, 512);
+    for (int i = 0; i < 20; i++) {
+        EXPECT_TRUE(session->reportActualWorkDuration(heavy).isOk());
+        // The model needs a few heavy frames to predict an overrun
+        if (i >= 5) {
+            EXPECT_EQ(boosted, LastCall(1001).min);
+        }
+    }
+    // Without a predicted overrun the threads drop back to the baseline
+    config.predictEnable = false;
+    PidController::setConfig(std::make_shared<const PidConfig>(config));
+    EXPECT_TRUE(session->reportActualWorkDuration(heavy).isOk());
+    EXPECT_EQ(baseline, LastCall(1001).min);
+    PidController::setConfig(previous);
+    session->close();
+}
+
+// Test clients on several binder threads, reporting on their own sessions
+// and racing state changes on a shared one, leave every thread of a session
+// at the same uclamp
+TEST_F(PowerHintSessionTest, ConcurrentClientsTest) {
+    constexpr int kClients = 8;
+    constexpr int kReports = 500;
+    std::vector<std::shared_ptr<PowerHintSession>> sessions;
+    for (int c = 0; c < kClients; c++) {
+        sessions.push_back(MakeSession({2000 + c * 4, 2001 + c * 4, 2002 + c * 4}));
+    }
+    auto shared = MakeSession({3000, 3001, 3002});
+    std::atomic<int> pauses(0);
+    std::atomic<int> resumes(0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < kClients; c++) {
+        threads.emplace_back([&, c] {
+            std::vector<WorkDuration> over(2);
+            std::vector<WorkDuration> under(2);
+            for (int i = 0; i < 2; i++) {
+                over[i].durationNanos = kTargetNanos * 2;
+                under[i].durationNanos = kTargetNanos / 4;
+            }
+            for (int r = 0; r < kReports; r++) {
+                const auto &report = (r / 10) % 2 ? under : over;
+                EXPECT_TRUE(sessions[c]->reportActualWorkDuration(report).isOk());
+                // Reports on a paused session are rejected
+                shared->reportActualWorkDuration(report);
+                if (r % 50 == 0) {
+                    shared->updateTargetWorkDuration(kTargetNanos + c);
+                }
+                if (c % 2) {
+                    pauses += shared->pause().isOk();
+                } else {
+                    resumes += shared->resume().isOk();
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    // pause and resume alternate, starting from active
+    EXPECT_EQ(pauses.load() - resumes.load(), shared->isActive() ? 0 : 1);
+    sessions.push_back(shared);
+    for (int c = 0; c <= kClients; c++) {
+        const auto &tids = sessions[c]->getTidList();
+        for (int tid : tids) {
+            EXPECT_EQ(LastCall(tids[0]).min, LastCall(tid).min) << "tid " << tid;
+        }
+        sessions[c]->close();
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
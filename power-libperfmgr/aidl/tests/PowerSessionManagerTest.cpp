@@ -0,0 +1,207 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "PowerSessionManager.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::literals::chrono_literals::operator""ms;
+using std::literals::chrono_literals::operator""s;
+
+namespace {
+
+constexpr int64_t kTargetNanos = 16666666;
+constexpr int kSessions = 200;
+constexpr int kThreads = 8;
+// Tids shared by several sessions, below the tids owned by one session
+constexpr int kSharedTids = 50;
+constexpr int kFirstTid = 2000;
+// Longest wait for a session to go stale
+constexpr std::chrono::seconds kStaleWait(5);
+
+// Records the last task profile set on each tid
+std::mutex sProfilesLock;
+std::map<int, std::string> sProfiles;
+size_t sProfileCalls;
+
+bool FakeTaskProfileSetter(int tid, const std::vector<std::string> &profiles) {
+    std::lock_guard<std::mutex> guard(sProfilesLock);
+    sProfiles[tid] = profiles.empty() ? "" : profiles.back();
+    sProfileCalls++;
+    return true;
+}
+
+int FakeUclampSetter(int, int32_t, int32_t) {
+    return 0;
+}
+
+}  // namespace
+
+class PowerSessionManagerTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        {
+            std::lock_guard<std::mutex> guard(sProfilesLock);
+            sProfiles.clear();
+            sProfileCalls = 0;
+        }
+        previous_profile_setter_ =
+                PowerSessionManager::setTaskProfileSetter(FakeTaskProfileSetter);
+        previous_uclamp_setter_ = PowerHintSession::setUclampSetter(FakeUclampSetter);
+        initial_active_ = PowerSessionManager::getInstance()->getActiveSessionCount();
+    }
+
+    virtual void TearDown() {
+        PowerSessionManager::setTaskProfileSetter(previous_profile_setter_);
+        PowerHintSession::setUclampSetter(previous_uclamp_setter_);
+    }
+
+    PowerSessionManager::TaskProfileSetter previous_profile_setter_;
+    PowerHintSession::UclampSetter previous_uclamp_setter_;
+    size_t initial_active_;
+};
+
+// Test the active count and tid task profiles stay consistent while kThreads
+// threads create, pause, resume and close kSessions sessions sharing tids
+TEST_F(PowerSessionManagerTest, StressTest) {
+    auto manager = PowerSessionManager::getInstance();
+    std::vector<std::shared_ptr<PowerHintSession>> sessions(kSessions);
+    std::vector<bool> paused(kSessions, false);
+    auto run = [&](int thread, auto &&step) {
+        for (int i = thread; i < kSessions; i += kThreads) {
+            step(i);
+        }
+    };
+    auto parallel = [&](auto &&step) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; t++) {
+            threads.emplace_back(run, t, step);
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    };
+
+    // Each session has two shared tids and one of its own
+    parallel([&](int i) {
+        std::vector<int32_t> tids = {kFirstTid + i % kSharedTids,
+                                     kFirstTid + (i * 7 + 3) % kSharedTids,
+                                     kFirstTid + kSharedTids + i};
+        // A long rate so no session goes stale during the test
+        sessions[i] = ndk::SharedRefBase::make<PowerHintSession>(1000 + i, 10000, tids,
+                                                                 kTargetNanos, 10s);
+    });
+    EXPECT_EQ(initial_active_ + kSessions, manager->getActiveSessionCount());
+    {
+        std::lock_guard<std::mutex> guard(sProfilesLock);
+        EXPECT_EQ(static_cast<size_t>(kSharedTids + kSessions), sProfileCalls);
+        for (int t = kFirstTid; t < kFirstTid + kSharedTids + kSessions; t++) {
+            EXPECT_EQ("ResetUclampGrp", sProfiles[t]) << "tid " << t;
+        }
+    }
+
+    // Pause a random half, with racing pause and resume calls on each session
+    std::mt19937 rng(11);
+    for (int i = 0; i < kSessions; i++) {
+        paused[i] = rng() % 2;
+    }
+    parallel([&](int i) {
+        for (int n = 0; n < 3; n++) {
+            sessions[i]->pause();
+            sessions[i]->resume();
+        }
+        if (paused[i]) {
+            EXPECT_TRUE(sessions[i]->pause().isOk());
+        }
+    });
+    size_t active = 0;
+    for (int i = 0; i < kSessions; i++) {
+        EXPECT_EQ(!paused[i], sessions[i]->isActive());
+        active += !paused[i];
+    }
+    EXPECT_EQ(initial_active_ + active, manager->getActiveSessionCount());
+
+    // Close every other session, then the rest
+    parallel([&](int i) {
+        if (i % 2) {
+            EXPECT_TRUE(sessions[i]->close().isOk());
+        }
+    });
+    for (int i = 0; i < kSessions; i += 2) {
+        active -= !paused[i + 1];
+    }
+    EXPECT_EQ(initial_active_ + active, manager->getActiveSessionCount());
+    parallel([&](int i) { sessions[i]->close(); });
+    EXPECT_EQ(initial_active_, manager->getActiveSessionCount());
+    {
+        std::lock_guard<std::mutex> guard(sProfilesLock);
+        for (int t = kFirstTid; t < kFirstTid + kSharedTids + kSessions; t++) {
+            EXPECT_EQ("NoResetUclampGrp", sProfiles[t]) << "tid " << t;
+        }
+    }
+    // A second close of every session changes nothing
+    parallel([&](int i) { EXPECT_FALSE(sessions[i]->close().isOk()); });
+    EXPECT_EQ(initial_active_, manager->getActiveSessionCount());
+}
+
+// Test a session which never reports stops being counted active once it goes
+// stale, both after it is created and after it is resumed
+TEST_F(PowerSessionManagerTest, StaleWithoutReportTest) {
+    auto manager = PowerSessionManager::getInstance();
+    // Pump the monitor looper, which runs the stale timers, from this thread
+    auto waitForActiveCount = [&](size_t count) {
+        const auto deadline = std::chrono::steady_clock::now() + kStaleWait;
+        while (manager->getActiveSessionCount() != count &&
+               std::chrono::steady_clock::now() < deadline) {
+            PowerHintMonitor::getInstance()->getLooper()->pollOnce(10);
+        }
+        return manager->getActiveSessionCount();
+    };
+
+    std::shared_ptr<PowerHintSession> session = ndk::SharedRefBase::make<PowerHintSession>(
+            1000, 10000, std::vector<int32_t>{kFirstTid}, kTargetNanos, 5ms);
+    EXPECT_EQ(initial_active_ + 1, manager->getActiveSessionCount());
+    EXPECT_EQ(initial_active_, waitForActiveCount(initial_active_));
+
+    EXPECT_TRUE(session->pause().isOk());
+    EXPECT_TRUE(session->resume().isOk());
+    EXPECT_EQ(initial_active_ + 1, manager->getActiveSessionCount());
+    EXPECT_EQ(initial_active_, waitForActiveCount(initial_active_));
+
+    EXPECT_TRUE(session->close().isOk());
+    EXPECT_EQ(initial_active_, manager->getActiveSessionCount());
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
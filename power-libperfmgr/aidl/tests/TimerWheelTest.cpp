@@ -0,0 +1,211 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+
+#include "TimerWheel.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::literals::chrono_literals::operator""ms;
+
+namespace {
+
+constexpr int64_t kMs = 1000000;
+
+// Records when it fired, by the fake clock passed to advance()
+class FakeTimer : public TimerWheel::Timer {
+  public:
+    explicit FakeTimer(const int64_t *clock) : clock_(clock), fired_(0), fired_at_(-1) {}
+    void onExpired() override {
+        fired_++;
+        fired_at_ = *clock_;
+    }
+    int fired() const { return fired_; }
+    int64_t fired_at() const { return fired_at_; }
+
+  private:
+    const int64_t *clock_;
+    int fired_;
+    int64_t fired_at_;
+};
+
+}  // namespace
+
+class TimerWheelTest : public ::testing::Test {
+  protected:
+    TimerWheelTest() : now_(0), wheel_(10ms, 8) {}
+
+    // Move the fake clock to nowMs and fire what is due
+    int64_t AdvanceTo(int64_t nowMs) {
+        now_ = nowMs * kMs;
+        return wheel_.advance(now_);
+    }
+
+    int64_t now_;
+    TimerWheel wheel_;
+};
+
+// Test an armed timer fires once, at the first tick at or after its deadline
+TEST_F(TimerWheelTest, ArmTest) {
+    FakeTimer timer(&now_);
+    EXPECT_TRUE(wheel_.schedule(&timer, 25 * kMs));
+    EXPECT_EQ(1u, wheel_.size());
+    EXPECT_EQ(30 * kMs, wheel_.nextExpiry());
+    EXPECT_EQ(30 * kMs, AdvanceTo(20));
+    EXPECT_EQ(0, timer.fired());
+    EXPECT_EQ(-1, AdvanceTo(30));
+    EXPECT_EQ(1, timer.fired());
+    EXPECT_EQ(30 * kMs, timer.fired_at());
+    EXPECT_EQ(0u, wheel_.size());
+    EXPECT_EQ(-1, AdvanceTo(100));
+    EXPECT_EQ(1, timer.fired());
+}
+
+// Test only a timer expiring before all others asks for an earlier wakeup
+TEST_F(TimerWheelTest, EarliestExpiryTest) {
+    FakeTimer late(&now_);
+    FakeTimer early(&now_);
+    FakeTimer middle(&now_);
+    EXPECT_TRUE(wheel_.schedule(&late, 60 * kMs));
+    EXPECT_TRUE(wheel_.schedule(&early, 20 * kMs));
+    EXPECT_FALSE(wheel_.schedule(&middle, 40 * kMs));
+    EXPECT_EQ(20 * kMs, wheel_.nextExpiry());
+    EXPECT_EQ(40 * kMs, AdvanceTo(20));
+    EXPECT_EQ(60 * kMs, AdvanceTo(40));
+    EXPECT_EQ(-1, AdvanceTo(60));
+    EXPECT_EQ(20 * kMs, early.fired_at());
+    EXPECT_EQ(40 * kMs, middle.fired_at());
+    EXPECT_EQ(60 * kMs, late.fired_at());
+}
+
+// Test re-arming an armed timer pushes its deadline back
+TEST_F(TimerWheelTest, RearmTest) {
+    FakeTimer timer(&now_);
+    EXPECT_TRUE(wheel_.schedule(&timer, 25 * kMs));
+    EXPECT_FALSE(wheel_.schedule(&timer, 55 * kMs));
+    EXPECT_EQ(1u, wheel_.size());
+    // The old bucket comes due and the timer moves to the new deadline
+    EXPECT_EQ(60 * kMs, AdvanceTo(30));
+    EXPECT_EQ(0, timer.fired());
+    EXPECT_EQ(1u, wheel_.size());
+    EXPECT_EQ(-1, AdvanceTo(60));
+    EXPECT_EQ(1, timer.fired());
+    // A fired timer can be armed again
+    EXPECT_TRUE(wheel_.schedule(&timer, 75 * kMs));
+    EXPECT_EQ(-1, AdvanceTo(80));
+    EXPECT_EQ(2, timer.fired());
+    EXPECT_EQ(80 * kMs, timer.fired_at());
+}
+
+// Test a cancelled timer does not fire
+TEST_F(TimerWheelTest, CancelTest) {
+    FakeTimer timer(&now_);
+    FakeTimer other(&now_);
+    EXPECT_TRUE(wheel_.schedule(&timer, 20 * kMs));
+    EXPECT_FALSE(wheel_.schedule(&other, 20 * kMs));
+    wheel_.cancel(&timer);
+    EXPECT_EQ(1u, wheel_.size());
+    // Cancelling twice is fine
+    wheel_.cancel(&timer);
+    EXPECT_EQ(1u, wheel_.size());
+    EXPECT_EQ(-1, AdvanceTo(20));
+    EXPECT_EQ(0, timer.fired());
+    EXPECT_EQ(1, other.fired());
+    // Cancelling a timer that fired is fine
+    wheel_.cancel(&other);
+    EXPECT_EQ(0u, wheel_.size());
+    EXPECT_EQ(-1, wheel_.nextExpiry());
+}
+
+// Test timers more than one round of the wheel away stay armed until their
+// own round, and are all fired after a long sleep
+TEST_F(TimerWheelTest, CascadeTest) {
+    FakeTimer near(&now_);
+    FakeTimer far(&now_);
+    FakeTimer farther(&now_);
+    // The wheel spans 80ms: far shares a slot with near, 3 rounds later
+    EXPECT_TRUE(wheel_.schedule(&near, 30 * kMs));
+    EXPECT_FALSE(wheel_.schedule(&far, 270 * kMs));
+    EXPECT_FALSE(wheel_.schedule(&farther, 1000 * kMs));
+    for (int64_t t = 10; t < 270; t += 10) {
+        AdvanceTo(t);
+    }
+    EXPECT_EQ(30 * kMs, near.fired_at());
+    EXPECT_EQ(0, far.fired());
+    EXPECT_EQ(270 * kMs, wheel_.nextExpiry());
+    EXPECT_EQ(1000 * kMs, AdvanceTo(270));
+    EXPECT_EQ(270 * kMs, far.fired_at());
+    // Sleep past the deadline of farther, and past a full round
+    EXPECT_EQ(-1, AdvanceTo(5000));
+    EXPECT_EQ(1, farther.fired());
+    EXPECT_EQ(5000 * kMs, farther.fired_at());
+}
+
+// Test randomized schedules, push-backs and cancels against a model of the
+// expected deadlines
+TEST_F(TimerWheelTest, RandomScheduleTest) {
+    constexpr size_t kTimers = 32;
+    std::vector<std::unique_ptr<FakeTimer>> timers;
+    // Deadline in ms of each armed timer, -1 if not armed
+    std::vector<int64_t> deadlines(kTimers, -1);
+    std::vector<int> fired(kTimers, 0);
+    for (size_t i = 0; i < kTimers; i++) {
+        timers.emplace_back(std::make_unique<FakeTimer>(&now_));
+    }
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, kTimers - 1);
+    std::uniform_int_distribution<int64_t> delay(1, 300);
+    std::uniform_int_distribution<int> action(0, 9);
+    for (int64_t t = 0; t < 5000; t += 10) {
+        for (int n = 0; n < 4; n++) {
+            const size_t i = pick(rng);
+            const int a = action(rng);
+            if (a == 0) {
+                wheel_.cancel(timers[i].get());
+                deadlines[i] = -1;
+            } else {
+                // Armed deadlines may only move later
+                const int64_t deadline = std::max(deadlines[i], t + delay(rng));
+                wheel_.schedule(timers[i].get(), deadline * kMs);
+                deadlines[i] = deadline;
+            }
+        }
+        AdvanceTo(t + 10);
+        for (size_t i = 0; i < kTimers; i++) {
+            if (deadlines[i] >= 0 && deadlines[i] <= t + 10) {
+                fired[i]++;
+                deadlines[i] = -1;
+            }
+            ASSERT_EQ(fired[i], timers[i]->fired()) << "timer " << i << " at " << t + 10;
+        }
+    }
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
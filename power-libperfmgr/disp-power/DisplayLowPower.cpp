@@ -17,8 +17,12 @@
 #define LOG_TAG "powerhal-libperfmgr"
 
 #include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <cutils/sockets.h>
 #include <log/log.h>
 
@@ -31,28 +35,118 @@ namespace power {
 namespace impl {
 namespace pixel {
 
-DisplayLowPower::DisplayLowPower() : mFossStatus(false) {}
+DisplayLowPower::DisplayLowPower(std::string socket_path)
+    : mSocketPath(std::move(socket_path)),
+      mFossRequested(false),
+      mFossStatus(false),
+      mExit(false) {}
+
+DisplayLowPower::~DisplayLowPower() {
+    if (!mThread)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExit = true;
+    }
+    mCond.notify_all();
+    mThread->join();
+}
 
 void DisplayLowPower::Init() {
-    ConnectPpsDaemon();
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mThread)
+        return;
+    mThread = std::unique_ptr<std::thread>(new std::thread(&DisplayLowPower::Routine, this));
 }
 
 void DisplayLowPower::SetDisplayLowPower(bool enable) {
     SetFoss(enable);
 }
 
-void DisplayLowPower::ConnectPpsDaemon() {
+void DisplayLowPower::Routine() {
+    std::chrono::milliseconds reconnect_delay = kMinReconnectDelay;
+    bool connect_failed = false;
+
+    std::unique_lock<std::mutex> lk(mLock);
+    while (!mExit) {
+        // Only (re)connect while there is a state to send, so an unused
+        // daemon, or a device without one, costs nothing
+        mCond.wait(lk, [this] { return mExit || mFossRequested != mFossStatus; });
+        if (mExit)
+            break;
+
+        if (!mPpsSocket.ok()) {
+            lk.unlock();
+            const bool connected = ConnectPpsDaemon();
+            lk.lock();
+            if (!connected) {
+                // Only log the first failure of a streak to avoid spamming
+                // while the daemon is down
+                if (!connect_failed) {
+                    ALOGW("Connecting to PPS daemon failed (%s)", strerror(errno));
+                    connect_failed = true;
+                }
+                mCond.wait_for(lk, reconnect_delay, [this] { return mExit; });
+                reconnect_delay = std::min(reconnect_delay * 2, kMaxReconnectDelay);
+                continue;
+            }
+            connect_failed = false;
+            // A (re)started daemon has foss off, which may be the requested state
+            mFossStatus = false;
+            continue;
+        }
+
+        const bool enable = mFossRequested;
+        lk.unlock();
+        ALOGI("%s foss", (enable) ? "Enable" : "Disable");
+        int ret = -1;
+        if (IsPpsDaemonConnected()) {
+            ret = SendPpsCommand(enable ? "foss:on" : "foss:off");
+        }
+        if (ret) {
+            mPpsSocket.reset();
+        }
+        lk.lock();
+        if (!ret) {
+            mFossStatus = enable;
+            reconnect_delay = kMinReconnectDelay;
+        } else {
+            mCond.wait_for(lk, reconnect_delay, [this] { return mExit; });
+            reconnect_delay = std::min(reconnect_delay * 2, kMaxReconnectDelay);
+        }
+    }
+}
+
+bool DisplayLowPower::ConnectPpsDaemon() {
     constexpr const char kPpsDaemon[] = "pps";
 
-    mPpsSocket.reset(
-            socket_local_client(kPpsDaemon, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM));
-    if (mPpsSocket.get() < 0) {
-        ALOGW("Connecting to PPS daemon failed (%s)", strerror(errno));
+    if (mSocketPath.empty()) {
+        mPpsSocket.reset(
+                socket_local_client(kPpsDaemon, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM));
+    } else {
+        mPpsSocket.reset(socket_local_client(mSocketPath.c_str(),
+                                             ANDROID_SOCKET_NAMESPACE_FILESYSTEM, SOCK_STREAM));
+    }
+    return mPpsSocket.ok();
+}
+
+bool DisplayLowPower::IsPpsDaemonConnected() const {
+    // A write to a socket whose peer has gone away may still succeed, so
+    // check for hang up before sending
+    struct pollfd pfd = {.fd = mPpsSocket.get(), .events = POLLRDHUP};
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, 0)) < 0) {
+        return false;
     }
+    if (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL)) {
+        ALOGW("PPS daemon disconnected");
+        return false;
+    }
+    return true;
 }
 
 int DisplayLowPower::SendPpsCommand(const std::string_view cmd) {
-    if (TEMP_FAILURE_RETRY(write(mPpsSocket.get(), cmd.data(), cmd.size())) < 0) {
+    if (TEMP_FAILURE_RETRY(send(mPpsSocket.get(), cmd.data(), cmd.size(), MSG_NOSIGNAL)) < 0) {
         ALOGE("Failed to send pps command '%s' over socket (%s)", cmd.data(), strerror(errno));
         return -1;
     }
@@ -61,22 +155,13 @@ int DisplayLowPower::SendPpsCommand(const std::string_view cmd) {
 }
 
 void DisplayLowPower::SetFoss(bool enable) {
-    if (mPpsSocket.get() < 0 || mFossStatus == enable) {
-        return;
-    }
-
-    ALOGI("%s foss", (enable) ? "Enable" : "Disable");
-
-    std::string_view foss_cmd;
-    if (enable) {
-        foss_cmd = "foss:on";
-    } else {
-        foss_cmd = "foss:off";
-    }
-
-    if (!SendPpsCommand(foss_cmd)) {
-        mFossStatus = enable;
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        if (mFossRequested == enable)
+            return;
+        mFossRequested = enable;
     }
+    mCond.notify_one();
 }
 
 }  // namespace pixel
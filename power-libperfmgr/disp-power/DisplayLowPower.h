@@ -16,7 +16,13 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
 
 #include <android-base/unique_fd.h>
 
@@ -27,20 +33,42 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+// Sends the requested foss state to the PPS daemon from a worker thread, so
+// callers never block on the daemon. Only the latest requested state is kept:
+// requests superseded before the worker gets to them are dropped. The worker
+// connects on the first state to send and keeps the connection. While a state
+// is pending, it reconnects with backoff when the daemon goes away, and it
+// never connects while nothing is pending.
 class DisplayLowPower {
   public:
-    DisplayLowPower();
-    ~DisplayLowPower() {}
+    // socket_path is the UNIX socket of the daemon, the reserved pps socket
+    // if empty.
+    explicit DisplayLowPower(std::string socket_path = "");
+    ~DisplayLowPower();
     void Init();
     void SetDisplayLowPower(bool enable);
 
   private:
-    void ConnectPpsDaemon();
+    void Routine();
+    bool ConnectPpsDaemon();
+    bool IsPpsDaemonConnected() const;
     int SendPpsCommand(const std::string_view cmd);
     void SetFoss(bool enable);
 
+    static constexpr std::chrono::milliseconds kMinReconnectDelay{100};
+    static constexpr std::chrono::milliseconds kMaxReconnectDelay{10000};
+
+    const std::string mSocketPath;
+    // Only accessed by the worker thread
     ::android::base::unique_fd mPpsSocket;
+    // Foss state requested by the latest SetFoss, and the one last sent to
+    // the connected daemon, protected by mLock
+    bool mFossRequested;
     bool mFossStatus;
+    bool mExit;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::unique_ptr<std::thread> mThread;
 };
 
 }  // namespace pixel
@@ -17,11 +17,12 @@
 #define LOG_TAG "powerhal-libperfmgr"
 #define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
 
+#include <algorithm>
 #include <array>
 #include <memory>
 
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
@@ -34,7 +35,6 @@
 
 #define MAX_LENGTH 64
 
-#define MSINSEC 1000L
 #define NSINMS 1000000L
 
 namespace aidl {
@@ -58,18 +58,21 @@ static const uint32_t kMaxDurationMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.max", /*default*/ 5650U);
 static const uint32_t kDurationOffsetMs =
         ::android::base::GetUintProperty("vendor.powerhal.interaction.offset", /*default*/ 650U);
-
-static size_t CalcTimespecDiffMs(struct timespec start, struct timespec end) {
-    size_t diff_in_ms = 0;
-    diff_in_ms += (end.tv_sec - start.tv_sec) * MSINSEC;
-    diff_in_ms += (end.tv_nsec - start.tv_nsec) / NSINMS;
-    return diff_in_ms;
+static const bool kLearnDuration =
+        ::android::base::GetBoolProperty("vendor.powerhal.interaction.learn", true);
+static const uint32_t kLearnMinDurationMs =
+        ::android::base::GetUintProperty("vendor.powerhal.interaction.learn.min", /*default*/ 500U);
+
+static int64_t NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-static int FbIdleOpen(void) {
+static int FbIdleOpen(const std::vector<std::string> &paths) {
     int fd;
-    for (const auto &path : kDispIdlePath) {
-        fd = open(path, O_RDONLY);
+    for (const auto &path : paths) {
+        fd = open(path.c_str(), O_RDONLY);
         if (fd >= 0)
             return fd;
     }
@@ -79,10 +82,47 @@ static int FbIdleOpen(void) {
 
 }  // namespace
 
-InteractionHandler::InteractionHandler(std::shared_ptr<HintManager> const &hint_manager)
+size_t IdleTimeLearner::BucketOf(int32_t requestMs) {
+    // Bucket 0 for unknown durations, then bounds doubling from 125ms
+    size_t bucket = 0;
+    for (int32_t bound = 0; bucket < kBuckets - 1 && requestMs > bound;
+         bound = bound ? bound * 2 : 125) {
+        bucket++;
+    }
+    return bucket;
+}
+
+void IdleTimeLearner::Record(int32_t requestMs, int32_t idleMs) {
+    Bucket &b = mBuckets[BucketOf(requestMs)];
+    b.samples[b.next] = idleMs;
+    b.next = (b.next + 1) % kSamples;
+    b.count = std::min(b.count + 1, kSamples);
+}
+
+int32_t IdleTimeLearner::Predict(int32_t requestMs) const {
+    const Bucket &b = mBuckets[BucketOf(requestMs)];
+    if (b.count < kMinSamples) {
+        return 0;
+    }
+    std::array<int32_t, kSamples> sorted = b.samples;
+    const size_t rank = (b.count * 95 + 99) / 100 - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + b.count);
+    return sorted[rank];
+}
+
+InteractionHandler::InteractionHandler(std::shared_ptr<HintManager> const &hint_manager,
+                                       std::vector<std::string> idle_paths)
     : mState(INTERACTION_STATE_UNINITIALIZED),
-      mDurationMs(0),
-      mHintManager(hint_manager) {}
+      mIdlePaths(idle_paths.empty()
+                         ? std::vector<std::string>(kDispIdlePath.begin(), kDispIdlePath.end())
+                         : std::move(idle_paths)),
+      mEpollFd(-1),
+      mLastAcquireNs(0),
+      mDeadlineNs(0),
+      mRequestMs(0),
+      mFixedDurationMs(0),
+      mHintManager(hint_manager),
+      mInteractionHintId(hint_manager->GetHintId("INTERACTION")) {}
 
 InteractionHandler::~InteractionHandler() {
     Exit();
@@ -94,7 +134,7 @@ bool InteractionHandler::Init() {
     if (mState != INTERACTION_STATE_UNINITIALIZED)
         return true;
 
-    int fd = FbIdleOpen();
+    int fd = FbIdleOpen(mIdlePaths);
     if (fd < 0)
         return false;
     mIdleFd = fd;
@@ -106,6 +146,33 @@ bool InteractionHandler::Init() {
         return false;
     }
 
+    // The idle node stays registered for the life of the handler; edge
+    // triggered, so a notification is reported once rather than until the
+    // node is read again.
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = mEventFd;
+    bool ok = mEpollFd >= 0 && !epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mEventFd, &ev);
+    if (ok) {
+        ev.events = EPOLLPRI | EPOLLERR | EPOLLET;
+        ev.data.fd = mIdleFd;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mIdleFd, &ev)) {
+            // A node that cannot be polled, e.g. a regular file, is only
+            // checked once the settle time after an interaction has passed
+            ok = errno == EPERM;
+            ALOGW_IF(ok, "idle_state does not support poll, checking it after settling only");
+        }
+    }
+    if (!ok) {
+        ALOGE("Unable to set up epoll (%d)", errno);
+        if (mEpollFd >= 0)
+            close(mEpollFd);
+        close(mEventFd);
+        close(mIdleFd);
+        return false;
+    }
+
     mState = INTERACTION_STATE_IDLE;
     mThread = std::unique_ptr<std::thread>(new std::thread(&InteractionHandler::Routine, this));
 
@@ -124,13 +191,14 @@ void InteractionHandler::Exit() {
     mCond.notify_all();
     mThread->join();
 
+    close(mEpollFd);
     close(mEventFd);
     close(mIdleFd);
 }
 
 void InteractionHandler::PerfLock() {
     ALOGV("%s: acquiring perf lock", __func__);
-    if (!mHintManager->DoHint("INTERACTION")) {
+    if (!mHintManager->DoHint(mInteractionHintId)) {
         ALOGE("%s: do hint INTERACTION failed", __func__);
     }
     ATRACE_INT("interaction_lock", 1);
@@ -138,7 +206,7 @@ void InteractionHandler::PerfLock() {
 
 void InteractionHandler::PerfRel() {
     ALOGV("%s: releasing perf lock", __func__);
-    if (!mHintManager->EndHint("INTERACTION")) {
+    if (!mHintManager->EndHint(mInteractionHintId)) {
         ALOGE("%s: end hint INTERACTION failed", __func__);
     }
     ATRACE_INT("interaction_lock", 0);
@@ -157,48 +225,66 @@ void InteractionHandler::Acquire(int32_t duration) {
         finalDuration = inputDuration;
     else
         finalDuration = kMinDurationMs;
+    const int fixedDuration = finalDuration;
+
+    // Stop short of the fixed duration when interactions like this one have
+    // gone idle sooner
+    if (kLearnDuration && kDisplayIdleSupport) {
+        int learned = mIdleLearner.Predict(duration);
+        if (learned > 0) {
+            learned = std::max(learned, static_cast<int>(kLearnMinDurationMs));
+            finalDuration = std::min(finalDuration, learned);
+        }
+    }
 
     // Fallback to do boost directly
     // 1) override property is set OR
     // 2) InteractionHandler not initialized
     if (!kDisplayIdleSupport || mState == INTERACTION_STATE_UNINITIALIZED) {
-        mHintManager->DoHint("INTERACTION", std::chrono::milliseconds(finalDuration));
+        mHintManager->DoHint(mInteractionHintId, std::chrono::milliseconds(finalDuration));
         return;
     }
 
-    struct timespec cur_timespec;
-    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
-    if (mState != INTERACTION_STATE_IDLE && finalDuration <= mDurationMs) {
-        size_t elapsed_time = CalcTimespecDiffMs(mLastTimespec, cur_timespec);
-        // don't hint if previous hint's duration covers this hint's duration
-        if (elapsed_time <= (mDurationMs - finalDuration)) {
-            ALOGV("%s: Previous duration (%d) cover this (%d) elapsed: %lld", __func__,
-                  static_cast<int>(mDurationMs), static_cast<int>(finalDuration),
-                  static_cast<long long>(elapsed_time));
-            return;
-        }
+    const int64_t now = NowNs();
+    // The boost covers the settle wait before idle is checked, as well
+    const int64_t deadline = now + (kWaitMs + finalDuration) * NSINMS;
+    // don't hint if previous hint's duration covers this hint's duration
+    if (mState != INTERACTION_STATE_IDLE && deadline <= mDeadlineNs.load()) {
+        ALOGV("%s: Previous deadline covers this (%d)", __func__, finalDuration);
+        return;
     }
-    mLastTimespec = cur_timespec;
-    mDurationMs = finalDuration;
+    mLastAcquireNs.store(now);
+    mDeadlineNs.store(deadline);
+    mRequestMs = duration;
+    mFixedDurationMs = fixedDuration;
 
     ALOGV("%s: input: %d final duration: %d", __func__, duration, finalDuration);
 
-    if (mState == INTERACTION_STATE_WAITING)
-        AbortWaitLocked();
-    else if (mState == INTERACTION_STATE_IDLE)
+    // While waiting, the idle thread picks up the new deadline when its
+    // current wait ends, so only a new boost wakes it.
+    if (mState == INTERACTION_STATE_IDLE) {
         PerfLock();
-
-    mState = INTERACTION_STATE_INTERACTION;
-    mCond.notify_one();
+        mState = INTERACTION_STATE_INTERACTION;
+        mCond.notify_one();
+    }
 }
 
-void InteractionHandler::Release() {
+void InteractionHandler::Release(IdleWaitResult result, int64_t acquire_ns) {
     std::lock_guard<std::mutex> lk(mLock);
-    if (mState == INTERACTION_STATE_WAITING) {
+    if (mState == INTERACTION_STATE_WAITING && result != IDLE_WAIT_ABORTED &&
+        acquire_ns == mLastAcquireNs.load()) {
         ATRACE_CALL();
+        if (result == IDLE_WAIT_IDLE) {
+            const int64_t idle_ms = (NowNs() - acquire_ns) / NSINMS;
+            mIdleLearner.Record(mRequestMs, static_cast<int32_t>(idle_ms));
+        } else if (result == IDLE_WAIT_TIMEOUT) {
+            // Count a boost cut short by a learned duration as needing the
+            // full one, so learning does not lock in its own guess
+            mIdleLearner.Record(mRequestMs, mFixedDurationMs);
+        }
         PerfRel();
         mState = INTERACTION_STATE_IDLE;
-    } else {
+    } else if (result == IDLE_WAIT_ABORTED) {
         // clear any wait aborts pending in event fd
         uint64_t val;
         ssize_t ret = read(mEventFd, &val, sizeof(val));
@@ -215,49 +301,66 @@ void InteractionHandler::AbortWaitLocked() {
         ALOGW("Unable to write to event fd (%zd)", ret);
 }
 
-void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
+IdleWaitResult InteractionHandler::WaitForIdle(int32_t wait_ms, int64_t *acquire_ns) {
     char data[MAX_LENGTH];
     ssize_t ret;
-    struct pollfd pfd[2];
+    struct epoll_event events[2];
+    // Interaction whose settle time was last checked against the node
+    int64_t checked_ns = -1;
 
     ATRACE_CALL();
 
-    ALOGV("%s: wait:%d timeout:%d", __func__, wait_ms, timeout_ms);
-
-    pfd[0].fd = mEventFd;
-    pfd[0].events = POLLIN;
-    pfd[1].fd = mIdleFd;
-    pfd[1].events = POLLPRI | POLLERR;
-
-    ret = poll(pfd, 1, wait_ms);
-    if (ret > 0) {
-        ALOGV("%s: wait aborted", __func__);
-        return;
-    } else if (ret < 0) {
-        ALOGE("%s: error in poll while waiting", __func__);
-        return;
-    }
-
-    ret = pread(mIdleFd, data, sizeof(data), 0);
-    if (!ret) {
-        ALOGE("%s: Unexpected EOF!", __func__);
-        return;
-    }
+    while (true) {
+        const int64_t acquired = mLastAcquireNs.load();
+        const int64_t deadline = mDeadlineNs.load();
+        const int64_t settle = acquired + wait_ms * NSINMS;
+        const int64_t now = NowNs();
+        *acquire_ns = acquired;
+        if (now >= deadline) {
+            ALOGV("%s: timed out waiting for idle", __func__);
+            return IDLE_WAIT_TIMEOUT;
+        }
+        if (now >= settle && checked_ns != acquired) {
+            // Idle may have been signalled while settling, check the node
+            checked_ns = acquired;
+            ret = pread(mIdleFd, data, sizeof(data), 0);
+            if (ret <= 0) {
+                ALOGE("%s: Unexpected EOF!", __func__);
+                return IDLE_WAIT_ERROR;
+            }
+            if (!strncmp(data, "idle", 4)) {
+                ALOGV("%s: already idle", __func__);
+                return IDLE_WAIT_IDLE;
+            }
+        }
 
-    if (!strncmp(data, "idle", 4)) {
-        ALOGV("%s: already idle", __func__);
-        return;
+        const int64_t wake = now < settle ? std::min(settle, deadline) : deadline;
+        const int timeout_ms = static_cast<int>((wake - now + NSINMS - 1) / NSINMS);
+        int n = epoll_wait(mEpollFd, events, 2, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("%s: Error on waiting for idle (%d)", __func__, errno);
+            return IDLE_WAIT_ERROR;
+        }
+        bool idle_event = false;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == mEventFd) {
+                ALOGV("%s: wait for idle aborted", __func__);
+                return IDLE_WAIT_ABORTED;
+            }
+            idle_event = true;
+        }
+        // Events while settling are covered by the check once it ends
+        if (idle_event && NowNs() >= mLastAcquireNs.load() + wait_ms * NSINMS) {
+            ret = pread(mIdleFd, data, sizeof(data), 0);
+            if (ret > 0 && !strncmp(data, "idle", 4)) {
+                ALOGV("%s: idle detected", __func__);
+                *acquire_ns = mLastAcquireNs.load();
+                return IDLE_WAIT_IDLE;
+            }
+        }
     }
-
-    ret = poll(pfd, 2, timeout_ms);
-    if (ret < 0)
-        ALOGE("%s: Error on waiting for idle (%zd)", __func__, ret);
-    else if (ret == 0)
-        ALOGV("%s: timed out waiting for idle", __func__);
-    else if (pfd[0].revents)
-        ALOGV("%s: wait for idle aborted", __func__);
-    else if (pfd[1].revents)
-        ALOGV("%s: idle detected", __func__);
 }
 
 void InteractionHandler::Routine() {
@@ -272,8 +375,9 @@ void InteractionHandler::Routine() {
         mState = INTERACTION_STATE_WAITING;
         lk.unlock();
 
-        WaitForIdle(kWaitMs, mDurationMs);
-        Release();
+        int64_t acquire_ns;
+        IdleWaitResult result = WaitForIdle(kWaitMs, &acquire_ns);
+        Release(result, acquire_ns);
     }
 }
 
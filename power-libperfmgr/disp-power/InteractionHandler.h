@@ -16,11 +16,14 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <perfmgr/HintManager.h>
 
@@ -31,6 +34,7 @@ namespace power {
 namespace impl {
 namespace pixel {
 
+using ::android::perfmgr::HintId;
 using ::android::perfmgr::HintManager;
 
 enum InteractionState {
@@ -40,17 +44,55 @@ enum InteractionState {
     INTERACTION_STATE_WAITING,
 };
 
+// Learns how long the display takes to go idle after an interaction, bucketed
+// by the duration requested by the framework, so boosts can stop short of the
+// fixed maximum when interactions like them settle sooner.
+class IdleTimeLearner {
+  public:
+    // Record that an interaction requested for requestMs went idle after idleMs
+    void Record(int32_t requestMs, int32_t idleMs);
+    // Return the 95th percentile idle time of interactions like requestMs, or
+    // 0 if too few have been recorded.
+    int32_t Predict(int32_t requestMs) const;
+
+  private:
+    static constexpr size_t kBuckets = 8;
+    static constexpr size_t kSamples = 32;
+    static constexpr size_t kMinSamples = 8;
+    struct Bucket {
+        std::array<int32_t, kSamples> samples{};
+        size_t count = 0;
+        size_t next = 0;
+    };
+    static size_t BucketOf(int32_t requestMs);
+    std::array<Bucket, kBuckets> mBuckets;
+};
+
+enum IdleWaitResult {
+    IDLE_WAIT_IDLE,
+    IDLE_WAIT_TIMEOUT,
+    IDLE_WAIT_ABORTED,
+    IDLE_WAIT_ERROR,
+};
+
 class InteractionHandler {
   public:
-    InteractionHandler(std::shared_ptr<HintManager> const &hint_manager);
+    // idle_paths lists the display idle_state nodes to try in order, the
+    // sysfs nodes of the display if empty.
+    InteractionHandler(std::shared_ptr<HintManager> const &hint_manager,
+                       std::vector<std::string> idle_paths = {});
     ~InteractionHandler();
     bool Init();
     void Exit();
     void Acquire(int32_t duration);
 
   private:
-    void Release();
-    void WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
+    // Release the boost unless an interaction after acquire_ns extended it
+    void Release(IdleWaitResult result, int64_t acquire_ns);
+    // Wait until the display is idle at least wait_ms after the latest
+    // interaction, or its boost deadline passes. Set *acquire_ns to the time
+    // of the interaction the result applies to.
+    IdleWaitResult WaitForIdle(int32_t wait_ms, int64_t *acquire_ns);
     void AbortWaitLocked();
     void Routine();
 
@@ -58,14 +100,25 @@ class InteractionHandler {
     void PerfRel();
 
     enum InteractionState mState;
+    const std::vector<std::string> mIdlePaths;
     int mIdleFd;
     int mEventFd;
-    int32_t mDurationMs;
-    struct timespec mLastTimespec;
+    int mEpollFd;
+    // Time of the latest interaction and the end of its boost, on
+    // CLOCK_MONOTONIC. Written under mLock and read by the idle thread
+    // without it, so interactions that only extend the boost do not wake it.
+    std::atomic<int64_t> mLastAcquireNs;
+    std::atomic<int64_t> mDeadlineNs;
+    // Duration requested for the current interaction, and the boost it would
+    // get without learning
+    int32_t mRequestMs;
+    int32_t mFixedDurationMs;
+    IdleTimeLearner mIdleLearner;  // protected by mLock
     std::unique_ptr<std::thread> mThread;
     std::mutex mLock;
     std::condition_variable mCond;
     std::shared_ptr<HintManager> mHintManager;
+    const HintId mInteractionHintId;
 };
 
 }  // namespace pixel
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disp-power/DisplayLowPower.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using ::android::base::unique_fd;
+using std::literals::chrono_literals::operator""ms;
+
+constexpr std::chrono::milliseconds kWAIT_TIMEOUT_MS = 5000ms;
+
+// Stand-in for the PPS daemon: accepts one client at a time on a UNIX
+// socket and records the foss commands it receives.
+class FakePpsDaemon {
+  public:
+    explicit FakePpsDaemon(const std::string &path) : path_(path) {
+        listen_fd_.reset(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(path.c_str());
+        EXPECT_EQ(0, bind(listen_fd_.get(), reinterpret_cast<struct sockaddr *>(&addr),
+                          sizeof(addr)))
+                << strerror(errno);
+        EXPECT_EQ(0, listen(listen_fd_.get(), 1)) << strerror(errno);
+        stop_fd_.reset(eventfd(0, EFD_CLOEXEC));
+        thread_ = std::thread(&FakePpsDaemon::Run, this);
+    }
+
+    ~FakePpsDaemon() {
+        uint64_t val = 1;
+        EXPECT_EQ(static_cast<ssize_t>(sizeof(val)), write(stop_fd_.get(), &val, sizeof(val)));
+        thread_.join();
+        unlink(path_.c_str());
+    }
+
+    // Wait until count commands were received, and return all of them
+    std::vector<std::string> WaitCommands(size_t count) {
+        std::unique_lock<std::mutex> lk(lock_);
+        cond_.wait_for(lk, kWAIT_TIMEOUT_MS, [&] { return commands_.size() >= count; });
+        return commands_;
+    }
+
+    size_t connections() {
+        std::lock_guard<std::mutex> lk(lock_);
+        return connections_;
+    }
+
+  private:
+    void Run() {
+        unique_fd client;
+        std::string buffer;
+        while (true) {
+            struct pollfd fds[2] = {{.fd = stop_fd_.get(), .events = POLLIN},
+                                    {.fd = client.ok() ? client.get() : listen_fd_.get(),
+                                     .events = POLLIN}};
+            if (poll(fds, 2, -1) < 0 || fds[0].revents) {
+                return;
+            }
+            if (!fds[1].revents) {
+                continue;
+            }
+            if (!client.ok()) {
+                client.reset(accept4(listen_fd_.get(), nullptr, nullptr, SOCK_CLOEXEC));
+                std::lock_guard<std::mutex> lk(lock_);
+                connections_++;
+                continue;
+            }
+            char data[64];
+            ssize_t n = read(client.get(), data, sizeof(data));
+            if (n <= 0) {
+                client.reset();
+                continue;
+            }
+            buffer.append(data, n);
+            Parse(&buffer);
+        }
+    }
+
+    // Split the stream into commands
+    void Parse(std::string *buffer) {
+        std::lock_guard<std::mutex> lk(lock_);
+        while (!buffer->empty()) {
+            size_t length = 0;
+            for (const std::string cmd : {"foss:on", "foss:off"}) {
+                if (buffer->compare(0, cmd.size(), cmd) == 0) {
+                    length = cmd.size();
+                }
+            }
+            if (!length) {
+                // Wait for the rest of a command, or keep unknown data whole
+                if (buffer->size() < 8) {
+                    break;
+                }
+                length = buffer->size();
+            }
+            commands_.push_back(buffer->substr(0, length));
+            buffer->erase(0, length);
+        }
+        cond_.notify_all();
+    }
+
+    const std::string path_;
+    unique_fd listen_fd_;
+    unique_fd stop_fd_;
+    std::thread thread_;
+    std::mutex lock_;
+    std::condition_variable cond_;
+    std::vector<std::string> commands_;
+    size_t connections_ = 0;
+};
+
+class DisplayLowPowerTest : public ::testing::Test {
+  protected:
+    DisplayLowPowerTest() : socket_path_(std::string(dir_.path) + "/pps") {}
+
+    TemporaryDir dir_;
+    const std::string socket_path_;
+};
+
+// Test requested states are sent, and a request for the current state is not
+TEST_F(DisplayLowPowerTest, SendTest) {
+    FakePpsDaemon daemon(socket_path_);
+    DisplayLowPower dlpw(socket_path_);
+    dlpw.Init();
+    dlpw.SetDisplayLowPower(false);
+    dlpw.SetDisplayLowPower(true);
+    EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+    dlpw.SetDisplayLowPower(false);
+    EXPECT_EQ(std::vector<std::string>({"foss:on", "foss:off"}), daemon.WaitCommands(2));
+}
+
+// Test only the latest of the states requested before the worker starts is
+// sent, and a burst of requests is coalesced
+TEST_F(DisplayLowPowerTest, CoalesceTest) {
+    FakePpsDaemon daemon(socket_path_);
+    DisplayLowPower dlpw(socket_path_);
+    for (int i = 0; i < 1000; i++) {
+        dlpw.SetDisplayLowPower(i % 2 == 0);
+    }
+    dlpw.SetDisplayLowPower(true);
+    dlpw.Init();
+    EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+    for (int i = 0; i < 1000; i++) {
+        dlpw.SetDisplayLowPower(i % 2 == 1);
+    }
+    dlpw.SetDisplayLowPower(false);
+    std::vector<std::string> commands = daemon.WaitCommands(1);
+    // Wait for the worker to reach the final state
+    while (commands.back() != "foss:off") {
+        const size_t received = commands.size();
+        commands = daemon.WaitCommands(received + 1);
+        if (commands.size() == received) {
+            break;
+        }
+    }
+    EXPECT_EQ("foss:off", commands.back());
+    EXPECT_GT(1001u, commands.size());
+    for (size_t i = 1; i < commands.size(); i++) {
+        EXPECT_NE(commands[i - 1], commands[i]);
+    }
+}
+
+// Test the worker does not connect to the daemon until a state differing from
+// the current one is requested
+TEST_F(DisplayLowPowerTest, IdleTest) {
+    FakePpsDaemon daemon(socket_path_);
+    DisplayLowPower dlpw(socket_path_);
+    dlpw.Init();
+    dlpw.SetDisplayLowPower(false);
+    std::this_thread::sleep_for(200ms);
+    EXPECT_EQ(0u, daemon.connections());
+    dlpw.SetDisplayLowPower(true);
+    EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+    EXPECT_EQ(1u, daemon.connections());
+}
+
+// Test a state requested while the daemon is down is sent once it is up
+TEST_F(DisplayLowPowerTest, DaemonStartsLaterTest) {
+    DisplayLowPower dlpw(socket_path_);
+    dlpw.Init();
+    dlpw.SetDisplayLowPower(true);
+    std::this_thread::sleep_for(50ms);
+    FakePpsDaemon daemon(socket_path_);
+    EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+}
+
+// Test the worker notices a restarted daemon on the next request, reconnects,
+// and resends a state the new daemon does not start in
+TEST_F(DisplayLowPowerTest, ReconnectTest) {
+    DisplayLowPower dlpw(socket_path_);
+    {
+        FakePpsDaemon daemon(socket_path_);
+        dlpw.Init();
+        dlpw.SetDisplayLowPower(true);
+        EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+    }
+    FakePpsDaemon daemon(socket_path_);
+    // The restarted daemon already has foss off, so nothing is sent for this
+    dlpw.SetDisplayLowPower(false);
+    const auto deadline = std::chrono::steady_clock::now() + kWAIT_TIMEOUT_MS;
+    while (daemon.connections() == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(10ms);
+    }
+    ASSERT_EQ(1u, daemon.connections());
+    dlpw.SetDisplayLowPower(true);
+    EXPECT_EQ(std::vector<std::string>({"foss:on"}), daemon.WaitCommands(1));
+    EXPECT_EQ(1u, daemon.connections());
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
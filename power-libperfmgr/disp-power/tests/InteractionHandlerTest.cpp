@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "disp-power/InteractionHandler.h"
+
+namespace aidl {
+namespace google {
+namespace hardware {
+namespace power {
+namespace impl {
+namespace pixel {
+
+using std::literals::chrono_literals::operator""ms;
+
+constexpr double kTIMING_TOLERANCE_MS = 150;
+// Default vendor.powerhal.disp.idle_wait, interaction.min and learn.min
+constexpr int64_t kWaitMs = 100;
+constexpr int64_t kMinDurationMs = 1400;
+constexpr int64_t kLearnMinDurationMs = 500;
+
+constexpr char kJSON_RAW[] = R"(
+{
+    "Nodes": [
+        {
+            "Name": "Boost",
+            "Path": "NODE_PATH",
+            "Values": [
+                "1",
+                "0"
+            ],
+            "DefaultIndex": 1,
+            "ResetOnInit": true
+        }
+    ],
+    "Actions": [
+        {
+            "PowerHint": "INTERACTION",
+            "Node": "Boost",
+            "Value": "1",
+            "Duration": 10000
+        }
+    ]
+}
+)";
+
+// Test IdleTimeLearner only predicts once a bucket has enough samples
+TEST(IdleTimeLearnerTest, MinSamplesTest) {
+    IdleTimeLearner learner;
+    for (int i = 0; i < 7; i++) {
+        learner.Record(0, 300);
+        EXPECT_EQ(0, learner.Predict(0));
+    }
+    learner.Record(0, 300);
+    EXPECT_EQ(300, learner.Predict(0));
+}
+
+// Test the prediction is the 95th percentile of the latest 32 samples
+TEST(IdleTimeLearnerTest, PercentileTest) {
+    IdleTimeLearner learner;
+    for (int i = 1; i <= 20; i++) {
+        learner.Record(100, i * 10);
+    }
+    // The 19th of 20 samples
+    EXPECT_EQ(190, learner.Predict(100));
+    // Old samples are replaced once 32 were recorded
+    for (int i = 0; i < 32; i++) {
+        learner.Record(100, 50);
+    }
+    EXPECT_EQ(50, learner.Predict(100));
+}
+
+// Test requests of different durations are learned separately
+TEST(IdleTimeLearnerTest, BucketTest) {
+    IdleTimeLearner learner;
+    for (int i = 0; i < 8; i++) {
+        learner.Record(100, 200);
+        learner.Record(1000, 900);
+    }
+    EXPECT_EQ(200, learner.Predict(120));
+    EXPECT_EQ(900, learner.Predict(1000));
+    EXPECT_EQ(0, learner.Predict(0));
+    EXPECT_EQ(0, learner.Predict(300));
+}
+
+class InteractionHandlerTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        std::string json_doc = kJSON_RAW;
+        json_doc.replace(json_doc.find("NODE_PATH"), 9, node_.path);
+        ASSERT_TRUE(::android::base::WriteStringToFile(json_doc, config_.path));
+        hm_ = std::shared_ptr<HintManager>(HintManager::GetFromJSON(config_.path));
+        ASSERT_TRUE(hm_ != nullptr);
+        SetIdle(false);
+        handler_ = std::make_unique<InteractionHandler>(
+                hm_, std::vector<std::string>{"/nonexistent/idle_state", idle_.path});
+        ASSERT_TRUE(handler_->Init());
+    }
+
+    virtual void TearDown() {
+        handler_.reset();
+        hm_.reset();
+    }
+
+    // Write the content of the fake display idle_state node
+    void SetIdle(bool idle) {
+        ASSERT_TRUE(::android::base::WriteStringToFile(idle ? "idle" : "busy", idle_.path));
+    }
+
+    bool Boosted() {
+        std::string value;
+        ::android::base::ReadFileToString(node_.path, &value);
+        return value == "1";
+    }
+
+    // Wait for the boost node to be boosted or not, return false on timeout
+    bool WaitBoosted(bool boosted) {
+        const auto timeout = std::chrono::steady_clock::now() + 10000ms;
+        while (Boosted() != boosted) {
+            if (std::chrono::steady_clock::now() > timeout) {
+                return false;
+            }
+            std::this_thread::sleep_for(5ms);
+        }
+        return true;
+    }
+
+    // Run an interaction and return how long its boost lasted in ms
+    int64_t BoostMs(int32_t duration) {
+        const auto start = std::chrono::steady_clock::now();
+        handler_->Acquire(duration);
+        EXPECT_TRUE(WaitBoosted(true));
+        EXPECT_TRUE(WaitBoosted(false));
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - start)
+                .count();
+    }
+
+    TemporaryFile node_;
+    TemporaryFile config_;
+    TemporaryFile idle_;
+    std::shared_ptr<HintManager> hm_;
+    std::unique_ptr<InteractionHandler> handler_;
+};
+
+// Test a boost lasts the settle wait and the fixed duration while the
+// display stays busy, and ends after the settle wait once it is idle
+TEST_F(InteractionHandlerTest, IdleStateTest) {
+    EXPECT_NEAR(kWaitMs + kMinDurationMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+    SetIdle(true);
+    EXPECT_NEAR(kWaitMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+}
+
+// Test interactions that go idle early cap later boosts, and a boost cut
+// short while the display stayed busy raises the cap again
+TEST_F(InteractionHandlerTest, LearnDurationTest) {
+    SetIdle(true);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_NEAR(kWaitMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+    }
+    SetIdle(false);
+    // Capped at the learned idle time, but never below learn.min
+    EXPECT_NEAR(kWaitMs + kLearnMinDurationMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+    EXPECT_NEAR(kWaitMs + kMinDurationMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+}
+
+// Test interactions during a boost extend it without restarting it
+TEST_F(InteractionHandlerTest, ExtendBoostTest) {
+    const auto start = std::chrono::steady_clock::now();
+    handler_->Acquire(0);
+    ASSERT_TRUE(WaitBoosted(true));
+    std::this_thread::sleep_for(700ms);
+    handler_->Acquire(0);
+    // The node stays boosted until the deadline of the second interaction
+    while (Boosted()) {
+        std::this_thread::sleep_for(5ms);
+    }
+    const int64_t boost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+    EXPECT_NEAR(700 + kWaitMs + kMinDurationMs, boost_ms, kTIMING_TOLERANCE_MS);
+    EXPECT_EQ(1u, hm_->GetHintStats("INTERACTION").count);
+}
+
+// Test a burst of interactions is one boost
+TEST_F(InteractionHandlerTest, BurstTest) {
+    SetIdle(true);
+    for (int i = 0; i < 100; i++) {
+        handler_->Acquire(0);
+    }
+    ASSERT_TRUE(WaitBoosted(true));
+    ASSERT_TRUE(WaitBoosted(false));
+    EXPECT_EQ(1u, hm_->GetHintStats("INTERACTION").count);
+    // An interaction after the boost ended starts a new one
+    EXPECT_NEAR(kWaitMs, BoostMs(0), kTIMING_TOLERANCE_MS);
+    EXPECT_EQ(2u, hm_->GetHintStats("INTERACTION").count);
+}
+
+// Test idle is only checked once the settle time after the latest
+// interaction has passed
+TEST_F(InteractionHandlerTest, SettleAfterLatestTest) {
+    SetIdle(true);
+    const auto start = std::chrono::steady_clock::now();
+    handler_->Acquire(0);
+    ASSERT_TRUE(WaitBoosted(true));
+    std::this_thread::sleep_for(60ms);
+    handler_->Acquire(0);
+    ASSERT_TRUE(WaitBoosted(false));
+    const int64_t boost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+    EXPECT_LE(60 + kWaitMs, boost_ms);
+    EXPECT_NEAR(60 + kWaitMs, boost_ms, kTIMING_TOLERANCE_MS);
+    EXPECT_EQ(1u, hm_->GetHintStats("INTERACTION").count);
+}
+
+}  // namespace pixel
+}  // namespace impl
+}  // namespace power
+}  // namespace hardware
+}  // namespace google
+}  // namespace aidl
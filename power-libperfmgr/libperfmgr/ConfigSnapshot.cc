@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "libperfmgr"
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "perfmgr/FileNode.h"
+#include "perfmgr/HintManager.h"
+#include "perfmgr/PropertyNode.h"
+
+// A snapshot is a header followed by a payload of little-endian fields:
+//   u32 string count, then per string: u32 length, bytes
+//   u32 node count, then per node:
+//     u32 name, u32 path, u8 type, u8 reset on init, u8 hold fd,
+//     u32 default index, u32 value count, u32 value per value
+//   u32 hint count, then per hint:
+//     u32 name, u32 node action count,
+//     per node action: u32 node index, u32 value index, u64 timeout ms,
+//     u32 hint action count, per hint action: u8 type, u32 value
+// All strings are stored once in the string table and referenced by index.
+
+namespace android {
+namespace perfmgr {
+
+namespace {
+
+constexpr uint32_t kSnapshotMagic = 0x4e534d50;  // "PMSN"
+constexpr uint32_t kSnapshotVersion = 1;
+constexpr char kJsonExtension[] = ".json";
+constexpr char kSnapshotExtension[] = ".bin";
+
+enum class SnapshotNodeType : uint8_t { File, Property };
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t payload_size;
+    // FNV-1a of the payload
+    uint32_t checksum;
+    // FNV-1a of the JSON config the snapshot was compiled from
+    uint64_t source_hash;
+};
+
+uint32_t Fnv1a32(const void *data, std::size_t size) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint64_t Fnv1a64(const void *data, std::size_t size) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+class SnapshotWriter {
+  public:
+    template <typename T>
+    void Put(T v) {
+        buf_.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+
+    // Write the index of s in the string table
+    void PutString(const std::string &s) {
+        auto it = string_ids_.find(s);
+        if (it == string_ids_.end()) {
+            it = string_ids_.emplace(s, static_cast<uint32_t>(strings_.size())).first;
+            strings_.push_back(s);
+        }
+        Put<uint32_t>(it->second);
+    }
+
+    std::string Finish(uint64_t source_hash) const {
+        std::string payload;
+        uint32_t count = strings_.size();
+        payload.append(reinterpret_cast<const char *>(&count), sizeof(count));
+        for (const auto &s : strings_) {
+            uint32_t len = s.size();
+            payload.append(reinterpret_cast<const char *>(&len), sizeof(len));
+            payload.append(s);
+        }
+        payload.append(buf_);
+
+        SnapshotHeader header = {kSnapshotMagic, kSnapshotVersion,
+                                 static_cast<uint32_t>(payload.size()),
+                                 Fnv1a32(payload.data(), payload.size()), source_hash};
+        std::string snapshot(reinterpret_cast<const char *>(&header), sizeof(header));
+        snapshot.append(payload);
+        return snapshot;
+    }
+
+  private:
+    std::string buf_;
+    std::map<std::string, uint32_t> string_ids_;
+    std::vector<std::string> strings_;
+};
+
+class SnapshotReader {
+  public:
+    SnapshotReader(const char *data, std::size_t size) : data_(data), size_(size), pos_(0) {}
+
+    template <typename T>
+    bool Get(T *v) {
+        if (size_ - pos_ < sizeof(T)) {
+            return false;
+        }
+        memcpy(v, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    bool GetBytes(std::size_t len, std::string *s) {
+        if (size_ - pos_ < len) {
+            return false;
+        }
+        s->assign(data_ + pos_, len);
+        pos_ += len;
+        return true;
+    }
+
+    bool AtEnd() const { return pos_ == size_; }
+
+  private:
+    const char *data_;
+    const std::size_t size_;
+    std::size_t pos_;
+};
+
+// Read a string table reference
+bool GetString(SnapshotReader *reader, const std::vector<std::string> &strings,
+               std::string *s) {
+    uint32_t id;
+    if (!reader->Get(&id) || id >= strings.size()) {
+        return false;
+    }
+    *s = strings[id];
+    return true;
+}
+
+bool ParsePayload(SnapshotReader *reader, std::vector<std::unique_ptr<Node>> *nodes,
+                  std::unordered_map<std::string, Hint> *actions) {
+    uint32_t string_count;
+    if (!reader->Get(&string_count)) {
+        return false;
+    }
+    std::vector<std::string> strings(string_count);
+    for (auto &s : strings) {
+        uint32_t len;
+        if (!reader->Get(&len) || !reader->GetBytes(len, &s)) {
+            return false;
+        }
+    }
+
+    uint32_t node_count;
+    if (!reader->Get(&node_count) || node_count == 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < node_count; i++) {
+        std::string name, path;
+        uint8_t type, reset, hold_fd;
+        uint32_t default_index, value_count;
+        if (!GetString(reader, strings, &name) || !GetString(reader, strings, &path) ||
+            !reader->Get(&type) || !reader->Get(&reset) || !reader->Get(&hold_fd) ||
+            !reader->Get(&default_index) || !reader->Get(&value_count) ||
+            default_index >= value_count) {
+            return false;
+        }
+        std::vector<RequestGroup> values;
+        for (uint32_t j = 0; j < value_count; j++) {
+            std::string value;
+            if (!GetString(reader, strings, &value)) {
+                return false;
+            }
+            values.emplace_back(value);
+        }
+        switch (static_cast<SnapshotNodeType>(type)) {
+            case SnapshotNodeType::File:
+                nodes->emplace_back(std::make_unique<FileNode>(name, path, values, default_index,
+                                                               reset, hold_fd));
+                break;
+            case SnapshotNodeType::Property:
+                nodes->emplace_back(
+                        std::make_unique<PropertyNode>(name, path, values, default_index, reset));
+                break;
+            default:
+                return false;
+        }
+    }
+
+    uint32_t hint_count;
+    if (!reader->Get(&hint_count) || hint_count == 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < hint_count; i++) {
+        std::string hint_type;
+        uint32_t node_action_count;
+        if (!GetString(reader, strings, &hint_type) || !reader->Get(&node_action_count)) {
+            return false;
+        }
+        Hint &hint = (*actions)[hint_type];
+        for (uint32_t j = 0; j < node_action_count; j++) {
+            uint32_t node_index, value_index;
+            uint64_t timeout_ms;
+            if (!reader->Get(&node_index) || !reader->Get(&value_index) ||
+                !reader->Get(&timeout_ms) || node_index >= nodes->size() ||
+                value_index >= (*nodes)[node_index]->GetValueCount()) {
+                return false;
+            }
+            hint.node_actions.emplace_back(node_index, value_index,
+                                           std::chrono::milliseconds(timeout_ms));
+        }
+        uint32_t hint_action_count;
+        if (!reader->Get(&hint_action_count)) {
+            return false;
+        }
+        for (uint32_t j = 0; j < hint_action_count; j++) {
+            uint8_t type;
+            std::string value;
+            if (!reader->Get(&type) || !GetString(reader, strings, &value) ||
+                type > static_cast<uint8_t>(HintActionType::MaskHint)) {
+                return false;
+            }
+            hint.hint_actions.emplace_back(static_cast<HintActionType>(type), value);
+        }
+    }
+    return reader->AtEnd();
+}
+
+}  // namespace
+
+std::string HintManager::GetSnapshotPath(const std::string &config_path) {
+    const std::size_t ext_len = strlen(kJsonExtension);
+    if (config_path.size() >= ext_len &&
+        config_path.compare(config_path.size() - ext_len, ext_len, kJsonExtension) == 0) {
+        return config_path.substr(0, config_path.size() - ext_len) + kSnapshotExtension;
+    }
+    return config_path + kSnapshotExtension;
+}
+
+bool HintManager::CompileSnapshot(const std::string &json_doc, std::string *snapshot) {
+    std::vector<std::unique_ptr<Node>> nodes = ParseNodes(json_doc);
+    if (nodes.empty()) {
+        LOG(ERROR) << "Failed to parse Nodes section";
+        return false;
+    }
+    std::size_t hint_cycles = 0;
+    std::unordered_map<std::string, Hint> actions = ParseActions(json_doc, nodes, &hint_cycles);
+    if (actions.empty()) {
+        LOG(ERROR) << "Failed to parse Actions section";
+        return false;
+    }
+    // Tolerated when loading the JSON at runtime, but a config compiled at
+    // build time must not ship with them
+    if (hint_cycles > 0) {
+        LOG(ERROR) << "Config has " << hint_cycles << " circular DoHint actions";
+        return false;
+    }
+
+    // Node type and HoldFd are not exposed by Node, take them from the JSON
+    // that ParseNodes already validated
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errorMessage;
+    if (!reader->parse(&*json_doc.begin(), &*json_doc.end(), &root, &errorMessage)) {
+        LOG(ERROR) << "Failed to parse JSON config: " << errorMessage;
+        return false;
+    }
+    const Json::Value &json_nodes = root["Nodes"];
+
+    SnapshotWriter writer;
+    writer.Put<uint32_t>(nodes.size());
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        const Json::Value &json_node = json_nodes[static_cast<Json::ArrayIndex>(i)];
+        const bool is_property = json_node["Type"].asString() == "Property";
+        const bool hold_fd = !is_property && json_node["HoldFd"].isBool() &&
+                             json_node["HoldFd"].asBool();
+        writer.PutString(nodes[i]->GetName());
+        writer.PutString(nodes[i]->GetPath());
+        writer.Put<uint8_t>(static_cast<uint8_t>(is_property ? SnapshotNodeType::Property
+                                                             : SnapshotNodeType::File));
+        writer.Put<uint8_t>(nodes[i]->GetResetOnInit());
+        writer.Put<uint8_t>(hold_fd);
+        writer.Put<uint32_t>(nodes[i]->GetDefaultIndex());
+        std::vector<std::string> values = nodes[i]->GetValues();
+        writer.Put<uint32_t>(values.size());
+        for (const auto &value : values) {
+            writer.PutString(value);
+        }
+    }
+
+    // Sorted so that the same config always compiles to the same snapshot
+    std::map<std::string, const Hint *> sorted_actions;
+    for (const auto &action : actions) {
+        sorted_actions.emplace(action.first, &action.second);
+    }
+    writer.Put<uint32_t>(sorted_actions.size());
+    for (const auto &[hint_type, hint] : sorted_actions) {
+        writer.PutString(hint_type);
+        writer.Put<uint32_t>(hint->node_actions.size());
+        for (const auto &action : hint->node_actions) {
+            writer.Put<uint32_t>(action.node_index);
+            writer.Put<uint32_t>(action.value_index);
+            writer.Put<uint64_t>(action.timeout_ms.count());
+        }
+        writer.Put<uint32_t>(hint->hint_actions.size());
+        for (const auto &action : hint->hint_actions) {
+            writer.Put<uint8_t>(static_cast<uint8_t>(action.type));
+            writer.PutString(action.value);
+        }
+    }
+
+    *snapshot = writer.Finish(Fnv1a64(json_doc.data(), json_doc.size()));
+    return true;
+}
+
+bool HintManager::LoadSnapshot(const std::string &snapshot_path, const std::string &json_doc,
+                               std::vector<std::unique_ptr<Node>> *nodes,
+                               std::unordered_map<std::string, Hint> *actions) {
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(snapshot_path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        LOG(VERBOSE) << "No config snapshot at " << snapshot_path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+        LOG(WARNING) << "Config snapshot too small: " << snapshot_path;
+        return false;
+    }
+    const std::size_t size = st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        PLOG(WARNING) << "Failed to map config snapshot: " << snapshot_path;
+        return false;
+    }
+
+    const char *bytes = static_cast<const char *>(data);
+    SnapshotHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    const char *payload = bytes + sizeof(header);
+    bool ok = false;
+    if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+        header.payload_size != size - sizeof(header)) {
+        LOG(WARNING) << "Invalid config snapshot header: " << snapshot_path;
+    } else if (header.checksum != Fnv1a32(payload, header.payload_size)) {
+        LOG(WARNING) << "Config snapshot checksum mismatch: " << snapshot_path;
+    } else if (header.source_hash != Fnv1a64(json_doc.data(), json_doc.size())) {
+        LOG(WARNING) << "Config snapshot is stale: " << snapshot_path;
+    } else {
+        SnapshotReader reader(payload, header.payload_size);
+        ok = ParsePayload(&reader, nodes, actions);
+        if (!ok) {
+            LOG(WARNING) << "Failed to parse config snapshot: " << snapshot_path;
+        } else if (RemoveHintCycles(actions) > 0) {
+            // Same validation as ParseActions, a snapshot may not come from
+            // CompileSnapshot
+            LOG(WARNING) << "Config snapshot has circular DoHint actions: " << snapshot_path;
+        }
+    }
+    munmap(data, size);
+
+    if (!ok) {
+        nodes->clear();
+        actions->clear();
+        return false;
+    }
+    LOG(INFO) << nodes->size() << " Nodes and " << actions->size()
+              << " PowerHints loaded from snapshot";
+    return true;
+}
+
+}  // namespace perfmgr
+}  // namespace android
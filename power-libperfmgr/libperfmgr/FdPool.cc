@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "libperfmgr"
+
+#include "perfmgr/FdPool.h"
+
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace android {
+namespace perfmgr {
+
+namespace {
+bool IsPseudoFs(int fd) {
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) != 0) {
+        return false;
+    }
+    switch (static_cast<uint64_t>(sfs.f_type)) {
+        case SYSFS_MAGIC:
+        case PROC_SUPER_MAGIC:
+        case CGROUP_SUPER_MAGIC:
+        case CGROUP2_SUPER_MAGIC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Return true if fd is a regular file backed by storage, which keeps stale
+// bytes past a shorter value and needs fsync. Device nodes, pipes and sockets
+// reject ftruncate, and pseudo filesystem attributes report S_IFREG but
+// have no backing storage.
+bool IsStoredFile(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    return !IsPseudoFs(fd);
+}
+}  // namespace
+
+FdPool::FdPool(std::size_t capacity) : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+FdPool* FdPool::GetInstance() {
+    static FdPool instance(kDefaultCapacity);
+    return &instance;
+}
+
+FdPool::Entry* FdPool::Acquire(const std::string& path) {
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return &lru_.front();
+    }
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        return nullptr;
+    }
+    stats_.opens++;
+    if (lru_.size() >= capacity_) {
+        // fds with writes in flight must stay open, let the pool grow instead
+        auto victim = std::find_if(lru_.rbegin(), lru_.rend(),
+                                   [](const Entry& e) { return e.pending == 0; });
+        if (victim != lru_.rend()) {
+            entries_.erase(victim->path);
+            lru_.erase(std::next(victim).base());
+            stats_.evictions++;
+        }
+    }
+    lru_.emplace_front();
+    Entry& e = lru_.front();
+    e.path = path;
+    e.stored_file = IsStoredFile(fd);
+    e.fd = std::move(fd);
+    entries_[path] = lru_.begin();
+    return &e;
+}
+
+bool FdPool::Write(const std::string& path, const std::string& value) {
+    std::lock_guard<std::mutex> lock(lock_);
+    Entry* e = Acquire(path);
+    if (e == nullptr) {
+        return false;
+    }
+    if (e->has_value && e->last_value == value) {
+        stats_.elided_writes++;
+        return true;
+    }
+    stats_.writes++;
+    ssize_t ret = TEMP_FAILURE_RETRY(pwrite(e->fd, value.data(), value.size(), 0));
+    bool written = ret == static_cast<ssize_t>(value.size());
+    Complete(e, value, written);
+    return written;
+}
+
+bool FdPool::QueueWrite(const std::string& path, const std::string& value, WriteBatch* batch,
+                        WriteBatch::Callback done) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!batch->IsEnabled()) {
+        return false;
+    }
+    Entry* e = Acquire(path);
+    if (e == nullptr) {
+        return false;
+    }
+    // last_value is not final while another write to path is in flight
+    if (e->pending == 0 && e->has_value && e->last_value == value) {
+        stats_.elided_writes++;
+        done(true);
+        return true;
+    }
+    // Keep writes to the same path in queue order
+    const bool ordered = e->pending > 0;
+    bool queued = batch->Add(e->fd, value, ordered,
+                             [this, &path, &value, done = std::move(done)](bool written) {
+                                 CompleteQueued(path, value, written);
+                                 done(written);
+                             });
+    if (queued) {
+        e->pending++;
+        stats_.writes++;
+    }
+    return queued;
+}
+
+void FdPool::CompleteQueued(const std::string& path, const std::string& value, bool written) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return;
+    }
+    Entry* e = &*it->second;
+    e->pending--;
+    Complete(e, value, written);
+}
+
+void FdPool::Complete(Entry* e, const std::string& value, bool written) {
+    if (written && e->stored_file) {
+        // Regular files keep stale bytes past a shorter value
+        written = TEMP_FAILURE_RETRY(ftruncate(e->fd, value.size())) == 0;
+        fsync(e->fd);
+        stats_.fsyncs++;
+    }
+    if (!written) {
+        // Reopen on the next write in case the node went away, unless other
+        // writes still use the fd
+        e->has_value = false;
+        if (e->pending == 0) {
+            auto it = entries_.find(e->path);
+            auto lru_it = it->second;
+            entries_.erase(it);
+            lru_.erase(lru_it);
+        }
+        return;
+    }
+    e->has_value = true;
+    e->last_value = value;
+}
+
+void FdPool::Close(const std::string& path) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        lru_.erase(it->second);
+        entries_.erase(it);
+    }
+}
+
+std::size_t FdPool::GetCapacity() const {
+    return capacity_;
+}
+
+std::size_t FdPool::GetSize() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return lru_.size();
+}
+
+FdPool::Stats FdPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return stats_;
+}
+
+}  // namespace perfmgr
+}  // namespace android
@@ -33,25 +33,25 @@ namespace perfmgr {
 FileNode::FileNode(std::string name, std::string node_path,
                    std::vector<RequestGroup> req_sorted,
                    std::size_t default_val_index, bool reset_on_init,
-                   bool hold_fd)
+                   bool hold_fd, FdPool* fd_pool)
     : Node(std::move(name), std::move(node_path), std::move(req_sorted),
            default_val_index, reset_on_init),
       hold_fd_(hold_fd),
+      fd_pool_(fd_pool ? fd_pool : FdPool::GetInstance()),
       warn_timeout_(
           android::base::GetBoolProperty("ro.debuggable", false) ? 5ms : 50ms) {
 }
 
+FileNode::~FileNode() {
+    // The path may be reused by a different file once this node is gone
+    if (!hold_fd_) {
+        fd_pool_->Close(node_path_);
+    }
+}
+
 std::chrono::milliseconds FileNode::Update(bool log_error) {
-    std::size_t value_index = default_val_index_;
     std::chrono::milliseconds expire_time = std::chrono::milliseconds::max();
-
-    // Find the highest outstanding request's expire time
-    for (std::size_t i = 0; i < req_sorted_.size(); i++) {
-        if (req_sorted_[i].GetExpireTime(&expire_time)) {
-            value_index = i;
-            break;
-        }
-    }
+    std::size_t value_index = GetActiveValueIndex(&expire_time);
 
     // Update node only if request index changes
     if (value_index != current_val_index_ || reset_on_init_) {
@@ -62,27 +62,20 @@ std::chrono::milliseconds FileNode::Update(bool log_error) {
             ATRACE_BEGIN(tag.c_str());
         }
         android::base::Timer t;
-        fd_.reset(TEMP_FAILURE_RETRY(
-            open(node_path_.c_str(), O_WRONLY | O_CLOEXEC | O_TRUNC)));
+        const auto start_time = std::chrono::steady_clock::now();
+        bool success = hold_fd_
+                ? WriteHoldFd(req_value, value_index == default_val_index_)
+                : fd_pool_->Write(node_path_, req_value);
+        RecordWrite(success, std::chrono::steady_clock::now() - start_time);
 
-        if (fd_ == -1 || !android::base::WriteStringToFd(req_value, fd_)) {
+        if (!success) {
             if (log_error) {
                 LOG(WARNING) << "Failed to write to node: " << node_path_
-                             << " with value: " << req_value << ", fd: " << fd_;
+                             << " with value: " << req_value;
             }
             // Retry in 500ms or sooner
             expire_time = std::min(expire_time, std::chrono::milliseconds(500));
         } else {
-            // For regular file system, we need fsync
-            fsync(fd_);
-            // Some dev node requires file to remain open during the entire hint
-            // duration e.g. /dev/cpu_dma_latency, so fd_ is intentionally kept
-            // open during any requested value other than default one. If
-            // request a default value, node will write the value and then
-            // release the fd.
-            if ((!hold_fd_) || value_index == default_val_index_) {
-                fd_.reset();
-            }
             auto duration = t.duration();
             if (duration > warn_timeout_) {
                 LOG(WARNING) << "Slow writing to file: '" << node_path_
@@ -100,6 +93,54 @@ std::chrono::milliseconds FileNode::Update(bool log_error) {
     return expire_time;
 }
 
+void FileNode::UpdateBatched(WriteBatch* batch) {
+    if (hold_fd_) {
+        Update(false);
+        return;
+    }
+    std::chrono::milliseconds expire_time = std::chrono::milliseconds::max();
+    std::size_t value_index = GetActiveValueIndex(&expire_time);
+    if (value_index == current_val_index_ && !reset_on_init_) {
+        return;
+    }
+    const std::string& req_value = req_sorted_[value_index].GetRequestValue();
+    const auto queued_time = std::chrono::steady_clock::now();
+    bool queued = fd_pool_->QueueWrite(node_path_, req_value, batch,
+                                       [this, value_index, queued_time](bool written) {
+                                           RecordWrite(written,
+                                                       std::chrono::steady_clock::now() -
+                                                               queued_time);
+                                           // Update current index only when succeed
+                                           if (written) {
+                                               current_val_index_ = value_index;
+                                               reset_on_init_ = false;
+                                           }
+                                       });
+    if (!queued) {
+        Update(false);
+    }
+}
+
+bool FileNode::WriteHoldFd(const std::string& value, bool is_default) {
+    fd_.reset(TEMP_FAILURE_RETRY(
+        open(node_path_.c_str(), O_WRONLY | O_CLOEXEC | O_TRUNC)));
+    if (fd_ == -1 || !android::base::WriteStringToFd(value, fd_)) {
+        fd_.reset();
+        return false;
+    }
+    // For regular file system, we need fsync
+    fsync(fd_);
+    // Some dev node requires file to remain open during the entire hint
+    // duration e.g. /dev/cpu_dma_latency, so fd_ is intentionally kept
+    // open during any requested value other than default one. If
+    // request a default value, node will write the value and then
+    // release the fd.
+    if (is_default) {
+        fd_.reset();
+    }
+    return true;
+}
+
 bool FileNode::GetHoldFd() const {
     return hold_fd_;
 }
@@ -26,6 +26,7 @@
 
 #include <inttypes.h>
 #include <algorithm>
+#include <cstring>
 #include <set>
 
 #include "perfmgr/FileNode.h"
@@ -38,122 +39,254 @@ namespace {
 constexpr std::chrono::milliseconds kMilliSecondZero = std::chrono::milliseconds(0);
 constexpr std::chrono::steady_clock::time_point kTimePointMax =
         std::chrono::steady_clock::time_point::max();
+// Stats snapshot is refreshed from the looper at most this often
+constexpr std::chrono::milliseconds kStatsPublishInterval(1000);
 }  // namespace
 
-bool HintManager::ValidateHint(const std::string& hint_type) const {
+HintManager::HintManager(sp<NodeLooperThread> nm,
+                         const std::unordered_map<std::string, Hint> &actions)
+    : nm_(std::move(nm)) {
+    // Intern hints in name order so that ids are stable for a given config.
+    for (const auto &action : actions) {
+        hint_names_.push_back(action.first);
+    }
+    std::sort(hint_names_.begin(), hint_names_.end());
+    hints_.reserve(hint_names_.size());
+    for (HintId id = 0; id < hint_names_.size(); ++id) {
+        hint_ids_.emplace(hint_names_[id], id);
+        hints_.push_back(actions.at(hint_names_[id]));
+        if (nm_.get() != nullptr) {
+            nm_hint_ids_.push_back(nm_->RegisterHint(hint_names_[id]));
+        }
+    }
+    // Resolve chained hints so they are not looked up by name.
+    for (auto &hint : hints_) {
+        for (auto &action : hint.hint_actions) {
+            action.value_id = GetHintId(action.value);
+            if (action.value_id == kInvalidHintId) {
+                LOG(ERROR) << "Failed to find " << action.value << " action";
+            }
+        }
+    }
+    // Flatten the chained actions so DoHint and EndHint run them in a single
+    // pass without recursion.
+    std::vector<bool> in_chain(hints_.size(), false);
+    std::vector<std::size_t> done(hints_.size(), 0);
+    for (HintId id = 0; id < hints_.size(); ++id) {
+        in_chain[id] = true;
+        FlattenDoOps(id, true, &in_chain, &done, &hints_[id].do_ops);
+        in_chain[id] = false;
+        done.assign(hints_.size(), 0);
+        FlattenEndOps(id, &hints_[id].end_ops);
+    }
+}
+
+void HintManager::FlattenDoOps(HintId hint_id, bool top_level, std::vector<bool> *in_chain,
+                               std::vector<std::size_t> *done, std::vector<HintOp> *ops) const {
+    for (const auto &action : hints_[hint_id].hint_actions) {
+        const HintId value_id = action.value_id;
+        if (value_id == kInvalidHintId) {
+            continue;
+        }
+        switch (action.type) {
+            case HintActionType::DoHint: {
+                if ((*in_chain)[value_id]) {
+                    // ParseActions drops such actions, so only reachable with
+                    // a hand-built actions map.
+                    LOG(ERROR) << "Circular DoHint " << action.value << " from "
+                               << hint_names_[hint_id] << ", ignored";
+                    break;
+                }
+                if ((*done)[value_id] != 0) {
+                    // Already done earlier in this chain with nothing undoing
+                    // it since, doing it again only counts it and the hints it
+                    // chains to.
+                    const std::size_t first = (*done)[value_id] - 1;
+                    const std::size_t last = first + (*ops)[first].skip;
+                    for (std::size_t i = first; i <= last; ++i) {
+                        const HintId count_id = (*ops)[i].hint_id;
+                        ops->emplace_back(HintOpType::CountHint, count_id);
+                    }
+                    break;
+                }
+                const std::size_t pos = ops->size();
+                ops->emplace_back(HintOpType::DoHint, value_id);
+                (*in_chain)[value_id] = true;
+                FlattenDoOps(value_id, false, in_chain, done, ops);
+                (*in_chain)[value_id] = false;
+                (*ops)[pos].skip = ops->size() - pos - 1;
+                // A nested DoHint is skipped along with its parent, so a later
+                // one may still be needed. Ending or masking a hint is not
+                // idempotent across the chain, so a hint that does either is
+                // always done again.
+                const bool only_do = std::all_of(
+                        ops->begin() + pos + 1, ops->end(), [](const HintOp &op) {
+                            return op.type == HintOpType::DoHint ||
+                                   op.type == HintOpType::CountHint;
+                        });
+                if (top_level && only_do) {
+                    (*done)[value_id] = pos + 1;
+                }
+                break;
+            }
+            case HintActionType::EndHint: {
+                const std::size_t pos = ops->size();
+                ops->emplace_back(HintOpType::EndHint, value_id);
+                FlattenEndOps(value_id, ops);
+                (*ops)[pos].skip = ops->size() - pos - 1;
+                done->assign(done->size(), 0);
+                break;
+            }
+            case HintActionType::MaskHint:
+                ops->emplace_back(HintOpType::MaskHint, value_id);
+                done->assign(done->size(), 0);
+                break;
+            default:
+                // should not reach here
+                LOG(ERROR) << "Invalid "
+                           << static_cast<std::underlying_type<HintActionType>::type>(action.type)
+                           << " type";
+        }
+    }
+}
+
+void HintManager::FlattenEndOps(HintId hint_id, std::vector<HintOp> *ops) const {
+    for (const auto &action : hints_[hint_id].hint_actions) {
+        if (action.type == HintActionType::MaskHint && action.value_id != kInvalidHintId) {
+            ops->emplace_back(HintOpType::UnmaskHint, action.value_id);
+        }
+    }
+}
+
+HintId HintManager::GetHintId(const std::string &hint_type) const {
+    auto it = hint_ids_.find(hint_type);
+    return it == hint_ids_.end() ? kInvalidHintId : it->second;
+}
+
+bool HintManager::ValidateHint(HintId hint_id) const {
     if (nm_.get() == nullptr) {
         LOG(ERROR) << "NodeLooperThread not present";
         return false;
     }
-    return IsHintSupported(hint_type);
+    return IsHintSupported(hint_id);
 }
 
 bool HintManager::IsHintSupported(const std::string& hint_type) const {
-    if (actions_.find(hint_type) == actions_.end()) {
+    if (hint_ids_.find(hint_type) == hint_ids_.end()) {
         LOG(INFO) << "Hint type not present in actions: " << hint_type;
         return false;
     }
     return true;
 }
 
+bool HintManager::IsHintSupported(HintId hint_id) const {
+    return hint_id < hints_.size();
+}
+
 bool HintManager::IsHintEnabled(const std::string &hint_type) const {
-    return actions_.at(hint_type).enabled;
+    return hints_[hint_ids_.at(hint_type)].enabled.load();
 }
 
 bool HintManager::InitHintStatus(const std::unique_ptr<HintManager> &hm) {
     if (hm.get() == nullptr) {
         return false;
     }
-    for (auto &a : hm->actions_) {
+    for (auto &hint : hm->hints_) {
         // timeout_ms equaling kMilliSecondZero means forever until cancelling.
         // As a result, if there's one NodeAction has timeout_ms of 0, we will store
         // 0 instead of max. Also node actions could be empty, set to 0 in that case.
         std::chrono::milliseconds timeout = kMilliSecondZero;
-        if (a.second.node_actions.size()) {
+        if (hint.node_actions.size()) {
             auto [min, max] =
-                    std::minmax_element(a.second.node_actions.begin(), a.second.node_actions.end(),
+                    std::minmax_element(hint.node_actions.begin(), hint.node_actions.end(),
                                         [](const auto act1, const auto act2) {
                                             return act1.timeout_ms < act2.timeout_ms;
                                         });
             timeout = min->timeout_ms == kMilliSecondZero ? kMilliSecondZero : max->timeout_ms;
         }
-        a.second.status.reset(new HintStatus(timeout));
+        hint.status.reset(new HintStatus(timeout));
     }
     return true;
 }
 
-void HintManager::DoHintStatus(const std::string &hint_type, std::chrono::milliseconds timeout_ms) {
-    std::lock_guard<std::mutex> lock(actions_.at(hint_type).status->mutex);
-    actions_.at(hint_type).status->stats.count.fetch_add(1);
+void HintManager::DoHintStatus(HintId hint_id, std::chrono::milliseconds timeout_ms) {
+    HintStatus &status = *hints_[hint_id].status;
+    std::lock_guard<std::mutex> lock(status.mutex);
+    status.stats.count.fetch_add(1);
     auto now = std::chrono::steady_clock::now();
-    if (now > actions_.at(hint_type).status->end_time) {
-        actions_.at(hint_type).status->stats.duration_ms.fetch_add(
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                        actions_.at(hint_type).status->end_time -
-                        actions_.at(hint_type).status->start_time)
+    if (now > status.end_time) {
+        status.stats.duration_ms.fetch_add(
+                std::chrono::duration_cast<std::chrono::milliseconds>(status.end_time -
+                                                                      status.start_time)
                         .count());
-        actions_.at(hint_type).status->start_time = now;
+        status.start_time = now;
     }
-    actions_.at(hint_type).status->end_time =
-            (timeout_ms == kMilliSecondZero) ? kTimePointMax : now + timeout_ms;
+    status.end_time = (timeout_ms == kMilliSecondZero) ? kTimePointMax : now + timeout_ms;
 }
 
-void HintManager::EndHintStatus(const std::string &hint_type) {
-    std::lock_guard<std::mutex> lock(actions_.at(hint_type).status->mutex);
+void HintManager::EndHintStatus(HintId hint_id) {
+    HintStatus &status = *hints_[hint_id].status;
+    std::lock_guard<std::mutex> lock(status.mutex);
     // Update HintStats if the hint ends earlier than expected end_time
     auto now = std::chrono::steady_clock::now();
-    if (now < actions_.at(hint_type).status->end_time) {
-        actions_.at(hint_type).status->stats.duration_ms.fetch_add(
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                        now - actions_.at(hint_type).status->start_time)
+    if (now < status.end_time) {
+        status.stats.duration_ms.fetch_add(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - status.start_time)
                         .count());
-        actions_.at(hint_type).status->end_time = now;
+        status.end_time = now;
     }
 }
 
-void HintManager::DoHintAction(const std::string &hint_type) {
-    for (auto &action : actions_.at(hint_type).hint_actions) {
-        switch (action.type) {
-            case HintActionType::DoHint:
-                // TODO: add parse logic to prevent circular hints.
-                DoHint(action.value);
+void HintManager::RunHintOps(const std::vector<HintOp> &ops) {
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+        const HintOp &op = ops[i];
+        Hint &hint = hints_[op.hint_id];
+        switch (op.type) {
+            case HintOpType::DoHint:
+                if (!hint.enabled.load() || !nm_->Request(hint.node_actions, nm_hint_ids_[op.hint_id])) {
+                    i += op.skip;
+                    break;
+                }
+                DoHintStatus(op.hint_id, hint.status->max_timeout);
                 break;
-            case HintActionType::EndHint:
-                EndHint(action.value);
+            case HintOpType::EndHint:
+                if (!nm_->Cancel(hint.node_actions, nm_hint_ids_[op.hint_id])) {
+                    i += op.skip;
+                    break;
+                }
+                EndHintStatus(op.hint_id);
                 break;
-            case HintActionType::MaskHint:
-                if (actions_.find(action.value) == actions_.end()) {
-                    LOG(ERROR) << "Failed to find " << action.value << " action";
-                } else {
-                    actions_.at(action.value).enabled = false;
+            case HintOpType::MaskHint:
+                hint.enabled.store(false);
+                break;
+            case HintOpType::UnmaskHint:
+                hint.enabled.store(true);
+                break;
+            case HintOpType::CountHint:
+                if (hint.enabled.load()) {
+                    DoHintStatus(op.hint_id, hint.status->max_timeout);
                 }
                 break;
-            default:
-                // should not reach here
-                LOG(ERROR) << "Invalid "
-                           << static_cast<std::underlying_type<HintActionType>::type>(action.type)
-                           << " type";
         }
     }
 }
 
-void HintManager::EndHintAction(const std::string &hint_type) {
-    for (auto &action : actions_.at(hint_type).hint_actions) {
-        if (action.type == HintActionType::MaskHint &&
-            actions_.find(action.value) != actions_.end()) {
-            actions_.at(action.value).enabled = true;
-        }
+bool HintManager::DoHint(const std::string& hint_type) {
+    LOG(VERBOSE) << "Do Powerhint: " << hint_type;
+    if (!IsHintSupported(hint_type)) {
+        return false;
     }
+    return DoHint(hint_ids_.at(hint_type));
 }
 
-bool HintManager::DoHint(const std::string& hint_type) {
-    LOG(VERBOSE) << "Do Powerhint: " << hint_type;
-    if (!ValidateHint(hint_type) || !IsHintEnabled(hint_type) ||
-        !nm_->Request(actions_.at(hint_type).node_actions, hint_type)) {
+bool HintManager::DoHint(HintId hint_id) {
+    if (!ValidateHint(hint_id) || !hints_[hint_id].enabled.load() ||
+        !nm_->Request(hints_[hint_id].node_actions, nm_hint_ids_[hint_id])) {
         return false;
     }
-    DoHintStatus(hint_type, actions_.at(hint_type).status->max_timeout);
-    DoHintAction(hint_type);
+    DoHintStatus(hint_id, hints_[hint_id].status->max_timeout);
+    RunHintOps(hints_[hint_id].do_ops);
+    ScheduleStatsPublish();
     return true;
 }
 
@@ -161,28 +294,40 @@ bool HintManager::DoHint(const std::string& hint_type,
                          std::chrono::milliseconds timeout_ms_override) {
     LOG(VERBOSE) << "Do Powerhint: " << hint_type << " for "
                  << timeout_ms_override.count() << "ms";
-    if (!ValidateHint(hint_type) || !IsHintEnabled(hint_type)) {
+    if (!IsHintSupported(hint_type)) {
         return false;
     }
-    std::vector<NodeAction> actions_override = actions_.at(hint_type).node_actions;
-    for (auto& action : actions_override) {
-        action.timeout_ms = timeout_ms_override;
-    }
-    if (!nm_->Request(actions_override, hint_type)) {
+    return DoHint(hint_ids_.at(hint_type), timeout_ms_override);
+}
+
+bool HintManager::DoHint(HintId hint_id, std::chrono::milliseconds timeout_ms_override) {
+    if (!ValidateHint(hint_id) || !hints_[hint_id].enabled.load() ||
+        !nm_->Request(hints_[hint_id].node_actions, nm_hint_ids_[hint_id],
+                      timeout_ms_override)) {
         return false;
     }
-    DoHintStatus(hint_type, timeout_ms_override);
-    DoHintAction(hint_type);
+    DoHintStatus(hint_id, timeout_ms_override);
+    RunHintOps(hints_[hint_id].do_ops);
+    ScheduleStatsPublish();
     return true;
 }
 
 bool HintManager::EndHint(const std::string& hint_type) {
     LOG(VERBOSE) << "End Powerhint: " << hint_type;
-    if (!ValidateHint(hint_type) || !nm_->Cancel(actions_.at(hint_type).node_actions, hint_type)) {
+    if (!IsHintSupported(hint_type)) {
         return false;
     }
-    EndHintStatus(hint_type);
-    EndHintAction(hint_type);
+    return EndHint(hint_ids_.at(hint_type));
+}
+
+bool HintManager::EndHint(HintId hint_id) {
+    if (!ValidateHint(hint_id) ||
+        !nm_->Cancel(hints_[hint_id].node_actions, nm_hint_ids_[hint_id])) {
+        return false;
+    }
+    EndHintStatus(hint_id);
+    RunHintOps(hints_[hint_id].end_ops);
+    ScheduleStatsPublish();
     return true;
 }
 
@@ -191,24 +336,48 @@ bool HintManager::IsRunning() const {
 }
 
 std::vector<std::string> HintManager::GetHints() const {
-    std::vector<std::string> hints;
-    for (auto const& action : actions_) {
-        hints.push_back(action.first);
-    }
-    return hints;
+    return hint_names_;
 }
 
 HintStats HintManager::GetHintStats(const std::string &hint_type) const {
     HintStats hint_stats;
-    if (ValidateHint(hint_type)) {
+    HintId hint_id = GetHintId(hint_type);
+    if (ValidateHint(hint_id)) {
         hint_stats.count =
-                actions_.at(hint_type).status->stats.count.load(std::memory_order_relaxed);
+                hints_[hint_id].status->stats.count.load(std::memory_order_relaxed);
         hint_stats.duration_ms =
-                actions_.at(hint_type).status->stats.duration_ms.load(std::memory_order_relaxed);
+                hints_[hint_id].status->stats.duration_ms.load(std::memory_order_relaxed);
     }
     return hint_stats;
 }
 
+HintFanOut HintManager::GetHintFanOut(const std::string &hint_type) const {
+    HintFanOut fan_out;
+    HintId hint_id = GetHintId(hint_type);
+    if (!IsHintSupported(hint_id)) {
+        return fan_out;
+    }
+    fan_out.node_requests = hints_[hint_id].node_actions.size();
+    for (const auto &op : hints_[hint_id].do_ops) {
+        switch (op.type) {
+            case HintOpType::DoHint:
+                fan_out.node_requests += hints_[op.hint_id].node_actions.size();
+                ++fan_out.chained_hints;
+                break;
+            case HintOpType::EndHint:
+                ++fan_out.ended_hints;
+                break;
+            case HintOpType::MaskHint:
+            case HintOpType::UnmaskHint:
+                ++fan_out.mask_ops;
+                break;
+            case HintOpType::CountHint:
+                break;
+        }
+    }
+    return fan_out;
+}
+
 void HintManager::DumpToFd(int fd) {
     std::string header(
         "========== Begin perfmgr nodes ==========\n"
@@ -250,6 +419,99 @@ void HintManager::DumpToFd(int fd) {
     fsync(fd);
 }
 
+void HintManager::ExportStats(std::string *stats) const {
+    const std::vector<std::unique_ptr<Node>> &nodes = nm_->GetNodes();
+    stats->assign(sizeof(StatsHeader) + hints_.size() * sizeof(HintStatsRecord) +
+                          nodes.size() * sizeof(NodeStatsRecord),
+                  '\0');
+    char *p = stats->data();
+    StatsHeader header = {};
+    header.magic = kStatsMagic;
+    header.version = kStatsVersion;
+    header.hint_count = hints_.size();
+    header.node_count = nodes.size();
+    header.write_latency_buckets = kWriteLatencyBuckets;
+    header.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch())
+                                  .count();
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    auto to_ns = [](std::chrono::steady_clock::time_point t) -> int64_t {
+        if (t == std::chrono::steady_clock::time_point::min()) {
+            return 0;
+        }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch())
+                .count();
+    };
+    for (HintId id = 0; id < hints_.size(); ++id) {
+        HintStatsRecord record = {};
+        hint_names_[id].copy(record.name, kStatsNameSize - 1);
+        HintStatus &status = *hints_[id].status;
+        {
+            std::lock_guard<std::mutex> lock(status.mutex);
+            record.last_start_ns = to_ns(status.start_time);
+            record.last_end_ns = to_ns(status.end_time);
+        }
+        record.count = status.stats.count.load(std::memory_order_relaxed);
+        record.duration_ms = status.stats.duration_ms.load(std::memory_order_relaxed);
+        std::memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+    }
+    for (const auto &node : nodes) {
+        NodeStatsRecord record = {};
+        node->GetName().copy(record.name, kStatsNameSize - 1);
+        NodeStats node_stats = node->GetStats();
+        record.writes = node_stats.writes;
+        record.write_failures = node_stats.write_failures;
+        std::copy(node_stats.write_latency.begin(), node_stats.write_latency.end(),
+                  record.write_latency);
+        std::memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+    }
+}
+
+uint64_t HintManager::GetLooperWakeCount() const {
+    return nm_->GetWakeCount();
+}
+
+bool HintManager::DumpStatsToFd(int fd) const {
+    std::string stats;
+    ExportStats(&stats);
+    if (!android::base::WriteFully(fd, stats.data(), stats.size())) {
+        LOG(ERROR) << "Failed to dump fd: " << fd;
+        return false;
+    }
+    return true;
+}
+
+bool HintManager::EnableStatsSnapshot(const std::string &path) {
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    ExportStats(&stats_buf_);
+    stats_snapshot_ = StatsSnapshot::Create(path, stats_buf_.size());
+    if (!stats_snapshot_ || !stats_snapshot_->Publish(stats_buf_)) {
+        stats_snapshot_.reset();
+        return false;
+    }
+    nm_->SetDeferredTask([this] { PublishStats(); }, kStatsPublishInterval);
+    return true;
+}
+
+void HintManager::ScheduleStatsPublish() {
+    if (stats_snapshot_) {
+        nm_->ScheduleDeferredTask();
+    }
+}
+
+void HintManager::PublishStats() {
+    if (!stats_snapshot_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stats_lock_);
+    ExportStats(&stats_buf_);
+    stats_snapshot_->Publish(stats_buf_);
+}
+
 bool HintManager::Start() {
     return nm_->Start();
 }
@@ -263,16 +525,23 @@ std::unique_ptr<HintManager> HintManager::GetFromJSON(
         return nullptr;
     }
 
-    std::vector<std::unique_ptr<Node>> nodes = ParseNodes(json_doc);
-    if (nodes.empty()) {
-        LOG(ERROR) << "Failed to parse Nodes section from " << config_path;
-        return nullptr;
-    }
-    std::unordered_map<std::string, Hint> actions = HintManager::ParseActions(json_doc, nodes);
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::unordered_map<std::string, Hint> actions;
+    const std::string snapshot_path = GetSnapshotPath(config_path);
+    if (LoadSnapshot(snapshot_path, json_doc, &nodes, &actions)) {
+        LOG(INFO) << "Loaded config snapshot: " << snapshot_path;
+    } else {
+        nodes = ParseNodes(json_doc);
+        if (nodes.empty()) {
+            LOG(ERROR) << "Failed to parse Nodes section from " << config_path;
+            return nullptr;
+        }
+        actions = HintManager::ParseActions(json_doc, nodes);
 
-    if (actions.empty()) {
-        LOG(ERROR) << "Failed to parse Actions section from " << config_path;
-        return nullptr;
+        if (actions.empty()) {
+            LOG(ERROR) << "Failed to parse Actions section from " << config_path;
+            return nullptr;
+        }
     }
 
     sp<NodeLooperThread> nm = new NodeLooperThread(std::move(nodes));
@@ -441,7 +710,8 @@ std::vector<std::unique_ptr<Node>> HintManager::ParseNodes(
 }
 
 std::unordered_map<std::string, Hint> HintManager::ParseActions(
-        const std::string &json_doc, const std::vector<std::unique_ptr<Node>> &nodes) {
+        const std::string &json_doc, const std::vector<std::unique_ptr<Node>> &nodes,
+        std::size_t *hint_cycles) {
     // function starts
     std::unordered_map<std::string, Hint> actions_parsed;
     Json::Value root;
@@ -553,6 +823,11 @@ std::unordered_map<std::string, Hint> HintManager::ParseActions(
         ++total_parsed;
     }
 
+    const std::size_t removed = RemoveHintCycles(&actions_parsed);
+    if (hint_cycles != nullptr) {
+        *hint_cycles = removed;
+    }
+
     LOG(INFO) << total_parsed << " actions parsed successfully";
 
     for (const auto& action : actions_parsed) {
@@ -564,5 +839,64 @@ std::unordered_map<std::string, Hint> HintManager::ParseActions(
     return actions_parsed;
 }
 
+std::size_t HintManager::RemoveHintCycles(std::unordered_map<std::string, Hint> *actions) {
+    // Depth first search over DoHint edges, a hint reached again while it is
+    // still on the stack closes a cycle. Dropping every such back edge leaves
+    // no cycle.
+    enum class Visit { New, InChain, Done };
+    std::unordered_map<std::string, Visit> visits;
+    std::vector<std::string> chain;
+    std::vector<std::pair<Hint *, std::size_t>> stack;
+    std::size_t removed = 0;
+    for (auto &root : *actions) {
+        if (visits[root.first] != Visit::New) {
+            continue;
+        }
+        visits[root.first] = Visit::InChain;
+        chain.push_back(root.first);
+        stack.emplace_back(&root.second, 0);
+        while (!stack.empty()) {
+            auto &[hint, next] = stack.back();
+            if (next == hint->hint_actions.size()) {
+                visits[chain.back()] = Visit::Done;
+                chain.pop_back();
+                stack.pop_back();
+                continue;
+            }
+            const HintAction &action = hint->hint_actions[next];
+            if (action.type != HintActionType::DoHint) {
+                ++next;
+                continue;
+            }
+            auto it = actions->find(action.value);
+            if (it == actions->end()) {
+                ++next;
+                continue;
+            }
+            Visit &visit = visits[action.value];
+            if (visit == Visit::InChain) {
+                std::string cycle;
+                auto start = std::find(chain.begin(), chain.end(), action.value);
+                for (auto c = start; c != chain.end(); ++c) {
+                    cycle += *c + " -> ";
+                }
+                LOG(ERROR) << "Circular DoHint actions: " << cycle << action.value
+                           << ", dropping DoHint " << action.value << " from " << chain.back();
+                hint->hint_actions.erase(hint->hint_actions.begin() + next);
+                ++removed;
+                continue;
+            }
+            ++next;
+            if (visit == Visit::New) {
+                visit = Visit::InChain;
+                chain.push_back(action.value);
+                // Invalidates hint and next
+                stack.emplace_back(&it->second, 0);
+            }
+        }
+    }
+    return removed;
+}
+
 }  // namespace perfmgr
 }  // namespace android
@@ -23,6 +23,8 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
+
 namespace android {
 namespace perfmgr {
 
@@ -34,29 +36,93 @@ Node::Node(std::string name, std::string node_path,
       req_sorted_(std::move(req_sorted)),
       default_val_index_(default_val_index),
       reset_on_init_(reset_on_init),
-      current_val_index_(default_val_index) {}
+      current_val_index_(default_val_index) {
+    for (std::size_t i = 0; i < req_sorted_.size(); i++) {
+        value_indexes_.emplace(req_sorted_[i].GetRequestValue(), i);
+    }
+}
 
-bool Node::AddRequest(std::size_t value_index, const std::string& hint_type,
-                      ReqTime end_time) {
+bool Node::AddRequest(std::size_t value_index, RequestHintId hint_id, ReqTime end_time) {
     if (value_index >= req_sorted_.size()) {
         LOG(ERROR) << "Value index out of bound: " << value_index
                    << " ,size: " << req_sorted_.size();
         return false;
     }
     // Add/Update request to the new end_time for the specific hint_type
-    req_sorted_[value_index].AddRequest(hint_type, end_time);
+    req_sorted_[value_index].AddRequest(hint_id, end_time);
+    std::vector<std::size_t>& slots = hint_slots_[hint_id];
+    if (std::find(slots.begin(), slots.end(), value_index) == slots.end()) {
+        slots.push_back(value_index);
+    }
     return true;
 }
 
-bool Node::RemoveRequest(const std::string& hint_type) {
+bool Node::AddRequest(std::size_t value_index, const std::string& hint_type,
+                      ReqTime end_time) {
+    return AddRequest(value_index, InternHint(hint_type), end_time);
+}
+
+bool Node::RemoveRequest(RequestHintId hint_id) {
+    auto it = hint_slots_.find(hint_id);
+    if (it == hint_slots_.end()) {
+        return false;
+    }
     bool ret = false;
     // Remove all requests for the specific hint_type
-    for (auto& value : req_sorted_) {
-        ret = value.RemoveRequest(hint_type) || ret;
+    for (std::size_t value_index : it->second) {
+        ret = req_sorted_[value_index].RemoveRequest(hint_id) || ret;
     }
+    hint_slots_.erase(it);
     return ret;
 }
 
+bool Node::RemoveRequest(const std::string& hint_type) {
+    return RemoveRequest(InternHint(hint_type));
+}
+
+void Node::UpdateBatched(WriteBatch*) {
+    Update(false);
+}
+
+std::size_t Node::GetActiveValueIndex(std::chrono::milliseconds* expire_time) {
+    // Find the highest outstanding request's expire time
+    for (std::size_t i = 0; i < req_sorted_.size(); i++) {
+        if (req_sorted_[i].GetExpireTime(expire_time)) {
+            return i;
+        }
+    }
+    return default_val_index_;
+}
+
+bool Node::IsUpToDate() {
+    std::chrono::milliseconds expire_time = std::chrono::milliseconds::max();
+    return !reset_on_init_ && GetActiveValueIndex(&expire_time) == current_val_index_;
+}
+
+void Node::RecordWrite(bool success, std::chrono::nanoseconds duration) {
+    // Only the thread updating the node writes, so relaxed increments suffice
+    if (!success) {
+        write_failures_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    writes_.fetch_add(1, std::memory_order_relaxed);
+    std::size_t bucket = 0;
+    while (bucket < kWriteLatencyBounds.size() && duration > kWriteLatencyBounds[bucket]) {
+        ++bucket;
+    }
+    write_latency_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+NodeStats Node::GetStats() const {
+    NodeStats stats;
+    stats.writes = writes_.load(std::memory_order_relaxed);
+    stats.write_failures = write_failures_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < kWriteLatencyBuckets; i++) {
+        stats.write_latency[i] = write_latency_[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
 const std::string& Node::GetName() const {
     return name_;
 }
@@ -66,15 +132,12 @@ const std::string& Node::GetPath() const {
 }
 
 bool Node::GetValueIndex(const std::string& value, std::size_t* index) const {
-    bool found = false;
-    for (std::size_t i = 0; i < req_sorted_.size(); i++) {
-        if (req_sorted_[i].GetRequestValue() == value) {
-            *index = i;
-            found = true;
-            break;
-        }
+    auto it = value_indexes_.find(value);
+    if (it == value_indexes_.end()) {
+        return false;
     }
-    return found;
+    *index = it->second;
+    return true;
 }
 
 std::size_t Node::GetDefaultIndex() const {
@@ -85,6 +148,10 @@ bool Node::GetResetOnInit() const {
     return reset_on_init_;
 }
 
+std::size_t Node::GetValueCount() const {
+    return req_sorted_.size();
+}
+
 std::vector<std::string> Node::GetValues() const {
     std::vector<std::string> values;
     for (const auto& value : req_sorted_) {
@@ -26,103 +26,332 @@
 namespace android {
 namespace perfmgr {
 
+namespace {
+// Delay before retrying a node whose write failed
+constexpr std::chrono::milliseconds kRetryUpdateMs(500);
+
+// Key of the pending request for a hint on a node, used for coalescing
+inline uint64_t PendingKey(uint32_t node_index, RequestHintId hint_id) {
+    return (static_cast<uint64_t>(node_index) << 32) | static_cast<uint32_t>(hint_id);
+}
+}  // namespace
+
+RequestHintId NodeLooperThread::RegisterHint(const std::string& hint_type) {
+    return InternHint(hint_type);
+}
+
 bool NodeLooperThread::Request(const std::vector<NodeAction>& actions,
                                const std::string& hint_type) {
+    return Request(actions, RegisterHint(hint_type));
+}
+
+bool NodeLooperThread::Request(const std::vector<NodeAction>& actions, RequestHintId hint_id) {
+    return RequestInternal(actions, hint_id, nullptr);
+}
+
+bool NodeLooperThread::Request(const std::vector<NodeAction>& actions, RequestHintId hint_id,
+                               std::chrono::milliseconds timeout_ms_override) {
+    return RequestInternal(actions, hint_id, &timeout_ms_override);
+}
+
+bool NodeLooperThread::RequestInternal(const std::vector<NodeAction>& actions,
+                                       RequestHintId hint_id,
+                                       const std::chrono::milliseconds* timeout_ms_override) {
     if (::android::Thread::exitPending()) {
         LOG(WARNING) << "NodeLooperThread is exiting";
         return false;
     }
     if (!::android::Thread::isRunning()) {
-        LOG(WARNING) << "NodeLooperThread is not running, request " << hint_type;
+        LOG(WARNING) << "NodeLooperThread is not running, request " << GetHintName(hint_id);
+    }
+    if (!IsHintInterned(hint_id)) {
+        LOG(ERROR) << "Invalid hint id: " << static_cast<uint32_t>(hint_id);
+        return false;
     }
 
     bool ret = true;
-    ::android::AutoMutex _l(lock_);
+    auto now = std::chrono::steady_clock::now();
     for (const auto& a : actions) {
         if (a.node_index >= nodes_.size()) {
             LOG(ERROR) << "Node index out of bound: " << a.node_index
                        << " ,size: " << nodes_.size();
             ret = false;
+        } else if (a.value_index >= nodes_[a.node_index]->GetValueCount()) {
+            LOG(ERROR) << "Value index out of bound: " << a.value_index
+                       << " ,size: " << nodes_[a.node_index]->GetValueCount();
+            ret = false;
         } else {
+            const std::chrono::milliseconds timeout_ms =
+                    timeout_ms_override ? *timeout_ms_override : a.timeout_ms;
             // End time set to steady time point max
             ReqTime end_time = ReqTime::max();
             // Timeout is non-zero
-            if (a.timeout_ms != std::chrono::milliseconds::zero()) {
-                auto now = std::chrono::steady_clock::now();
+            if (timeout_ms != std::chrono::milliseconds::zero()) {
                 // Overflow protection in case timeout_ms is too big to overflow
                 // time point which is unsigned integer
                 if (std::chrono::duration_cast<std::chrono::milliseconds>(
-                        ReqTime::max() - now) > a.timeout_ms) {
-                    end_time = now + a.timeout_ms;
+                        ReqTime::max() - now) > timeout_ms) {
+                    end_time = now + timeout_ms;
                 }
             }
-            ret = nodes_[a.node_index]->AddRequest(a.value_index, hint_type,
-                                                   end_time) &&
-                  ret;
+            Submit({NodeRequestType::Add, static_cast<uint32_t>(a.node_index),
+                    static_cast<uint32_t>(a.value_index), hint_id, end_time});
         }
     }
-    wake_cond_.signal();
+    Wake();
     return ret;
 }
 
 bool NodeLooperThread::Cancel(const std::vector<NodeAction>& actions,
                               const std::string& hint_type) {
+    return Cancel(actions, RegisterHint(hint_type));
+}
+
+bool NodeLooperThread::Cancel(const std::vector<NodeAction>& actions, RequestHintId hint_id) {
     if (::android::Thread::exitPending()) {
         LOG(WARNING) << "NodeLooperThread is exiting";
         return false;
     }
     if (!::android::Thread::isRunning()) {
-        LOG(WARNING) << "NodeLooperThread is not running, cancel " << hint_type;
+        LOG(WARNING) << "NodeLooperThread is not running, cancel " << GetHintName(hint_id);
+    }
+    if (!IsHintInterned(hint_id)) {
+        LOG(ERROR) << "Invalid hint id: " << static_cast<uint32_t>(hint_id);
+        return false;
     }
 
     bool ret = true;
-    ::android::AutoMutex _l(lock_);
     for (const auto& a : actions) {
         if (a.node_index >= nodes_.size()) {
             LOG(ERROR) << "Node index out of bound: " << a.node_index
                        << " ,size: " << nodes_.size();
             ret = false;
         } else {
-            nodes_[a.node_index]->RemoveRequest(hint_type);
+            Submit({NodeRequestType::Cancel, static_cast<uint32_t>(a.node_index), 0, hint_id,
+                    ReqTime::min()});
         }
     }
-    wake_cond_.signal();
+    Wake();
     return ret;
 }
 
+void NodeLooperThread::Submit(const NodeRequest& request) {
+    if (queue_.Push(request)) {
+        return;
+    }
+    // Queue is full: the looper is far behind, so take the slow path and
+    // apply the request directly after everything already queued.
+    LOG(WARNING) << "NodeLooperThread request queue full, size: " << queue_.GetCapacity();
+    ::android::AutoMutex _l(lock_);
+    DrainRequests();
+    pending_.clear();
+    pending_.push_back(request);
+    ApplyPendingRequests();
+}
+
+void NodeLooperThread::Wake() {
+    // Only the first caller after the looper last woke up needs to signal
+    if (!wake_pending_.exchange(true)) {
+        ::android::AutoMutex _w(wake_lock_);
+        wake_cond_.signal();
+    }
+}
+
+void NodeLooperThread::DrainRequests() {
+    pending_.clear();
+    pending_index_.clear();
+    NodeRequest r;
+    while (queue_.Pop(&r)) {
+        const uint64_t key = PendingKey(r.node_index, r.hint_id);
+        auto it = pending_index_.find(key);
+        if (it != pending_index_.end()) {
+            NodeRequest& prev = pending_[it->second];
+            if (r.type == NodeRequestType::Add && prev.type == NodeRequestType::Add &&
+                prev.value_index == r.value_index) {
+                // Same hint re-requesting the same value: keep the longer one
+                prev.end_time = std::max(prev.end_time, r.end_time);
+                continue;
+            }
+            if (r.type == NodeRequestType::Cancel && prev.type == NodeRequestType::Cancel) {
+                continue;
+            }
+            if (r.type == NodeRequestType::Cancel) {
+                // A cancel after an add in the same batch makes the add a no-op
+                prev.type = NodeRequestType::None;
+            }
+        }
+        pending_index_[key] = pending_.size();
+        pending_.push_back(r);
+    }
+    ApplyPendingRequests();
+}
+
+void NodeLooperThread::ApplyPendingRequests() {
+    if (pending_.empty()) {
+        return;
+    }
+    for (const auto& r : pending_) {
+        switch (r.type) {
+            case NodeRequestType::Add:
+                nodes_[r.node_index]->AddRequest(r.value_index, r.hint_id, r.end_time);
+                dirty_[r.node_index] = true;
+                break;
+            case NodeRequestType::Cancel:
+                nodes_[r.node_index]->RemoveRequest(r.hint_id);
+                dirty_[r.node_index] = true;
+                break;
+            case NodeRequestType::None:
+                break;
+        }
+    }
+}
+
+void NodeLooperThread::CollectExpiredNodes(ReqTime now) {
+    while (!deadlines_.empty() && deadlines_.top().first <= now) {
+        auto [deadline, i] = deadlines_.top();
+        deadlines_.pop();
+        if (next_update_[i] == deadline) {
+            next_update_[i] = ReqTime::max();
+            dirty_[i] = true;
+        }
+    }
+}
+
+void NodeLooperThread::ScheduleUpdate(std::size_t node_index, ReqTime now,
+                                      std::chrono::milliseconds timeout_ms) {
+    // Forever requests report a timeout that would overflow the clock
+    if (timeout_ms >=
+        std::chrono::duration_cast<std::chrono::milliseconds>(ReqTime::max() - now)) {
+        next_update_[node_index] = ReqTime::max();
+        return;
+    }
+    ReqTime deadline = now + timeout_ms;
+    if (deadline == next_update_[node_index]) {
+        return;
+    }
+    next_update_[node_index] = deadline;
+    deadlines_.emplace(deadline, node_index);
+}
+
 void NodeLooperThread::DumpToFd(int fd) {
     ::android::AutoMutex _l(lock_);
+    DrainRequests();
     for (auto& n : nodes_) {
         n->DumpToFd(fd);
     }
 }
 
-bool NodeLooperThread::threadLoop() {
+const std::vector<std::unique_ptr<Node>>& NodeLooperThread::GetNodes() const {
+    return nodes_;
+}
+
+uint64_t NodeLooperThread::GetWakeCount() const {
+    return wake_count_.load(std::memory_order_relaxed);
+}
+
+void NodeLooperThread::SetDeferredTask(std::function<void()> task,
+                                       std::chrono::milliseconds min_interval) {
     ::android::AutoMutex _l(lock_);
-    std::chrono::milliseconds timeout_ms = kMaxUpdatePeriod;
+    deferred_task_ = std::move(task);
+    deferred_interval_ = min_interval;
+}
 
-    // Update 2 passes: some node may have dependency in other node
-    // e.g. update cpufreq min to VAL while cpufreq max still set to
-    // a value lower than VAL, is expected to fail in first pass
-    ATRACE_BEGIN("update_nodes");
-    for (auto& n : nodes_) {
-        n->Update(false);
+void NodeLooperThread::ScheduleDeferredTask() {
+    if (!deferred_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        Wake();
     }
-    for (auto& n : nodes_) {
-        timeout_ms = std::min(n->Update(true), timeout_ms);
+}
+
+ReqTime NodeLooperThread::RunDeferredTask(ReqTime now) {
+    if (!deferred_task_ || !deferred_scheduled_.load(std::memory_order_acquire)) {
+        return ReqTime::max();
+    }
+    if (deferred_last_run_ != ReqTime::min() && now - deferred_last_run_ < deferred_interval_) {
+        return deferred_last_run_ + deferred_interval_;
     }
+    // Cleared first so a schedule while the task runs is not lost
+    deferred_scheduled_.store(false, std::memory_order_release);
+    deferred_last_run_ = now;
+    ATRACE_BEGIN("deferred_task");
+    deferred_task_();
     ATRACE_END();
+    return ReqTime::max();
+}
 
+bool NodeLooperThread::threadLoop() {
+    wake_count_.fetch_add(1, std::memory_order_relaxed);
     nsecs_t sleep_timeout_ns = std::numeric_limits<nsecs_t>::max();
-    if (timeout_ms.count() < sleep_timeout_ns / 1000 / 1000) {
-        sleep_timeout_ns = timeout_ms.count() * 1000 * 1000;
+    {
+        ::android::AutoMutex _l(lock_);
+        DrainRequests();
+        CollectExpiredNodes(std::chrono::steady_clock::now());
+
+        update_list_.clear();
+        for (std::size_t i = 0; i < nodes_.size(); i++) {
+            if (dirty_[i]) {
+                dirty_[i] = false;
+                update_list_.push_back(i);
+            }
+        }
+
+        // Update 2 passes: some node may have dependency in other node
+        // e.g. update cpufreq min to VAL while cpufreq max still set to
+        // a value lower than VAL, is expected to fail in first pass.
+        ATRACE_BEGIN("update_nodes");
+        for (auto i : update_list_) {
+            nodes_[i]->UpdateBatched(&batch_);
+        }
+        batch_.Submit();
+        for (auto i : update_list_) {
+            std::chrono::milliseconds timeout_ms = nodes_[i]->Update(true);
+            // The dependency may be on a node that is not dirty this cycle, so
+            // keep a node whose write still failed dirty and retry it
+            if (!nodes_[i]->IsUpToDate()) {
+                dirty_[i] = true;
+                timeout_ms = std::min(timeout_ms, kRetryUpdateMs);
+            }
+            ScheduleUpdate(i, std::chrono::steady_clock::now(), timeout_ms);
+        }
+        ATRACE_END();
+
+        // Drop stale entries so the heap top is the real next deadline, and
+        // rebuild the heap if re-requested hints left too many behind
+        while (!deadlines_.empty() &&
+               next_update_[deadlines_.top().second] != deadlines_.top().first) {
+            deadlines_.pop();
+        }
+        if (deadlines_.size() > 2 * nodes_.size()) {
+            decltype(deadlines_) live;
+            for (std::size_t i = 0; i < nodes_.size(); i++) {
+                if (next_update_[i] != ReqTime::max()) {
+                    live.emplace(next_update_[i], i);
+                }
+            }
+            deadlines_.swap(live);
+        }
+
+        ReqTime wake_time = RunDeferredTask(std::chrono::steady_clock::now());
+        if (!deadlines_.empty()) {
+            wake_time = std::min(wake_time, deadlines_.top().first);
+        }
+        if (wake_time != ReqTime::max()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    wake_time - std::chrono::steady_clock::now());
+            sleep_timeout_ns = std::max<nsecs_t>(remaining.count(), 0);
+        }
     }
+
     // VERBOSE level won't print by default in user/userdebug build
     LOG(VERBOSE) << "NodeLooperThread will wait for " << sleep_timeout_ns
                  << "ns";
-    ATRACE_BEGIN("wait");
-    wake_cond_.waitRelative(lock_, sleep_timeout_ns);
-    ATRACE_END();
+    ::android::AutoMutex _w(wake_lock_);
+    if (!wake_pending_.load() && !::android::Thread::exitPending()) {
+        ATRACE_BEGIN("wait");
+        wake_cond_.waitRelative(wake_lock_, sleep_timeout_ns);
+        ATRACE_END();
+    }
+    // Pairs with Wake() so requests queued before it are seen by the next drain
+    wake_pending_.exchange(false);
     return true;
 }
 
@@ -140,9 +369,10 @@ void NodeLooperThread::Stop() {
     if (::android::Thread::isRunning()) {
         LOG(INFO) << "NodeLooperThread stopping";
         {
-            ::android::AutoMutex _l(lock_);
-            wake_cond_.signal();
+            ::android::AutoMutex _w(wake_lock_);
             ::android::Thread::requestExit();
+            wake_pending_.store(true);
+            wake_cond_.signal();
         }
         ::android::Thread::join();
         LOG(INFO) << "NodeLooperThread stopped";
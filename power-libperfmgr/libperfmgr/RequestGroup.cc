@@ -21,25 +21,89 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 namespace android {
 namespace perfmgr {
 
-bool RequestGroup::AddRequest(const std::string& hint_type, ReqTime end_time) {
-    if (request_map_.find(hint_type) == request_map_.end()) {
-        request_map_.emplace(hint_type, end_time);
-        return true;
-    } else {
-        if (request_map_[hint_type] < end_time) {
-            request_map_[hint_type] = end_time;
+namespace {
+std::mutex gHintLock;
+// deque keeps names in place as it grows
+std::deque<std::string> gHintNames;
+std::unordered_map<std::string, RequestHintId> gHintIds;
+// number of interned hints, published after their name is added
+std::atomic<uint32_t> gHintCount{0};
+}  // namespace
+
+RequestHintId InternHint(const std::string& hint_type) {
+    std::lock_guard<std::mutex> lock(gHintLock);
+    auto it = gHintIds.find(hint_type);
+    if (it != gHintIds.end()) {
+        return it->second;
+    }
+    const uint32_t index = static_cast<uint32_t>(gHintNames.size());
+    const RequestHintId hint_id = static_cast<RequestHintId>(index);
+    gHintNames.push_back(hint_type);
+    gHintIds.emplace(hint_type, hint_id);
+    gHintCount.store(index + 1, std::memory_order_release);
+    return hint_id;
+}
+
+std::string GetHintName(RequestHintId hint_id) {
+    const uint32_t index = static_cast<uint32_t>(hint_id);
+    std::lock_guard<std::mutex> lock(gHintLock);
+    return index < gHintNames.size() ? gHintNames[index] : std::string();
+}
+
+bool IsHintInterned(RequestHintId hint_id) {
+    return static_cast<uint32_t>(hint_id) < gHintCount.load(std::memory_order_acquire);
+}
+
+bool RequestGroup::AddRequest(RequestHintId hint_id, ReqTime end_time) {
+    auto [it, added] = requests_.try_emplace(hint_id, end_time);
+    if (!added) {
+        if (it->second >= end_time) {
+            return false;
         }
-        return false;
+        // The old heap entry is left stale
+        it->second = end_time;
     }
+    deadlines_.emplace(end_time, hint_id);
+    CompactDeadlines();
+    return added;
+}
+
+bool RequestGroup::AddRequest(const std::string& hint_type, ReqTime end_time) {
+    return AddRequest(InternHint(hint_type), end_time);
+}
+
+bool RequestGroup::RemoveRequest(RequestHintId hint_id) {
+    // The heap entry is left stale
+    return requests_.erase(hint_id) > 0;
 }
 
 bool RequestGroup::RemoveRequest(const std::string& hint_type) {
-    return request_map_.erase(hint_type);
+    return RemoveRequest(InternHint(hint_type));
+}
+
+void RequestGroup::CompactDeadlines() {
+    if (deadlines_.size() <= 2 * requests_.size() + 8) {
+        return;
+    }
+    std::vector<Deadline> live;
+    live.reserve(requests_.size());
+    for (const auto& [hint_id, end_time] : requests_) {
+        live.emplace_back(end_time, hint_id);
+    }
+    deadlines_ = decltype(deadlines_)(std::greater<Deadline>(), std::move(live));
+}
+
+std::size_t RequestGroup::GetRequestCount() const {
+    return requests_.size();
 }
 
 const std::string& RequestGroup::GetRequestValue() const {
@@ -50,29 +114,33 @@ bool RequestGroup::GetExpireTime(std::chrono::milliseconds* expire_time) {
     ReqTime now = std::chrono::steady_clock::now();
     *expire_time = std::chrono::milliseconds::max();
 
-    bool active = false;
-    for (auto it = request_map_.begin(); it != request_map_.end();) {
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            it->second - now);
-        if (duration <= std::chrono::milliseconds::zero()) {
-            it = request_map_.erase(it);
-        } else {
-            *expire_time = std::min(duration, *expire_time);
-            active = true;
-            ++it;
+    // Pop expired requests and stale entries until the top is a live request
+    while (!deadlines_.empty()) {
+        const auto [end_time, hint_id] = deadlines_.top();
+        auto it = requests_.find(hint_id);
+        const bool stale = it == requests_.end() || it->second != end_time;
+        if (!stale) {
+            auto duration =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(end_time - now);
+            if (duration > std::chrono::milliseconds::zero()) {
+                *expire_time = duration;
+                break;
+            }
+            requests_.erase(it);
         }
+        deadlines_.pop();
     }
-    return active;
+    return !requests_.empty();
 }
 
 void RequestGroup::DumpToFd(int fd, const std::string& prefix) const {
     std::ostringstream dump_buf;
     ReqTime now = std::chrono::steady_clock::now();
-    for (auto it = request_map_.begin(); it != request_map_.end(); it++) {
+    for (const auto& [hint_id, end_time] : requests_) {
         auto remaining_duration =
-            std::chrono::duration_cast<std::chrono::milliseconds>(it->second -
+            std::chrono::duration_cast<std::chrono::milliseconds>(end_time -
                                                                   now);
-        dump_buf << prefix << it->first << "\t" << remaining_duration.count()
+        dump_buf << prefix << GetHintName(hint_id) << "\t" << remaining_duration.count()
                  << "\t" << request_value_ << "\n";
     }
     if (!android::base::WriteStringToFd(dump_buf.str(), fd)) {
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfmgr/RequestQueue.h"
+
+namespace android {
+namespace perfmgr {
+
+namespace {
+std::size_t RoundUpToPowerOfTwo(std::size_t n) {
+    std::size_t v = 1;
+    while (v < n) {
+        v <<= 1;
+    }
+    return v;
+}
+}  // namespace
+
+RequestQueue::RequestQueue(std::size_t capacity)
+    : mask_(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1),
+      cells_(new Cell[mask_ + 1]),
+      enqueue_pos_(0),
+      dequeue_pos_(0) {
+    for (std::size_t i = 0; i <= mask_; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool RequestQueue::Push(const NodeRequest& request) {
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            // Cell is free for this position, try to claim it
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Consumer has not released this cell yet: queue is full
+            return false;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    cell->request = request;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool RequestQueue::Pop(NodeRequest* request) {
+    Cell* cell = &cells_[dequeue_pos_ & mask_];
+    std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+    if (seq != dequeue_pos_ + 1) {
+        return false;
+    }
+    *request = cell->request;
+    cell->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+}
+
+std::size_t RequestQueue::GetCapacity() const {
+    return mask_ + 1;
+}
+
+}  // namespace perfmgr
+}  // namespace android
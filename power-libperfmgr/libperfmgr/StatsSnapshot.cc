@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "libperfmgr"
+
+#include "perfmgr/StatsSnapshot.h"
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <thread>
+
+namespace android {
+namespace perfmgr {
+
+namespace {
+constexpr std::size_t kSeqOffset = offsetof(StatsHeader, seq);
+constexpr std::size_t kSeqEnd = kSeqOffset + sizeof(uint32_t);
+constexpr int kReadRetries = 100;
+
+inline uint32_t *SeqOf(void *addr) {
+    return reinterpret_cast<uint32_t *>(static_cast<char *>(addr) + kSeqOffset);
+}
+}  // namespace
+
+StatsSnapshot::StatsSnapshot(void *addr, std::size_t size) : addr_(addr), size_(size) {}
+
+StatsSnapshot::~StatsSnapshot() {
+    munmap(addr_, size_);
+}
+
+std::unique_ptr<StatsSnapshot> StatsSnapshot::Create(const std::string &path, std::size_t size) {
+    if (size < sizeof(StatsHeader)) {
+        LOG(ERROR) << "Stats snapshot too small: " << size;
+        return nullptr;
+    }
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)));
+    if (fd == -1 || ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+        PLOG(ERROR) << "Failed to create stats snapshot: " << path;
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map stats snapshot: " << path;
+        return nullptr;
+    }
+    return std::unique_ptr<StatsSnapshot>(new StatsSnapshot(addr, size));
+}
+
+bool StatsSnapshot::Publish(const std::string &stats) {
+    if (stats.size() != size_) {
+        LOG(ERROR) << "Stats size " << stats.size() << " does not match snapshot size " << size_;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    uint32_t *seq = SeqOf(addr_);
+    const uint32_t begin = __atomic_load_n(seq, __ATOMIC_RELAXED) | 1;
+    __atomic_store_n(seq, begin, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    char *dst = static_cast<char *>(addr_);
+    std::memcpy(dst, stats.data(), kSeqOffset);
+    std::memcpy(dst + kSeqEnd, stats.data() + kSeqEnd, size_ - kSeqEnd);
+    __atomic_store_n(seq, begin + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool StatsSnapshot::Read(const std::string &path, std::string *stats) {
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        PLOG(ERROR) << "Failed to open stats snapshot: " << path;
+        return false;
+    }
+    const std::size_t size = st.st_size;
+    if (size < sizeof(StatsHeader)) {
+        LOG(ERROR) << "Stats snapshot too small: " << size;
+        return false;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map stats snapshot: " << path;
+        return false;
+    }
+    bool ret = false;
+    const uint32_t *seq = SeqOf(addr);
+    for (int i = 0; i < kReadRetries && !ret; i++) {
+        const uint32_t begin = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        stats->assign(static_cast<const char *>(addr), size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        ret = __atomic_load_n(seq, __ATOMIC_RELAXED) == begin;
+    }
+    munmap(addr, size);
+    if (!ret) {
+        LOG(ERROR) << "Failed to read consistent stats snapshot: " << path;
+        return false;
+    }
+    const StatsHeader *header = reinterpret_cast<const StatsHeader *>(stats->data());
+    if (header->magic != kStatsMagic || header->version != kStatsVersion) {
+        LOG(ERROR) << "Invalid stats snapshot: " << path;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace perfmgr
+}  // namespace android
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "libperfmgr"
+
+#include "perfmgr/WriteBatch.h"
+
+#include <android-base/logging.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace android {
+namespace perfmgr {
+
+namespace {
+constexpr std::size_t kMaxEntries = 4096;
+// How often completions are polled for once waiting on the ring failed
+constexpr std::chrono::milliseconds kFailedWaitPollInterval(1);
+
+int IoUringSetup(uint32_t entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return static_cast<int>(
+            syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+void* MapRing(int fd, std::size_t size, off_t offset) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+template <typename T>
+T* RingField(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+}  // namespace
+
+WriteBatch::WriteBatch(std::size_t capacity, bool enable) {
+    if (enable && !Setup(std::clamp<std::size_t>(capacity, 1, kMaxEntries))) {
+        Teardown();
+    }
+}
+
+WriteBatch::~WriteBatch() {
+    Teardown();
+}
+
+bool WriteBatch::Setup(std::size_t capacity) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd_.reset(IoUringSetup(capacity, &params));
+    if (!ring_fd_.ok()) {
+        LOG(INFO) << "io_uring unavailable, writing nodes synchronously: "
+                  << strerror(errno);
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = MapRing(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+        PLOG(ERROR) << "Failed to map io_uring submission ring";
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = MapRing(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == nullptr) {
+            PLOG(ERROR) << "Failed to map io_uring completion ring";
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(MapRing(ring_fd_, sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+        PLOG(ERROR) << "Failed to map io_uring submission entries";
+        return false;
+    }
+
+    sq_head_ = RingField<uint32_t>(sq_ring_, params.sq_off.head);
+    sq_tail_ = RingField<uint32_t>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *RingField<uint32_t>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = RingField<uint32_t>(sq_ring_, params.sq_off.array);
+    cq_head_ = RingField<uint32_t>(cq_ring_, params.cq_off.head);
+    cq_tail_ = RingField<uint32_t>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *RingField<uint32_t>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = RingField<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+    capacity_ = params.sq_entries;
+    // Ops are referenced by the kernel through their iovec, never reallocate
+    ops_.reserve(capacity_);
+    return true;
+}
+
+void WriteBatch::Teardown() {
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    sqes_ = nullptr;
+    cq_ring_ = nullptr;
+    sq_ring_ = nullptr;
+    ring_fd_.reset();
+    capacity_ = 0;
+}
+
+bool WriteBatch::IsEnabled() const {
+    return ring_fd_.ok();
+}
+
+bool WriteBatch::Add(int fd, const std::string& value, bool ordered, Callback done) {
+    if (!IsEnabled() || ops_.size() >= capacity_) {
+        return false;
+    }
+    // Only this thread moves the submission tail
+    const uint32_t tail = *sq_tail_;
+    const uint32_t index = tail & sq_mask_;
+    ops_.push_back(Op{{const_cast<char*>(value.data()), value.size()}, std::move(done)});
+
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    // WRITEV rather than WRITE to work on the first io_uring kernels
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = 0;
+    sqe->addr = reinterpret_cast<uint64_t>(&ops_.back().iov);
+    sqe->len = 1;
+    sqe->user_data = ops_.size() - 1;
+    if (ordered) {
+        sqe->flags = IOSQE_IO_DRAIN;
+    }
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void WriteBatch::FailQueued(std::size_t from) {
+    for (std::size_t i = from; i < ops_.size(); i++) {
+        if (ops_[i].done) {
+            ops_[i].done(false);
+            ops_[i].done = nullptr;
+        }
+    }
+}
+
+std::size_t WriteBatch::ReapCompletions() {
+    std::size_t reaped = 0;
+    uint32_t head = *cq_head_;
+    const uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        Op& op = ops_[cqe.user_data];
+        if (op.done) {
+            op.done(cqe.res == static_cast<int32_t>(op.iov.iov_len));
+            op.done = nullptr;
+        }
+        reaped++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+std::size_t WriteBatch::Submit() {
+    const std::size_t queued = ops_.size();
+    if (queued == 0) {
+        return 0;
+    }
+
+    // Submit without waiting: the kernel may consume fewer entries than
+    // asked, and waiting for more completions than were submitted would
+    // never return
+    std::size_t submitted = 0;
+    while (submitted < queued) {
+        const uint32_t left = queued - submitted;
+        int ret = IoUringEnter(ring_fd_, left, 0, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            PLOG(ERROR) << "io_uring submit failed, " << left << " writes not submitted";
+        } else if (ret == 0) {
+            LOG(ERROR) << "io_uring submit returned " << ret << ", " << left
+                       << " writes not submitted";
+        }
+        if (ret <= 0) {
+            // Take back the entries the kernel did not consume
+            __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE),
+                             __ATOMIC_RELEASE);
+            break;
+        }
+        submitted += ret;
+    }
+
+    // Every submitted write is in flight, so waiting for all of them is
+    // bounded. The ring must not be closed before they are all reaped:
+    // closing it does not wait for them, so a write reported failed and
+    // retried could still land after the retry.
+    std::size_t completed = ReapCompletions();
+    bool failed = false;
+    while (completed < submitted) {
+        int ret = IoUringEnter(ring_fd_, 0, submitted - completed, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            if (!failed) {
+                PLOG(ERROR) << "io_uring wait failed, disabling batched writes";
+                failed = true;
+            }
+            // Completions are still posted to the ring, poll for them
+            std::this_thread::sleep_for(kFailedWaitPollInterval);
+        }
+        completed += ReapCompletions();
+    }
+
+    if (failed) {
+        Teardown();
+    }
+    // Only writes that were never submitted are left unreported
+    FailQueued(0);
+    ops_.clear();
+    return submitted;
+}
+
+}  // namespace perfmgr
+}  // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+#include "perfmgr/FileNode.h"
+
+namespace android {
+namespace perfmgr {
+
+using std::literals::chrono_literals::operator""ms;
+
+namespace {
+
+constexpr std::size_t kBoostNodes = 24;
+
+class BoostNodes {
+  public:
+    BoostNodes() : pool_(kBoostNodes) {
+        for (std::size_t i = 0; i < kBoostNodes; i++) {
+            files_.emplace_back(std::make_unique<TemporaryFile>());
+            nodes_.emplace_back(std::make_unique<FileNode>(
+                    "n" + std::to_string(i), files_.back()->path,
+                    std::vector<RequestGroup>{{"2000000"}, {"1000000"}}, 1, true, false, &pool_));
+        }
+    }
+
+    // Flip every node between boosted and default, as a boost and its end do
+    void Toggle(bool boost) {
+        for (auto& n : nodes_) {
+            if (boost) {
+                n->AddRequest(0, "LAUNCH", std::chrono::steady_clock::now() + 5000ms);
+            } else {
+                n->RemoveRequest("LAUNCH");
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<FileNode>>& nodes() { return nodes_; }
+
+  private:
+    FdPool pool_;
+    std::vector<std::unique_ptr<TemporaryFile>> files_;
+    std::vector<std::unique_ptr<FileNode>> nodes_;
+};
+
+}  // namespace
+
+// Write a boost to kBoostNodes files one node after another
+static void BM_FileNode_SyncBoost(benchmark::State& state) {
+    BoostNodes boost;
+    bool on = false;
+    for (auto _ : state) {
+        on = !on;
+        boost.Toggle(on);
+        for (auto& n : boost.nodes()) {
+            n->Update(false);
+        }
+    }
+}
+BENCHMARK(BM_FileNode_SyncBoost);
+
+// Write a boost to kBoostNodes files in one WriteBatch submission
+static void BM_FileNode_BatchedBoost(benchmark::State& state) {
+    WriteBatch batch(kBoostNodes, true);
+    if (!batch.IsEnabled()) {
+        state.SkipWithError("io_uring unavailable");
+        return;
+    }
+    BoostNodes boost;
+    bool on = false;
+    for (auto _ : state) {
+        on = !on;
+        boost.Toggle(on);
+        for (auto& n : boost.nodes()) {
+            n->UpdateBatched(&batch);
+        }
+        batch.Submit();
+    }
+}
+BENCHMARK(BM_FileNode_BatchedBoost);
+
+}  // namespace perfmgr
+}  // namespace android
+
+BENCHMARK_MAIN();
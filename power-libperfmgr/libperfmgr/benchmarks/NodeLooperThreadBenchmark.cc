@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "perfmgr/FileNode.h"
+#include "perfmgr/NodeLooperThread.h"
+
+namespace android {
+namespace perfmgr {
+
+using std::literals::chrono_literals::operator""ms;
+
+namespace {
+
+std::atomic<uint64_t> gUpdateCount{0};
+
+// FileNode that counts Update and UpdateBatched calls across all nodes
+class CountingFileNode : public FileNode {
+  public:
+    CountingFileNode(std::string name, std::string node_path,
+                     std::vector<RequestGroup> req_sorted, std::size_t default_val_index)
+        : FileNode(std::move(name), std::move(node_path), std::move(req_sorted),
+                   default_val_index, true) {}
+
+    std::chrono::milliseconds Update(bool log_error) override {
+        gUpdateCount.fetch_add(1);
+        update_count.fetch_add(1);
+        return FileNode::Update(log_error);
+    }
+
+    void UpdateBatched(WriteBatch* batch) override {
+        gUpdateCount.fetch_add(1);
+        update_count.fetch_add(1);
+        FileNode::UpdateBatched(batch);
+    }
+
+    std::atomic<uint64_t> update_count{0};
+};
+
+void WaitForUpdates(const CountingFileNode* node, uint64_t count) {
+    while (node->update_count.load() < count) {
+        std::this_thread::yield();
+    }
+}
+
+}  // namespace
+
+// Request and cancel a hint touching one node out of range(0) nodes, and
+// report how many node updates the looper runs per hint
+static void BM_NodeLooperThread_UpdatesPerHint(benchmark::State& state) {
+    const std::size_t node_count = state.range(0);
+    std::vector<std::unique_ptr<TemporaryFile>> files;
+    std::vector<std::unique_ptr<Node>> nodes;
+    for (std::size_t i = 0; i < node_count; i++) {
+        files.emplace_back(std::make_unique<TemporaryFile>());
+        nodes.emplace_back(std::make_unique<CountingFileNode>(
+                "n" + std::to_string(i), files.back()->path,
+                std::vector<RequestGroup>{{"value0"}, {"value1"}}, 1));
+    }
+    const auto* node0 = static_cast<CountingFileNode*>(nodes[0].get());
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes));
+    th->Start();
+    // Every node is updated in 2 passes on init
+    while (gUpdateCount.load() < 2 * node_count) {
+        std::this_thread::yield();
+    }
+
+    const RequestHintId hint_id = th->RegisterHint("BENCHMARK");
+    std::vector<NodeAction> actions{{0, 0, 0ms}};
+    const uint64_t start_count = gUpdateCount.load();
+    uint64_t hints = 0;
+    for (auto _ : state) {
+        uint64_t node0_count = node0->update_count.load();
+        th->Request(actions, hint_id);
+        WaitForUpdates(node0, node0_count + 2);
+        th->Cancel(actions, hint_id);
+        WaitForUpdates(node0, node0_count + 4);
+        hints += 2;
+    }
+    th->Stop();
+    state.counters["updates_per_hint"] =
+            static_cast<double>(gUpdateCount.load() - start_count) / hints;
+    gUpdateCount.store(0);
+}
+BENCHMARK(BM_NodeLooperThread_UpdatesPerHint)->Arg(8)->Arg(64)->UseRealTime();
+
+}  // namespace perfmgr
+}  // namespace android
+
+BENCHMARK_MAIN();
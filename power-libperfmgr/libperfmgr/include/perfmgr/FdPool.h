@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBPERFMGR_FDPOOL_H_
+#define ANDROID_LIBPERFMGR_FDPOOL_H_
+
+#include <android-base/unique_fd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "perfmgr/WriteBatch.h"
+
+namespace android {
+namespace perfmgr {
+
+// FdPool keeps a bounded LRU set of open write fds for node paths, so boosts
+// don't pay an open/close per node write. Values are written with pwrite at
+// offset 0; sysfs, procfs and cgroup files are neither truncated nor
+// fsync'ed as they ignore both. A write is skipped when the value equals the
+// last one successfully written through the pool to the same path.
+class FdPool {
+  public:
+    struct Stats {
+        uint64_t opens = 0;
+        uint64_t evictions = 0;
+        uint64_t writes = 0;
+        uint64_t elided_writes = 0;
+        uint64_t fsyncs = 0;
+    };
+
+    explicit FdPool(std::size_t capacity);
+
+    // Pool shared by all FileNodes not given their own
+    static FdPool* GetInstance();
+
+    // Return true when value is in place, either written or elided.
+    bool Write(const std::string& path, const std::string& value);
+    // Queue the write of value to path on batch, calling done with the
+    // result once the batch is submitted, or right away when elided. path and
+    // value must stay valid until then. Return false if the write could not be
+    // queued and done will not be called.
+    bool QueueWrite(const std::string& path, const std::string& value, WriteBatch* batch,
+                    WriteBatch::Callback done);
+    // Close the fd for path and forget its last written value
+    void Close(const std::string& path);
+
+    std::size_t GetCapacity() const;
+    std::size_t GetSize() const;
+    Stats GetStats() const;
+
+  private:
+    FdPool(FdPool const&) = delete;
+    void operator=(FdPool const&) = delete;
+
+    struct Entry {
+        std::string path;
+        android::base::unique_fd fd;
+        // regular file on a storage filesystem, truncated and synced after
+        // each write
+        bool stored_file = false;
+        bool has_value = false;
+        std::string last_value;
+        // writes queued on a batch and not yet completed
+        uint32_t pending = 0;
+    };
+
+    // Return the entry for path as most recently used, opening it and
+    // evicting the least recently used entry without pending writes if
+    // needed. Must be called with lock_ held.
+    Entry* Acquire(const std::string& path);
+    // Record the result of a write to e. Must be called with lock_ held.
+    void Complete(Entry* e, const std::string& value, bool written);
+    // Handle a batched write to path completing
+    void CompleteQueued(const std::string& path, const std::string& value, bool written);
+
+    static constexpr std::size_t kDefaultCapacity = 64;
+
+    const std::size_t capacity_;
+    mutable std::mutex lock_;
+    // most recently used first, protected by lock_
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+    Stats stats_;
+};
+
+}  // namespace perfmgr
+}  // namespace android
+
+#endif  // ANDROID_LIBPERFMGR_FDPOOL_H_
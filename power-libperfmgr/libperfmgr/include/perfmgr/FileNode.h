@@ -23,19 +23,23 @@
 #include <string>
 #include <vector>
 
+#include "perfmgr/FdPool.h"
 #include "perfmgr/Node.h"
 
 namespace android {
 namespace perfmgr {
 
-// FileNode represents file
+// FileNode represents file. Writes go through an FdPool, the shared one
+// unless fd_pool is given, except for hold_fd nodes which own their fd.
 class FileNode : public Node {
   public:
     FileNode(std::string name, std::string node_path,
              std::vector<RequestGroup> req_sorted, std::size_t default_val_index,
-             bool reset_on_init, bool hold_fd = false);
+             bool reset_on_init, bool hold_fd = false, FdPool* fd_pool = nullptr);
+    ~FileNode() override;
 
     std::chrono::milliseconds Update(bool log_error) override;
+    void UpdateBatched(WriteBatch* batch) override;
 
     bool GetHoldFd() const;
 
@@ -45,7 +49,11 @@ class FileNode : public Node {
     FileNode(const Node& other) = delete;
     FileNode& operator=(Node const&) = delete;
 
+    // Write through fd_, which stays open while a non-default value is held
+    bool WriteHoldFd(const std::string& value, bool is_default);
+
     const bool hold_fd_;
+    FdPool* const fd_pool_;
     const std::chrono::milliseconds warn_timeout_;
     android::base::unique_fd fd_;
 };
@@ -20,6 +20,7 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -28,10 +29,17 @@
 #include <vector>
 
 #include "perfmgr/NodeLooperThread.h"
+#include "perfmgr/StatsSnapshot.h"
 
 namespace android {
 namespace perfmgr {
 
+// HintId is the index of a PowerHint in one HintManager, as returned by
+// GetHintId, and is only meaningful to that HintManager. Hints are requested
+// on nodes with the process-wide RequestHintId instead.
+using HintId = uint32_t;
+constexpr HintId kInvalidHintId = std::numeric_limits<HintId>::max();
+
 struct HintStats {
     HintStats() : count(0), duration_ms(0) {}
     uint32_t count;
@@ -58,18 +66,63 @@ struct HintStatus {
 enum class HintActionType { Node, DoHint, EndHint, MaskHint };
 
 struct HintAction {
-    HintAction(HintActionType t, std::string v) : type(t), value(v) {}
+    HintAction(HintActionType t, std::string v) : type(t), value(v), value_id(kInvalidHintId) {}
     HintActionType type;
     std::string value;
+    // Resolved from value when the HintManager is constructed.
+    HintId value_id;
+};
+
+// CountHint is a DoHint already done earlier in the same chain, which only
+// updates the hint's stats.
+enum class HintOpType : uint8_t { DoHint, EndHint, MaskHint, UnmaskHint, CountHint };
+
+// One step of a flattened hint action chain.
+struct HintOp {
+    HintOp(HintOpType t, HintId id) : type(t), hint_id(id), skip(0) {}
+    HintOpType type;
+    HintId hint_id;
+    // Number of following ops that belong to this DoHint or EndHint, skipped
+    // when it does not take effect.
+    uint32_t skip;
+};
+
+// Flattened fan-out of a hint, counting the hints it chains to.
+struct HintFanOut {
+    HintFanOut() : node_requests(0), chained_hints(0), ended_hints(0), mask_ops(0) {}
+    std::size_t node_requests;
+    std::size_t chained_hints;
+    std::size_t ended_hints;
+    std::size_t mask_ops;
 };
 
 struct Hint {
     Hint() : enabled(true) {}
+    Hint(const Hint &other)
+        : node_actions(other.node_actions),
+          hint_actions(other.hint_actions),
+          do_ops(other.do_ops),
+          end_ops(other.end_ops),
+          enabled(other.enabled.load()),
+          status(other.status) {}
+    Hint &operator=(const Hint &other) {
+        node_actions = other.node_actions;
+        hint_actions = other.hint_actions;
+        do_ops = other.do_ops;
+        end_ops = other.end_ops;
+        enabled.store(other.enabled.load());
+        status = other.status;
+        return *this;
+    }
     std::vector<NodeAction> node_actions;
     std::vector<HintAction> hint_actions;
-    // No locking for `enabled' flag
-    // There should not be multiple writers
-    bool enabled;
+    // Chained actions flattened when the HintManager is constructed, run in
+    // order on DoHint and EndHint respectively.
+    std::vector<HintOp> do_ops;
+    std::vector<HintOp> end_ops;
+    // Cleared and set by MaskHint and UnmaskHint ops, which may run on
+    // several binder threads while others read it in DoHint
+    std::atomic<bool> enabled;
     std::shared_ptr<HintStatus> status;
 };
 
@@ -79,8 +132,7 @@ struct Hint {
 // PowerHint to the set of actions that are performed for that PowerHint.
 class HintManager {
   public:
-    HintManager(sp<NodeLooperThread> nm, const std::unordered_map<std::string, Hint> &actions)
-        : nm_(std::move(nm)), actions_(std::move(actions)) {}
+    HintManager(sp<NodeLooperThread> nm, const std::unordered_map<std::string, Hint> &actions);
     ~HintManager() {
         if (nm_.get() != nullptr) nm_->Stop();
     }
@@ -92,60 +144,123 @@ class HintManager {
     // section of the JSON config. Return true with valid hint_type and also
     // NodeLooperThread::Request succeeds; otherwise return false.
     bool DoHint(const std::string& hint_type);
+    bool DoHint(HintId hint_id);
 
     // Do hint with the override time for all actions defined for the given
     // hint_type.  Return true with valid hint_type and also
     // NodeLooperThread::Request succeeds; otherwise return false.
     bool DoHint(const std::string& hint_type,
                 std::chrono::milliseconds timeout_ms_override);
+    bool DoHint(HintId hint_id, std::chrono::milliseconds timeout_ms_override);
 
     // End hint early. Return true with valid hint_type and also
     // NodeLooperThread::Cancel succeeds; otherwise return false.
     bool EndHint(const std::string& hint_type);
+    bool EndHint(HintId hint_id);
 
     // Query if given hint supported.
     bool IsHintSupported(const std::string& hint_type) const;
+    bool IsHintSupported(HintId hint_id) const;
+
+    // Return the interned id of hint_type, or kInvalidHintId if the hint is
+    // not supported. Callers on hot paths should resolve ids once and use the
+    // HintId overloads above to skip the string lookup.
+    HintId GetHintId(const std::string &hint_type) const;
 
     // Query if given hint enabled.
     bool IsHintEnabled(const std::string &hint_type) const;
 
-    // Static method to construct HintManager from the JSON config file.
+    // Static method to construct HintManager from the JSON config file. A
+    // snapshot compiled from the same JSON at GetSnapshotPath(config_path) is
+    // loaded instead of parsing the JSON when present and valid.
     static std::unique_ptr<HintManager> GetFromJSON(
         const std::string& config_path, bool start = true);
 
+    // Compile the JSON config json_doc into a binary snapshot. Return false
+    // if json_doc is not a valid config or has circular DoHint actions.
+    static bool CompileSnapshot(const std::string &json_doc, std::string *snapshot);
+
+    // Return the path of the snapshot of the JSON config at config_path.
+    static std::string GetSnapshotPath(const std::string &config_path);
+
     // Return available hints managed by HintManager
     std::vector<std::string> GetHints() const;
 
     // Return stats of hints managed by HintManager
     HintStats GetHintStats(const std::string &hint_type) const;
 
+    // Return the flattened fan-out of DoHint for hint_type.
+    HintFanOut GetHintFanOut(const std::string &hint_type) const;
+
     // Dump internal status to fd
     void DumpToFd(int fd);
 
+    // Export stats of hints and nodes in the binary layout of StatsSnapshot.h
+    void ExportStats(std::string *stats) const;
+
+    // Return the number of NodeLooperThread cycles run so far
+    uint64_t GetLooperWakeCount() const;
+
+    // Dump stats exported by ExportStats to fd
+    bool DumpStatsToFd(int fd) const;
+
+    // Publish stats to a StatsSnapshot at path. After a DoHint or EndHint it is
+    // refreshed from the looper thread, at most once a second. Must be called
+    // before any hint is done.
+    bool EnableStatsSnapshot(const std::string &path);
+
     // Start thread loop
     bool Start();
 
   protected:
     static std::vector<std::unique_ptr<Node>> ParseNodes(
         const std::string& json_doc);
+    // Circular DoHint actions are dropped, and counted in hint_cycles if set
     static std::unordered_map<std::string, Hint> ParseActions(
-            const std::string &json_doc, const std::vector<std::unique_ptr<Node>> &nodes);
+            const std::string &json_doc, const std::vector<std::unique_ptr<Node>> &nodes,
+            std::size_t *hint_cycles = nullptr);
+    // Drop DoHint actions in actions that chain back to a hint already being
+    // done, which would recurse forever. Return the number of dropped actions.
+    static std::size_t RemoveHintCycles(std::unordered_map<std::string, Hint> *actions);
     static bool InitHintStatus(const std::unique_ptr<HintManager> &hm);
+    // Load nodes and actions from the snapshot at snapshot_path. Return false
+    // if it is missing, corrupted, or was not compiled from json_doc.
+    static bool LoadSnapshot(const std::string &snapshot_path, const std::string &json_doc,
+                             std::vector<std::unique_ptr<Node>> *nodes,
+                             std::unordered_map<std::string, Hint> *actions);
 
   private:
     HintManager(HintManager const&) = delete;
     void operator=(HintManager const&) = delete;
-    bool ValidateHint(const std::string& hint_type) const;
+    bool ValidateHint(HintId hint_id) const;
     // Helper function to update the HintStatus when DoHint
-    void DoHintStatus(const std::string &hint_type, std::chrono::milliseconds timeout_ms);
+    void DoHintStatus(HintId hint_id, std::chrono::milliseconds timeout_ms);
     // Helper function to update the HintStatus when EndHint
-    void EndHintStatus(const std::string &hint_type);
-    // Helper function to take hint actions when DoHint
-    void DoHintAction(const std::string &hint_type);
-    // Helper function to take hint actions when EndHint
-    void EndHintAction(const std::string &hint_type);
+    void EndHintStatus(HintId hint_id);
+    // Helper functions to flatten the chained actions of a hint into ops
+    // done holds, for each hint done at the top level of the chain and not
+    // undone since, 1 + the position of its DoHint op in ops, else 0.
+    void FlattenDoOps(HintId hint_id, bool top_level, std::vector<bool> *in_chain,
+                      std::vector<std::size_t> *done, std::vector<HintOp> *ops) const;
+    void FlattenEndOps(HintId hint_id, std::vector<HintOp> *ops) const;
+    // Helper function to run flattened ops when DoHint or EndHint
+    void RunHintOps(const std::vector<HintOp> &ops);
+    // Helper function to refresh the stats snapshot, run on the looper thread
+    void PublishStats();
+    // Helper function to have the looper refresh the stats snapshot if enabled
+    void ScheduleStatsPublish();
     sp<NodeLooperThread> nm_;
-    std::unordered_map<std::string, Hint> actions_;
+    // Hints interned at construction: hint_ids_ maps a PowerHint name to its
+    // index in hints_ and hint_names_.
+    std::unordered_map<std::string, HintId> hint_ids_;
+    std::vector<std::string> hint_names_;
+    std::vector<Hint> hints_;
+    // Id of each hint as registered with nm_, indexed by HintId
+    std::vector<RequestHintId> nm_hint_ids_;
+    std::unique_ptr<StatsSnapshot> stats_snapshot_;
+    // Guards stats_buf_, which PublishStats exports into
+    std::mutex stats_lock_;
+    std::string stats_buf_;
 };
 
 }  // namespace perfmgr
@@ -19,8 +19,13 @@
 
 #include <android-base/unique_fd.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "perfmgr/RequestGroup.h"
@@ -28,6 +33,22 @@
 namespace android {
 namespace perfmgr {
 
+class WriteBatch;
+
+// Upper bounds of the write latency histogram buckets, the last bucket counts
+// every write slower than the last bound.
+constexpr std::array<std::chrono::microseconds, 5> kWriteLatencyBounds = {
+        std::chrono::microseconds(100), std::chrono::microseconds(1000),
+        std::chrono::microseconds(5000), std::chrono::microseconds(20000),
+        std::chrono::microseconds(50000)};
+constexpr std::size_t kWriteLatencyBuckets = kWriteLatencyBounds.size() + 1;
+
+struct NodeStats {
+    uint64_t writes = 0;
+    uint64_t write_failures = 0;
+    std::array<uint64_t, kWriteLatencyBuckets> write_latency = {};
+};
+
 // The Node class provides an interface for adding and cancelling powerhint
 // requests, as well as checking the next time that an in-progress powerhint
 // request will expire. There are additional methods for getting the Node’s name
@@ -49,10 +70,12 @@ class Node {
     virtual ~Node() {}
 
     // Return true if successfully add a request
+    bool AddRequest(std::size_t value_index, RequestHintId hint_id, ReqTime end_time);
     bool AddRequest(std::size_t value_index, const std::string& hint_type,
                     ReqTime end_time);
 
     // Return true if successfully remove a request
+    bool RemoveRequest(RequestHintId hint_id);
     bool RemoveRequest(const std::string& hint_type);
 
     // Return the nearest expire time of active requests; return
@@ -61,12 +84,23 @@ class Node {
     // active request.
     virtual std::chrono::milliseconds Update(bool log_error) = 0;
 
+    // Same as Update(false), except the node may queue its write on batch, in
+    // which case it takes effect once the batch is submitted.
+    virtual void UpdateBatched(WriteBatch* batch);
+
+    // Return true if the node holds the value of its active request, false if
+    // writing it failed and the node needs another Update.
+    bool IsUpToDate();
+
     const std::string& GetName() const;
     const std::string& GetPath() const;
     std::vector<std::string> GetValues() const;
+    std::size_t GetValueCount() const;
     std::size_t GetDefaultIndex() const;
     bool GetResetOnInit() const;
     bool GetValueIndex(const std::string& value, std::size_t* index) const;
+    // Safe to call while another thread updates the node
+    NodeStats GetStats() const;
     virtual void DumpToFd(int fd) const = 0;
 
   protected:
@@ -76,14 +110,32 @@ class Node {
     Node(const Node& other) = delete;
     Node& operator=(Node const&) = delete;
 
+    // Return the index of the highest priority value with an active request,
+    // or the default one, and set expire_time to the nearest expiry of that
+    // value's requests, or std::chrono::milliseconds::max() if none.
+    std::size_t GetActiveValueIndex(std::chrono::milliseconds* expire_time);
+
+    // Count a write of the node value that took duration
+    void RecordWrite(bool success, std::chrono::nanoseconds duration);
+
     const std::string name_;
     const std::string node_path_;
     // request vector, one entry per possible value, sorted by priority.
     std::vector<RequestGroup> req_sorted_;
+    // value to its index in req_sorted_
+    std::unordered_map<std::string, std::size_t> value_indexes_;
+    // value indexes each hint has requested, so that removing a hint only
+    // visits those RequestGroups. May list requests that have since expired.
+    std::unordered_map<RequestHintId, std::vector<std::size_t>> hint_slots_;
     const std::size_t default_val_index_;
     // node will be explicitly initialized when first time called Update().
     bool reset_on_init_;
     std::size_t current_val_index_;
+
+  private:
+    std::atomic<uint64_t> writes_{0};
+    std::atomic<uint64_t> write_failures_{0};
+    std::array<std::atomic<uint64_t>, kWriteLatencyBuckets> write_latency_ = {};
 };
 
 }  // namespace perfmgr
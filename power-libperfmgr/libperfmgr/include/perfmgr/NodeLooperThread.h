@@ -17,15 +17,22 @@
 #ifndef ANDROID_LIBPERFMGR_NODELOOPERTHREAD_H_
 #define ANDROID_LIBPERFMGR_NODELOOPERTHREAD_H_
 
+#include <android-base/properties.h>
 #include <utils/Thread.h>
 
+#include <atomic>
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <queue>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "perfmgr/Node.h"
+#include "perfmgr/RequestQueue.h"
+#include "perfmgr/WriteBatch.h"
 
 namespace android {
 namespace perfmgr {
@@ -51,10 +58,26 @@ struct NodeAction {
 // decides how to apply the requests. The NodeLooperThread contains a ThreadLoop
 // to maintain the sysfs nodes, and that thread is woken up both to handle
 // powerhint requests and when the timeout expires for an in-progress powerhint.
+// Requests and cancellations are pushed into a lock-free RequestQueue and
+// applied by the looper at the start of its next cycle, so callers never wait
+// for the node lock that is held while nodes are being written.
+// Only nodes whose requests changed, or whose next expiry has passed, are
+// updated in a cycle; expiries are kept in a min-heap that also decides how
+// long the looper sleeps. The first update pass queues node writes on a
+// WriteBatch so they are submitted to the kernel together.
 class NodeLooperThread : public ::android::Thread {
   public:
     explicit NodeLooperThread(std::vector<std::unique_ptr<Node>> nodes)
-        : Thread(false), nodes_(std::move(nodes)) {}
+        : Thread(false),
+          nodes_(std::move(nodes)),
+          dirty_(nodes_.size(), true),
+          next_update_(nodes_.size(), ReqTime::max()),
+          batch_(nodes_.size(), android::base::GetBoolProperty(kBatchWriteProperty, true)),
+          deferred_interval_(0),
+          deferred_last_run_(ReqTime::min()),
+          deferred_scheduled_(false),
+          queue_(kRequestQueueSize),
+          wake_pending_(false) {}
     virtual ~NodeLooperThread() { Stop(); }
 
     // Need call Stop() as the threadloop will hold a strong pointer
@@ -64,18 +87,46 @@ class NodeLooperThread : public ::android::Thread {
 
     // Return true when successfully adds request from actions for the hint_type
     // in each individual node. Return false if any of the actions has either
-    // invalid node index or value index.
+    // invalid node index or value index, or hint_id was not returned by
+    // RegisterHint.
     bool Request(const std::vector<NodeAction>& actions,
                  const std::string& hint_type);
+    bool Request(const std::vector<NodeAction>& actions, RequestHintId hint_id);
+    // Same as above, but every action uses timeout_ms_override instead of its
+    // own timeout.
+    bool Request(const std::vector<NodeAction>& actions, RequestHintId hint_id,
+                 std::chrono::milliseconds timeout_ms_override);
     // Return when successfully cancels request from actions for the hint_type
     // in each individual node. Return false if any of the actions has invalid
-    // node index.
+    // node index, or hint_id was not returned by RegisterHint.
     bool Cancel(const std::vector<NodeAction>& actions,
                 const std::string& hint_type);
+    bool Cancel(const std::vector<NodeAction>& actions, RequestHintId hint_id);
+
+    // Return the id of hint_type for the RequestHintId overloads above,
+    // interning the name on first use. Same as InternHint.
+    RequestHintId RegisterHint(const std::string& hint_type);
 
     // Dump all nodes to fd
     void DumpToFd(int fd);
 
+    // Return the nodes, which may only be queried for their name, path,
+    // values and stats while the looper runs
+    const std::vector<std::unique_ptr<Node>>& GetNodes() const;
+
+    // Return the number of looper cycles run so far, each one after a wake
+    // up for new requests or a node expiring
+    uint64_t GetWakeCount() const;
+
+    // Run task on the looper thread after ScheduleDeferredTask, at most once
+    // every min_interval, so that callers can move work off their own thread.
+    // An empty task disables it.
+    void SetDeferredTask(std::function<void()> task, std::chrono::milliseconds min_interval);
+
+    // Ask the looper to run the deferred task. Lock-free, and wakes the looper
+    // at most once per run of the task.
+    void ScheduleDeferredTask();
+
     // Return true when successfully started the looper thread
     bool Start();
 
@@ -83,16 +134,74 @@ class NodeLooperThread : public ::android::Thread {
     NodeLooperThread(NodeLooperThread const&) = delete;
     void operator=(NodeLooperThread const&) = delete;
     bool threadLoop() override;
-
-    static constexpr auto kMaxUpdatePeriod = std::chrono::milliseconds::max();
+    // Request actions for hint_id, with timeout_ms_override replacing each
+    // action's timeout when not null
+    bool RequestInternal(const std::vector<NodeAction>& actions, RequestHintId hint_id,
+                         const std::chrono::milliseconds* timeout_ms_override);
+    // Queue a request, applying it directly if the queue is full
+    void Submit(const NodeRequest& request);
+    // Wake up the looper without taking lock_
+    void Wake();
+    // Pop all queued requests into pending_, coalescing duplicates, and apply
+    // them to the nodes. Must be called with lock_ held.
+    void DrainRequests();
+    // Apply pending_ to the nodes. Must be called with lock_ held.
+    void ApplyPendingRequests();
+    // Mark nodes whose scheduled update is due as dirty. Must be called with
+    // lock_ held.
+    void CollectExpiredNodes(ReqTime now);
+    // Record when node_index needs its next update. Must be called with
+    // lock_ held.
+    void ScheduleUpdate(std::size_t node_index, ReqTime now,
+                        std::chrono::milliseconds timeout_ms);
+    // Run the deferred task if it is scheduled and its interval has passed.
+    // Return when it is due otherwise, or ReqTime::max() if it is not
+    // scheduled. Must be called with lock_ held.
+    ReqTime RunDeferredTask(ReqTime now);
+
+    static constexpr std::size_t kRequestQueueSize = 1024;
+    static constexpr const char kBatchWriteProperty[] = "ro.vendor.perfmgr.batch_write";
 
     std::vector<std::unique_ptr<Node>> nodes_;  // parsed from Config
+    // nodes needing an update in the next cycle, protected by lock_
+    std::vector<bool> dirty_;
+    // next scheduled update of each node, ReqTime::max() if none, protected
+    // by lock_
+    std::vector<ReqTime> next_update_;
+    // min-heap of (deadline, node index); an entry is stale once its deadline
+    // no longer matches next_update_, protected by lock_
+    std::priority_queue<std::pair<ReqTime, std::size_t>,
+                        std::vector<std::pair<ReqTime, std::size_t>>,
+                        std::greater<std::pair<ReqTime, std::size_t>>>
+            deadlines_;
+    // scratch list of nodes updated in one cycle, protected by lock_
+    std::vector<std::size_t> update_list_;
+    // writes of the first update pass, protected by lock_
+    WriteBatch batch_;
+
+    // task set by SetDeferredTask and when it last ran, protected by lock_
+    std::function<void()> deferred_task_;
+    std::chrono::milliseconds deferred_interval_;
+    ReqTime deferred_last_run_;
+    // set by ScheduleDeferredTask, cleared by the looper when it runs the task
+    std::atomic<bool> deferred_scheduled_;
+
+    RequestQueue queue_;
+    // requests popped from queue_ in one drain, protected by lock_
+    std::vector<NodeRequest> pending_;
+    // index in pending_ of the latest request per (node, hint), protected by
+    // lock_
+    std::unordered_map<uint64_t, std::size_t> pending_index_;
 
     // conditional variable from C++ standard library can be affected by wall
     // time change as it is using CLOCK_REAL (b/35756266). The component should
     // not be impacted by wall time, thus need use Android specific Condition
     // class for waking up threadloop.
     ::android::Condition wake_cond_;
+    // lock for wake_cond_, only held briefly to signal or start waiting
+    ::android::Mutex wake_lock_;
+    std::atomic<bool> wake_pending_;
+    std::atomic<uint64_t> wake_count_{0};
 
     // lock to protect nodes_
     ::android::Mutex lock_;
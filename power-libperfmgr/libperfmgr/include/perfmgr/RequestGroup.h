@@ -18,47 +18,84 @@
 #define ANDROID_LIBPERFMGR_REQUESTGROUP_H_
 
 #include <chrono>
-#include <map>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace android {
 namespace perfmgr {
 
 using ReqTime = std::chrono::time_point<std::chrono::steady_clock>;
 
+// RequestHintId is the dense index of a hint name interned process-wide by
+// InternHint. It is a distinct type from HintManager's HintId, which indexes
+// the hints of a single HintManager, so that one cannot be passed for the
+// other.
+enum class RequestHintId : uint32_t {};
+constexpr RequestHintId kInvalidRequestHintId =
+        static_cast<RequestHintId>(std::numeric_limits<uint32_t>::max());
+
+// Return the id of hint_type, interning it on first use. Ids are shared by the
+// whole process, so the same hint has the same id on every node.
+RequestHintId InternHint(const std::string& hint_type);
+// Return the name of an interned hint, or an empty string for unknown ids.
+std::string GetHintName(RequestHintId hint_id);
+// Return true if hint_id was returned by InternHint. Does not take the intern
+// lock, so it is cheap enough to validate ids on every request.
+bool IsHintInterned(RequestHintId hint_id);
+
 // The RequestGroup type represents the set of requests for a given value on a
 // particular sysfs node, and the interface is simple: there is a function to
 // add requests, a function to remove requests, and a function to check for the
 // next expiration time if there is an outstanding request, and a function to
 // check the requested value. There may only be one request per PowerHint, so
-// the representation is simple: a map from PowerHint to the expiration time for
-// that hint.
+// the representation is simple: a hash from hint to its expiration time, so
+// adding or removing a hint's request is a constant time lookup, and a min-heap
+// of (expiration time, hint) to find the nearest expiration. Heap entries of
+// removed or extended requests are dropped lazily.
 class RequestGroup {
   public:
     RequestGroup(std::string request_value)  // NOLINT(runtime/explicit)
         : request_value_(std::move(request_value)) {}
 
-    // Remove expired request in the map and return true when request_map_ is
-    // not empty, false when request_map_ is empty; also update expire_time with
-    // nearest timeout in request_map_ or std::chrono::milliseconds::max() when
-    // request_map_ is empty.
+    // Remove expired request in requests_ and return true when requests_ is
+    // not empty, false when requests_ is empty; also update expire_time with
+    // nearest timeout in requests_ or std::chrono::milliseconds::max() when
+    // requests_ is empty.
     bool GetExpireTime(std::chrono::milliseconds* expire_time);
     // Return the request value.
     const std::string& GetRequestValue() const;
     // Return true for adding request, false for extending expire time of
-    // existing active request on given hint_type.
+    // existing active request on given hint_type. If request exits and the new
+    // end_time is less than the active time, expire time will not be updated.
+    bool AddRequest(RequestHintId hint_id, ReqTime end_time);
     bool AddRequest(const std::string& hint_type, ReqTime end_time);
     // Return true for removing request, false if request is not active on given
-    // hint_type. If request exits and the new end_time is less than the active
-    // time, expire time will not be updated; also returns false.
+    // hint_type.
+    bool RemoveRequest(RequestHintId hint_id);
     bool RemoveRequest(const std::string& hint_type);
+    // Return the number of requests, including expired ones not yet removed.
+    std::size_t GetRequestCount() const;
     // Dump internal status to fd
     void DumpToFd(int fd, const std::string& prefix) const;
 
   private:
+    using Deadline = std::pair<ReqTime, RequestHintId>;
+
+    // Drop heap entries that no longer match requests_, once they outnumber
+    // the requests
+    void CompactDeadlines();
+
     const std::string request_value_;
-    std::map<std::string, ReqTime> request_map_;
+    // end time of each hint's request, at most one per hint
+    std::unordered_map<RequestHintId, ReqTime> requests_;
+    // min-heap by end time, may hold stale entries
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
 };
 
 }  // namespace perfmgr
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBPERFMGR_REQUESTQUEUE_H_
+#define ANDROID_LIBPERFMGR_REQUESTQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "perfmgr/RequestGroup.h"
+
+namespace android {
+namespace perfmgr {
+
+enum class NodeRequestType : uint8_t { Add, Cancel, None };
+
+// The NodeRequest is one pending add or cancel of a hint on a single node, as
+// submitted by NodeLooperThread::Request/Cancel. end_time is only meaningful
+// for Add requests.
+struct NodeRequest {
+    NodeRequestType type;
+    uint32_t node_index;
+    uint32_t value_index;
+    RequestHintId hint_id;
+    ReqTime end_time;
+};
+
+// RequestQueue is a bounded multi-producer single-consumer ring of
+// NodeRequests. Push is lock-free and may be called from any thread; Pop must
+// only be called by one consumer at a time, which NodeLooperThread guarantees
+// by only draining the queue while holding its node lock.
+class RequestQueue {
+  public:
+    // capacity is rounded up to the next power of two.
+    explicit RequestQueue(std::size_t capacity);
+
+    // Return false if the queue is full.
+    bool Push(const NodeRequest& request);
+    // Return false if the queue is empty.
+    bool Pop(NodeRequest* request);
+
+    std::size_t GetCapacity() const;
+
+  private:
+    RequestQueue(RequestQueue const&) = delete;
+    void operator=(RequestQueue const&) = delete;
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        NodeRequest request;
+    };
+
+    const std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    // Producers and the consumer update these from different threads, keep
+    // them on separate cache lines.
+    alignas(64) std::atomic<std::size_t> enqueue_pos_;
+    alignas(64) std::size_t dequeue_pos_;
+};
+
+}  // namespace perfmgr
+}  // namespace android
+
+#endif  // ANDROID_LIBPERFMGR_REQUESTQUEUE_H_
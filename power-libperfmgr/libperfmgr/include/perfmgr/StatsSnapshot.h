@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBPERFMGR_STATSSNAPSHOT_H_
+#define ANDROID_LIBPERFMGR_STATSSNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "perfmgr/Node.h"
+
+namespace android {
+namespace perfmgr {
+
+// Fixed binary layout of HintManager stats: a StatsHeader followed by
+// hint_count HintStatsRecords and node_count NodeStatsRecords, in host byte
+// order. Times are steady clock nanoseconds, 0 if never set.
+constexpr uint32_t kStatsMagic = 0x54534d50;  // "PMST"
+constexpr uint32_t kStatsVersion = 1;
+constexpr std::size_t kStatsNameSize = 64;
+
+struct StatsHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Odd while a StatsSnapshot is being published
+    uint32_t seq;
+    uint32_t hint_count;
+    uint32_t node_count;
+    uint32_t write_latency_buckets;
+    int64_t timestamp_ns;
+};
+
+struct HintStatsRecord {
+    char name[kStatsNameSize];
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t duration_ms;
+    int64_t last_start_ns;
+    int64_t last_end_ns;
+};
+
+struct NodeStatsRecord {
+    char name[kStatsNameSize];
+    uint64_t writes;
+    uint64_t write_failures;
+    // Bucket i counts writes up to kWriteLatencyBounds[i]
+    uint64_t write_latency[kWriteLatencyBuckets];
+};
+
+// StatsSnapshot publishes stats to a file mapped shared, so that tools can
+// read them without a binder call. Publishing is a seqlock: readers retry
+// until they copy the stats with an even seq that did not change.
+class StatsSnapshot {
+  public:
+    ~StatsSnapshot();
+
+    // Create the file at path sized for size bytes of stats and map it.
+    // Return nullptr on failure.
+    static std::unique_ptr<StatsSnapshot> Create(const std::string &path, std::size_t size);
+
+    // Copy stats, which must be in the layout above and of the size given to
+    // Create, to the mapping. Return false otherwise.
+    bool Publish(const std::string &stats);
+
+    // Read a consistent copy of the stats published at path.
+    static bool Read(const std::string &path, std::string *stats);
+
+  private:
+    StatsSnapshot(void *addr, std::size_t size);
+    StatsSnapshot(StatsSnapshot const &) = delete;
+    void operator=(StatsSnapshot const &) = delete;
+
+    std::mutex lock_;
+    void *const addr_;
+    const std::size_t size_;
+};
+
+}  // namespace perfmgr
+}  // namespace android
+
+#endif  // ANDROID_LIBPERFMGR_STATSSNAPSHOT_H_
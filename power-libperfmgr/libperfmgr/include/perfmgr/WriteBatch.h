@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LIBPERFMGR_WRITEBATCH_H_
+#define ANDROID_LIBPERFMGR_WRITEBATCH_H_
+
+#include <android-base/unique_fd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace android {
+namespace perfmgr {
+
+// WriteBatch collects node writes of one NodeLooperThread cycle and submits
+// them to the kernel together through io_uring, so slow store handlers of
+// different nodes run concurrently instead of back to back. When io_uring is
+// unavailable (old kernel, or denied by policy) the batch is disabled and
+// Add always fails, leaving callers on their synchronous write path.
+class WriteBatch {
+  public:
+    // Called with whether the whole value was written
+    using Callback = std::function<void(bool)>;
+
+    WriteBatch(std::size_t capacity, bool enable);
+    ~WriteBatch();
+
+    bool IsEnabled() const;
+
+    // Queue a write of value at offset 0 of fd. value and fd must stay valid
+    // until Submit returns. With ordered set, the write only starts after all
+    // writes queued before it complete. Return false if the batch is disabled
+    // or full, in which case done is not called.
+    bool Add(int fd, const std::string& value, bool ordered, Callback done);
+
+    // Submit all queued writes, wait for them, and run their callbacks.
+    // Return the number of writes submitted.
+    std::size_t Submit();
+
+  private:
+    WriteBatch(WriteBatch const&) = delete;
+    void operator=(WriteBatch const&) = delete;
+
+    bool Setup(std::size_t capacity);
+    void Teardown();
+    // Fail all queued writes from index from whose result was not reported
+    void FailQueued(std::size_t from);
+    // Report the results in the completion queue, return how many there were
+    std::size_t ReapCompletions();
+
+    struct Op {
+        struct iovec iov;
+        Callback done;
+    };
+
+    android::base::unique_fd ring_fd_;
+    void* sq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+    uint32_t* sq_head_ = nullptr;
+    uint32_t* sq_tail_ = nullptr;
+    uint32_t sq_mask_ = 0;
+    uint32_t* sq_array_ = nullptr;
+    uint32_t* cq_head_ = nullptr;
+    uint32_t* cq_tail_ = nullptr;
+    uint32_t cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    // queued writes, indexed by sqe user_data
+    std::vector<Op> ops_;
+    std::size_t capacity_ = 0;
+};
+
+}  // namespace perfmgr
+}  // namespace android
+
+#endif  // ANDROID_LIBPERFMGR_WRITEBATCH_H_
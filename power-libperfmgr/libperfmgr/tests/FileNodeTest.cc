@@ -230,5 +230,161 @@ TEST(FileNodeTest, AddRequestTestHoldFdOverride) {
     EXPECT_EQ(std::chrono::milliseconds::max(), expire_time);
 }
 
+// Test writes reuse the pooled fd and keep the file content exact
+TEST(FileNodeTest, FdPoolReuseTest) {
+    FdPool pool(4);
+    TemporaryFile tf;
+    FileNode t("t", tf.path, {{"1000000"}, {"10"}, {"500"}}, 2, true, false, &pool);
+    t.Update(false);
+    _VerifyPathValue(tf.path, "500");
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(t.AddRequest(0, "LAUNCH", start + 500ms));
+    t.Update(false);
+    _VerifyPathValue(tf.path, "1000000");
+    EXPECT_TRUE(t.AddRequest(1, "INTERACTION", start + 500ms));
+    t.RemoveRequest("LAUNCH");
+    t.Update(false);
+    _VerifyPathValue(tf.path, "10");
+    t.RemoveRequest("INTERACTION");
+    t.Update(false);
+    _VerifyPathValue(tf.path, "500");
+    FdPool::Stats stats = pool.GetStats();
+    EXPECT_EQ(1u, stats.opens);
+    EXPECT_EQ(4u, stats.writes);
+    // tmpfs is a regular file system and needs fsync
+    EXPECT_EQ(4u, stats.fsyncs);
+    EXPECT_EQ(0u, stats.elided_writes);
+    EXPECT_EQ(1u, pool.GetSize());
+}
+
+// Test writes to a device node are neither truncated nor synced
+TEST(FileNodeTest, FdPoolDeviceNodeTest) {
+    FdPool pool(4);
+    FileNode t("t", "/dev/null", {{"value0"}, {"value1"}}, 1, true, false, &pool);
+    EXPECT_EQ(std::chrono::milliseconds::max(), t.Update(false));
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(t.AddRequest(0, "LAUNCH", start + 500ms));
+    t.Update(false);
+    FdPool::Stats stats = pool.GetStats();
+    EXPECT_EQ(1u, stats.opens);
+    EXPECT_EQ(2u, stats.writes);
+    EXPECT_EQ(0u, stats.fsyncs);
+    EXPECT_EQ(0u, t.GetStats().write_failures);
+}
+
+// Test writing the last written value of a path is elided
+TEST(FileNodeTest, FdPoolElisionTest) {
+    FdPool pool(4);
+    TemporaryFile tf;
+    FileNode t("t", tf.path, {{"value0"}, {"value1"}}, 1, true, false, &pool);
+    FileNode t2("t2", tf.path, {{"value0"}, {"value1"}}, 1, true, false, &pool);
+    t.Update(false);
+    t2.Update(false);
+    _VerifyPathValue(tf.path, "value1");
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(t2.AddRequest(0, "LAUNCH", start + 500ms));
+    t2.Update(false);
+    _VerifyPathValue(tf.path, "value0");
+    FdPool::Stats stats = pool.GetStats();
+    EXPECT_EQ(1u, stats.opens);
+    EXPECT_EQ(2u, stats.writes);
+    EXPECT_EQ(1u, stats.elided_writes);
+}
+
+// Test least recently used fds are evicted from a full pool
+TEST(FileNodeTest, FdPoolEvictionTest) {
+    FdPool pool(2);
+    std::vector<std::unique_ptr<TemporaryFile>> files;
+    std::vector<std::unique_ptr<FileNode>> nodes;
+    for (int i = 0; i < 3; i++) {
+        files.emplace_back(std::make_unique<TemporaryFile>());
+        nodes.emplace_back(std::make_unique<FileNode>(
+                "t" + std::to_string(i), files.back()->path,
+                std::vector<RequestGroup>{{"value0"}, {"value1"}}, 1, true, false, &pool));
+        nodes.back()->Update(false);
+    }
+    EXPECT_EQ(2u, pool.GetSize());
+    FdPool::Stats stats = pool.GetStats();
+    EXPECT_EQ(3u, stats.opens);
+    EXPECT_EQ(1u, stats.evictions);
+    // t0 was evicted and is reopened
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(nodes[0]->AddRequest(0, "LAUNCH", start + 500ms));
+    nodes[0]->Update(false);
+    _VerifyPathValue(files[0]->path, "value0");
+    stats = pool.GetStats();
+    EXPECT_EQ(4u, stats.opens);
+    EXPECT_EQ(2u, stats.evictions);
+    nodes.clear();
+    EXPECT_EQ(0u, pool.GetSize());
+}
+
+// Test batched writes land once the batch is submitted
+TEST(FileNodeTest, BatchedWriteTest) {
+    WriteBatch batch(8, true);
+    if (!batch.IsEnabled()) {
+        GTEST_SKIP() << "io_uring unavailable";
+    }
+    FdPool pool(4);
+    TemporaryFile tf;
+    TemporaryFile tf2;
+    FileNode t("t", tf.path, {{"1000000"}, {"10"}, {"500"}}, 2, true, false, &pool);
+    FileNode t2("t2", tf2.path, {{"value0"}, {"value1"}}, 1, true, false, &pool);
+    t.UpdateBatched(&batch);
+    t2.UpdateBatched(&batch);
+    EXPECT_EQ(2u, batch.Submit());
+    _VerifyPathValue(tf.path, "500");
+    _VerifyPathValue(tf2.path, "value1");
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(t.AddRequest(1, "INTERACTION", start + 500ms));
+    t.UpdateBatched(&batch);
+    t2.UpdateBatched(&batch);
+    EXPECT_EQ(1u, batch.Submit());
+    _VerifyPathValue(tf.path, "10");
+    // Batched writes are tracked, a second pass has nothing left to write
+    std::chrono::milliseconds expire_time = t.Update(true);
+    EXPECT_NEAR(std::chrono::milliseconds(500).count(), expire_time.count(),
+                kTIMING_TOLERANCE_MS);
+    EXPECT_EQ(3u, pool.GetStats().writes);
+}
+
+// Test a disabled batch falls back to synchronous writes
+TEST(FileNodeTest, BatchedWriteDisabledTest) {
+    WriteBatch batch(8, false);
+    EXPECT_FALSE(batch.IsEnabled());
+    FdPool pool(4);
+    TemporaryFile tf;
+    FileNode t("t", tf.path, {{"value0"}, {"value1"}}, 1, true, false, &pool);
+    t.UpdateBatched(&batch);
+    _VerifyPathValue(tf.path, "value1");
+    EXPECT_EQ(0u, batch.Submit());
+    EXPECT_EQ(1u, pool.GetStats().writes);
+}
+
+// Test write counts and latency histogram
+TEST(FileNodeTest, WriteStatsTest) {
+    FileNode f("f", "/sys/android/nonexist_node_test", {{"value0"}, {"value1"}}, 1, true);
+    f.Update(false);
+    NodeStats stats = f.GetStats();
+    EXPECT_EQ(0u, stats.writes);
+    EXPECT_EQ(1u, stats.write_failures);
+    TemporaryFile tf;
+    FileNode t("t", tf.path, {{"value0"}, {"value1"}}, 1, true);
+    t.Update(false);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(t.AddRequest(0, "INTERACTION", start + 500ms));
+    t.Update(false);
+    // No change, no write
+    t.Update(false);
+    stats = t.GetStats();
+    EXPECT_EQ(2u, stats.writes);
+    EXPECT_EQ(0u, stats.write_failures);
+    uint64_t histogram_writes = 0;
+    for (auto count : stats.write_latency) {
+        histogram_writes += count;
+    }
+    EXPECT_EQ(2u, histogram_writes);
+}
+
 }  // namespace perfmgr
 }  // namespace android
@@ -19,6 +19,7 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <thread>
@@ -199,6 +200,36 @@ static inline void _VerifyPathValue(const std::string& path,
     EXPECT_EQ(value, s);
 }
 
+static inline void _VerifySameConfig(const std::vector<std::unique_ptr<Node>>& nodes,
+                                     const std::unordered_map<std::string, Hint>& actions,
+                                     const std::vector<std::unique_ptr<Node>>& other_nodes,
+                                     const std::unordered_map<std::string, Hint>& other_actions) {
+    ASSERT_EQ(nodes.size(), other_nodes.size());
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        EXPECT_EQ(nodes[i]->GetName(), other_nodes[i]->GetName());
+        EXPECT_EQ(nodes[i]->GetPath(), other_nodes[i]->GetPath());
+        EXPECT_EQ(nodes[i]->GetValues(), other_nodes[i]->GetValues());
+        EXPECT_EQ(nodes[i]->GetDefaultIndex(), other_nodes[i]->GetDefaultIndex());
+        EXPECT_EQ(nodes[i]->GetResetOnInit(), other_nodes[i]->GetResetOnInit());
+    }
+    ASSERT_EQ(actions.size(), other_actions.size());
+    for (const auto& [hint_type, hint] : actions) {
+        ASSERT_NE(other_actions.end(), other_actions.find(hint_type)) << hint_type;
+        const Hint& other_hint = other_actions.at(hint_type);
+        ASSERT_EQ(hint.node_actions.size(), other_hint.node_actions.size()) << hint_type;
+        for (std::size_t i = 0; i < hint.node_actions.size(); i++) {
+            EXPECT_EQ(hint.node_actions[i].node_index, other_hint.node_actions[i].node_index);
+            EXPECT_EQ(hint.node_actions[i].value_index, other_hint.node_actions[i].value_index);
+            EXPECT_EQ(hint.node_actions[i].timeout_ms, other_hint.node_actions[i].timeout_ms);
+        }
+        ASSERT_EQ(hint.hint_actions.size(), other_hint.hint_actions.size()) << hint_type;
+        for (std::size_t i = 0; i < hint.hint_actions.size(); i++) {
+            EXPECT_EQ(hint.hint_actions[i].type, other_hint.hint_actions[i].type);
+            EXPECT_EQ(hint.hint_actions[i].value, other_hint.hint_actions[i].value);
+        }
+    }
+}
+
 static inline void _VerifyStats(const HintStats &stats, uint32_t count, uint64_t duration_min,
                                 uint64_t duration_max) {
     EXPECT_EQ(stats.count, count);
@@ -249,6 +280,41 @@ TEST_F(HintManagerTest, HintSupportedTest) {
     EXPECT_FALSE(hm.IsHintSupported("NO_SUCH_HINT"));
 }
 
+// Test GetHintId and the HintId overloads
+TEST_F(HintManagerTest, HintIdTest) {
+    auto hm = std::make_unique<HintManager>(nm_, actions_);
+    EXPECT_TRUE(InitHintStatus(hm));
+    HintId interaction = hm->GetHintId("INTERACTION");
+    HintId launch = hm->GetHintId("LAUNCH");
+    EXPECT_NE(kInvalidHintId, interaction);
+    EXPECT_NE(kInvalidHintId, launch);
+    EXPECT_NE(interaction, launch);
+    EXPECT_EQ(kInvalidHintId, hm->GetHintId("NO_SUCH_HINT"));
+    EXPECT_TRUE(hm->IsHintSupported(interaction));
+    EXPECT_FALSE(hm->IsHintSupported(kInvalidHintId));
+    EXPECT_FALSE(hm->DoHint(kInvalidHintId));
+    EXPECT_FALSE(hm->EndHint(kInvalidHintId));
+    EXPECT_TRUE(hm->Start());
+    EXPECT_TRUE(hm->DoHint(interaction));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0]->path, "n0_value1");
+    _VerifyPathValue(files_[1]->path, "n1_value1");
+    _VerifyPropertyValue(prop_, "n2_value1");
+    EXPECT_TRUE(hm->DoHint(launch, 200ms));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0]->path, "n0_value0");
+    _VerifyPathValue(files_[1]->path, "n1_value0");
+    _VerifyPropertyValue(prop_, "n2_value0");
+    EXPECT_TRUE(hm->EndHint(launch));
+    EXPECT_TRUE(hm->EndHint(interaction));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0]->path, "n0_value2");
+    _VerifyPathValue(files_[1]->path, "n1_value2");
+    _VerifyPropertyValue(prop_, "n2_value2");
+    EXPECT_EQ(1u, hm->GetHintStats("INTERACTION").count);
+    EXPECT_EQ(1u, hm->GetHintStats("LAUNCH").count);
+}
+
 // Test DumpToFd
 TEST_F(HintManagerTest, DumpToFdTest) {
     auto hm = std::make_unique<HintManager>(nm_, actions_);
@@ -593,6 +659,183 @@ TEST_F(HintManagerTest, ParseBadActionsTest) {
     EXPECT_EQ(0u, actions.size());
 }
 
+// Test parsing actions with circular DoHint
+TEST_F(HintManagerTest, ParseCircularActionsTest) {
+    std::string from = R"("Type": "DoHint",
+            "Value": "LAUNCH"
+        })";
+    size_t start_pos = json_doc_.find(from);
+    json_doc_.replace(start_pos, from.length(), from + R"(,
+        {
+            "PowerHint": "LAUNCH",
+            "Type": "DoHint",
+            "Value": "DO_LAUNCH_MODE"
+        })");
+    std::vector<std::unique_ptr<Node>> nodes = HintManager::ParseNodes(json_doc_);
+    EXPECT_EQ(3u, nodes.size());
+    auto actions = HintManager::ParseActions(json_doc_, nodes);
+    EXPECT_EQ(5u, actions.size());
+    // One DoHint of the cycle is dropped, the rest of the config is kept
+    EXPECT_EQ(1u, actions["LAUNCH"].hint_actions.size() +
+                          actions["DO_LAUNCH_MODE"].hint_actions.size());
+    EXPECT_EQ(3u, actions["LAUNCH"].node_actions.size());
+    TemporaryFile json_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(json_doc_, json_file.path)) << strerror(errno);
+    EXPECT_NE(nullptr, HintManager::GetFromJSON(json_file.path, false));
+    // But it is not compiled into a snapshot
+    std::string snapshot;
+    EXPECT_FALSE(HintManager::CompileSnapshot(json_doc_, &snapshot));
+    std::size_t hint_cycles = 0;
+    HintManager::ParseActions(json_doc_, nodes, &hint_cycles);
+    EXPECT_EQ(1u, hint_cycles);
+}
+
+// Test flattening chained hint actions
+TEST_F(HintManagerTest, HintChainTest) {
+    actions_["MID"].hint_actions.emplace_back(HintActionType::DoHint, "INTERACTION");
+    actions_["MID"].hint_actions.emplace_back(HintActionType::MaskHint, "LAUNCH");
+    actions_["CHAIN"].hint_actions.emplace_back(HintActionType::DoHint, "MID");
+    actions_["CHAIN"].hint_actions.emplace_back(HintActionType::DoHint, "INTERACTION");
+    actions_["DUP"].hint_actions.emplace_back(HintActionType::DoHint, "INTERACTION");
+    actions_["DUP"].hint_actions.emplace_back(HintActionType::DoHint, "INTERACTION");
+    actions_["LOOP"].hint_actions.emplace_back(HintActionType::DoHint, "LOOP");
+    actions_["MASK_MID"].hint_actions.emplace_back(HintActionType::MaskHint, "MID");
+    auto acyclic = actions_;
+    EXPECT_EQ(1u, RemoveHintCycles(&acyclic));
+    EXPECT_EQ(0u, acyclic["LOOP"].hint_actions.size());
+    EXPECT_EQ(2u, acyclic["DUP"].hint_actions.size());
+    // Keep LOOP to check flattening also drops it
+    auto hm = std::make_unique<HintManager>(nm_, actions_);
+    EXPECT_TRUE(InitHintStatus(hm));
+
+    HintFanOut fan_out = hm->GetHintFanOut("CHAIN");
+    EXPECT_EQ(6u, fan_out.node_requests);
+    EXPECT_EQ(3u, fan_out.chained_hints);
+    EXPECT_EQ(0u, fan_out.ended_hints);
+    EXPECT_EQ(1u, fan_out.mask_ops);
+    // Doing INTERACTION twice in a row is flattened to once
+    fan_out = hm->GetHintFanOut("DUP");
+    EXPECT_EQ(3u, fan_out.node_requests);
+    EXPECT_EQ(1u, fan_out.chained_hints);
+    // Circular DoHint is dropped
+    fan_out = hm->GetHintFanOut("LOOP");
+    EXPECT_EQ(0u, fan_out.chained_hints);
+
+    EXPECT_TRUE(hm->Start());
+    EXPECT_TRUE(hm->DoHint("LOOP"));
+    EXPECT_TRUE(hm->DoHint("CHAIN"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0]->path, "n0_value1");
+    _VerifyPathValue(files_[1]->path, "n1_value1");
+    _VerifyPropertyValue(prop_, "n2_value1");
+    EXPECT_EQ(1u, hm->GetHintStats("MID").count);
+    EXPECT_EQ(2u, hm->GetHintStats("INTERACTION").count);
+    EXPECT_FALSE(hm->IsHintEnabled("LAUNCH"));
+    EXPECT_FALSE(hm->DoHint("LAUNCH"));
+    // Ending CHAIN leaves the hints it chained to
+    EXPECT_TRUE(hm->EndHint("CHAIN"));
+    EXPECT_FALSE(hm->IsHintEnabled("LAUNCH"));
+    EXPECT_TRUE(hm->EndHint("MID"));
+    EXPECT_TRUE(hm->IsHintEnabled("LAUNCH"));
+    // A masked hint skips the hints it chains to
+    EXPECT_TRUE(hm->DoHint("MASK_MID"));
+    EXPECT_TRUE(hm->DoHint("CHAIN"));
+    EXPECT_EQ(1u, hm->GetHintStats("MID").count);
+    EXPECT_EQ(3u, hm->GetHintStats("INTERACTION").count);
+    EXPECT_TRUE(hm->IsHintEnabled("LAUNCH"));
+    // A flattened repeat still counts as a request
+    EXPECT_TRUE(hm->DoHint("DUP"));
+    EXPECT_EQ(5u, hm->GetHintStats("INTERACTION").count);
+}
+
+// Test masking and unmasking a hint from several threads while others do it
+TEST_F(HintManagerTest, ConcurrentMaskTest) {
+    constexpr int kNumThreads = 4;
+    constexpr int kNumRounds = 500;
+    actions_["MASK"].hint_actions.emplace_back(HintActionType::MaskHint, "LAUNCH");
+    auto hm = std::make_unique<HintManager>(nm_, actions_);
+    EXPECT_TRUE(InitHintStatus(hm));
+    EXPECT_TRUE(hm->Start());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+        const std::string hint = t % 2 ? "MASK" : "LAUNCH";
+        threads.emplace_back([&hm, hint] {
+            for (int i = 0; i < kNumRounds; i++) {
+                hm->DoHint(hint);
+                hm->EndHint(hint);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    // The last mask op run is an unmask
+    EXPECT_TRUE(hm->IsHintEnabled("LAUNCH"));
+}
+
+// Test exporting stats and publishing them to a snapshot
+TEST_F(HintManagerTest, StatsExportTest) {
+    auto hm = std::make_unique<HintManager>(nm_, actions_);
+    EXPECT_TRUE(InitHintStatus(hm));
+    TemporaryFile snapshot_file;
+    EXPECT_TRUE(hm->EnableStatsSnapshot(snapshot_file.path));
+    EXPECT_TRUE(hm->Start());
+    EXPECT_TRUE(hm->DoHint("INTERACTION"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    EXPECT_TRUE(hm->DoHint("LAUNCH"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    EXPECT_TRUE(hm->EndHint("LAUNCH"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+
+    TemporaryFile dump_file;
+    EXPECT_TRUE(hm->DumpStatsToFd(dump_file.fd));
+    std::string stats;
+    EXPECT_TRUE(android::base::ReadFileToString(dump_file.path, &stats));
+    ASSERT_EQ(sizeof(StatsHeader) + 2 * sizeof(HintStatsRecord) + 3 * sizeof(NodeStatsRecord),
+              stats.size());
+    const StatsHeader *header = reinterpret_cast<const StatsHeader *>(stats.data());
+    EXPECT_EQ(kStatsMagic, header->magic);
+    EXPECT_EQ(kStatsVersion, header->version);
+    EXPECT_EQ(2u, header->hint_count);
+    EXPECT_EQ(3u, header->node_count);
+    EXPECT_EQ(kWriteLatencyBuckets, header->write_latency_buckets);
+    const HintStatsRecord *hints =
+            reinterpret_cast<const HintStatsRecord *>(stats.data() + sizeof(StatsHeader));
+    EXPECT_STREQ("INTERACTION", hints[0].name);
+    EXPECT_EQ(1u, hints[0].count);
+    EXPECT_STREQ("LAUNCH", hints[1].name);
+    EXPECT_EQ(1u, hints[1].count);
+    EXPECT_NE(0, hints[1].last_start_ns);
+    EXPECT_GE(hints[1].last_end_ns, hints[1].last_start_ns);
+    const NodeStatsRecord *nodes = reinterpret_cast<const NodeStatsRecord *>(
+            stats.data() + sizeof(StatsHeader) + 2 * sizeof(HintStatsRecord));
+    EXPECT_STREQ("n0", nodes[0].name);
+    // INTERACTION, LAUNCH and back to INTERACTION
+    EXPECT_EQ(3u, nodes[0].writes);
+    EXPECT_EQ(0u, nodes[0].write_failures);
+
+    // The looper publishes at most once a second, the first hint right away
+    // and EndHint a second later, so only node writes since may differ
+    std::string snapshot;
+    EXPECT_TRUE(StatsSnapshot::Read(snapshot_file.path, &snapshot));
+    ASSERT_EQ(stats.size(), snapshot.size());
+    const HintStatsRecord *snapshot_hints =
+            reinterpret_cast<const HintStatsRecord *>(snapshot.data() + sizeof(StatsHeader));
+    EXPECT_EQ(1u, snapshot_hints[0].count);
+    EXPECT_EQ(0u, snapshot_hints[1].count);
+    std::this_thread::sleep_for(1000ms);
+    EXPECT_TRUE(StatsSnapshot::Read(snapshot_file.path, &snapshot));
+    ASSERT_EQ(stats.size(), snapshot.size());
+    snapshot_hints =
+            reinterpret_cast<const HintStatsRecord *>(snapshot.data() + sizeof(StatsHeader));
+    for (std::size_t i = 0; i < 2; i++) {
+        EXPECT_STREQ(hints[i].name, snapshot_hints[i].name);
+        EXPECT_EQ(hints[i].count, snapshot_hints[i].count);
+        EXPECT_EQ(hints[i].last_start_ns, snapshot_hints[i].last_start_ns);
+        EXPECT_EQ(hints[i].last_end_ns, snapshot_hints[i].last_end_ns);
+    }
+}
+
 // Test hint/cancel/expire with json config
 TEST_F(HintManagerTest, GetFromJSONTest) {
     TemporaryFile json_file;
@@ -673,5 +916,135 @@ TEST_F(HintManagerTest, GetFromJSONTest) {
     _VerifyPropertyValue(prop_, "HIGH");
 }
 
+// Test compiling a snapshot and loading it back
+TEST_F(HintManagerTest, SnapshotRoundTripTest) {
+    std::string snapshot;
+    EXPECT_TRUE(HintManager::CompileSnapshot(json_doc_, &snapshot));
+    TemporaryFile snapshot_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot, snapshot_file.path))
+        << strerror(errno);
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::unordered_map<std::string, Hint> actions;
+    EXPECT_TRUE(HintManager::LoadSnapshot(snapshot_file.path, json_doc_, &nodes, &actions));
+    std::vector<std::unique_ptr<Node>> json_nodes = HintManager::ParseNodes(json_doc_);
+    _VerifySameConfig(json_nodes, HintManager::ParseActions(json_doc_, json_nodes), nodes,
+                      actions);
+    // no dynamic_cast intentionally in Android
+    EXPECT_FALSE(reinterpret_cast<FileNode*>(nodes[0].get())->GetHoldFd());
+    EXPECT_TRUE(reinterpret_cast<FileNode*>(nodes[1].get())->GetHoldFd());
+    // Same config compiles to the same snapshot
+    std::string snapshot2;
+    EXPECT_TRUE(HintManager::CompileSnapshot(json_doc_, &snapshot2));
+    EXPECT_EQ(snapshot, snapshot2);
+}
+
+// Test compiling and loading the shipped config
+TEST_F(HintManagerTest, SnapshotShippedConfigTest) {
+    const std::string config_path = android::base::GetExecutableDirectory() + "/powerhint.json";
+    std::string json_doc;
+    ASSERT_TRUE(android::base::ReadFileToString(config_path, &json_doc)) << config_path;
+    std::string snapshot;
+    EXPECT_TRUE(HintManager::CompileSnapshot(json_doc, &snapshot));
+    TemporaryFile snapshot_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot, snapshot_file.path))
+        << strerror(errno);
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::unordered_map<std::string, Hint> actions;
+    EXPECT_TRUE(HintManager::LoadSnapshot(snapshot_file.path, json_doc, &nodes, &actions));
+    std::vector<std::unique_ptr<Node>> json_nodes = HintManager::ParseNodes(json_doc);
+    _VerifySameConfig(json_nodes, HintManager::ParseActions(json_doc, json_nodes), nodes,
+                      actions);
+}
+
+// Test stale or corrupted snapshots are rejected
+TEST_F(HintManagerTest, SnapshotInvalidTest) {
+    std::string snapshot;
+    EXPECT_TRUE(HintManager::CompileSnapshot(json_doc_, &snapshot));
+    TemporaryFile snapshot_file;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::unordered_map<std::string, Hint> actions;
+    // Missing
+    EXPECT_FALSE(HintManager::LoadSnapshot("/nonexist/powerhint.bin", json_doc_, &nodes,
+                                           &actions));
+    // Compiled from a different JSON
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot, snapshot_file.path));
+    std::string json_doc = json_doc_;
+    json_doc.replace(json_doc.find("800"), 3, "900");
+    EXPECT_FALSE(HintManager::LoadSnapshot(snapshot_file.path, json_doc, &nodes, &actions));
+    // Corrupted payload
+    std::string corrupted = snapshot;
+    corrupted[corrupted.size() / 2] ^= 0x1;
+    ASSERT_TRUE(android::base::WriteStringToFile(corrupted, snapshot_file.path));
+    EXPECT_FALSE(HintManager::LoadSnapshot(snapshot_file.path, json_doc_, &nodes, &actions));
+    // Truncated
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot.substr(0, snapshot.size() - 1),
+                                                 snapshot_file.path));
+    EXPECT_FALSE(HintManager::LoadSnapshot(snapshot_file.path, json_doc_, &nodes, &actions));
+    EXPECT_EQ(0u, nodes.size());
+    EXPECT_EQ(0u, actions.size());
+    // Invalid JSON
+    EXPECT_FALSE(HintManager::CompileSnapshot("invalid json", &snapshot));
+}
+
+// Test circular DoHint actions in a snapshot are dropped like in the JSON
+TEST_F(HintManagerTest, SnapshotHintCycleTest) {
+    // LAUNCH -> DO_LAUNCH_MODX compiles, then the name is patched to close
+    // LAUNCH -> DO_LAUNCH_MODE -> LAUNCH
+    std::string json_doc = json_doc_;
+    json_doc.insert(json_doc.rfind(']'),
+                    R"(, {"PowerHint": "LAUNCH", "Type": "DoHint", "Value": "DO_LAUNCH_MODX"})");
+    std::string snapshot;
+    ASSERT_TRUE(HintManager::CompileSnapshot(json_doc, &snapshot));
+    const std::size_t pos = snapshot.find("DO_LAUNCH_MODX");
+    ASSERT_NE(std::string::npos, pos);
+    snapshot[pos + strlen("DO_LAUNCH_MOD")] = 'E';
+    // Recompute the FNV-1a payload checksum after the 24 bytes header
+    uint32_t checksum = 2166136261u;
+    for (std::size_t i = 24; i < snapshot.size(); i++) {
+        checksum = (checksum ^ static_cast<uint8_t>(snapshot[i])) * 16777619u;
+    }
+    memcpy(&snapshot[12], &checksum, sizeof(checksum));
+    TemporaryFile snapshot_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot, snapshot_file.path));
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::unordered_map<std::string, Hint> actions;
+    EXPECT_TRUE(HintManager::LoadSnapshot(snapshot_file.path, json_doc, &nodes, &actions));
+    EXPECT_EQ(3u, nodes.size());
+    EXPECT_EQ(1u, actions["LAUNCH"].hint_actions.size() +
+                          actions["DO_LAUNCH_MODE"].hint_actions.size());
+}
+
+// Test hint with a snapshot next to the json config
+TEST_F(HintManagerTest, GetFromSnapshotTest) {
+    TemporaryFile json_file;
+    ASSERT_TRUE(android::base::WriteStringToFile(json_doc_, json_file.path))
+        << strerror(errno);
+    std::string snapshot;
+    EXPECT_TRUE(HintManager::CompileSnapshot(json_doc_, &snapshot));
+    const std::string snapshot_path = HintManager::GetSnapshotPath(json_file.path);
+    ASSERT_TRUE(android::base::WriteStringToFile(snapshot, snapshot_path)) << strerror(errno);
+    std::unique_ptr<HintManager> hm = HintManager::GetFromJSON(json_file.path);
+    unlink(snapshot_path.c_str());
+    EXPECT_NE(nullptr, hm.get());
+    EXPECT_TRUE(hm->IsRunning());
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    // Initial default value on Node0
+    _VerifyPathValue(files_[0 + 2]->path, "384000");
+    _VerifyPathValue(files_[1 + 2]->path, "");
+    _VerifyPropertyValue(prop_, "");
+    // Do LAUNCH
+    EXPECT_TRUE(hm->DoHint("LAUNCH"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0 + 2]->path, "1134000");
+    _VerifyPathValue(files_[1 + 2]->path, "1512000");
+    _VerifyPropertyValue(prop_, "HIGH");
+    // END_LAUNCH_MODE should deactivate LAUNCH
+    EXPECT_TRUE(hm->DoHint("END_LAUNCH_MODE"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0 + 2]->path, "384000");
+    _VerifyPathValue(files_[1 + 2]->path, "384000");
+    _VerifyPropertyValue(prop_, "NONE");
+}
+
 }  // namespace perfmgr
 }  // namespace android
@@ -18,6 +18,10 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <thread>
 
 #include "perfmgr/FileNode.h"
@@ -29,6 +33,125 @@ namespace perfmgr {
 using std::literals::chrono_literals::operator""ms;
 
 constexpr auto kSLEEP_TOLERANCE_MS = 50ms;
+constexpr auto kGATE_TIMEOUT_MS = 10000ms;
+
+// FileNode whose updates block until the gate is opened, like a sysfs node
+// stuck in a slow write
+class GatedFileNode : public FileNode {
+  public:
+    GatedFileNode(std::string name, std::string node_path, std::vector<RequestGroup> req_sorted,
+                  std::size_t default_val_index)
+        : FileNode(std::move(name), std::move(node_path), std::move(req_sorted),
+                   default_val_index, false) {}
+
+    std::chrono::milliseconds Update(bool log_error) override {
+        Enter();
+        auto ret = FileNode::Update(log_error);
+        Leave();
+        return ret;
+    }
+
+    void UpdateBatched(WriteBatch* batch) override {
+        Enter();
+        FileNode::UpdateBatched(batch);
+        Leave();
+    }
+
+    void SetGate(bool open) {
+        std::lock_guard<std::mutex> lock(lock_);
+        open_ = open;
+        cond_.notify_all();
+    }
+
+    // Return true once at least count updates entered the node
+    bool WaitEntered(uint32_t count) {
+        std::unique_lock<std::mutex> lock(lock_);
+        return cond_.wait_for(lock, kGATE_TIMEOUT_MS, [&] { return entered_ >= count; });
+    }
+
+    // Return true once at least count updates finished writing the node
+    bool WaitUpdated(uint32_t count) {
+        std::unique_lock<std::mutex> lock(lock_);
+        return cond_.wait_for(lock, kGATE_TIMEOUT_MS, [&] { return updated_ >= count; });
+    }
+
+    uint32_t updated() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return updated_;
+    }
+
+  private:
+    void Enter() {
+        std::unique_lock<std::mutex> lock(lock_);
+        entered_++;
+        cond_.notify_all();
+        cond_.wait(lock, [this] { return open_; });
+    }
+
+    void Leave() {
+        std::lock_guard<std::mutex> lock(lock_);
+        updated_++;
+        cond_.notify_all();
+    }
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    bool open_ = true;
+    uint32_t entered_ = 0;
+    uint32_t updated_ = 0;
+};
+
+// FileNode that counts its Update and UpdateBatched calls
+class CountingFileNode : public FileNode {
+  public:
+    CountingFileNode(std::string name, std::string node_path,
+                     std::vector<RequestGroup> req_sorted, std::size_t default_val_index)
+        : FileNode(std::move(name), std::move(node_path), std::move(req_sorted),
+                   default_val_index, true) {}
+
+    std::chrono::milliseconds Update(bool log_error) override {
+        update_count.fetch_add(1);
+        return FileNode::Update(log_error);
+    }
+
+    void UpdateBatched(WriteBatch* batch) override {
+        update_count.fetch_add(1);
+        FileNode::UpdateBatched(batch);
+    }
+
+    std::atomic<uint32_t> update_count{0};
+};
+
+// Node whose first writes fail, like a PropertyNode while the property
+// service rejects it
+class FailingNode : public Node {
+  public:
+    FailingNode(std::string name, std::vector<RequestGroup> req_sorted,
+                std::size_t default_val_index, uint32_t failures)
+        : Node(std::move(name), "", std::move(req_sorted), default_val_index, false),
+          failures_(failures) {}
+
+    std::chrono::milliseconds Update(bool) override {
+        std::chrono::milliseconds expire_time = std::chrono::milliseconds::max();
+        std::size_t value_index = GetActiveValueIndex(&expire_time);
+        if (value_index != current_val_index_) {
+            if (failures_ > 0) {
+                failures_--;
+            } else {
+                current_val_index_ = value_index;
+                written_index.store(value_index);
+            }
+        }
+        return expire_time;
+    }
+
+    void DumpToFd(int) const override {}
+
+    std::atomic<std::size_t> written_index{std::numeric_limits<std::size_t>::max()};
+
+  private:
+    uint32_t failures_;
+};
 
 class NodeLooperThreadTest : public ::testing::Test {
   protected:
@@ -191,5 +314,195 @@ TEST_F(NodeLooperThreadTest, MultipleRequest) {
     EXPECT_FALSE(th->isRunning());
 }
 
+// Test only nodes with changed or expired requests are updated
+TEST_F(NodeLooperThreadTest, DirtyNodeTest) {
+    TemporaryFile tf;
+    auto counting = std::make_unique<CountingFileNode>(
+            "counting", tf.path, std::vector<RequestGroup>{{"c_value0"}, {"c_value1"}}, 1);
+    CountingFileNode* counting_ptr = counting.get();
+    nodes_.emplace_back(std::move(counting));
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes_));
+    EXPECT_TRUE(th->Start());
+    EXPECT_TRUE(th->isRunning());
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    // Every node is updated in 2 passes on init
+    EXPECT_EQ(2u, counting_ptr->update_count.load());
+    _VerifyPathValue(tf.path, "c_value1");
+    // Dummy LAUNCH boost actions:
+    // Node0, value0, 100ms
+    std::vector<NodeAction> actions{{0, 0, 100ms}};
+    EXPECT_TRUE(th->Request(actions, "LAUNCH"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(files_[0]->path, "n0_value0");
+    std::this_thread::sleep_for(100ms);
+    // Node0 value0 expired
+    _VerifyPathValue(files_[0]->path, "n0_value2");
+    EXPECT_EQ(2u, counting_ptr->update_count.load());
+    // Dummy VSYNC boost actions:
+    // Node2, value0, forever
+    std::vector<NodeAction> actions_counting{{2, 0, 0ms}};
+    EXPECT_TRUE(th->Request(actions_counting, "VSYNC"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    _VerifyPathValue(tf.path, "c_value0");
+    EXPECT_EQ(4u, counting_ptr->update_count.load());
+    th->Stop();
+    EXPECT_FALSE(th->isRunning());
+}
+
+// Test a node whose write fails is retried without another request
+TEST_F(NodeLooperThreadTest, RetryFailedWriteTest) {
+    // Both passes of the request cycle and of the first retry fail
+    auto failing = std::make_unique<FailingNode>(
+            "failing", std::vector<RequestGroup>{{"f_value0"}, {"f_value1"}}, 1, 4);
+    FailingNode* failing_ptr = failing.get();
+    nodes_.emplace_back(std::move(failing));
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes_));
+    EXPECT_TRUE(th->Start());
+    EXPECT_TRUE(th->isRunning());
+    // Let the init cycle finish so the request runs in a cycle of its own
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    std::vector<NodeAction> actions{{2, 0, 0ms}};
+    EXPECT_TRUE(th->Request(actions, "LAUNCH"));
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    EXPECT_NE(0u, failing_ptr->written_index.load());
+    // Retried every 500ms without another request
+    auto deadline = std::chrono::steady_clock::now() + 2000ms;
+    while (failing_ptr->written_index.load() != 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_EQ(0u, failing_ptr->written_index.load());
+    th->Stop();
+    EXPECT_FALSE(th->isRunning());
+}
+
+// Test the deferred task runs on the looper at most once per interval
+TEST_F(NodeLooperThreadTest, DeferredTaskTest) {
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes_));
+    std::atomic<uint32_t> runs{0};
+    th->SetDeferredTask([&runs] { runs.fetch_add(1); }, 200ms);
+    EXPECT_TRUE(th->Start());
+    EXPECT_TRUE(th->isRunning());
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    // Not run until scheduled
+    EXPECT_EQ(0u, runs.load());
+    th->ScheduleDeferredTask();
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    EXPECT_EQ(1u, runs.load());
+    for (int i = 0; i < 100; i++) {
+        th->ScheduleDeferredTask();
+    }
+    std::this_thread::sleep_for(kSLEEP_TOLERANCE_MS);
+    EXPECT_EQ(1u, runs.load());
+    // Schedules within the interval are coalesced into one run
+    std::this_thread::sleep_for(200ms);
+    EXPECT_EQ(2u, runs.load());
+    std::this_thread::sleep_for(200ms);
+    EXPECT_EQ(2u, runs.load());
+    th->Stop();
+    EXPECT_FALSE(th->isRunning());
+}
+
+// Test ids not returned by RegisterHint are rejected
+TEST_F(NodeLooperThreadTest, InvalidHintIdTest) {
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes_));
+    EXPECT_TRUE(th->Start());
+    EXPECT_TRUE(th->isRunning());
+    std::vector<NodeAction> actions{{0, 0, 0ms}, {1, 1, 0ms}};
+    EXPECT_FALSE(th->Request(actions, kInvalidRequestHintId));
+    EXPECT_FALSE(th->Request(actions, kInvalidRequestHintId, 100ms));
+    EXPECT_FALSE(th->Cancel(actions, kInvalidRequestHintId));
+    const RequestHintId hint_id = th->RegisterHint("LAUNCH");
+    EXPECT_TRUE(th->Request(actions, hint_id));
+    EXPECT_TRUE(th->Cancel(actions, hint_id));
+    th->Stop();
+    EXPECT_FALSE(th->isRunning());
+}
+
+// Test Request/Cancel from many threads do not wait for the looper while it
+// is stuck updating a node
+TEST_F(NodeLooperThreadTest, ContentionTest) {
+    TemporaryFile tf;
+    auto gated = std::make_unique<GatedFileNode>(
+            "gated", tf.path, std::vector<RequestGroup>{{"gated_value0"}, {"gated_value1"}}, 1);
+    GatedFileNode* gated_ptr = gated.get();
+    nodes_.emplace_back(std::move(gated));
+    sp<NodeLooperThread> th = new NodeLooperThread(std::move(nodes_));
+    EXPECT_TRUE(th->Start());
+    EXPECT_TRUE(th->isRunning());
+    // Every node is updated in 2 passes on init
+    ASSERT_TRUE(gated_ptr->WaitUpdated(2));
+    const uint32_t init_updates = gated_ptr->updated();
+
+    // Keep the looper inside the gated node's update
+    gated_ptr->SetGate(false);
+    std::vector<NodeAction> gated_actions{{2, 0, 0ms}};
+    EXPECT_TRUE(th->Request(gated_actions, "GATED"));
+    ASSERT_TRUE(gated_ptr->WaitEntered(init_updates + 1));
+
+    // Stay within the request queue capacity: overflowing it falls back to
+    // taking the node lock
+    constexpr int kThreads = 4;
+    constexpr int kIterations = 100;
+    std::vector<NodeAction> actions{{0, 0, 0ms}, {1, 1, 0ms}};
+    std::atomic<int64_t> max_latency_ns{0};
+    std::atomic<int64_t> total_latency_ns{0};
+    std::mutex done_lock;
+    std::condition_variable done_cond;
+    int done = 0;
+    std::vector<std::thread> callers;
+    for (int t = 0; t < kThreads; t++) {
+        callers.emplace_back([&, t]() {
+            const RequestHintId hint_id = th->RegisterHint("HINT_" + std::to_string(t));
+            for (int i = 0; i < kIterations; i++) {
+                auto start = std::chrono::steady_clock::now();
+                bool ok = (i % 2 == 0) ? th->Request(actions, hint_id)
+                                       : th->Cancel(actions, hint_id);
+                auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count();
+                EXPECT_TRUE(ok);
+                total_latency_ns.fetch_add(latency);
+                int64_t prev = max_latency_ns.load();
+                while (latency > prev && !max_latency_ns.compare_exchange_weak(prev, latency)) {
+                }
+            }
+            std::lock_guard<std::mutex> lock(done_lock);
+            done++;
+            done_cond.notify_all();
+        });
+    }
+    // Callers must not wait for the gated node update
+    {
+        std::unique_lock<std::mutex> lock(done_lock);
+        EXPECT_TRUE(done_cond.wait_for(lock, kGATE_TIMEOUT_MS,
+                                       [&] { return done == kThreads; }));
+    }
+    EXPECT_EQ(init_updates, gated_ptr->updated());
+    // Dirty the gated node again so the cycle draining the callers' requests
+    // can be observed; GATED still wins
+    std::vector<NodeAction> sync_actions{{2, 1, 0ms}};
+    EXPECT_TRUE(th->Request(sync_actions, "SYNC"));
+    gated_ptr->SetGate(true);
+    for (auto& c : callers) {
+        c.join();
+    }
+    const int64_t avg_latency_ns = total_latency_ns.load() / (kThreads * kIterations);
+    RecordProperty("avg_latency_ns", std::to_string(avg_latency_ns));
+    RecordProperty("max_latency_ns", std::to_string(max_latency_ns.load()));
+
+    // 2 passes for GATED, then 2 passes for the cycle that drained every
+    // queued request
+    ASSERT_TRUE(gated_ptr->WaitUpdated(init_updates + 4));
+    // Every hint ended with a cancel, so only GATED and SYNC stay active. All
+    // of them were queued while the looper was stuck and coalesced away, so
+    // n0, which is not reset on init, was never written.
+    _VerifyPathValue(files_[0]->path, "");
+    _VerifyPathValue(files_[1]->path, "n1_value2");
+    _VerifyPathValue(tf.path, "gated_value0");
+    th->Stop();
+    EXPECT_FALSE(th->isRunning());
+}
+
 }  // namespace perfmgr
 }  // namespace android
@@ -160,5 +160,99 @@ TEST(RequestGroupTest, RemoveRequestTestMultiple) {
     EXPECT_EQ(true, active);
 }
 
+// Test InternHint() and GetHintName()
+TEST(RequestGroupTest, InternHintTest) {
+    RequestHintId interaction = InternHint("INTERACTION");
+    RequestHintId launch = InternHint("LAUNCH");
+    EXPECT_NE(interaction, launch);
+    EXPECT_EQ(interaction, InternHint("INTERACTION"));
+    EXPECT_EQ("INTERACTION", GetHintName(interaction));
+    EXPECT_EQ("LAUNCH", GetHintName(launch));
+    EXPECT_EQ("", GetHintName(kInvalidRequestHintId));
+    // String and id requests refer to the same hint
+    RequestGroup req("");
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(req.AddRequest(interaction, start + 500ms));
+    EXPECT_FALSE(req.AddRequest("INTERACTION", start + 600ms));
+    EXPECT_TRUE(req.RemoveRequest("INTERACTION"));
+    EXPECT_FALSE(req.RemoveRequest(interaction));
+}
+
+// Test 1000 concurrent hints added out of deadline order
+TEST(RequestGroupTest, AddRequestScaleTest) {
+    constexpr int kHints = 1000;
+    RequestGroup req("");
+    std::vector<RequestHintId> hint_ids;
+    for (int i = 0; i < kHints; i++) {
+        hint_ids.push_back(InternHint("SCALE_" + std::to_string(i)));
+    }
+    auto start = std::chrono::steady_clock::now();
+    // Hint i lasts 10s + i * 10ms, added in a scattered order
+    for (int i = 0; i < kHints; i++) {
+        int h = (i * 7) % kHints;
+        EXPECT_TRUE(req.AddRequest(hint_ids[h], start + 10000ms + h * 10ms));
+    }
+    EXPECT_EQ(static_cast<std::size_t>(kHints), req.GetRequestCount());
+    std::chrono::milliseconds expire_time;
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(10000, expire_time.count(), kTIMING_TOLERANCE_MS);
+    // Extending the soonest hint moves it to the back
+    EXPECT_FALSE(req.AddRequest(hint_ids[0], start + 30000ms));
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(10010, expire_time.count(), kTIMING_TOLERANCE_MS);
+    // Remove the first half
+    for (int i = 0; i < kHints / 2; i++) {
+        EXPECT_TRUE(req.RemoveRequest(hint_ids[i]));
+    }
+    EXPECT_EQ(static_cast<std::size_t>(kHints / 2), req.GetRequestCount());
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(10000 + kHints / 2 * 10, expire_time.count(), kTIMING_TOLERANCE_MS);
+}
+
+// Test 1000 concurrent hints expiring
+TEST(RequestGroupTest, ExpireRequestScaleTest) {
+    constexpr int kHints = 1000;
+    RequestGroup req("");
+    auto start = std::chrono::steady_clock::now();
+    // Even hints last 5ms, odd hints last 5000ms
+    for (int i = 0; i < kHints; i++) {
+        auto duration = (i % 2 == 0) ? 5ms : 5000ms;
+        EXPECT_TRUE(req.AddRequest("SCALE_" + std::to_string(i), start + duration));
+    }
+    std::this_thread::sleep_for(15ms);
+    std::chrono::milliseconds expire_time;
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(5000 - 15, expire_time.count(), kTIMING_TOLERANCE_MS);
+    EXPECT_EQ(static_cast<std::size_t>(kHints / 2), req.GetRequestCount());
+    for (int i = 1; i < kHints; i += 2) {
+        EXPECT_TRUE(req.RemoveRequest("SCALE_" + std::to_string(i)));
+    }
+    EXPECT_FALSE(req.GetExpireTime(&expire_time));
+    EXPECT_EQ(std::chrono::milliseconds::max(), expire_time);
+}
+
+// Test re-requesting and cancelling a hint 1000 times keeps one request
+TEST(RequestGroupTest, ChurnRequestScaleTest) {
+    constexpr int kRounds = 1000;
+    RequestGroup req("");
+    const RequestHintId churn = InternHint("CHURN");
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(req.AddRequest("STEADY", start + 20000ms));
+    for (int i = 0; i < kRounds; i++) {
+        // Extended each round, then cancelled and added back every 10th
+        EXPECT_EQ(i % 10 == 0, req.AddRequest(churn, start + 1000ms + i * 1ms));
+        if (i % 10 == 9) {
+            EXPECT_TRUE(req.RemoveRequest(churn));
+        }
+    }
+    EXPECT_EQ(1u, req.GetRequestCount());
+    std::chrono::milliseconds expire_time;
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(20000, expire_time.count(), kTIMING_TOLERANCE_MS);
+    EXPECT_TRUE(req.AddRequest(churn, start + 500ms));
+    EXPECT_TRUE(req.GetExpireTime(&expire_time));
+    EXPECT_NEAR(500, expire_time.count(), kTIMING_TOLERANCE_MS);
+}
+
 }  // namespace perfmgr
 }  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specic language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "perfmgr/RequestQueue.h"
+
+namespace android {
+namespace perfmgr {
+
+static inline NodeRequest _MakeRequest(uint32_t node_index, uint32_t hint_index) {
+    return {NodeRequestType::Add, node_index, 0, static_cast<RequestHintId>(hint_index),
+            ReqTime::max()};
+}
+
+static inline uint32_t _HintIndex(const NodeRequest& r) {
+    return static_cast<uint32_t>(r.hint_id);
+}
+
+// Test capacity rounding
+TEST(RequestQueueTest, CapacityTest) {
+    EXPECT_EQ(2u, RequestQueue(0).GetCapacity());
+    EXPECT_EQ(8u, RequestQueue(8).GetCapacity());
+    EXPECT_EQ(16u, RequestQueue(9).GetCapacity());
+}
+
+// Test FIFO order, full and empty
+TEST(RequestQueueTest, PushPopTest) {
+    RequestQueue q(4);
+    NodeRequest r;
+    EXPECT_FALSE(q.Pop(&r));
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_TRUE(q.Push(_MakeRequest(i, i + 10)));
+    }
+    EXPECT_FALSE(q.Push(_MakeRequest(4, 14)));
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_TRUE(q.Pop(&r));
+        EXPECT_EQ(i, r.node_index);
+        EXPECT_EQ(i + 10, _HintIndex(r));
+    }
+    EXPECT_FALSE(q.Pop(&r));
+    // Wrap around
+    EXPECT_TRUE(q.Push(_MakeRequest(5, 15)));
+    EXPECT_TRUE(q.Pop(&r));
+    EXPECT_EQ(5u, r.node_index);
+}
+
+// Test multiple producers with a concurrent consumer
+TEST(RequestQueueTest, MultiProducerTest) {
+    constexpr uint32_t kProducers = 4;
+    constexpr uint32_t kPerProducer = 10000;
+    RequestQueue q(64);
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < kProducers; p++) {
+        producers.emplace_back([&q, p]() {
+            for (uint32_t i = 0; i < kPerProducer; i++) {
+                while (!q.Push(_MakeRequest(i, p))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    // Requests from each producer must come out in order
+    std::vector<uint32_t> next(kProducers, 0);
+    uint32_t popped = 0;
+    NodeRequest r;
+    while (popped < kProducers * kPerProducer) {
+        if (!q.Pop(&r)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_LT(_HintIndex(r), kProducers);
+        EXPECT_EQ(next[_HintIndex(r)], r.node_index);
+        next[_HintIndex(r)] = r.node_index + 1;
+        popped++;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_FALSE(q.Pop(&r));
+}
+
+}  // namespace perfmgr
+}  // namespace android
@@ -16,10 +16,21 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/strings.h>
 #include <getopt.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <json/writer.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
 #include <thread>
 
 #include "perfmgr/HintManager.h"
@@ -52,6 +63,336 @@ class NodeVerifier : public HintManager {
     void operator=(NodeVerifier const &) = delete;
 };
 
+
+// TraceReplayer drives a HintManager with a recorded trace of hints, against
+// a copy of the config whose nodes are redirected to files under a scratch
+// directory, and reports how libperfmgr kept up.
+class TraceReplayer : public HintManager {
+  public:
+    static bool Replay(const std::string& config_path, const std::string& trace_path,
+                       const std::string& root_dir, double speed) {
+        std::vector<TraceEvent> events;
+        if (!ReadTrace(trace_path, &events)) {
+            return false;
+        }
+        std::string fake_dir = root_dir + "/perfmgr_replay_XXXXXX";
+        if (!mkdtemp(fake_dir.data())) {
+            PLOG(ERROR) << "Failed to create replay directory under " << root_dir;
+            return false;
+        }
+        struct statfs fs;
+        if (statfs(fake_dir.c_str(), &fs) == 0 && fs.f_type != TMPFS_MAGIC) {
+            LOG(WARNING) << root_dir << " is not tmpfs, writes include disk latency";
+        }
+        std::vector<std::string> created;
+        bool ret = ReplayIn(config_path, events, fake_dir, speed, &created);
+        // Remove the fake tree, deepest paths first
+        std::sort(created.begin(), created.end(), std::greater<std::string>());
+        for (const auto& path : created) {
+            remove(path.c_str());
+        }
+        rmdir(fake_dir.c_str());
+        return ret;
+    }
+
+  private:
+    TraceReplayer() = delete;
+    TraceReplayer(TraceReplayer const&) = delete;
+    void operator=(TraceReplayer const&) = delete;
+
+    // duration_ms > 0 does the hint for that long, 0 for its configured
+    // durations, and < 0 ends it, as Power::setBoost does.
+    struct TraceEvent {
+        uint64_t timestamp_ms;
+        std::string hint;
+        int64_t duration_ms;
+    };
+
+    // Requests expected on one node, by hint, as (value index, end time)
+    using NodeModel = std::map<std::string, std::pair<std::size_t, ReqTime>>;
+
+    // Expected node requests, following HintManager semantics
+    struct Model {
+        const std::unordered_map<std::string, Hint>* actions;
+        std::vector<NodeModel> nodes;
+        std::map<std::string, bool> disabled;
+
+        void DoHint(const std::string& hint, ReqTime now, const std::chrono::milliseconds* timeout) {
+            auto it = actions->find(hint);
+            if (it == actions->end() || disabled[hint]) {
+                return;
+            }
+            for (const auto& a : it->second.node_actions) {
+                const std::chrono::milliseconds t = timeout ? *timeout : a.timeout_ms;
+                const ReqTime end = t == std::chrono::milliseconds::zero() ? ReqTime::max()
+                                                                          : now + t;
+                auto [req, added] = nodes[a.node_index].try_emplace(hint, a.value_index, end);
+                if (!added) {
+                    req->second.second = std::max(req->second.second, end);
+                }
+            }
+            for (const auto& a : it->second.hint_actions) {
+                if (a.type == HintActionType::DoHint) {
+                    DoHint(a.value, now, nullptr);
+                } else if (a.type == HintActionType::EndHint) {
+                    EndHint(a.value);
+                } else if (a.type == HintActionType::MaskHint) {
+                    disabled[a.value] = true;
+                }
+            }
+        }
+
+        void EndHint(const std::string& hint) {
+            auto it = actions->find(hint);
+            if (it == actions->end()) {
+                return;
+            }
+            for (auto& node : nodes) {
+                node.erase(hint);
+            }
+            for (const auto& a : it->second.hint_actions) {
+                if (a.type == HintActionType::MaskHint) {
+                    disabled[a.value] = false;
+                }
+            }
+        }
+    };
+
+    static bool ReadTrace(const std::string& trace_path, std::vector<TraceEvent>* events) {
+        std::string trace;
+        if (!android::base::ReadFileToString(trace_path, &trace)) {
+            LOG(ERROR) << "Failed to read trace from " << trace_path;
+            return false;
+        }
+        std::size_t line_no = 0;
+        for (const auto& line : android::base::Split(trace, "\n")) {
+            ++line_no;
+            const std::string l = android::base::Trim(line);
+            if (l.empty() || l[0] == '#') {
+                continue;
+            }
+            std::istringstream in(l);
+            TraceEvent e;
+            if (!(in >> e.timestamp_ms >> e.hint >> e.duration_ms)) {
+                LOG(ERROR) << "Invalid trace line " << line_no << ": " << l;
+                return false;
+            }
+            events->push_back(std::move(e));
+        }
+        std::stable_sort(events->begin(), events->end(),
+                         [](const TraceEvent& a, const TraceEvent& b) {
+                             return a.timestamp_ms < b.timestamp_ms;
+                         });
+        if (events->empty()) {
+            LOG(ERROR) << "No events in trace " << trace_path;
+            return false;
+        }
+        return true;
+    }
+
+    // Create path and its missing parent directories under dir, recording
+    // what was created.
+    static bool CreateFile(const std::string& dir, const std::string& path,
+                           std::vector<std::string>* created) {
+        std::size_t pos = dir.size();
+        while ((pos = path.find('/', pos + 1)) != std::string::npos) {
+            const std::string parent = path.substr(0, pos);
+            if (mkdir(parent.c_str(), 0755) == 0) {
+                created->push_back(parent);
+            } else if (errno != EEXIST) {
+                PLOG(ERROR) << "Failed to create " << parent;
+                return false;
+            }
+        }
+        if (!android::base::WriteStringToFile("", path)) {
+            PLOG(ERROR) << "Failed to create " << path;
+            return false;
+        }
+        created->push_back(path);
+        return true;
+    }
+
+    // Write the config at config_path with its nodes redirected under
+    // fake_dir to fake_config. Property nodes become files too.
+    static bool FakeConfig(const std::string& config_path, const std::string& fake_dir,
+                           const std::string& fake_config, std::vector<std::string>* created) {
+        std::string json_doc;
+        if (!android::base::ReadFileToString(config_path, &json_doc)) {
+            LOG(ERROR) << "Failed to read JSON config from " << config_path;
+            return false;
+        }
+        Json::Value root;
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        std::string errorMessage;
+        if (!reader->parse(&*json_doc.begin(), &*json_doc.end(), &root, &errorMessage)) {
+            LOG(ERROR) << "Failed to parse JSON config: " << errorMessage;
+            return false;
+        }
+        Json::Value& nodes = root["Nodes"];
+        std::set<std::string> property_nodes;
+        for (Json::Value::ArrayIndex i = 0; i < nodes.size(); ++i) {
+            std::string path;
+            if (nodes[i]["Type"].asString() == "Property") {
+                // File nodes can't have empty values, which clear properties
+                path = fake_dir + "/property/" + nodes[i]["Name"].asString();
+                nodes[i]["Type"] = "File";
+                for (auto& value : nodes[i]["Values"]) {
+                    if (value.asString().empty()) {
+                        value = kEmptyPropertyValue;
+                    }
+                }
+                property_nodes.insert(nodes[i]["Name"].asString());
+            } else {
+                path = fake_dir + nodes[i]["Path"].asString();
+            }
+            nodes[i]["Path"] = path;
+            if (!CreateFile(fake_dir, path, created)) {
+                return false;
+            }
+        }
+        for (auto& action : root["Actions"]) {
+            if (property_nodes.count(action["Node"].asString()) &&
+                action["Value"].asString().empty()) {
+                action["Value"] = kEmptyPropertyValue;
+            }
+        }
+        Json::StreamWriterBuilder writer;
+        if (!android::base::WriteStringToFile(Json::writeString(writer, root), fake_config)) {
+            LOG(ERROR) << "Failed to write " << fake_config;
+            return false;
+        }
+        created->push_back(fake_config);
+        return true;
+    }
+
+    static uint64_t CountWrites(const HintManager& hm, uint64_t* failures) {
+        std::string stats;
+        hm.ExportStats(&stats);
+        const StatsHeader* header = reinterpret_cast<const StatsHeader*>(stats.data());
+        const NodeStatsRecord* records = reinterpret_cast<const NodeStatsRecord*>(
+                stats.data() + sizeof(StatsHeader) + header->hint_count * sizeof(HintStatsRecord));
+        uint64_t writes = 0;
+        *failures = 0;
+        for (uint32_t i = 0; i < header->node_count; i++) {
+            writes += records[i].writes;
+            *failures += records[i].write_failures;
+        }
+        return writes;
+    }
+
+    static bool ReplayIn(const std::string& config_path, const std::vector<TraceEvent>& events,
+                         const std::string& fake_dir, double speed,
+                         std::vector<std::string>* created) {
+        const std::string fake_config = fake_dir + "/powerhint.json";
+        if (!FakeConfig(config_path, fake_dir, fake_config, created)) {
+            return false;
+        }
+        // Parsed separately to model the expected node values
+        std::string json_doc;
+        android::base::ReadFileToString(fake_config, &json_doc);
+        std::vector<std::unique_ptr<Node>> nodes = ParseNodes(json_doc);
+        std::unordered_map<std::string, Hint> actions = ParseActions(json_doc, nodes);
+        std::unique_ptr<HintManager> hm = GetFromJSON(fake_config);
+        if (!hm || nodes.empty() || actions.empty()) {
+            LOG(ERROR) << "Failed to load JSON config " << config_path;
+            return false;
+        }
+        Model model{&actions, std::vector<NodeModel>(nodes.size()), {}};
+        // Let the looper apply the initial node values
+        std::this_thread::sleep_for(kSettleTime);
+        uint64_t failures_start;
+        const uint64_t writes_start = CountWrites(*hm, &failures_start);
+        const uint64_t wakes_start = hm->GetLooperWakeCount();
+
+        std::vector<std::chrono::nanoseconds> latencies;
+        latencies.reserve(events.size());
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& e : events) {
+            if (speed > 0) {
+                std::this_thread::sleep_until(
+                        start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::duration<double, std::milli>(
+                                                e.timestamp_ms / speed)));
+            }
+            const std::chrono::milliseconds timeout(e.duration_ms);
+            const auto t0 = std::chrono::steady_clock::now();
+            if (e.duration_ms > 0) {
+                hm->DoHint(e.hint, timeout);
+            } else if (e.duration_ms == 0) {
+                hm->DoHint(e.hint);
+            } else {
+                hm->EndHint(e.hint);
+            }
+            latencies.push_back(std::chrono::steady_clock::now() - t0);
+            if (e.duration_ms >= 0) {
+                model.DoHint(e.hint, t0, e.duration_ms > 0 ? &timeout : nullptr);
+            } else {
+                model.EndHint(e.hint);
+            }
+        }
+        std::this_thread::sleep_for(kSettleTime);
+        const auto end = std::chrono::steady_clock::now();
+        uint64_t failures_end;
+        const uint64_t writes = CountWrites(*hm, &failures_end) - writes_start;
+        const uint64_t wakes = hm->GetLooperWakeCount() - wakes_start;
+
+        // Compare node values with the model, skipping nodes with a request
+        // expiring too close to now to tell which value is right
+        std::size_t checked = 0, skipped = 0, mismatches = 0;
+        for (std::size_t i = 0; i < nodes.size(); i++) {
+            std::size_t expected = nodes[i]->GetDefaultIndex();
+            bool ambiguous = false;
+            for (const auto& [hint, req] : model.nodes[i]) {
+                if (req.second > end + kSettleTime) {
+                    expected = std::min(expected, req.first);
+                } else if (req.second > end - kSettleTime) {
+                    ambiguous = true;
+                }
+            }
+            if (ambiguous) {
+                ++skipped;
+                continue;
+            }
+            ++checked;
+            std::string value;
+            android::base::ReadFileToString(nodes[i]->GetPath(), &value);
+            value = android::base::Trim(value);
+            // Nodes not reset on init are left empty until first requested
+            if (value.empty() && expected == nodes[i]->GetDefaultIndex()) {
+                continue;
+            }
+            const std::string expected_value = nodes[i]->GetValues()[expected];
+            if (value != expected_value) {
+                ++mismatches;
+                LOG(ERROR) << "Node " << nodes[i]->GetName() << " is '" << value
+                           << "', expected '" << expected_value << "'";
+            }
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile_us = [&latencies](double p) {
+            const std::size_t i = std::min(latencies.size() - 1,
+                                           static_cast<std::size_t>(p * latencies.size()));
+            return std::chrono::duration_cast<std::chrono::microseconds>(latencies[i]).count();
+        };
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        LOG(INFO) << "Replayed " << events.size() << " events in " << seconds << "s";
+        LOG(INFO) << "Hint call latency us: p50 " << percentile_us(0.5) << ", p90 "
+                  << percentile_us(0.9) << ", p99 " << percentile_us(0.99) << ", max "
+                  << percentile_us(1.0);
+        LOG(INFO) << "Looper wakes: " << wakes << ", node writes: " << writes << " ("
+                  << writes / seconds << "/s), write failures: "
+                  << failures_end - failures_start;
+        LOG(INFO) << "Final values: " << checked << " nodes checked, " << mismatches
+                  << " mismatched, " << skipped << " skipped";
+        return mismatches == 0;
+    }
+
+    static constexpr std::chrono::milliseconds kSettleTime = std::chrono::milliseconds(100);
+    static constexpr const char kEmptyPropertyValue[] = "<empty>";
+};
+
 }  // namespace perfmgr
 }  // namespace android
 
@@ -74,6 +415,17 @@ static void printUsage(const char* exec_name) {
         "       do only the specific hint\n\n"
         "   --hint_duration, -d  [duration]\n"
         "       duration in ms for each hint\n\n"
+        "   --compile, -o  [PATH]\n"
+        "       compile Json config into a binary snapshot at PATH\n\n"
+        "   --fanout, -f\n"
+        "       print the flattened fan-out of each hint\n\n"
+        "   --replay, -r  [PATH]\n"
+        "       replay a trace of 'timestamp_ms hint duration_ms' lines against\n"
+        "       fake nodes, duration 0 for the configured one and -1 to end\n\n"
+        "   --speed, -s  [factor]\n"
+        "       replay speed factor, 0 to replay without waiting\n\n"
+        "   --replay_root, -R  [PATH]\n"
+        "       directory to create fake nodes in, preferably on tmpfs\n\n"
         "   --help, -h\n"
         "       print this message\n\n"
         "   --verbose, -v\n"
@@ -82,6 +434,43 @@ static void printUsage(const char* exec_name) {
     LOG(INFO) << usage;
 }
 
+static bool compileConfig(const std::string& json_file, const std::string& snapshot_file) {
+    std::string json_doc;
+    if (!android::base::ReadFileToString(json_file, &json_doc)) {
+        LOG(ERROR) << "Failed to read JSON config from " << json_file;
+        return false;
+    }
+    std::string snapshot;
+    if (!android::perfmgr::HintManager::CompileSnapshot(json_doc, &snapshot)) {
+        LOG(ERROR) << "Failed to compile JSON config";
+        return false;
+    }
+    if (!android::base::WriteStringToFile(snapshot, snapshot_file)) {
+        LOG(ERROR) << "Failed to write snapshot to " << snapshot_file;
+        return false;
+    }
+    LOG(INFO) << "Compiled " << snapshot.size() << " bytes snapshot to " << snapshot_file;
+    return true;
+}
+
+static bool printFanOut(const std::string& json_file, const std::string& hint_name) {
+    std::unique_ptr<android::perfmgr::HintManager> hm =
+        android::perfmgr::HintManager::GetFromJSON(json_file, false);
+    if (!hm.get()) {
+        LOG(ERROR) << "Failed to Parse JSON config";
+        return false;
+    }
+    std::vector<std::string> hints = hm->GetHints();
+    for (const auto& hint : hints) {
+        if (!hint_name.empty() && hint_name != hint) continue;
+        android::perfmgr::HintFanOut fan_out = hm->GetHintFanOut(hint);
+        LOG(INFO) << hint << ": " << fan_out.node_requests << " node requests, "
+                  << fan_out.chained_hints << " chained hints, " << fan_out.ended_hints
+                  << " ended hints, " << fan_out.mask_ops << " mask ops";
+    }
+    return true;
+}
+
 static void execConfig(const std::string& json_file,
                        const std::string& hint_name, uint64_t hint_duration) {
     std::unique_ptr<android::perfmgr::HintManager> hm =
@@ -111,7 +500,12 @@ int main(int argc, char* argv[]) {
 
     std::string config_path;
     std::string hint_name;
+    std::string snapshot_path;
     bool exec_hint = false;
+    bool fan_out = false;
+    std::string trace_path;
+    std::string replay_root = "/data/local/tmp";
+    double replay_speed = 1.0;
     uint64_t hint_duration = 100;
 
     while (true) {
@@ -120,13 +514,18 @@ int main(int argc, char* argv[]) {
             {"exec_hint", no_argument, nullptr, 'e'},
             {"hint_name", required_argument, nullptr, 'i'},
             {"hint_duration", required_argument, nullptr, 'd'},
+            {"compile", required_argument, nullptr, 'o'},
+            {"fanout", no_argument, nullptr, 'f'},
+            {"replay", required_argument, nullptr, 'r'},
+            {"speed", required_argument, nullptr, 's'},
+            {"replay_root", required_argument, nullptr, 'R'},
             {"help", no_argument, nullptr, 'h'},
             {"verbose", no_argument, nullptr, 'v'},
             {0, 0, 0, 0}  // termination of the option list
         };
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "c:ei:d:hv", opts, &option_index);
+        int c = getopt_long(argc, argv, "c:ei:d:o:fr:s:R:hv", opts, &option_index);
         if (c == -1) {
             break;
         }
@@ -144,6 +543,21 @@ int main(int argc, char* argv[]) {
             case 'd':
                 hint_duration = strtoul(optarg, NULL, 10);
                 break;
+            case 'o':
+                snapshot_path = optarg;
+                break;
+            case 'f':
+                fan_out = true;
+                break;
+            case 'r':
+                trace_path = optarg;
+                break;
+            case 's':
+                replay_speed = strtod(optarg, NULL);
+                break;
+            case 'R':
+                replay_root = optarg;
+                break;
             case 'v':
                 android::base::SetMinimumLogSeverity(android::base::VERBOSE);
                 break;
@@ -162,6 +576,21 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (!snapshot_path.empty()) {
+        return compileConfig(config_path, snapshot_path) ? 0 : 1;
+    }
+
+    if (!trace_path.empty()) {
+        return android::perfmgr::TraceReplayer::Replay(config_path, trace_path, replay_root,
+                                                       replay_speed)
+                       ? 0
+                       : 1;
+    }
+
+    if (fan_out) {
+        return printFanOut(config_path, hint_name) ? 0 : 1;
+    }
+
     if (exec_hint) {
         execConfig(config_path, hint_name, hint_duration);
         return 0;
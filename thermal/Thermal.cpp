@@ -638,6 +638,28 @@ Return<void> Thermal::debug(const hidl_handle &handle, const hidl_vec<hidl_strin
                     dump_buf << "]" << std::endl;
                 }
             }
+            {
+                dump_buf << "SensorReadTimeout:" << std::endl;
+                const auto now = boot_clock::now();
+                const auto &map = thermal_helper_.GetSensorStatusMap();
+                for (const auto &name_status_pair : map) {
+                    if (!name_status_pair.second.reading_timed_out) {
+                        continue;
+                    }
+                    dump_buf << " Name: " << name_status_pair.first;
+                    if (name_status_pair.second.reading_valid) {
+                        dump_buf << " LastReading: " << name_status_pair.second.reading
+                                 << " Age: "
+                                 << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            now - name_status_pair.second.reading_time)
+                                            .count()
+                                 << "ms";
+                    } else {
+                        dump_buf << " LastReading: N/A";
+                    }
+                    dump_buf << std::endl;
+                }
+            }
             {
                 dump_buf << "SendCallback" << std::endl;
                 dump_buf << "  Enabled List: ";
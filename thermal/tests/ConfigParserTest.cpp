@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "utils/config_parser.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+constexpr size_t kNUM_SHIPPED_CDEVS = 5;
+
+// Write a config with a CPU cooling device using state2power to a file
+void WriteCdevConfig(const TemporaryFile &file, const std::string &state2power) {
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            R"({"CoolingDevices": [{"Name": "thermal-cpufreq-0", "Type": "CPU",
+                                    "State2Power": )" +
+                    state2power + "}]}",
+            file.path));
+}
+
+// Test a state2power table is valid when its power never increases with
+// state and has no NaN entry
+TEST(ConfigParserTest, State2PowerValidTest) {
+    EXPECT_TRUE(IsState2PowerValid({}));
+    EXPECT_TRUE(IsState2PowerValid({1000.0f}));
+    EXPECT_TRUE(IsState2PowerValid({3000.0f, 2000.0f, 1500.0f, 0.0f}));
+    EXPECT_TRUE(IsState2PowerValid({3000.0f, 2000.0f, 2000.0f, 0.0f}));
+    EXPECT_TRUE(IsState2PowerValid({500.0f, 500.0f, 500.0f}));
+
+    EXPECT_FALSE(IsState2PowerValid({2000.0f, 3000.0f}));
+    EXPECT_FALSE(IsState2PowerValid({3000.0f, 2000.0f, 1500.0f, 1501.0f}));
+    EXPECT_FALSE(IsState2PowerValid({0.0f, 1000.0f, 2000.0f}));
+    EXPECT_FALSE(IsState2PowerValid({NAN}));
+    EXPECT_FALSE(IsState2PowerValid({NAN, 2000.0f, 1000.0f}));
+    EXPECT_FALSE(IsState2PowerValid({3000.0f, NAN, 1000.0f}));
+    EXPECT_FALSE(IsState2PowerValid({3000.0f, 2000.0f, NAN}));
+}
+
+// Test the shipped cooling devices, which have no state2power, are parsed
+TEST(ConfigParserTest, ShippedCoolingDeviceTest) {
+    const auto cdevs = ParseCoolingDevice(android::base::GetExecutableDirectory() +
+                                          "/thermal_info_config.json");
+    ASSERT_EQ(kNUM_SHIPPED_CDEVS, cdevs.size());
+    for (const auto &cdev_info_pair : cdevs) {
+        EXPECT_TRUE(cdev_info_pair.second.state2power.empty()) << cdev_info_pair.first;
+    }
+}
+
+// Test a config is rejected if a cooling device's power increases with
+// state, and kept as is otherwise
+TEST(ConfigParserTest, CoolingDeviceState2PowerTest) {
+    TemporaryFile config_file;
+
+    WriteCdevConfig(config_file, "[3000, 2000, 2000, 0]");
+    const auto cdevs = ParseCoolingDevice(config_file.path);
+    ASSERT_EQ(1u, cdevs.size());
+    EXPECT_EQ(std::vector<float>({3000.0f, 2000.0f, 2000.0f, 0.0f}),
+              cdevs.at("thermal-cpufreq-0").state2power);
+
+    WriteCdevConfig(config_file, "[3000, 2000, 2500, 0]");
+    EXPECT_TRUE(ParseCoolingDevice(config_file.path).empty());
+
+    WriteCdevConfig(config_file, R"([3000, "NAN", 1000])");
+    EXPECT_TRUE(ParseCoolingDevice(config_file.path).empty());
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
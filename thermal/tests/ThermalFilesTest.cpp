@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/thermal_files.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using std::literals::chrono_literals::operator""ms;
+
+constexpr size_t kNUM_ZONES = 40;
+
+// Fake sysfs tree of thermal_zone directories, each with a temp node
+class ThermalFilesTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        for (size_t i = 0; i < kNUM_ZONES; i++) {
+            const std::string zone = ZonePath(i);
+            ASSERT_EQ(0, mkdir(zone.c_str(), 0755));
+            WriteTemp(i, std::to_string(30000 + i) + "\n");
+            ASSERT_TRUE(files_.addThermalFile(ZoneName(i), zone + "/temp"));
+        }
+    }
+
+    std::string ZonePath(size_t i) const {
+        return android::base::StringPrintf("%s/thermal_zone%zu", dir_.path, i);
+    }
+
+    static std::string ZoneName(size_t i) { return "zone" + std::to_string(i); }
+
+    void WriteTemp(size_t i, const std::string &content) {
+        ASSERT_TRUE(android::base::WriteStringToFile(content, ZonePath(i) + "/temp"));
+    }
+
+    TemporaryDir dir_;
+    ThermalFiles files_;
+};
+
+// Test the content is read as a string with surrounding whitespace stripped,
+// and as numbers
+TEST_F(ThermalFilesTest, ReadTest) {
+    EXPECT_EQ(kNUM_ZONES, files_.getNumThermalFiles());
+    EXPECT_EQ(ZonePath(3) + "/temp", files_.getThermalFilePath(ZoneName(3)));
+
+    std::string data;
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(3), &data));
+    EXPECT_EQ("30003", data);
+    float value = NAN;
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(4), &value));
+    EXPECT_EQ(30004.0f, value);
+    int int_value = 0;
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(5), &int_value));
+    EXPECT_EQ(30005, int_value);
+
+    WriteTemp(6, "  -1500 \n");
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(6), &value));
+    EXPECT_EQ(-1500.0f, value);
+    WriteTemp(7, "36.5\n");
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(7), &value));
+    EXPECT_EQ(36.5f, value);
+}
+
+// Test unknown names, missing nodes and content that is not a number fail
+TEST_F(ThermalFilesTest, ReadFailTest) {
+    std::string data = "stale";
+    EXPECT_FALSE(files_.readThermalFile("unknown", &data));
+    EXPECT_EQ("", data);
+    float value;
+    EXPECT_FALSE(files_.readThermalFile("unknown", &value));
+    EXPECT_TRUE(files_.addThermalFile("missing", ZonePath(kNUM_ZONES) + "/temp"));
+    EXPECT_FALSE(files_.readThermalFile("missing", &value));
+    EXPECT_FALSE(files_.addThermalFile(ZoneName(0), "/dev/null"));
+
+    WriteTemp(1, "enabled\n");
+    EXPECT_FALSE(files_.readThermalFile(ZoneName(1), &value));
+    int int_value;
+    EXPECT_FALSE(files_.readThermalFile(ZoneName(1), &int_value));
+    WriteTemp(2, "\n");
+    EXPECT_FALSE(files_.readThermalFile(ZoneName(2), &value));
+    EXPECT_TRUE(files_.readThermalFile(ZoneName(2), &data));
+    EXPECT_EQ("", data);
+}
+
+// Test a node kept open is re-read from the start after being updated in place,
+// also when the new content is shorter
+TEST_F(ThermalFilesTest, UpdateTest) {
+    float value;
+    for (int temp : {45000, 9, 123456789, -7}) {
+        WriteTemp(0, std::to_string(temp) + "\n");
+        EXPECT_TRUE(files_.readThermalFile(ZoneName(0), &value));
+        EXPECT_EQ(static_cast<float>(temp), value);
+    }
+}
+
+// Test a node which does not exist yet is read once it appears
+TEST_F(ThermalFilesTest, LateNodeTest) {
+    const std::string zone = ZonePath(kNUM_ZONES);
+    ASSERT_TRUE(files_.addThermalFile("late", zone + "/temp"));
+    float value;
+    EXPECT_FALSE(files_.readThermalFile("late", &value));
+    ASSERT_EQ(0, mkdir(zone.c_str(), 0755));
+    ASSERT_TRUE(android::base::WriteStringToFile("51000\n", zone + "/temp"));
+    EXPECT_TRUE(files_.readThermalFile("late", &value));
+    EXPECT_EQ(51000.0f, value);
+}
+
+// Test a batch of reads returns each node's value, and fails unknown names
+TEST_F(ThermalFilesTest, ReadFilesTest) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < kNUM_ZONES; i++) {
+        names.push_back(ZoneName(i));
+    }
+    names.push_back("unknown");
+    for (int round = 0; round < 3; round++) {
+        std::vector<ThermalFileRead> reads;
+        for (const auto &name : names) {
+            reads.push_back({.thermal_name = name,
+                             .value = NAN,
+                             .status = ThermalFileReadStatus::FAILED});
+        }
+        files_.readThermalFiles(&reads, 1000ms);
+        for (size_t i = 0; i < kNUM_ZONES; i++) {
+            EXPECT_EQ(ThermalFileReadStatus::OK, reads[i].status) << names[i];
+            EXPECT_EQ(static_cast<float>(30000 + i + round), reads[i].value) << names[i];
+            WriteTemp(i, std::to_string(30000 + i + round + 1));
+        }
+        EXPECT_EQ(ThermalFileReadStatus::FAILED, reads[kNUM_ZONES].status);
+        EXPECT_TRUE(std::isnan(reads[kNUM_ZONES].value));
+    }
+}
+
+// Test concurrent readers of the same nodes, as from binder threads and the
+// watcher, all get the node values
+TEST_F(ThermalFilesTest, ConcurrentReadTest) {
+    std::vector<std::thread> readers;
+    std::atomic<int> failures(0);
+    for (int t = 0; t < 8; t++) {
+        readers.emplace_back([this, &failures] {
+            for (int round = 0; round < 50; round++) {
+                for (size_t i = 0; i < kNUM_ZONES; i++) {
+                    float value;
+                    if (!files_.readThermalFile(ZoneName(i), &value) ||
+                        value != static_cast<float>(30000 + i)) {
+                        failures++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(0, failures.load());
+}
+
+// Test a node stalled in a read, simulated by a named pipe without a writer
+// on which the read blocks in open, only times out its own reads. The other
+// nodes, also ones opened for the first time, are read meanwhile and the
+// files can be destroyed without waiting for the stalled read.
+TEST_F(ThermalFilesTest, StalledNodeTest) {
+    const std::string fifo = std::string(dir_.path) + "/stalled";
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0644));
+    auto files = std::make_unique<ThermalFiles>();
+    ASSERT_TRUE(files->addThermalFile("stalled", fifo));
+    std::vector<std::string> names = {"stalled"};
+    for (size_t i = 0; i < kNUM_ZONES; i++) {
+        names.push_back(ZoneName(i));
+        ASSERT_TRUE(files->addThermalFile(ZoneName(i), ZonePath(i) + "/temp"));
+    }
+
+    for (int round = 0; round < 3; round++) {
+        std::vector<ThermalFileRead> reads;
+        // The last zone is only read on its own below
+        for (size_t i = 0; i < kNUM_ZONES; i++) {
+            reads.push_back({.thermal_name = names[i],
+                             .value = NAN,
+                             .status = ThermalFileReadStatus::FAILED});
+        }
+        const auto start = std::chrono::steady_clock::now();
+        files->readThermalFiles(&reads, 100ms);
+        // Later calls do not queue up behind the stalled read, so need not wait
+        if (round == 0) {
+            EXPECT_GT(std::chrono::steady_clock::now(), start + 50ms);
+        }
+        EXPECT_LT(std::chrono::steady_clock::now(), start + 1000ms);
+        EXPECT_EQ(ThermalFileReadStatus::TIMEOUT, reads[0].status);
+        for (size_t i = 1; i < kNUM_ZONES; i++) {
+            EXPECT_EQ(ThermalFileReadStatus::OK, reads[i].status) << names[i];
+            EXPECT_EQ(static_cast<float>(30000 + i - 1), reads[i].value) << names[i];
+        }
+    }
+    float value;
+    EXPECT_TRUE(files->readThermalFile(names[kNUM_ZONES], &value));
+    EXPECT_EQ(static_cast<float>(30000 + kNUM_ZONES - 1), value);
+
+    const auto start = std::chrono::steady_clock::now();
+    files.reset();
+    EXPECT_LT(std::chrono::steady_clock::now(), start + 1000ms);
+
+    // Let the worker blocked on the pipe finish
+    android::base::unique_fd writer(open(fifo.c_str(), O_RDWR | O_CLOEXEC));
+    EXPECT_TRUE(writer.ok());
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+#include "utils/update_interval.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using std::literals::chrono_literals::operator""ms;
+using std::literals::chrono_literals::operator""s;
+
+// Temperature in degC at a time since the start of a simulation
+using Curve = std::function<float(std::chrono::milliseconds t)>;
+
+struct Simulation {
+    int updates;
+    std::chrono::milliseconds min_interval;
+    std::chrono::milliseconds max_interval;
+    // Longest interval while the sensor was throttling
+    std::chrono::milliseconds max_passive_interval;
+    // From the first time the curve reaches the first hot threshold to the
+    // first update seeing it, or -1 if it is never reached
+    std::chrono::milliseconds detect_latency;
+};
+
+constexpr float kLIGHT_THRESHOLD = 39.0f;
+
+SensorInfo MakeSensorInfo(TemperatureType_2_0 type, std::chrono::milliseconds polling_delay,
+                          std::chrono::milliseconds passive_delay,
+                          std::chrono::milliseconds max_polling_delay = 0ms) {
+    SensorInfo sensor_info = {};
+    sensor_info.type = type;
+    sensor_info.hot_thresholds.fill(NAN);
+    sensor_info.hot_thresholds[static_cast<size_t>(ThrottlingSeverity::LIGHT)] = kLIGHT_THRESHOLD;
+    sensor_info.hot_thresholds[static_cast<size_t>(ThrottlingSeverity::SEVERE)] = 43.0f;
+    sensor_info.hot_thresholds[static_cast<size_t>(ThrottlingSeverity::SHUTDOWN)] = 45.0f;
+    sensor_info.polling_delay = polling_delay;
+    sensor_info.passive_delay = passive_delay;
+    sensor_info.max_polling_delay = max_polling_delay;
+    return sensor_info;
+}
+
+ThrottlingSeverity GetSeverity(const SensorInfo &sensor_info, float value) {
+    ThrottlingSeverity severity = ThrottlingSeverity::NONE;
+    for (size_t i = 0; i < kThrottlingSeverityCount; i++) {
+        if (!std::isnan(sensor_info.hot_thresholds[i]) && value >= sensor_info.hot_thresholds[i]) {
+            severity = static_cast<ThrottlingSeverity>(i);
+        }
+    }
+    return severity;
+}
+
+// Update a sensor following curve for duration, the way the watcher does,
+// each time after the interval given by getUpdateInterval
+Simulation Simulate(const SensorInfo &sensor_info, const Curve &curve,
+                    std::chrono::milliseconds duration) {
+    Simulation sim = {.updates = 0,
+                      .min_interval = std::chrono::milliseconds::max(),
+                      .max_interval = 0ms,
+                      .max_passive_interval = 0ms,
+                      .detect_latency = -1ms};
+    std::chrono::milliseconds reached = -1ms;
+    for (auto t = 0ms; t < duration && reached < 0ms; t += 10ms) {
+        if (curve(t) >= kLIGHT_THRESHOLD) {
+            reached = t;
+        }
+    }
+
+    float last_value = NAN;
+    float value_rate = NAN;
+    std::chrono::milliseconds last_update = 0ms;
+    for (auto t = 0ms; t < duration;) {
+        const float value = curve(t);
+        const ThrottlingSeverity severity = GetSeverity(sensor_info, value);
+        value_rate = updateValueRate(value_rate, last_value, value, t - last_update);
+        last_value = value;
+        last_update = t;
+        sim.updates++;
+        if (reached >= 0ms && sim.detect_latency < 0ms && severity != ThrottlingSeverity::NONE) {
+            sim.detect_latency = t - reached;
+        }
+
+        const auto interval = getUpdateInterval(sensor_info, severity, value, value_rate);
+        sim.min_interval = std::min(sim.min_interval, interval);
+        sim.max_interval = std::max(sim.max_interval, interval);
+        if (severity != ThrottlingSeverity::NONE) {
+            sim.max_passive_interval = std::max(sim.max_passive_interval, interval);
+        }
+        t += interval;
+    }
+    return sim;
+}
+
+Curve Flat(float value) {
+    return [value](std::chrono::milliseconds) { return value; };
+}
+
+// Rise from 30degC at rate degC/s from start, up to 50degC
+Curve Ramp(float rate, std::chrono::milliseconds start) {
+    return [rate, start](std::chrono::milliseconds t) {
+        if (t < start) {
+            return 30.0f;
+        }
+        return std::min(30.0f + rate * (t - start).count() / 1000, 50.0f);
+    };
+}
+
+// Test the rate is smoothed over updates, and only known after two updates
+TEST(UpdateIntervalTest, ValueRateTest) {
+    EXPECT_TRUE(std::isnan(updateValueRate(NAN, NAN, 30.0f, 0ms)));
+    EXPECT_TRUE(std::isnan(updateValueRate(NAN, 30.0f, 31.0f, 0ms)));
+    EXPECT_FLOAT_EQ(0.5f, updateValueRate(NAN, 30.0f, 31.0f, 2s));
+    EXPECT_FLOAT_EQ(1.25f, updateValueRate(0.5f, 31.0f, 35.0f, 2s));
+    EXPECT_FLOAT_EQ(-0.75f, updateValueRate(0.25f, 35.0f, 31.5f, 2s));
+}
+
+// Test the interval is the configured delay until the rate is known, and when
+// the sensor is not rising
+TEST(UpdateIntervalTest, DelayTest) {
+    const SensorInfo sensor_info = MakeSensorInfo(TemperatureType_2_0::CPU, 10s, 3s);
+    EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 30.0f, NAN));
+    EXPECT_EQ(3s, getUpdateInterval(sensor_info, ThrottlingSeverity::LIGHT, 40.0f, NAN));
+    EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 30.0f, 0.0f));
+    EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 30.0f, -2.0f));
+    EXPECT_EQ(3s, getUpdateInterval(sensor_info, ThrottlingSeverity::LIGHT, 40.0f, -2.0f));
+    // Above the last threshold there is nothing left to predict
+    EXPECT_EQ(3s, getUpdateInterval(sensor_info, ThrottlingSeverity::SHUTDOWN, 46.0f, 5.0f));
+}
+
+// Test a sensor is never updated less often than its configured delays, nor
+// more often than kMinPollIntervalMs, whatever its curve
+TEST(UpdateIntervalTest, BoundsTest) {
+    const SensorInfo sensor_info = MakeSensorInfo(TemperatureType_2_0::CPU, 10s, 3s);
+    for (const Curve &curve : {Flat(30.0f), Ramp(0.05f, 0s), Ramp(0.5f, 20s), Ramp(3.0f, 61s),
+                               Ramp(20.0f, 33s)}) {
+        const Simulation sim = Simulate(sensor_info, curve, 300s);
+        EXPECT_LE(sim.max_interval, 10s);
+        EXPECT_LE(sim.max_passive_interval, 3s);
+        EXPECT_GE(sim.min_interval, kMinPollIntervalMs);
+        EXPECT_LE(sim.detect_latency, 10s);
+    }
+
+    // Configured delays below the floor are raised to it
+    const SensorInfo fast_sensor_info = MakeSensorInfo(TemperatureType_2_0::CPU, 500ms, 1s);
+    const Simulation sim = Simulate(fast_sensor_info, Ramp(1.0f, 5s), 60s);
+    EXPECT_EQ(kMinPollIntervalMs, sim.min_interval);
+    EXPECT_EQ(kMinPollIntervalMs, sim.max_interval);
+}
+
+// Test a sensor rising towards its threshold is updated sooner than its
+// polling delay, and so reaching it is detected earlier
+TEST(UpdateIntervalTest, ShortenTest) {
+    const SensorInfo sensor_info = MakeSensorInfo(TemperatureType_2_0::CPU, 20s, 3s);
+    for (const float rate : {0.1f, 0.2f, 0.5f}) {
+        const Simulation sim = Simulate(sensor_info, Ramp(rate, 0s), 300s);
+        EXPECT_LT(sim.max_interval, 21s) << rate;
+        EXPECT_LE(sim.detect_latency, kMinPollIntervalMs) << rate;
+    }
+    // Without a rise, it is polled at its delay
+    const Simulation idle = Simulate(sensor_info, Flat(30.0f), 300s);
+    EXPECT_EQ(15, idle.updates);
+}
+
+// Test only a config setting MaxPollingDelay stretches the polling of a cool
+// temperature sensor, and that a ramp at the assumed rate is still caught
+// within the polling delay
+TEST(UpdateIntervalTest, StretchTest) {
+    const SensorInfo sensor_info = MakeSensorInfo(TemperatureType_2_0::SKIN, 10s, 3s);
+    const SensorInfo stretched_info = MakeSensorInfo(TemperatureType_2_0::SKIN, 10s, 3s, 40s);
+    EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 30.0f, 0.0f));
+    EXPECT_EQ(40s, getUpdateInterval(stretched_info, ThrottlingSeverity::NONE, -5.0f, 0.0f));
+    // Stretched as long as a rise at 0.5degC/s takes twice to the threshold
+    EXPECT_EQ(24s, getUpdateInterval(stretched_info, ThrottlingSeverity::NONE, 15.0f, 0.0f));
+    EXPECT_EQ(10s, getUpdateInterval(stretched_info, ThrottlingSeverity::NONE, 30.0f, 0.0f));
+    EXPECT_EQ(3s, getUpdateInterval(stretched_info, ThrottlingSeverity::LIGHT, 40.0f, 0.0f));
+
+    for (const float value : {10.0f, 20.0f, 30.0f}) {
+        const Simulation idle = Simulate(sensor_info, Flat(value), 600s);
+        const Simulation stretched_idle = Simulate(stretched_info, Flat(value), 600s);
+        EXPECT_EQ(60, idle.updates);
+        EXPECT_LE(stretched_idle.updates, idle.updates) << value;
+        EXPECT_LE(stretched_idle.max_interval, 40s) << value;
+        if (value < 25.0f) {
+            EXPECT_LT(stretched_idle.updates, idle.updates * 2 / 3) << value;
+        }
+    }
+
+    for (const float rate : {0.1f, 0.5f}) {
+        const Simulation sim = Simulate(stretched_info, Ramp(rate, 30s), 300s);
+        EXPECT_LE(sim.detect_latency, 10s) << rate;
+    }
+}
+
+// Test sensors which are not temperatures are not assumed to rise at any
+// rate, and so never have their polling stretched
+TEST(UpdateIntervalTest, NotTemperatureTest) {
+    for (const auto type : {TemperatureType_2_0::BCL_VOLTAGE, TemperatureType_2_0::BCL_CURRENT,
+                            TemperatureType_2_0::BCL_PERCENTAGE}) {
+        const SensorInfo sensor_info = MakeSensorInfo(type, 10s, 3s, 40s);
+        EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 10.0f, 0.0f));
+        EXPECT_EQ(10s, getUpdateInterval(sensor_info, ThrottlingSeverity::NONE, 10.0f, 0.1f));
+        const Simulation sim = Simulate(sensor_info, Flat(30.0f), 600s);
+        EXPECT_EQ(60, sim.updates);
+        EXPECT_EQ(10s, sim.max_interval);
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <json/writer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "utils/config_parser.h"
+#include "utils/virtual_sensor.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using SensorInfoMap = std::unordered_map<std::string, SensorInfo>;
+
+constexpr int kNUM_ROUNDS = 200;
+
+// Virtual sensors added to the shipped config, which has none, sharing
+// physical and virtual sensors and covering every formula
+constexpr char kVirtualSensors[] = R"([
+    {"Name": "VIRTUAL-CPU-MAX", "Formula": "MAXIMUM",
+     "Combination": ["cpu-0-0-usr", "cpu-0-1-usr", "cpu-0-2-usr", "cpu-0-3-usr",
+                     "cpu-1-0-usr", "cpu-1-1-usr", "cpu-1-2-usr", "cpu-1-3-usr"],
+     "Coefficient": [1, 1, 1, 1, 1, 1, 1, 1]},
+    {"Name": "VIRTUAL-CPU-AVG", "Formula": "WEIGHTED_AVG",
+     "Combination": ["cpu-1-0-usr", "cpu-1-1-usr", "cpu-1-2-usr", "cpu-1-3-usr"],
+     "Coefficient": [0.25, 0.25, 0.25, 0.25], "Offset": 1.5},
+    {"Name": "VIRTUAL-HOT-COUNT", "Formula": "COUNT_THRESHOLD",
+     "Combination": ["cpu-0-0-usr", "cpu-1-0-usr", "gpuss-0-usr"],
+     "Coefficient": [45, -20, 50]},
+    {"Name": "VIRTUAL-SKIN", "Formula": "WEIGHTED_AVG",
+     "Combination": ["VIRTUAL-CPU-MAX", "VIRTUAL-CPU-AVG", "battery", "quiet_therm"],
+     "Coefficient": [0.2, 0.3, 0.1, 0.4], "TriggerSensor": "quiet_therm"},
+    {"Name": "VIRTUAL-SKIN-MIN", "Formula": "MINIMUM",
+     "Combination": ["VIRTUAL-SKIN", "VIRTUAL-CPU-AVG", "quiet_therm"],
+     "Coefficient": [1, 1, 1]},
+    {"Name": "VIRTUAL-SKIN-HINT", "Formula": "MAXIMUM",
+     "Combination": ["VIRTUAL-SKIN", "VIRTUAL-SKIN-MIN", "VIRTUAL-HOT-COUNT"],
+     "Coefficient": [1, 1, 10], "Offset": -2}
+])";
+
+// How virtual sensors were evaluated before eval_order: recursively, reading
+// a linked sensor again for each virtual sensor linking to it
+bool ReferenceEvaluate(const SensorInfoMap &sensors, const std::string &sensor_name,
+                       const SensorValueReader &read_value, float *temp) {
+    float temp_val = 0.0;
+
+    const auto &sensor_info = sensors.at(sensor_name);
+    float offset = sensor_info.virtual_sensor_info->offset;
+    for (size_t i = 0; i < sensor_info.virtual_sensor_info->linked_sensors.size(); i++) {
+        const std::string &linked_sensor = sensor_info.virtual_sensor_info->linked_sensors[i];
+        float sensor_reading;
+        if (sensors.at(linked_sensor).virtual_sensor_info == nullptr) {
+            if (!read_value(linked_sensor, &sensor_reading)) {
+                continue;
+            }
+        } else if (!ReferenceEvaluate(sensors, linked_sensor, read_value, &sensor_reading)) {
+            return false;
+        }
+        if (std::isnan(sensor_info.virtual_sensor_info->coefficients[i])) {
+            return false;
+        }
+        float coefficient = sensor_info.virtual_sensor_info->coefficients[i];
+        switch (sensor_info.virtual_sensor_info->formula) {
+            case FormulaOption::COUNT_THRESHOLD:
+                if ((coefficient < 0 && sensor_reading < -coefficient) ||
+                    (coefficient >= 0 && sensor_reading >= coefficient))
+                    temp_val += 1;
+                break;
+            case FormulaOption::WEIGHTED_AVG:
+                temp_val += sensor_reading * coefficient;
+                break;
+            case FormulaOption::MAXIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::lowest();
+                if (sensor_reading * coefficient > temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            case FormulaOption::MINIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::max();
+                if (sensor_reading * coefficient < temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            default:
+                break;
+        }
+    }
+    *temp = temp_val + offset;
+    return true;
+}
+
+// Add the virtual sensors sensor_name depends on, directly or not, to deps
+void AddDependencies(const SensorInfoMap &sensors, const std::string &sensor_name,
+                     std::unordered_set<std::string> *deps) {
+    for (const auto &linked_sensor :
+         sensors.at(sensor_name).virtual_sensor_info->linked_sensors) {
+        if (sensors.at(linked_sensor).virtual_sensor_info != nullptr &&
+            deps->insert(linked_sensor).second) {
+            AddDependencies(sensors, linked_sensor, deps);
+        }
+    }
+}
+
+// Add a virtual sensor to sensors, linking to linked_sensors
+void AddVirtualSensor(SensorInfoMap *sensors, const std::string &name,
+                      const std::vector<std::string> &linked_sensors) {
+    SensorInfo &sensor_info = (*sensors)[name];
+    sensor_info.virtual_sensor_info.reset(new VirtualSensorInfo{
+            linked_sensors, std::vector<float>(linked_sensors.size(), 1.0f), 0, "",
+            FormulaOption::MAXIMUM, {}});
+}
+
+class VirtualSensorTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        const std::string config_path =
+                android::base::GetExecutableDirectory() + "/thermal_info_config.json";
+        std::string json_doc;
+        ASSERT_TRUE(android::base::ReadFileToString(config_path, &json_doc)) << config_path;
+        Json::Value root;
+        Json::Value virtual_sensors;
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        std::string errorMessage;
+        ASSERT_TRUE(reader->parse(&*json_doc.begin(), &*json_doc.end(), &root, &errorMessage))
+                << errorMessage;
+        ASSERT_TRUE(reader->parse(kVirtualSensors, kVirtualSensors + sizeof(kVirtualSensors) - 1,
+                                  &virtual_sensors, &errorMessage))
+                << errorMessage;
+        shipped_sensors_ = root["Sensors"].size();
+        for (auto &sensor : virtual_sensors) {
+            sensor["Type"] = "SKIN";
+            sensor["VirtualSensor"] = true;
+            sensor["HotThreshold"] = Json::Value(Json::arrayValue);
+            for (size_t i = 0; i < kThrottlingSeverityCount; i++) {
+                sensor["HotThreshold"].append("NAN");
+            }
+            sensor["VrThreshold"] = "NAN";
+            sensor["Multiplier"] = 1;
+            root["Sensors"].append(sensor);
+        }
+        ASSERT_TRUE(android::base::WriteStringToFile(Json::writeString(Json::StreamWriterBuilder(),
+                                                                       root),
+                                                     config_file_.path));
+        sensors_ = ParseSensorInfo(config_file_.path);
+        ASSERT_EQ(shipped_sensors_ + virtual_sensors.size(), sensors_.size());
+        for (const auto &sensor_info_pair : sensors_) {
+            if (sensor_info_pair.second.virtual_sensor_info != nullptr) {
+                virtual_sensor_names_.push_back(sensor_info_pair.first);
+            }
+        }
+        std::sort(virtual_sensor_names_.begin(), virtual_sensor_names_.end());
+        ASSERT_EQ(virtual_sensors.size(), virtual_sensor_names_.size());
+    }
+
+    TemporaryFile config_file_;
+    size_t shipped_sensors_;
+    SensorInfoMap sensors_;
+    std::vector<std::string> virtual_sensor_names_;
+};
+
+// Test each virtual sensor's eval_order holds every virtual sensor it depends
+// on once, each after the virtual sensors it links to, and ends with itself
+TEST_F(VirtualSensorTest, EvalOrderTest) {
+    for (const auto &name : virtual_sensor_names_) {
+        const auto &eval_order = sensors_.at(name).virtual_sensor_info->eval_order;
+        std::unordered_set<std::string> deps;
+        AddDependencies(sensors_, name, &deps);
+        deps.insert(name);
+        ASSERT_EQ(deps.size(), eval_order.size()) << name;
+        EXPECT_EQ(name, eval_order.back());
+        std::unordered_set<std::string> evaluated;
+        for (const auto &virtual_sensor : eval_order) {
+            EXPECT_TRUE(deps.count(virtual_sensor)) << name << ": " << virtual_sensor;
+            for (const auto &linked_sensor :
+                 sensors_.at(virtual_sensor).virtual_sensor_info->linked_sensors) {
+                if (sensors_.at(linked_sensor).virtual_sensor_info != nullptr) {
+                    EXPECT_TRUE(evaluated.count(linked_sensor))
+                            << name << ": " << virtual_sensor << " before " << linked_sensor;
+                }
+            }
+            EXPECT_TRUE(evaluated.insert(virtual_sensor).second) << name << ": " << virtual_sensor;
+        }
+    }
+}
+
+// Test missing linked sensors and cycles are rejected, and that a sensor
+// reached through several paths is ordered once
+TEST_F(VirtualSensorTest, EvalOrderLinksTest) {
+    SensorInfoMap sensors;
+    sensors["physical"];
+    AddVirtualSensor(&sensors, "diamond", {"left", "right"});
+    AddVirtualSensor(&sensors, "left", {"bottom", "physical"});
+    AddVirtualSensor(&sensors, "right", {"physical", "bottom"});
+    AddVirtualSensor(&sensors, "bottom", {"physical"});
+    AddVirtualSensor(&sensors, "self", {"physical", "self"});
+    AddVirtualSensor(&sensors, "cycle", {"cycle-a"});
+    AddVirtualSensor(&sensors, "cycle-a", {"cycle-b"});
+    AddVirtualSensor(&sensors, "cycle-b", {"physical", "cycle-a"});
+    AddVirtualSensor(&sensors, "missing", {"physical", "unknown"});
+
+    std::unordered_set<std::string> in_path;
+    std::unordered_set<std::string> visited;
+    std::vector<std::string> eval_order;
+    EXPECT_TRUE(addVirtualSensorEvalOrder(sensors, "diamond", &in_path, &visited, &eval_order));
+    EXPECT_EQ(std::vector<std::string>({"bottom", "left", "right", "diamond"}), eval_order);
+    EXPECT_TRUE(in_path.empty());
+
+    for (const std::string name : {"self", "cycle", "missing"}) {
+        in_path.clear();
+        visited.clear();
+        eval_order.clear();
+        EXPECT_FALSE(addVirtualSensorEvalOrder(sensors, name, &in_path, &visited, &eval_order))
+                << name;
+    }
+}
+
+// Test evaluating in eval_order gives the same values as the recursive
+// evaluator, both per sensor and for a whole watcher cycle, while reading
+// each physical sensor once per cycle
+TEST_F(VirtualSensorTest, EquivalenceTest) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> temp_dist(10.0f, 80.0f);
+    std::bernoulli_distribution fail_dist(0.1);
+
+    for (int round = 0; round < kNUM_ROUNDS; round++) {
+        std::map<std::string, float> temps;
+        for (const auto &sensor_info_pair : sensors_) {
+            if (sensor_info_pair.second.virtual_sensor_info == nullptr) {
+                temps[sensor_info_pair.first] = fail_dist(gen) ? NAN : temp_dist(gen);
+            }
+        }
+        std::map<std::string, int> reads;
+        const SensorValueReader read_value = [&temps, &reads](std::string_view sensor_name,
+                                                              float *value) {
+            reads[std::string(sensor_name)]++;
+            *value = temps.at(std::string(sensor_name));
+            return !std::isnan(*value);
+        };
+
+        LinkedSensorValueMap cycle_values;
+        for (const auto &name : virtual_sensor_names_) {
+            float expected = NAN;
+            const bool expected_valid = ReferenceEvaluate(sensors_, name, read_value, &expected);
+
+            LinkedSensorValueMap values;
+            const LinkedSensorValue value =
+                    evaluateVirtualSensor(sensors_, name, read_value, &values);
+            EXPECT_EQ(expected_valid, value.valid) << name;
+            const LinkedSensorValue cycle_value =
+                    evaluateVirtualSensor(sensors_, name, read_value, &cycle_values);
+            EXPECT_EQ(expected_valid, cycle_value.valid) << name;
+            if (expected_valid) {
+                EXPECT_EQ(expected, value.value) << name;
+                EXPECT_EQ(expected, cycle_value.value) << name;
+            }
+        }
+
+        // A cycle on its own reads every physical sensor once
+        reads.clear();
+        cycle_values.clear();
+        for (const auto &name : virtual_sensor_names_) {
+            evaluateVirtualSensor(sensors_, name, read_value, &cycle_values);
+        }
+        for (const auto &read : reads) {
+            EXPECT_EQ(1, read.second) << read.first;
+        }
+        EXPECT_EQ(shipped_sensors_, reads.size());
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
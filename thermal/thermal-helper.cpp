@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iterator>
 #include <set>
 #include <sstream>
@@ -29,6 +30,7 @@
 #include <hidl/HidlTransportSupport.h>
 
 #include "thermal-helper.h"
+#include "utils/update_interval.h"
 
 namespace android {
 namespace hardware {
@@ -56,6 +58,9 @@ constexpr std::string_view kConfigProperty("vendor.thermal.config");
 constexpr std::string_view kConfigDefaultFileName("thermal_info_config.json");
 constexpr std::string_view kThermalGenlProperty("persist.vendor.enable.thermal.genl");
 constexpr std::string_view kThermalDisabledProperty("vendor.disable.thermal.control");
+constexpr std::chrono::milliseconds kSensorReadTimeoutMs(100);
+// Sensors due within this window are updated together to save wakeups
+constexpr std::chrono::milliseconds kUpdateCoalesceWindowMs(100);
 
 namespace {
 using android::base::StringPrintf;
@@ -292,6 +297,13 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
                 .last_update_time = boot_clock::time_point::min(),
                 .err_integral = 0.0,
                 .prev_err = NAN,
+                .reading = NAN,
+                .reading_valid = false,
+                .reading_timed_out = false,
+                .reading_time = boot_clock::time_point::min(),
+                .last_value = NAN,
+                .value_rate = NAN,
+                .next_update_time = boot_clock::time_point::min(),
         };
 
         bool invalid_binded_cdev = false;
@@ -366,6 +378,13 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
         }
     }
 
+    for (const auto &cdev_status_pair : cdev_status_map_) {
+        cdev_request_aggregate_map_[cdev_status_pair.first] = {
+                .max_request = 0,
+                .written_state = 0,
+        };
+    }
+
     const bool thermal_throttling_disabled =
             android::base::GetBoolProperty(kThermalDisabledProperty.data(), false);
 
@@ -385,6 +404,19 @@ ThermalHelper::ThermalHelper(const NotificationCallback &cb)
     std::set<std::string> monitored_sensors;
     initializeTrip(tz_map, &monitored_sensors, thermal_genl_enabled);
 
+    // Update every monitored sensor once after booting
+    for (auto &name_status_pair : sensor_status_map_) {
+        const SensorInfo &sensor_info = sensor_info_map_.at(name_status_pair.first);
+        if (!sensor_info.is_monitor) {
+            continue;
+        }
+        scheduleSensorUpdate(name_status_pair.first, &name_status_pair.second,
+                             boot_clock::time_point::min());
+        if (sensor_info.virtual_sensor_info != nullptr) {
+            monitored_virtual_sensors_.push_back(name_status_pair.first);
+        }
+    }
+
     if (thermal_genl_enabled) {
         thermal_watcher_->registerFilesToWatchNl(monitored_sensors);
     } else {
@@ -423,8 +455,7 @@ bool getThermalZoneTypeById(int tz_id, std::string *type) {
 
 bool ThermalHelper::readCoolingDevice(std::string_view cooling_device,
                                       CoolingDevice_2_0 *out) const {
-    // Read the file.  If the file can't be read temp will be empty string.
-    std::string data;
+    int data;
 
     if (!cooling_devices_.readThermalFile(cooling_device, &data)) {
         LOG(ERROR) << "readCoolingDevice: failed to read cooling_device: " << cooling_device;
@@ -436,23 +467,17 @@ bool ThermalHelper::readCoolingDevice(std::string_view cooling_device,
 
     out->type = type;
     out->name = cooling_device.data();
-    out->value = std::stoi(data);
+    out->value = data;
 
     return true;
 }
 
 bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_0 *out,
                                     bool is_virtual_sensor) const {
-    // Read the file.  If the file can't be read temp will be empty string.
-    std::string temp;
+    float temp;
 
     if (!is_virtual_sensor) {
         if (!thermal_sensors_.readThermalFile(sensor_name, &temp)) {
-            LOG(ERROR) << "readTemperature: sensor not found: " << sensor_name;
-            return false;
-        }
-
-        if (temp.empty()) {
             LOG(ERROR) << "readTemperature: failed to read sensor: " << sensor_name;
             return false;
         }
@@ -470,7 +495,7 @@ bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_
             : static_cast<TemperatureType_1_0>(sensor_info.type);
     out->type = type;
     out->name = sensor_name.data();
-    out->currentValue = std::stof(temp) * sensor_info.multiplier;
+    out->currentValue = temp * sensor_info.multiplier;
     out->throttlingThreshold =
         sensor_info.hot_thresholds[static_cast<size_t>(ThrottlingSeverity::SEVERE)];
     out->shutdownThreshold =
@@ -483,22 +508,16 @@ bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_
 bool ThermalHelper::readTemperature(
         std::string_view sensor_name, Temperature_2_0 *out,
         std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status,
-        bool is_virtual_sensor) const {
-    // Read the file.  If the file can't be read temp will be empty string.
-    std::string temp;
+        bool is_virtual_sensor, bool from_readings) const {
+    float temp;
 
     if (!is_virtual_sensor) {
-        if (!thermal_sensors_.readThermalFile(sensor_name, &temp)) {
-            LOG(ERROR) << "readTemperature: sensor not found: " << sensor_name;
-            return false;
-        }
-
-        if (temp.empty()) {
+        if (!readSensorValue(sensor_name, from_readings, &temp)) {
             LOG(ERROR) << "readTemperature: failed to read sensor: " << sensor_name;
             return false;
         }
     } else {
-        if (!checkVirtualSensor(sensor_name.data(), &temp)) {
+        if (!checkVirtualSensor(sensor_name.data(), &temp, from_readings)) {
             LOG(ERROR) << "readTemperature: failed to read virtual sensor: " << sensor_name;
             return false;
         }
@@ -507,7 +526,7 @@ bool ThermalHelper::readTemperature(
     const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
     out->type = sensor_info.type;
     out->name = sensor_name.data();
-    out->value = std::stof(temp) * sensor_info.multiplier;
+    out->value = temp * sensor_info.multiplier;
 
     std::pair<ThrottlingSeverity, ThrottlingSeverity> status =
         std::make_pair(ThrottlingSeverity::NONE, ThrottlingSeverity::NONE);
@@ -652,11 +671,19 @@ bool ThermalHelper::requestCdevByPower(std::string_view sensor_name, SensorStatu
 
             const CdevInfo &cdev_info_pair =
                     cooling_device_info_map_.at(binded_cdev_info_pair.first);
-            for (j = 0; j < cdev_info_pair.state2power.size() - 1; ++j) {
-                if (cdev_power_budget > cdev_info_pair.state2power[j]) {
-                    break;
-                }
+            if (cdev_info_pair.state2power.empty()) {
+                LOG(ERROR) << "Sensor: " << sensor_name.data() << " cooling device "
+                           << binded_cdev_info_pair.first << " has no state2power";
+                continue;
             }
+            // The first state whose power fits the budget, or the last state. Power
+            // does not increase with state, so the states over budget come first.
+            const auto state2power_last = std::prev(cdev_info_pair.state2power.end());
+            j = std::distance(cdev_info_pair.state2power.begin(),
+                              std::partition_point(cdev_info_pair.state2power.begin(),
+                                                   state2power_last, [&](float power) {
+                                                       return !(cdev_power_budget > power);
+                                                   }));
             sensor_status->pid_request_map.at(binded_cdev_info_pair.first) = static_cast<int>(j);
             LOG(VERBOSE) << "Power allocator: Sensor " << sensor_name.data() << " allocate "
                          << cdev_power_budget << "mW to " << binded_cdev_info_pair.first
@@ -684,14 +711,16 @@ void ThermalHelper::computeCoolingDevicesRequest(
     int release_step = 0;
 
     std::unique_lock<std::shared_mutex> _lock(cdev_status_map_mutex_);
-    for (auto &cdev_request_pair : cdev_status_map_) {
-        if (!cdev_request_pair.second.count(sensor_name.data())) {
+    for (const auto &binded_cdev_info_pair : sensor_info.throttling_info->binded_cdev_info_map) {
+        const std::string &cdev_name = binded_cdev_info_pair.first;
+        const auto cdev_request_it = cdev_status_map_.find(cdev_name);
+        if (cdev_request_it == cdev_status_map_.end() ||
+            !cdev_request_it->second.count(sensor_name.data())) {
             continue;
         }
         int pid_request = 0;
         int hard_limit_request = 0;
-        const auto &binded_cdev_info =
-                sensor_info.throttling_info->binded_cdev_info_map.at(cdev_request_pair.first);
+        const auto &binded_cdev_info = binded_cdev_info_pair.second;
         const auto cdev_ceiling =
                 binded_cdev_info.cdev_ceiling[static_cast<size_t>(sensor_status.severity)];
         const auto cdev_floor =
@@ -699,17 +728,17 @@ void ThermalHelper::computeCoolingDevicesRequest(
                         .cdev_floor_with_power_link[static_cast<size_t>(sensor_status.severity)];
         release_step = 0;
 
-        if (sensor_status.pid_request_map.count(cdev_request_pair.first)) {
-            pid_request = sensor_status.pid_request_map.at(cdev_request_pair.first);
+        if (sensor_status.pid_request_map.count(cdev_name)) {
+            pid_request = sensor_status.pid_request_map.at(cdev_name);
         }
 
-        if (sensor_status.hard_limit_request_map.count(cdev_request_pair.first)) {
-            hard_limit_request = sensor_status.hard_limit_request_map.at(cdev_request_pair.first);
+        if (sensor_status.hard_limit_request_map.count(cdev_name)) {
+            hard_limit_request = sensor_status.hard_limit_request_map.at(cdev_name);
         }
 
-        release_step = power_files_.getReleaseStep(sensor_name, cdev_request_pair.first);
+        release_step = power_files_.getReleaseStep(sensor_name, cdev_name);
         LOG(VERBOSE) << "Sensor: " << sensor_name.data() << " binded cooling device "
-                     << cdev_request_pair.first << "'s pid_request=" << pid_request
+                     << cdev_name << "'s pid_request=" << pid_request
                      << " hard_limit_request=" << hard_limit_request
                      << " release_step=" << release_step
                      << " cdev_floor_with_power_link=" << cdev_floor
@@ -731,28 +760,44 @@ void ThermalHelper::computeCoolingDevicesRequest(
         if (request_state > cdev_ceiling) {
             request_state = cdev_ceiling;
         }
-        if (cdev_request_pair.second.at(sensor_name.data()) != request_state) {
-            cdev_request_pair.second.at(sensor_name.data()) = request_state;
-            cooling_devices_to_update->emplace_back(cdev_request_pair.first);
-            LOG(INFO) << "Sensor: " << sensor_name.data() << " request " << cdev_request_pair.first
-                      << " to " << request_state;
+
+        int &sensor_request = cdev_request_it->second.at(sensor_name.data());
+        if (sensor_request == request_state) {
+            continue;
+        }
+        const int prev_request = sensor_request;
+        sensor_request = request_state;
+        LOG(INFO) << "Sensor: " << sensor_name.data() << " request " << cdev_name << " to "
+                  << request_state;
+
+        // Only look through the other sensors when the highest request is lowered
+        int &max_request = cdev_request_aggregate_map_.at(cdev_name).max_request;
+        const int prev_max_request = max_request;
+        if (request_state >= max_request) {
+            max_request = request_state;
+        } else if (prev_request == max_request) {
+            max_request = 0;
+            for (const auto &sensor_request_pair : cdev_request_it->second) {
+                max_request = std::max(max_request, sensor_request_pair.second);
+            }
+        }
+        if (max_request != prev_max_request) {
+            cooling_devices_to_update->emplace_back(cdev_name);
         }
     }
 }
 
 void ThermalHelper::updateCoolingDevices(const std::vector<std::string> &updated_cdev) {
-    int max_state;
-
     for (const auto &target_cdev : updated_cdev) {
-        max_state = 0;
-        const CdevRequestStatus &cdev_status = cdev_status_map_.at(target_cdev);
-        for (auto &sensor_request_pair : cdev_status) {
-            if (sensor_request_pair.second > max_state) {
-                max_state = sensor_request_pair.second;
-            }
+        CdevRequestAggregate &cdev_request = cdev_request_aggregate_map_.at(target_cdev);
+        // Skip a cooling device listed twice, or whose request changed back
+        if (cdev_request.max_request == cdev_request.written_state) {
+            continue;
         }
-        if (cooling_devices_.writeCdevFile(target_cdev, std::to_string(max_state))) {
-            LOG(VERBOSE) << "Successfully update cdev " << target_cdev << " sysfs to " << max_state;
+        if (cooling_devices_.writeCdevFile(target_cdev, std::to_string(cdev_request.max_request))) {
+            cdev_request.written_state = cdev_request.max_request;
+            LOG(VERBOSE) << "Successfully update cdev " << target_cdev << " sysfs to "
+                         << cdev_request.max_request;
         }
     }
 }
@@ -853,20 +898,26 @@ bool ThermalHelper::initializeCoolingDevices(
                 "%s/%s", path.data(), kCoolingDeviceState2powerSuffix.data());
         std::string state2power_str;
         if (android::base::ReadFileToString(state2power_path, &state2power_str)) {
-            LOG(INFO) << "Cooling device " << cooling_device_info_pair.first
-                      << " use state2power read from sysfs";
-            cooling_device_info_pair.second.state2power.clear();
-
+            std::vector<float> state2power;
             std::stringstream power(state2power_str);
             unsigned int power_number;
             int i = 0;
             while (power >> power_number) {
-                cooling_device_info_pair.second.state2power.push_back(
-                        static_cast<float>(power_number));
+                state2power.push_back(static_cast<float>(power_number));
                 LOG(INFO) << "Cooling device " << cooling_device_info_pair.first << " state:" << i
                           << " power: " << power_number;
                 i++;
             }
+
+            if (IsState2PowerValid(state2power)) {
+                LOG(INFO) << "Cooling device " << cooling_device_info_pair.first
+                          << " use state2power read from sysfs";
+                cooling_device_info_pair.second.state2power = std::move(state2power);
+            } else {
+                LOG(ERROR) << "Cooling device " << cooling_device_info_pair.first
+                           << " ignore state2power read from sysfs, power should not increase "
+                           << "with state";
+            }
         }
 
         // Get max cooling device request state
@@ -1088,141 +1139,186 @@ bool ThermalHelper::fillCpuUsages(hidl_vec<CpuUsage> *cpu_usages) const {
     return true;
 }
 
-bool ThermalHelper::checkVirtualSensor(std::string_view sensor_name, std::string *temp) const {
-    float temp_val = 0.0;
+bool ThermalHelper::readSensorValue(std::string_view sensor_name, bool from_readings,
+                                    float *value) const {
+    if (!from_readings) {
+        return thermal_sensors_.readThermalFile(sensor_name, value);
+    }
+
+    std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+    const auto &sensor_status = sensor_status_map_.at(sensor_name.data());
+    if (!sensor_status.reading_valid) {
+        return false;
+    }
+    *value = sensor_status.reading;
+    return true;
+}
 
+bool ThermalHelper::checkVirtualSensor(std::string_view sensor_name, float *temp,
+                                       bool from_readings) const {
+    LinkedSensorValueMap local_values;
+    const LinkedSensorValue value = evaluateVirtualSensor(
+            sensor_info_map_, sensor_name,
+            [this, from_readings](std::string_view linked_sensor, float *value) {
+                return readSensorValue(linked_sensor, from_readings, value);
+            },
+            from_readings ? &linked_sensor_values_ : &local_values);
+    if (!value.valid) {
+        return false;
+    }
+    *temp = value.value;
+    return true;
+}
+
+void ThermalHelper::addSensorReads(std::string_view sensor_name,
+                                   std::vector<ThermalFileRead> *reads,
+                                   std::set<std::string_view> *added) const {
     const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
-    float offset = sensor_info.virtual_sensor_info->offset;
-    for (size_t i = 0; i < sensor_info.virtual_sensor_info->linked_sensors.size(); i++) {
-        std::string data;
-        const auto &linked_sensor_info =
-                sensor_info_map_.at(sensor_info.virtual_sensor_info->linked_sensors[i].data());
-        if (linked_sensor_info.virtual_sensor_info == nullptr) {
-            if (!thermal_sensors_.readThermalFile(
-                        sensor_info.virtual_sensor_info->linked_sensors[i], &data)) {
-                continue;
-            }
-        } else if (!checkVirtualSensor(sensor_info.virtual_sensor_info->linked_sensors[i], &data)) {
-            return false;
+    if (sensor_info.virtual_sensor_info == nullptr) {
+        if (added->insert(sensor_name).second) {
+            reads->push_back({.thermal_name = sensor_name,
+                              .value = NAN,
+                              .status = ThermalFileReadStatus::FAILED});
         }
+        return;
+    }
+    for (const auto &linked_sensor : sensor_info.virtual_sensor_info->linked_sensors) {
+        // Key of sensor_info_map_, which outlives the reads
+        addSensorReads(sensor_info_map_.find(linked_sensor)->first, reads, added);
+    }
+}
 
-        LOG(VERBOSE) << sensor_name.data() << "'s linked sensor "
-                     << sensor_info.virtual_sensor_info->linked_sensors[i] << ": temp = " << data;
-        data = ::android::base::Trim(data);
-        float sensor_reading = std::stof(data);
-        if (std::isnan(sensor_info.virtual_sensor_info->coefficients[i])) {
-            return false;
-        }
-        float coefficient = sensor_info.virtual_sensor_info->coefficients[i];
-        switch (sensor_info.virtual_sensor_info->formula) {
-            case FormulaOption::COUNT_THRESHOLD:
-                if ((coefficient < 0 && sensor_reading < -coefficient) ||
-                    (coefficient >= 0 && sensor_reading >= coefficient))
-                    temp_val += 1;
-                break;
-            case FormulaOption::WEIGHTED_AVG:
-                temp_val += sensor_reading * coefficient;
-                break;
-            case FormulaOption::MAXIMUM:
-                if (i == 0)
-                    temp_val = std::numeric_limits<float>::lowest();
-                if (sensor_reading * coefficient > temp_val)
-                    temp_val = sensor_reading * coefficient;
+void ThermalHelper::updateSensorReadings(std::vector<ThermalFileRead> *reads,
+                                         boot_clock::time_point now) {
+    if (reads->empty()) {
+        return;
+    }
+    thermal_sensors_.readThermalFiles(reads, kSensorReadTimeoutMs);
+
+    // writer lock
+    std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+    for (const auto &read : *reads) {
+        SensorStatus &sensor_status = sensor_status_map_.at(read.thermal_name.data());
+        switch (read.status) {
+            case ThermalFileReadStatus::OK:
+                if (sensor_status.reading_timed_out) {
+                    LOG(INFO) << "Sensor " << read.thermal_name << " read recovered";
+                }
+                sensor_status.reading = read.value;
+                sensor_status.reading_valid = true;
+                sensor_status.reading_timed_out = false;
+                sensor_status.reading_time = now;
                 break;
-            case FormulaOption::MINIMUM:
-                if (i == 0)
-                    temp_val = std::numeric_limits<float>::max();
-                if (sensor_reading * coefficient < temp_val)
-                    temp_val = sensor_reading * coefficient;
+            case ThermalFileReadStatus::FAILED:
+                sensor_status.reading_valid = false;
+                sensor_status.reading_timed_out = false;
                 break;
-            default:
+            case ThermalFileReadStatus::TIMEOUT:
+                // Keep the last value, if any, rather than stall every other sensor
+                if (!sensor_status.reading_timed_out) {
+                    LOG(WARNING) << "Sensor " << read.thermal_name << " read timed out after "
+                                 << kSensorReadTimeoutMs.count() << "ms, use its last value";
+                }
+                sensor_status.reading_timed_out = true;
                 break;
         }
     }
-    *temp = std::to_string(temp_val + offset);
-    return true;
+}
+
+void ThermalHelper::scheduleSensorUpdate(std::string_view sensor_name,
+                                         SensorStatus *sensor_status,
+                                         boot_clock::time_point next_update_time) {
+    sensor_status->next_update_time = next_update_time;
+    sensor_update_queue_.emplace(next_update_time, sensor_name);
 }
 
 // This is called in the different thread context and will update sensor_status
 // uevent_sensors is the set of sensors which trigger uevent from thermal core driver.
+// Sensors due for an update are picked first, then the physical sensors they
+// depend on are read concurrently with a deadline, so one slow node does not
+// delay the others, and finally the throttling is computed from those readings.
 std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
         const std::set<std::string> &uevent_sensors) {
     std::vector<Temperature_2_0> temps;
     std::vector<std::string> cooling_devices_to_update;
     std::set<std::string> updated_power_rails;
     boot_clock::time_point now = boot_clock::now();
-    auto min_sleep_ms = std::chrono::milliseconds::max();
+    std::vector<std::pair<const std::string *, std::chrono::milliseconds>> sensors_to_update;
+    std::vector<ThermalFileRead> reads;
+    std::set<std::string_view> added_reads;
+    std::set<std::string_view> sensors_due;
+
+    // Sensors whose update time is reached, or close enough to share this wakeup
+    while (!sensor_update_queue_.empty() &&
+           sensor_update_queue_.top().first <= now + kUpdateCoalesceWindowMs) {
+        const SensorUpdate sensor_update = sensor_update_queue_.top();
+        sensor_update_queue_.pop();
+        if (sensor_update.first ==
+            sensor_status_map_.at(sensor_update.second.data()).next_update_time) {
+            sensors_due.insert(sensor_update.second);
+        }
+    }
 
-    for (auto &name_status_pair : sensor_status_map_) {
-        bool force_update = false;
-        bool severity_changed = false;
-        Temperature_2_0 temp;
-        TemperatureThreshold threshold;
-        SensorStatus &sensor_status = name_status_pair.second;
-        const SensorInfo &sensor_info = sensor_info_map_.at(name_status_pair.first);
+    // Update the sensors from uevent
+    for (const auto &sensor_name : uevent_sensors) {
+        const auto sensor_info_it = sensor_info_map_.find(sensor_name);
+        if (sensor_info_it != sensor_info_map_.end() && sensor_info_it->second.is_monitor &&
+            sensor_info_it->second.virtual_sensor_info == nullptr) {
+            sensors_due.insert(sensor_info_it->first);
+        }
+    }
 
-        // Only handle the sensors in allow list
-        if (!sensor_info.is_monitor) {
-            continue;
+    // Update the virtual sensors from their trigger sensor's uevent, or while
+    // it is over the threshold
+    for (const auto &sensor_name : monitored_virtual_sensors_) {
+        const std::string &trigger_sensor =
+                sensor_info_map_.at(sensor_name.data()).virtual_sensor_info->trigger_sensor;
+        if (uevent_sensors.count(trigger_sensor) ||
+            sensor_status_map_.at(trigger_sensor).severity != ThrottlingSeverity::NONE) {
+            sensors_due.insert(sensor_name);
         }
+    }
 
+    for (const auto &sensor_name : sensors_due) {
+        const auto sensor_status_it = sensor_status_map_.find(sensor_name.data());
+        const SensorStatus &sensor_status = sensor_status_it->second;
         std::chrono::milliseconds time_elapsed_ms = std::chrono::milliseconds::zero();
-        auto sleep_ms = (sensor_status.severity != ThrottlingSeverity::NONE)
-                                ? sensor_info.passive_delay
-                                : sensor_info.polling_delay;
-        // Check if the sensor need to be updated
         if (sensor_status.last_update_time == boot_clock::time_point::min()) {
-            force_update = true;
-            LOG(VERBOSE) << "Force update " << name_status_pair.first
-                         << "'s temperature after booting";
+            LOG(VERBOSE) << "Force update " << sensor_name << "'s temperature after booting";
         } else {
             time_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                     now - sensor_status.last_update_time);
-
-            if (time_elapsed_ms > sleep_ms) {
-                // Update the sensor because sleep timeout
-                force_update = true;
-            } else if (uevent_sensors.size() &&
-                       uevent_sensors.find((sensor_info.virtual_sensor_info != nullptr)
-                                                   ? sensor_info.virtual_sensor_info->trigger_sensor
-                                                   : name_status_pair.first) !=
-                               uevent_sensors.end()) {
-                // Update the sensor from uevent
-                force_update = true;
-            } else if (sensor_info.virtual_sensor_info != nullptr) {
-                // Update the virtual sensor if it's trigger sensor over the threshold
-                const auto trigger_sensor_status =
-                        sensor_status_map_.at(sensor_info.virtual_sensor_info->trigger_sensor);
-                if (trigger_sensor_status.severity != ThrottlingSeverity::NONE) {
-                    force_update = true;
-                }
-            }
         }
+        LOG(VERBOSE) << "sensor " << sensor_name << ": time_elpased=" << time_elapsed_ms.count();
+
+        sensors_to_update.emplace_back(&sensor_status_it->first, time_elapsed_ms);
+        addSensorReads(sensor_name, &reads, &added_reads);
+    }
 
-        LOG(VERBOSE) << "sensor " << name_status_pair.first
-                     << ": time_elpased=" << time_elapsed_ms.count()
-                     << ", sleep_ms=" << sleep_ms.count() << ", force_update = " << force_update;
+    updateSensorReadings(&reads, now);
+    linked_sensor_values_.clear();
 
-        if (!force_update) {
-            auto timeout_remaining = sleep_ms - time_elapsed_ms;
-            if (min_sleep_ms > timeout_remaining) {
-                min_sleep_ms = timeout_remaining;
-            }
-            LOG(VERBOSE) << "sensor " << name_status_pair.first
-                         << ": timeout_remaining=" << timeout_remaining.count();
-            continue;
-        }
+    for (const auto &sensor_to_update : sensors_to_update) {
+        const std::string &sensor_name = *sensor_to_update.first;
+        const std::chrono::milliseconds time_elapsed_ms = sensor_to_update.second;
+        bool severity_changed = false;
+        Temperature_2_0 temp;
+        TemperatureThreshold threshold;
+        SensorStatus &sensor_status = sensor_status_map_.at(sensor_name);
+        const SensorInfo &sensor_info = sensor_info_map_.at(sensor_name);
 
         std::pair<ThrottlingSeverity, ThrottlingSeverity> throtting_status;
-        if (!readTemperature(name_status_pair.first, &temp, &throtting_status,
-                             (sensor_info.virtual_sensor_info != nullptr))) {
-            LOG(ERROR) << __func__
-                       << ": error reading temperature for sensor: " << name_status_pair.first;
+        if (!readTemperature(sensor_name, &temp, &throtting_status,
+                             (sensor_info.virtual_sensor_info != nullptr), true)) {
+            LOG(ERROR) << __func__ << ": error reading temperature for sensor: " << sensor_name;
+            // Retry as soon as a sensor may be updated again
+            scheduleSensorUpdate(sensor_name, &sensor_status, now + kMinPollIntervalMs);
             continue;
         }
-        if (!readTemperatureThreshold(name_status_pair.first, &threshold)) {
+        if (!readTemperatureThreshold(sensor_name, &threshold)) {
             LOG(ERROR) << __func__ << ": error reading temperature threshold for sensor: "
-                       << name_status_pair.first;
+                       << sensor_name;
+            scheduleSensorUpdate(sensor_name, &sensor_status, now + kMinPollIntervalMs);
             continue;
         }
 
@@ -1239,10 +1335,11 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
                 temps.push_back(temp);
                 severity_changed = true;
                 sensor_status.severity = temp.throttlingStatus;
-                sleep_ms = (sensor_status.severity != ThrottlingSeverity::NONE)
-                                   ? sensor_info.passive_delay
-                                   : sensor_info.polling_delay;
             }
+            sensor_status.value_rate =
+                    updateValueRate(sensor_status.value_rate, sensor_status.last_value,
+                                    temp.value, time_elapsed_ms);
+            sensor_status.last_value = temp.value;
         }
 
         if (sensor_status.severity != ThrottlingSeverity::NONE) {
@@ -1256,21 +1353,21 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
             size_t target_state = getTargetStateOfPID(sensor_info, sensor_status);
             float power_budget = pidPowerCalculator(temp, sensor_info, &sensor_status,
                                                     time_elapsed_ms, target_state);
-            if (!requestCdevByPower(name_status_pair.first, &sensor_status, sensor_info,
-                                    power_budget, target_state)) {
+            if (!requestCdevByPower(sensor_name, &sensor_status, sensor_info, power_budget,
+                                    target_state)) {
                 LOG(ERROR) << "Sensor " << temp.name << " PID request cdev failed";
             }
         }
 
         if (sensor_status.hard_limit_request_map.size()) {
             // Start hard limit computation
-            requestCdevBySeverity(name_status_pair.first, &sensor_status, sensor_info);
+            requestCdevBySeverity(sensor_name, &sensor_status, sensor_info);
         }
 
         // Aggregate cooling device request
         if (sensor_status.pid_request_map.size() || sensor_status.hard_limit_request_map.size()) {
             if (sensor_status.severity == ThrottlingSeverity::NONE) {
-                power_files_.setPowerDataToDefault(name_status_pair.first);
+                power_files_.setPowerDataToDefault(sensor_name);
             } else {
                 for (const auto &binded_cdev_info_pair :
                      sensor_info.throttling_info->binded_cdev_info_map) {
@@ -1279,7 +1376,7 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
                                 power_rail_info_map_.at(binded_cdev_info_pair.second.power_rail);
 
                         if (power_files_.throttlingReleaseUpdate(
-                                    name_status_pair.first, binded_cdev_info_pair.first,
+                                    sensor_name, binded_cdev_info_pair.first,
                                     sensor_status.severity, time_elapsed_ms,
                                     binded_cdev_info_pair.second, power_rail_info,
                                     !updated_power_rails.count(
@@ -1290,15 +1387,16 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
                     }
                 }
             }
-            computeCoolingDevicesRequest(name_status_pair.first, sensor_info, sensor_status,
+            computeCoolingDevicesRequest(sensor_name, sensor_info, sensor_status,
                                          &cooling_devices_to_update);
         }
 
-        if (min_sleep_ms > sleep_ms) {
-            min_sleep_ms = sleep_ms;
-        }
-        LOG(VERBOSE) << "Sensor " << name_status_pair.first << ": sleep_ms=" << sleep_ms.count()
-                     << ", min_sleep_ms voting result=" << min_sleep_ms.count();
+        const auto update_interval_ms =
+                getUpdateInterval(sensor_info, sensor_status.severity, sensor_status.last_value,
+                                  sensor_status.value_rate);
+        LOG(VERBOSE) << "Sensor " << sensor_name << ": rate=" << sensor_status.value_rate
+                     << "/s, next update in " << update_interval_ms.count() << "ms";
+        scheduleSensorUpdate(sensor_name, &sensor_status, now + update_interval_ms);
         sensor_status.last_update_time = now;
     }
 
@@ -1319,7 +1417,20 @@ std::chrono::milliseconds ThermalHelper::thermalWatcherCallbackFunc(
     }
 
     power_files_.clearEnergyInfoMap();
-    return min_sleep_ms < kMinPollIntervalMs ? kMinPollIntervalMs : min_sleep_ms;
+
+    // Sleep until the earliest sensor is due
+    while (!sensor_update_queue_.empty() &&
+           sensor_update_queue_.top().first !=
+                   sensor_status_map_.at(sensor_update_queue_.top().second.data())
+                           .next_update_time) {
+        sensor_update_queue_.pop();
+    }
+    if (sensor_update_queue_.empty()) {
+        return std::chrono::milliseconds::max();
+    }
+    return std::max(std::chrono::ceil<std::chrono::milliseconds>(
+                            sensor_update_queue_.top().first - boot_clock::now()),
+                    std::chrono::milliseconds::zero());
 }
 
 bool ThermalHelper::connectToPowerHal() {
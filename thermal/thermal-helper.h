@@ -31,7 +31,9 @@
 
 #include <array>
 #include <chrono>
+#include <functional>
 #include <mutex>
+#include <queue>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
@@ -47,6 +49,7 @@
 #include "utils/power_files.h"
 #include "utils/thermal_files.h"
 #include "utils/thermal_watcher.h"
+#include "utils/virtual_sensor.h"
 
 namespace android {
 namespace hardware {
@@ -73,6 +76,13 @@ using NotificationCallback = std::function<void(const Temperature_2_0 &t)>;
 using NotificationTime = std::chrono::time_point<std::chrono::steady_clock>;
 using CdevRequestStatus = std::unordered_map<std::string, int>;
 
+// Highest request of a cooling device over its sensors in CdevRequestStatus,
+// and the state last written to it
+struct CdevRequestAggregate {
+    int max_request;
+    int written_state;
+};
+
 // Get thermal_zone type
 bool getThermalZoneTypeById(int tz_id, std::string *);
 
@@ -86,6 +96,17 @@ struct SensorStatus {
     std::unordered_map<std::string, int> hard_limit_request_map;
     float err_integral;
     float prev_err;
+    // Latest value read by the watcher for a physical sensor, and when. Kept
+    // when a read times out, which sets reading_timed_out.
+    float reading;
+    bool reading_valid;
+    bool reading_timed_out;
+    boot_clock::time_point reading_time;
+    // Value of the last update, its rate of change in units per second
+    // smoothed over updates, and when the sensor is due to be updated next
+    float last_value;
+    float value_rate;
+    boot_clock::time_point next_update_time;
 };
 
 class PowerHalService {
@@ -129,10 +150,12 @@ class ThermalHelper {
     // Read the temperature of a single sensor.
     bool readTemperature(std::string_view sensor_name, Temperature_1_0 *out,
                          bool is_virtual_sensor = false) const;
+    // With from_readings, physical sensors are not read but take the value the
+    // watcher read in its current cycle.
     bool readTemperature(
             std::string_view sensor_name, Temperature_2_0 *out,
             std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status = nullptr,
-            bool is_virtual_sensor = false) const;
+            bool is_virtual_sensor = false, bool from_readings = false) const;
     bool readTemperatureThreshold(std::string_view sensor_name, TemperatureThreshold *out) const;
     // Read the value of a single cooling device.
     bool readCoolingDevice(std::string_view cooling_device, CoolingDevice_2_0 *out) const;
@@ -189,7 +212,20 @@ class ThermalHelper {
         const ThrottlingArray &hot_hysteresis, const ThrottlingArray &cold_hysteresis,
         ThrottlingSeverity prev_hot_severity, ThrottlingSeverity prev_cold_severity,
         float value) const;
-    bool checkVirtualSensor(std::string_view sensor_name, std::string *temp) const;
+    // Evaluate the virtual sensors in sensor_name's eval_order, each only once
+    // per watcher cycle with from_readings, or per call without it
+    bool checkVirtualSensor(std::string_view sensor_name, float *temp,
+                            bool from_readings = false) const;
+    // Read the value of a physical sensor, see readTemperature for from_readings
+    bool readSensorValue(std::string_view sensor_name, bool from_readings, float *value) const;
+    // Add the physical sensors sensor_name depends on to reads, once each
+    void addSensorReads(std::string_view sensor_name, std::vector<ThermalFileRead> *reads,
+                        std::set<std::string_view> *added) const;
+    // Read the due physical sensors concurrently and store their readings
+    void updateSensorReadings(std::vector<ThermalFileRead> *reads, boot_clock::time_point now);
+    // Schedule the next update of a monitored sensor at next_update_time
+    void scheduleSensorUpdate(std::string_view sensor_name, SensorStatus *sensor_status,
+                              boot_clock::time_point next_update_time);
 
     // Return the target state of PID algorithm
     size_t getTargetStateOfPID(const SensorInfo &sensor_info, const SensorStatus &sensor_status);
@@ -204,9 +240,12 @@ class ThermalHelper {
                             size_t target_state);
     void requestCdevBySeverity(std::string_view sensor_name, SensorStatus *sensor_status,
                                const SensorInfo &sensor_info);
+    // Update the sensor's requests of its cooling devices, and add the ones
+    // whose aggregated request changed to cooling_devices_to_update
     void computeCoolingDevicesRequest(std::string_view sensor_name, const SensorInfo &sensor_info,
                                       const SensorStatus &sensor_status,
                                       std::vector<std::string> *cooling_devices_to_update);
+    // Write the aggregated request of the cooling devices not already in that state
     void updateCoolingDevices(const std::vector<std::string> &cooling_devices_to_update);
     sp<ThermalWatcher> thermal_watcher_;
     PowerFiles power_files_;
@@ -225,6 +264,20 @@ class ThermalHelper {
     std::unordered_map<std::string, SensorStatus> sensor_status_map_;
     mutable std::shared_mutex cdev_status_map_mutex_;
     std::unordered_map<std::string, CdevRequestStatus> cdev_status_map_;
+    // Updated with cdev_status_map_ when a sensor's request changes
+    std::unordered_map<std::string, CdevRequestAggregate> cdev_request_aggregate_map_;
+
+    // Min-heap of the next update time of each monitored sensor, only used by
+    // the watcher thread. An entry is stale once it no longer matches the
+    // sensor's next_update_time, and is dropped when it reaches the top.
+    using SensorUpdate = std::pair<boot_clock::time_point, std::string_view>;
+    std::priority_queue<SensorUpdate, std::vector<SensorUpdate>, std::greater<SensorUpdate>>
+            sensor_update_queue_;
+    // Monitored virtual sensors, also updated with their trigger sensor
+    std::vector<std::string_view> monitored_virtual_sensors_;
+    // Values of the sensors linked to virtual sensors in the current watcher
+    // cycle, only used by the watcher thread
+    mutable LinkedSensorValueMap linked_sensor_values_;
 };
 
 }  // namespace implementation
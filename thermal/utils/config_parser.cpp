@@ -134,8 +134,41 @@ bool getFloatFromJsonValues(const Json::Value &values, ThrottlingArray *out, boo
     *out = ret;
     return true;
 }
+
 }  // namespace
 
+bool addVirtualSensorEvalOrder(const std::unordered_map<std::string, SensorInfo> &sensors,
+                               const std::string &sensor_name,
+                               std::unordered_set<std::string> *in_path,
+                               std::unordered_set<std::string> *visited,
+                               std::vector<std::string> *eval_order) {
+    in_path->insert(sensor_name);
+    for (const auto &linked_sensor : sensors.at(sensor_name).virtual_sensor_info->linked_sensors) {
+        const auto linked_sensor_it = sensors.find(linked_sensor);
+        if (linked_sensor_it == sensors.end()) {
+            LOG(ERROR) << "Sensor[" << sensor_name << "]'s combination sensor " << linked_sensor
+                       << " is not found";
+            return false;
+        }
+        if (linked_sensor_it->second.virtual_sensor_info == nullptr ||
+            visited->count(linked_sensor)) {
+            continue;
+        }
+        if (in_path->count(linked_sensor)) {
+            LOG(ERROR) << "Sensor[" << sensor_name << "]'s combination sensor " << linked_sensor
+                       << " links back to it";
+            return false;
+        }
+        if (!addVirtualSensorEvalOrder(sensors, linked_sensor, in_path, visited, eval_order)) {
+            return false;
+        }
+    }
+    in_path->erase(sensor_name);
+    visited->insert(sensor_name);
+    eval_order->push_back(sensor_name);
+    return true;
+}
+
 std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path) {
     std::string json_doc;
     std::unordered_map<std::string, SensorInfo> sensors_parsed;
@@ -389,6 +422,14 @@ std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view con
         }
         LOG(INFO) << "Sensor[" << name << "]'s Passive delay: " << passive_delay.count();
 
+        std::chrono::milliseconds max_polling_delay = std::chrono::milliseconds::zero();
+        if (!sensors[i]["MaxPollingDelay"].empty()) {
+            max_polling_delay =
+                    std::chrono::milliseconds(getIntFromValue(sensors[i]["MaxPollingDelay"]));
+            LOG(INFO) << "Sensor[" << name
+                      << "]'s Max polling delay: " << max_polling_delay.count();
+        }
+
         bool support_pid = false;
         std::array<float, kThrottlingSeverityCount> k_po;
         k_po.fill(0.0);
@@ -648,7 +689,7 @@ std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view con
         std::unique_ptr<VirtualSensorInfo> virtual_sensor_info;
         if (is_virtual_sensor) {
             virtual_sensor_info.reset(new VirtualSensorInfo{linked_sensors, coefficients, offset,
-                                                            trigger_sensor, formula});
+                                                            trigger_sensor, formula, {}});
         }
 
         std::unique_ptr<ThrottlingInfo> throttling_info(
@@ -666,6 +707,7 @@ std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view con
                 .multiplier = multiplier,
                 .polling_delay = polling_delay,
                 .passive_delay = passive_delay,
+                .max_polling_delay = max_polling_delay,
                 .send_cb = send_cb,
                 .send_powerhint = send_powerhint,
                 .is_monitor = is_monitor,
@@ -676,6 +718,23 @@ std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view con
         ++total_parsed;
     }
 
+    for (auto &sensor_info_pair : sensors_parsed) {
+        if (sensor_info_pair.second.virtual_sensor_info == nullptr) {
+            continue;
+        }
+        std::unordered_set<std::string> in_path;
+        std::unordered_set<std::string> visited;
+        std::vector<std::string> eval_order;
+        if (!addVirtualSensorEvalOrder(sensors_parsed, sensor_info_pair.first, &in_path, &visited,
+                                       &eval_order)) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << sensor_info_pair.first << "]'s combination";
+            sensors_parsed.clear();
+            return sensors_parsed;
+        }
+        sensor_info_pair.second.virtual_sensor_info->eval_order = std::move(eval_order);
+    }
+
     LOG(INFO) << total_parsed << " Sensors parsed successfully";
     return sensors_parsed;
 }
@@ -745,6 +804,13 @@ std::unordered_map<std::string, CdevInfo> ParseCoolingDevice(std::string_view co
                 LOG(INFO) << "Cooling device[" << name << "]'s Power2State[" << j
                           << "]: " << state2power[j];
             }
+            if (!IsState2PowerValid(state2power)) {
+                LOG(ERROR) << "Invalid "
+                           << "CoolingDevice[" << name << "]'s State2Power, power should not "
+                           << "increase with state";
+                cooling_devices_parsed.clear();
+                return cooling_devices_parsed;
+            }
         } else {
             LOG(INFO) << "CoolingDevice[" << i << "]'s Name: " << name
                       << " does not support Power2State";
@@ -766,6 +832,15 @@ std::unordered_map<std::string, CdevInfo> ParseCoolingDevice(std::string_view co
     return cooling_devices_parsed;
 }
 
+bool IsState2PowerValid(const std::vector<float> &state2power) {
+    for (size_t i = 0; i < state2power.size(); ++i) {
+        if (std::isnan(state2power[i]) || (i > 0 && state2power[i] > state2power[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 std::unordered_map<std::string, PowerRailInfo> ParsePowerRailInfo(std::string_view config_path) {
     std::string json_doc;
     std::unordered_map<std::string, PowerRailInfo> power_rails_parsed;
@@ -18,6 +18,8 @@
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <android/hardware/thermal/2.0/IThermal.h>
 
@@ -51,6 +53,9 @@ struct VirtualSensorInfo {
     float offset;
     std::string trigger_sensor;
     FormulaOption formula;
+    // The virtual sensors this one links to, directly or not, in an order
+    // they can be evaluated in, followed by this one
+    std::vector<std::string> eval_order;
 };
 
 struct VirtualPowerRailInfo {
@@ -107,6 +112,10 @@ struct SensorInfo {
     float multiplier;
     std::chrono::milliseconds polling_delay;
     std::chrono::milliseconds passive_delay;
+    // Longest interval the polling of a temperature sensor that is not
+    // throttling may be stretched to while it is far from its next hot
+    // threshold. Zero, the default, never stretches it beyond polling_delay.
+    std::chrono::milliseconds max_polling_delay;
     bool send_cb;
     bool send_powerhint;
     bool is_monitor;
@@ -129,8 +138,20 @@ struct PowerRailInfo {
 };
 
 std::unordered_map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path);
+// Add the virtual sensors sensor_name links to, and then sensor_name, to
+// eval_order in depth first order. Sensors in visited are skipped, and
+// in_path holds the ones being added. Return false if a linked sensor is
+// missing or the links form a cycle.
+bool addVirtualSensorEvalOrder(const std::unordered_map<std::string, SensorInfo> &sensors,
+                               const std::string &sensor_name,
+                               std::unordered_set<std::string> *in_path,
+                               std::unordered_set<std::string> *visited,
+                               std::vector<std::string> *eval_order);
 std::unordered_map<std::string, CdevInfo> ParseCoolingDevice(std::string_view config_path);
 std::unordered_map<std::string, PowerRailInfo> ParsePowerRailInfo(std::string_view config_path);
+// Return true if no power in state2power is NaN or higher than the one of the
+// previous state, so a state can be looked up by power with a binary search
+bool IsState2PowerValid(const std::vector<float> &state2power);
 
 }  // namespace implementation
 }  // namespace V2_0
@@ -14,7 +14,15 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <string_view>
 
 #include <android-base/file.h>
@@ -29,37 +37,245 @@ namespace thermal {
 namespace V2_0 {
 namespace implementation {
 
+namespace {
+
+constexpr size_t kMaxFileLength = 4096;
+constexpr size_t kMaxNumberLength = 32;
+
+android::base::unique_fd openThermalFile(const std::string &path) {
+    return android::base::unique_fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+}
+
+}  // namespace
+
+ThermalFiles::~ThermalFiles() {
+    // Workers are detached, and the ones blocked in a read exit once it returns
+    {
+        std::lock_guard<std::mutex> _lock(read_pool_->lock);
+        read_pool_->exit = true;
+    }
+    read_pool_->cond.notify_all();
+}
+
 std::string ThermalFiles::getThermalFilePath(std::string_view thermal_name) const {
     auto sensor_itr = thermal_name_to_path_map_.find(thermal_name.data());
     if (sensor_itr == thermal_name_to_path_map_.end()) {
         return "";
     }
-    return sensor_itr->second;
+    return sensor_itr->second->path;
 }
 
 bool ThermalFiles::addThermalFile(std::string_view thermal_name, std::string_view path) {
-    return thermal_name_to_path_map_.emplace(thermal_name, path).second;
+    // Opened on first read, so files that are only written are never opened
+    auto [file_itr, added] = thermal_name_to_path_map_.emplace(thermal_name, nullptr);
+    if (added) {
+        file_itr->second = std::make_shared<ThermalFile>(thermal_name, path);
+    }
+    return added;
+}
+
+bool ThermalFiles::reopenThermalFile(const ThermalFile &file,
+                                     const android::base::unique_fd *bad_fd) {
+    // Open outside the lock, so a node that is slow to open does not hold up
+    // reads of the same node through its old fd
+    android::base::unique_fd fd = openThermalFile(file.path);
+    const int open_errno = errno;
+    std::lock_guard<std::mutex> _lock(file.fd_lock);
+    // Another reader may have reopened it already
+    if (file.fd.get() == bad_fd) {
+        file.fd = fd.ok() ? std::make_shared<const android::base::unique_fd>(std::move(fd))
+                          : nullptr;
+    }
+    errno = open_errno;
+    return file.fd != nullptr;
+}
+
+ssize_t ThermalFiles::readThermalFileToBuffer(const ThermalFile &file, char *buf, size_t size) {
+    ssize_t len = -1;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::shared_ptr<const android::base::unique_fd> fd;
+        {
+            std::lock_guard<std::mutex> _lock(file.fd_lock);
+            fd = file.fd;
+        }
+        if (fd != nullptr) {
+            len = TEMP_FAILURE_RETRY(pread(fd->get(), buf, size - 1, 0));
+            if (len >= 0 || errno != ENODEV) {
+                break;
+            }
+        }
+        // Not opened yet, or the node has been removed since
+        if (!reopenThermalFile(file, fd.get())) {
+            break;
+        }
+    }
+    if (len < 0) {
+        PLOG(WARNING) << "Failed to read sensor: " << file.name;
+        return -1;
+    }
+
+    // Strip the newline.
+    ssize_t begin = 0;
+    while (len > 0 && isspace(static_cast<unsigned char>(buf[len - 1]))) {
+        --len;
+    }
+    while (begin < len && isspace(static_cast<unsigned char>(buf[begin]))) {
+        ++begin;
+    }
+    len -= begin;
+    memmove(buf, buf + begin, len);
+    buf[len] = '\0';
+    return len;
 }
 
 bool ThermalFiles::readThermalFile(std::string_view thermal_name, std::string *data) const {
-    std::string sensor_reading;
-    std::string file_path = getThermalFilePath(std::string_view(thermal_name));
+    char buf[kMaxFileLength];
     *data = "";
-    if (file_path.empty()) {
-        PLOG(WARNING) << "Failed to find " << thermal_name << "'s path";
+
+    auto file_itr = thermal_name_to_path_map_.find(thermal_name.data());
+    if (file_itr == thermal_name_to_path_map_.end()) {
+        LOG(WARNING) << "Failed to find " << thermal_name << "'s path";
         return false;
     }
+    const ssize_t len = readThermalFileToBuffer(*file_itr->second, buf, sizeof(buf));
+    if (len < 0) {
+        return false;
+    }
+    data->assign(buf, len);
+    return true;
+}
 
-    if (!::android::base::ReadFileToString(file_path, &sensor_reading)) {
-        PLOG(WARNING) << "Failed to read sensor: " << thermal_name;
+bool ThermalFiles::readThermalFile(std::string_view thermal_name, float *value) const {
+    auto file_itr = thermal_name_to_path_map_.find(thermal_name.data());
+    if (file_itr == thermal_name_to_path_map_.end()) {
+        LOG(WARNING) << "Failed to find " << thermal_name << "'s path";
         return false;
     }
+    return readThermalFileValue(*file_itr->second, value);
+}
 
-    // Strip the newline.
-    *data = ::android::base::Trim(sensor_reading);
+bool ThermalFiles::readThermalFileValue(const ThermalFile &file, float *value) {
+    char buf[kMaxNumberLength];
+
+    const ssize_t len = readThermalFileToBuffer(file, buf, sizeof(buf));
+    if (len <= 0) {
+        return false;
+    }
+    const char *end = buf + len;
+    // Thermal nodes report integers, which std::from_chars parses without
+    // locale or allocation. Anything else is left to strtof.
+    int64_t integer;
+    auto [ptr, ec] = std::from_chars(buf, end, integer);
+    if (ec == std::errc() && ptr == end) {
+        *value = static_cast<float>(integer);
+        return true;
+    }
+    char *float_end;
+    *value = strtof(buf, &float_end);
+    if (float_end == buf) {
+        LOG(WARNING) << "Failed to parse " << file.name << ": " << buf;
+        return false;
+    }
+    return true;
+}
+
+bool ThermalFiles::readThermalFile(std::string_view thermal_name, int *value) const {
+    char buf[kMaxNumberLength];
+
+    auto file_itr = thermal_name_to_path_map_.find(thermal_name.data());
+    if (file_itr == thermal_name_to_path_map_.end()) {
+        LOG(WARNING) << "Failed to find " << thermal_name << "'s path";
+        return false;
+    }
+    const ssize_t len = readThermalFileToBuffer(*file_itr->second, buf, sizeof(buf));
+    if (len <= 0) {
+        return false;
+    }
+    if (std::from_chars(buf, buf + len, *value).ec != std::errc()) {
+        LOG(WARNING) << "Failed to parse " << thermal_name << ": " << buf;
+        return false;
+    }
     return true;
 }
 
+void ThermalFiles::readThermalFiles(std::vector<ThermalFileRead> *reads,
+                                    std::chrono::milliseconds timeout) {
+    if (reads->empty()) {
+        return;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto batch = std::make_shared<ReadBatch>();
+    batch->pending = 0;
+    batch->values.resize(reads->size(), NAN);
+    batch->status.resize(reads->size(), ThermalFileReadStatus::TIMEOUT);
+    {
+        std::lock_guard<std::mutex> _lock(read_pool_->lock);
+        for (size_t i = 0; i < reads->size(); ++i) {
+            auto &read = (*reads)[i];
+            auto file_itr = thermal_name_to_path_map_.find(read.thermal_name.data());
+            if (file_itr == thermal_name_to_path_map_.end()) {
+                LOG(WARNING) << "Failed to find " << read.thermal_name << "'s path";
+                batch->status[i] = ThermalFileReadStatus::FAILED;
+                continue;
+            }
+            // Do not queue up behind a read that is still blocked
+            if (file_itr->second->reading.exchange(true)) {
+                continue;
+            }
+            read_pool_->tasks.push_back({batch, i, file_itr->second});
+            ++batch->pending;
+        }
+        while (read_pool_->tasks.size() > read_pool_->idle_workers &&
+               read_pool_->workers < kMaxReadWorkers) {
+            std::thread(&ThermalFiles::readWorker, read_pool_).detach();
+            ++read_pool_->workers;
+            ++read_pool_->idle_workers;
+        }
+    }
+    read_pool_->cond.notify_all();
+
+    std::unique_lock<std::mutex> _lock(batch->lock);
+    batch->cond.wait_until(_lock, deadline, [&batch] { return batch->pending == 0; });
+    for (size_t i = 0; i < reads->size(); ++i) {
+        (*reads)[i].value = batch->values[i];
+        (*reads)[i].status = batch->status[i];
+    }
+}
+
+void ThermalFiles::readWorker(std::shared_ptr<ReadPool> pool) {
+    while (true) {
+        ReadTask task;
+        {
+            std::unique_lock<std::mutex> _lock(pool->lock);
+            pool->cond.wait(_lock, [&pool] { return pool->exit || !pool->tasks.empty(); });
+            if (pool->exit) {
+                return;
+            }
+            task = std::move(pool->tasks.front());
+            pool->tasks.pop_front();
+            --pool->idle_workers;
+        }
+
+        float value = NAN;
+        const bool ok = readThermalFileValue(*task.file, &value);
+        task.file->reading.store(false);
+
+        {
+            std::lock_guard<std::mutex> _lock(task.batch->lock);
+            task.batch->values[task.index] = value;
+            task.batch->status[task.index] =
+                    ok ? ThermalFileReadStatus::OK : ThermalFileReadStatus::FAILED;
+            if (--task.batch->pending == 0) {
+                task.batch->cond.notify_all();
+            }
+        }
+
+        std::lock_guard<std::mutex> _lock(pool->lock);
+        ++pool->idle_workers;
+    }
+}
+
+
 bool ThermalFiles::writeCdevFile(std::string_view cdev_name, std::string_view data) {
     std::string file_path =
             getThermalFilePath(android::base::StringPrintf("%s_%s", cdev_name.data(), "w"));
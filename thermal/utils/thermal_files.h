@@ -16,8 +16,21 @@
 
 #pragma once
 
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#include <android-base/unique_fd.h>
 
 namespace android {
 namespace hardware {
@@ -25,10 +38,22 @@ namespace thermal {
 namespace V2_0 {
 namespace implementation {
 
+enum class ThermalFileReadStatus {
+    OK,
+    FAILED,
+    TIMEOUT,
+};
+
+struct ThermalFileRead {
+    std::string_view thermal_name;
+    float value;
+    ThermalFileReadStatus status;
+};
+
 class ThermalFiles {
   public:
     ThermalFiles() = default;
-    ~ThermalFiles() = default;
+    ~ThermalFiles();
     ThermalFiles(const ThermalFiles &) = delete;
     void operator=(const ThermalFiles &) = delete;
 
@@ -39,11 +64,76 @@ class ThermalFiles {
     // data to empty and return false. If the thermal_name is found and its content
     // is read, this function will fill in data accordingly then return true.
     bool readThermalFile(std::string_view thermal_name, std::string *data) const;
+    // Same as above, but parses the content as a number without allocating.
+    // Returns false if the content is not a number.
+    bool readThermalFile(std::string_view thermal_name, float *value) const;
+    bool readThermalFile(std::string_view thermal_name, int *value) const;
+    // Read the files of reads as numbers concurrently on a small pool of
+    // worker threads, waiting at most timeout for them. Reads still running by
+    // then, or whose file is still blocked in a read from an earlier call, are
+    // left to finish in the background and marked TIMEOUT.
+    void readThermalFiles(std::vector<ThermalFileRead> *reads, std::chrono::milliseconds timeout);
     bool writeCdevFile(std::string_view thermal_name, std::string_view data);
     size_t getNumThermalFiles() const { return thermal_name_to_path_map_.size(); }
 
   private:
-    std::unordered_map<std::string, std::string> thermal_name_to_path_map_;
+    // Files are opened on their first read, kept open and re-read from the
+    // start with pread. They are reopened if the read fails with ENODEV, as
+    // the node is then gone, e.g. after its thermal zone was unregistered.
+    struct ThermalFile {
+        ThermalFile(std::string_view name, std::string_view path)
+            : name(name), path(path), reading(false) {}
+        const std::string name;
+        const std::string path;
+        // Guards fd, and is only held to take or replace it, never across a
+        // read, so a read blocked on one node holds up no other.
+        mutable std::mutex fd_lock;
+        // Each read holds a reference, so a reopen never closes the fd under it
+        mutable std::shared_ptr<const android::base::unique_fd> fd;
+        // Set while a worker of readThermalFiles is reading the file
+        std::atomic<bool> reading;
+    };
+    // Results of one readThermalFiles call, shared with the workers so reads
+    // finishing after the call returned have somewhere to go.
+    struct ReadBatch {
+        std::mutex lock;
+        std::condition_variable cond;
+        size_t pending;
+        std::vector<float> values;
+        std::vector<ThermalFileReadStatus> status;
+    };
+    struct ReadTask {
+        std::shared_ptr<ReadBatch> batch;
+        size_t index;
+        std::shared_ptr<ThermalFile> file;
+    };
+    // Worker pool of readThermalFiles and its queue. Workers are detached
+    // and share it, with the files they read, so a worker blocked on a node
+    // can outlive the ThermalFiles and exit once its read returns.
+    struct ReadPool {
+        std::mutex lock;
+        std::condition_variable cond;
+        size_t workers = 0;
+        size_t idle_workers = 0;
+        std::deque<ReadTask> tasks;
+        bool exit = false;
+    };
+    // Read file into buf, NUL terminated and with surrounding whitespace
+    // stripped. Returns the length read, or -1 on failure.
+    static ssize_t readThermalFileToBuffer(const ThermalFile &file, char *buf, size_t size);
+    static bool readThermalFileValue(const ThermalFile &file, float *value);
+    // Replace the fd of file, unless a concurrent reader has already replaced
+    // bad_fd. Returns false if the file has no fd open.
+    static bool reopenThermalFile(const ThermalFile &file,
+                                  const android::base::unique_fd *bad_fd);
+    static void readWorker(std::shared_ptr<ReadPool> pool);
+
+    // Workers are added while queued reads outnumber idle workers, so reads
+    // blocked on slow nodes hold up the others only once all are busy.
+    static constexpr size_t kMaxReadWorkers = 8;
+
+    std::unordered_map<std::string, std::shared_ptr<ThermalFile>> thermal_name_to_path_map_;
+    const std::shared_ptr<ReadPool> read_pool_ = std::make_shared<ReadPool>();
 };
 
 }  // namespace implementation
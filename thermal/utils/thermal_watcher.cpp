@@ -505,8 +505,10 @@ bool ThermalWatcher::threadLoop() {
     auto time_elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(boot_clock::now() -
                                                                                  last_update_time_);
 
+    // Only wait for the rest of the interval after an ignored wakeup
     if (time_elapsed_ms < sleep_ms_ &&
-        looper_->pollOnce(sleep_ms_.count(), &fd, nullptr, nullptr) >= 0) {
+        looper_->pollOnce(std::min(sleep_ms_ - time_elapsed_ms, kUeventPollTimeoutMs).count(),
+                          &fd, nullptr, nullptr) >= 0) {
         if (fd != uevent_fd_.get() && fd != thermal_genl_fd_.get()) {
             return true;
         } else if (fd == thermal_genl_fd_.get()) {
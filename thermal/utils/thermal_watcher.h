@@ -96,7 +96,7 @@ class ThermalWatcher : public ::android::Thread {
     android::base::unique_fd thermal_genl_fd_;
     // Sensor list which monitor flag is enabled.
     std::set<std::string> monitored_sensors_;
-    // Sleep interval voting result
+    // Time from the last callback until the next sensor is due
     std::chrono::milliseconds sleep_ms_;
     // Timestamp for last thermal update
     boot_clock::time_point last_update_time_;
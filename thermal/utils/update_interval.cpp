@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "update_interval.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+// Weight of the newest rate in value_rate
+constexpr float kValueRateWeight = 0.5;
+// Lowest rate of rise assumed when stretching the interval of a cool
+// temperature sensor, in degC per second
+constexpr float kMinPredictedTemperatureRate = 0.5;
+
+bool isTemperature(TemperatureType_2_0 type) {
+    switch (type) {
+        case TemperatureType_2_0::BCL_VOLTAGE:
+        case TemperatureType_2_0::BCL_CURRENT:
+        case TemperatureType_2_0::BCL_PERCENTAGE:
+            return false;
+        default:
+            return true;
+    }
+}
+
+}  // namespace
+
+float updateValueRate(float value_rate, float last_value, float value,
+                      std::chrono::milliseconds elapsed) {
+    if (std::isnan(last_value) || elapsed.count() <= 0) {
+        return value_rate;
+    }
+    const float rate = (value - last_value) * 1000 / elapsed.count();
+    return std::isnan(value_rate) ? rate
+                                  : kValueRateWeight * rate + (1 - kValueRateWeight) * value_rate;
+}
+
+std::chrono::milliseconds getUpdateInterval(const SensorInfo &sensor_info,
+                                            ThrottlingSeverity severity, float last_value,
+                                            float value_rate) {
+    const bool throttling = severity != ThrottlingSeverity::NONE;
+    const auto delay = throttling ? sensor_info.passive_delay : sensor_info.polling_delay;
+    const bool stretch = !throttling && isTemperature(sensor_info.type) &&
+                         sensor_info.max_polling_delay > delay;
+    if (std::isnan(value_rate)) {
+        return std::max(delay, kMinPollIntervalMs);
+    }
+
+    float headroom = std::numeric_limits<float>::infinity();
+    for (size_t i = static_cast<size_t>(severity) + 1; i < kThrottlingSeverityCount; ++i) {
+        if (!std::isnan(sensor_info.hot_thresholds[i])) {
+            headroom = std::max(sensor_info.hot_thresholds[i] - last_value, 0.0f);
+            break;
+        }
+    }
+
+    // Half the time to reach the next threshold at rate, infinite if never
+    const auto half_predicted_ms = [headroom](float rate) {
+        return rate > 0 ? headroom / rate * 500 : std::numeric_limits<float>::infinity();
+    };
+    float interval_ms = std::min(static_cast<float>(delay.count()), half_predicted_ms(value_rate));
+    if (stretch) {
+        // Only a stretched interval relies on an assumed rate, and it never
+        // shortens the interval
+        interval_ms = std::max(
+                interval_ms,
+                std::min(static_cast<float>(sensor_info.max_polling_delay.count()),
+                         half_predicted_ms(std::max(value_rate, kMinPredictedTemperatureRate))));
+    }
+    return std::max(std::chrono::milliseconds(static_cast<int64_t>(interval_ms)),
+                    kMinPollIntervalMs);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
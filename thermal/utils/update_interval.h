@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "config_parser.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+// Return value_rate, the rate of change of a sensor in units per second
+// smoothed over its updates, updated with the change from last_value to value
+// over elapsed. NAN until the sensor has been updated twice.
+float updateValueRate(float value_rate, float last_value, float value,
+                      std::chrono::milliseconds elapsed);
+
+// Return how long a sensor can go until its next update. It is the configured
+// delay for its severity, shortened to half the time the sensor is predicted
+// to reach its next hot threshold at value_rate, so a rising sensor is caught
+// early. Only a temperature sensor that is not throttling and whose config
+// sets a MaxPollingDelay is stretched beyond its polling delay, while that
+// prediction is far away. The interval is never shorter than
+// kMinPollIntervalMs.
+std::chrono::milliseconds getUpdateInterval(const SensorInfo &sensor_info,
+                                            ThrottlingSeverity severity, float last_value,
+                                            float value_rate);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <limits>
+
+#include <android-base/logging.h>
+
+#include "virtual_sensor.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+// Evaluate sensor_name from the values of the sensors it links to, reading the
+// physical ones into values if they are not there yet
+LinkedSensorValue evaluateFormula(
+        const std::unordered_map<std::string, SensorInfo> &sensor_info_map,
+        std::string_view sensor_name, const SensorValueReader &read_value,
+        LinkedSensorValueMap *values) {
+    float temp_val = 0.0;
+
+    const auto &sensor_info = sensor_info_map.at(sensor_name.data());
+    float offset = sensor_info.virtual_sensor_info->offset;
+    for (size_t i = 0; i < sensor_info.virtual_sensor_info->linked_sensors.size(); i++) {
+        const std::string &linked_sensor = sensor_info.virtual_sensor_info->linked_sensors[i];
+        auto value_it = values->find(linked_sensor);
+        if (value_it == values->end()) {
+            // Virtual sensors are evaluated before, so this is a physical sensor
+            LinkedSensorValue value = {.valid = false, .value = NAN};
+            value.valid = read_value(linked_sensor, &value.value);
+            value_it = values->emplace(linked_sensor, value).first;
+        }
+        if (!value_it->second.valid) {
+            if (sensor_info_map.at(linked_sensor).virtual_sensor_info == nullptr) {
+                continue;
+            }
+            return {.valid = false, .value = NAN};
+        }
+        const float sensor_reading = value_it->second.value;
+
+        LOG(VERBOSE) << sensor_name.data() << "'s linked sensor " << linked_sensor
+                     << ": temp = " << sensor_reading;
+        if (std::isnan(sensor_info.virtual_sensor_info->coefficients[i])) {
+            return {.valid = false, .value = NAN};
+        }
+        float coefficient = sensor_info.virtual_sensor_info->coefficients[i];
+        switch (sensor_info.virtual_sensor_info->formula) {
+            case FormulaOption::COUNT_THRESHOLD:
+                if ((coefficient < 0 && sensor_reading < -coefficient) ||
+                    (coefficient >= 0 && sensor_reading >= coefficient))
+                    temp_val += 1;
+                break;
+            case FormulaOption::WEIGHTED_AVG:
+                temp_val += sensor_reading * coefficient;
+                break;
+            case FormulaOption::MAXIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::lowest();
+                if (sensor_reading * coefficient > temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            case FormulaOption::MINIMUM:
+                if (i == 0)
+                    temp_val = std::numeric_limits<float>::max();
+                if (sensor_reading * coefficient < temp_val)
+                    temp_val = sensor_reading * coefficient;
+                break;
+            default:
+                break;
+        }
+    }
+    return {.valid = true, .value = temp_val + offset};
+}
+
+}  // namespace
+
+LinkedSensorValue evaluateVirtualSensor(
+        const std::unordered_map<std::string, SensorInfo> &sensor_info_map,
+        std::string_view sensor_name, const SensorValueReader &read_value,
+        LinkedSensorValueMap *values) {
+    // Virtual sensors come after the ones they link to, so each is evaluated once
+    for (const auto &virtual_sensor :
+         sensor_info_map.at(sensor_name.data()).virtual_sensor_info->eval_order) {
+        if (!values->count(virtual_sensor)) {
+            values->emplace(virtual_sensor,
+                            evaluateFormula(sensor_info_map, virtual_sensor, read_value, values));
+        }
+    }
+    return values->at(sensor_name);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
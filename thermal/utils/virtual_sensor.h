@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "config_parser.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+// Value of a sensor linked to virtual sensors, shared by all of them while
+// they are evaluated. Not valid if the sensor failed to be read or evaluated.
+struct LinkedSensorValue {
+    bool valid;
+    float value;
+};
+// Keys are views of the sensor names in the SensorInfo map
+using LinkedSensorValueMap = std::unordered_map<std::string_view, LinkedSensorValue>;
+// Read the value of a physical sensor, return false on failure
+using SensorValueReader = std::function<bool(std::string_view sensor_name, float *value)>;
+
+// Evaluate the virtual sensors in the eval_order of sensor_name which are not
+// in values yet, reading the physical sensors they link to through read_value
+// if they are not there either, and return the value of sensor_name. Each
+// sensor is read or evaluated once for as long as values is kept.
+LinkedSensorValue evaluateVirtualSensor(
+        const std::unordered_map<std::string, SensorInfo> &sensor_info_map,
+        std::string_view sensor_name, const SensorValueReader &read_value,
+        LinkedSensorValueMap *values);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android